@@ -0,0 +1,30 @@
+# Writes the GLSL files into a C++ source file with a table of string
+# literals (see include/shaderSources.h), so no shader file has to be
+# opened at runtime.
+#
+# embed_shaders(<output file> <glsl files>...)
+#
+# The file is generated while configuring. The GLSL files are added to the
+# configure dependencies, i.e. changing a shader regenerates the file.
+function(embed_shaders output)
+    set(content "// Generated by cmake/EmbedShaders.cmake from the files in glsl/, do not edit\n")
+    set(content "${content}#include \"shaderSources.h\"\n\n")
+    set(content "${content}const ShaderSources::Entry ShaderSources::mEmbedded[] =\n{\n")
+    foreach(file ${ARGN})
+        get_filename_component(name ${file} NAME)
+        file(READ ${file} source)
+        set(content "${content}    { \"${name}\", R\"glsl(${source})glsl\" },\n")
+    endforeach(file)
+    set(content "${content}    { NULL, NULL }\n};\n")
+
+    # Only write a changed file, otherwise everything is recompiled on each configure
+    set(previous "")
+    if(EXISTS ${output})
+        file(READ ${output} previous)
+    endif(EXISTS ${output})
+    if(NOT previous STREQUAL content)
+        file(WRITE ${output} "${content}")
+    endif(NOT previous STREQUAL content)
+
+    set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS ${ARGN})
+endfunction(embed_shaders)
@@ -18,6 +18,10 @@ uniform vec2  u_factor;
 /*!
  * Last stage of the statistics computation
  *
+ * The sums are kept as wide integers (see \ref splitWide) and packed with
+ * \ref packSum, i.e. with 32 bits if u_wideSums is set and with 24 bits
+ * and a sign byte otherwise.
+ *
  * @author Jan Sommer
  * @date 2014
  * @namespace GLSL
@@ -30,28 +34,35 @@ uniform vec2  u_factor;
 
 #define CENTROID_X_COORD   -1
 #define CENTROID_Y_COORD   -2
+#define CENTROID_LUMINANCE -3
 
 void main()
 {
     if (u_stage == STAGE_CENTROIDING)
     {
-        float curCount  = unpackLong( texture2D( s_result, v_texCoord ) );
+        vec2  curCount  = unpackSum( texture2D( s_result, v_texCoord ) );
         vec2  curLabel  = unpack2shorts( texture2D( s_label, v_texCoord ) );
         vec2  curFill   = unpack2shorts( texture2D( s_fill, v_texCoord ) );
         vec2  curCoord  = tex2imgCoord(v_texCoord);
 
         if(u_pass == CENTROID_X_COORD) // x-coordinate
         {
-            float luminance = texture2D( s_orig, v_texCoord ).r * 255.0;
-            float weightedCoord = (curLabel.x-ONE-curCoord.x) * luminance;
-            gl_FragColor = packLong( weightedCoord * step(ONE, curLabel.x) );
+            float luminance = origTexture2D( s_orig, v_texCoord ) * origMaxValue();
+            vec2  weightedCoord = mulWide(curLabel.x-ONE-curCoord.x, luminance);
+            gl_FragColor = packSum( weightedCoord * step(ONE, curLabel.x) );
             return;
         }
         else if(u_pass == CENTROID_Y_COORD) // y-coordinate
         {
-            float luminance = texture2D( s_orig, v_texCoord ).r * 255.0;
-            float weightedCoord = (curLabel.y-ONE-curCoord.y) * luminance;
-            gl_FragColor = packLong( weightedCoord * step(ONE, curLabel.y) );
+            float luminance = origTexture2D( s_orig, v_texCoord ) * origMaxValue();
+            vec2  weightedCoord = mulWide(curLabel.y-ONE-curCoord.y, luminance);
+            gl_FragColor = packSum( weightedCoord * step(ONE, curLabel.y) );
+            return;
+        }
+        else if(u_pass == CENTROID_LUMINANCE) // luminance with 24 (32) bits (high bit depth images or wide sums)
+        {
+            float luminance = origTexture2D( s_orig, v_texCoord ) * origMaxValue();
+            gl_FragColor = packSum( splitWide(luminance) * step(ONE, curLabel.x) );
             return;
         }
 
@@ -62,45 +73,50 @@ void main()
         }
 
         float twoPow = exp2( float(u_pass) );
-        vec3 cornerX, cornerY, cornerXY;
+        vec4 cornerX, cornerY, cornerXY;
 
         cornerX.xy  = unpack2shorts( BoundedTexture2D( s_fill, img2texCoord( curCoord - u_factor * vec2(twoPow, ZERO) ) ) );
         cornerY.xy  = unpack2shorts( BoundedTexture2D( s_fill, img2texCoord( curCoord - u_factor * vec2(ZERO, twoPow) ) ) );
         cornerXY.xy = unpack2shorts( BoundedTexture2D( s_fill, img2texCoord( curCoord - u_factor * vec2(twoPow, twoPow) ) ) );
 
-        cornerX.z  = unpackLong( BoundedTexture2D( s_result, img2texCoord( curCoord - u_factor * vec2(twoPow, ZERO) ) ) );
-        cornerY.z  = unpackLong( BoundedTexture2D( s_result, img2texCoord( curCoord - u_factor * vec2(ZERO, twoPow) ) ) );
-        cornerXY.z = unpackLong( BoundedTexture2D( s_result, img2texCoord( curCoord - u_factor * vec2(twoPow, twoPow))) );
+        cornerX.zw  = unpackSum( BoundedTexture2D( s_result, img2texCoord( curCoord - u_factor * vec2(twoPow, ZERO) ) ) );
+        cornerY.zw  = unpackSum( BoundedTexture2D( s_result, img2texCoord( curCoord - u_factor * vec2(ZERO, twoPow) ) ) );
+        cornerXY.zw = unpackSum( BoundedTexture2D( s_result, img2texCoord( curCoord - u_factor * vec2(twoPow, twoPow))) );
 
+        // The low parts of the 4 sums stay below 2^18, the carry is added once
         float isEqual = float( all(equal(cornerX.xy, curFill) ) );
-        curCount += isEqual * cornerX.z;
+        curCount += isEqual * cornerX.zw;
         isEqual   = float( all(equal(cornerY.xy, curFill) ) );
-        curCount += isEqual * cornerY.z;
+        curCount += isEqual * cornerY.zw;
         isEqual   = float( all(equal(cornerXY.xy, curFill) ) );
-        curCount += isEqual * cornerXY.z;
+        curCount += isEqual * cornerXY.zw;
 
-        gl_FragColor = packLong( curCount );
+        gl_FragColor = packSum( addWide( curCount, vec2(ZERO) ) );
     }
     else if(u_stage == STAGE_BLEND)
     {
-        vec4 temp = texture2D( s_label, v_texCoord );
-        float reduced = unpackLong(temp);
-        float result  = unpackLong(texture2D( s_result, v_texCoord ));
-
-        if( result == ZERO )
+        // Only the columns of the table are drawn at the left border, u_savingOffset
+        // is the first column of the table
+        vec2 fragCoord = floor(gl_FragCoord.xy);
+        vec2 coord = fragCoord + vec2(u_savingOffset, ZERO);
+        vec4 temp = texture2D( s_label, table2texCoord(coord) );
+        vec2 reduced = unpackSum(temp);
+        vec2 result  = unpackSum(texture2D( s_result, img2texCoord(fragCoord) ));
+
+        if( all(equal(result, vec2(ZERO))) )
         {
             gl_FragColor = temp;
         }
         else
         {
-            gl_FragColor = packLong( result + reduced );
+            gl_FragColor = packSum( addWide(result, reduced) );
         }
     }
     else if(u_stage == STAGE_SAVE)
     {
-        vec2 coord = tex2imgCoord(v_texCoord) - vec2(u_savingOffset, ZERO);
-        float outOfBounds = float( coord.x >= ZERO);
-        vec2  lookupLabel = unpack2shorts (BoundedTexture2D( s_label, img2texCoord( coord ) ) );
+        // The columns are drawn at the left border, i.e. they are those of the labels in the table
+        vec2 coord = floor(gl_FragCoord.xy);
+        vec2  lookupLabel = unpack2shorts (BoundedTexture2D( s_label, table2texCoord( coord ) ) );
 
         if( all(equal(lookupLabel, vec2(ZERO) )) )
         {
@@ -108,9 +124,8 @@ void main()
             return;
         }
 
-        float currCount = unpackLong(texture2D( s_label, v_texCoord ));
         vec2 offset = clamp(-u_factor, ZERO, ONE);
-        gl_FragColor = BoundedTexture2D( s_result,   img2texCoord( lookupLabel - ONE + offset) ) * outOfBounds;
+        gl_FragColor = BoundedTexture2D( s_result,   img2texCoord( lookupLabel - ONE + offset) );
 
     }
 }
@@ -11,11 +11,16 @@ precision highp sampler2D;
  */
 
 uniform vec2  u_texDimensions;   /*!< Dimensions of the image in pixels */
+uniform vec2  u_tableDimensions; /*!< Dimensions of the result table of the reduction phase in pixels */
+uniform float u_origTopDown;      /*!< ONE if the original image starts with the top row, else ZERO */
+uniform float u_origMaxValue;     /*!< Largest grey value of the original image (2^bits-1), 255 or less for 8-bit images */
+uniform float u_wideSums;        /*!< ONE if the sums of the statistics are packed with 32 bits (\ref packWide), else ZERO (\ref packLong) */
 const float ZERO = 0.0;          /*!< Constant for 0.0 otherwise memory is reserved for every literal */
 const float ONE  = 1.0;          /*!< Constant for 1.0 otherwise memory is reserved for every literal*/
 const float TWO  = 2.0;          /*!< Constant for 2.0 otherwise memory is reserved for every literal*/
 const float f256 = 256.0;        /*!< Constant for 256.0 otherwise memory is reserved for every literal */
 const float f255 = 255.0;        /*!< Constant for 256.0 otherwise memory is reserved for every literal*/
+const float f65536 = 65536.0;    /*!< Constant for 65536.0 otherwise memory is reserved for every literal */
 
 
 /* If the texture coordinates are outside of the texture do not clamp to edge
@@ -30,6 +35,42 @@ vec4 BoundedTexture2D(sampler2D s, vec2 tc)
     return texture2D(s, tc);
 }
 
+/*!
+Reads the grey value of the original image.
+
+The original image is either a luminance texture (1 byte per pixel) or an
+RGBA texture with the grey value in every color channel, in both cases it
+is returned by the red channel. Images with more than 8 bits (u_origMaxValue
+above 255) have 2 bytes per pixel, the low byte in the red and the high byte
+in the alpha channel, and are combined exactly before the normalization.
+Camera frames are sampled as they were delivered, i.e. starting with the
+top row, which is given by u_origTopDown.
+Coordinates outside of the texture return ZERO like \ref BoundedTexture2D.
+
+\param s  sampler holding the original image
+\param tc texture coordinates in the orientation of the labels (bottom row first)
+
+\return grey value in [0,1], multiply with \ref origMaxValue for the sensor value
+*/
+float origTexture2D(sampler2D s, vec2 tc)
+{
+    vec4 texel = BoundedTexture2D(s, vec2(tc.x, mix(tc.y, ONE - tc.y, u_origTopDown)));
+    if (u_origMaxValue > f255)
+    {
+        return dot( floor(texel.ra * f255 + 0.5), vec2(ONE, f256) ) / u_origMaxValue;
+    }
+    return texel.r;
+}
+
+/*!
+Largest grey value of the original image, i.e. the sensor value of a grey
+value of ONE. Is 255 for 8-bit images even if u_origMaxValue is not set.
+*/
+float origMaxValue()
+{
+    return max(u_origMaxValue, f255);
+}
+
 /*!
 Assuming that the texture is 8-bit RGBA 32bits are available for packing.
 This function packs 2 16-bit unsigned short integer values into the 4 texture channels.
@@ -112,6 +153,106 @@ float unpackLong(in vec4 rgba)
     return floor(dot(rounded , bitShifts)+0.5) * (ONE-TWO*sign);
 }
 
+/*!
+  A float holds integers exactly up to 24 bits only, wider integers are
+  kept as two floats: wide.x*65536 + wide.y with wide.y in [0, 65536) and
+  a signed wide.x. This function rounds a value and splits it into this form.
+
+  \param value the integer as float
+  \return the wide integer
+*/
+vec2 splitWide(in float value)
+{
+    value = floor(value+0.5);
+    float high = floor(value / f65536);
+    return vec2(high, value - high*f65536);
+}
+
+/*!
+  Sum of two wide integers (see \ref splitWide), the carry of the low
+  parts is added to the high part.
+
+  \param a first wide integer
+  \param b second wide integer
+  \return the wide sum
+*/
+vec2 addWide(in vec2 a, in vec2 b)
+{
+    vec2 sum = a + b;
+    float carry = floor(sum.y / f65536);
+    return vec2(sum.x + carry, sum.y - carry*f65536);
+}
+
+/*!
+  Exact product of two integers of at most 16 bits (a may be negative) as
+  wide integer (see \ref splitWide). b is split into bytes, so both partial
+  products fit into 24 bits.
+
+  \param a signed integer as float
+  \param b unsigned integer as float
+  \return the wide product
+*/
+vec2 mulWide(in float a, in float b)
+{
+    b = floor(b+0.5);
+    float bHigh = floor(b / f256);
+    vec2 low  = splitWide( a * (b - bHigh*f256) );
+    vec2 high = splitWide( a * bHigh );
+    return addWide( low, addWide( vec2(high.x*f256, ZERO), splitWide(high.y*f256) ) );
+}
+
+/*!
+  Packs a wide integer (see \ref splitWide) as 32-bit two's complement with
+  LSB first, i.e. the client reads it as a signed 32-bit integer.
+
+  \param wide the wide integer, within [-2^31, 2^31)
+  \return RGBA value with the packed integer
+*/
+vec4 packWide(in vec2 wide)
+{
+    float high = wide.x + f65536 * (ONE - step(ZERO, wide.x));
+    return pack2shorts( vec2(wide.y, high) );
+}
+
+/*!
+  Reverse function of \ref packWide.
+
+  \param rgba the RGBA value which has the packed integer
+  \return the wide integer
+*/
+vec2 unpackWide(in vec4 rgba)
+{
+    vec2 shorts = unpack2shorts(rgba);
+    return vec2(shorts.y - f65536 * step(32768.0, shorts.y), shorts.x);
+}
+
+/*!
+  Packs a sum of the statistics with \ref packWide if u_wideSums is set,
+  otherwise with \ref packLong (the sum has to fit into 24 bits).
+
+  \param wide the sum as wide integer
+  \return RGBA value with the packed sum
+*/
+vec4 packSum(in vec2 wide)
+{
+    if (u_wideSums > ZERO)
+        return packWide(wide);
+    return packLong(wide.x*f65536 + wide.y);
+}
+
+/*!
+  Reverse function of \ref packSum.
+
+  \param rgba the RGBA value which has the packed sum
+  \return the sum as wide integer
+*/
+vec2 unpackSum(in vec4 rgba)
+{
+    if (u_wideSums > ZERO)
+        return unpackWide(rgba);
+    return splitWide(unpackLong(rgba));
+}
+
 /*!
 This function computes the image coordinates of the texture with the dimensions from u_texDimensions
 Example:
@@ -154,3 +295,15 @@ vec2 img2texCoord(in vec2 imgCoord)
 {
     return (TWO*imgCoord + ONE)/(TWO*u_texDimensions);
 }
+
+/*!
+Same as \ref img2texCoord for the result table of the reduction phase,
+which is smaller than the image and has the dimensions u_tableDimensions.
+
+\param tableCoord coordinates of a cell of the table
+\return texture coordinates in [0,1], [0,1]
+*/
+vec2 table2texCoord(in vec2 tableCoord)
+{
+    return (TWO*tableCoord + ONE)/(TWO*u_tableDimensions);
+}
@@ -0,0 +1,117 @@
+/*!
+    \ingroup stats
+    @{
+*/
+
+//////////////////////////////  BEGIN SHADER //////////////////////////
+
+// Number of spots in a row of the result table (has to match OFFSET in statsPhase.cpp)
+#define TABLE_COLUMNS       10
+
+uniform sampler2D s_table;
+uniform int   u_stage;
+uniform float u_tableRows;
+uniform float u_columnRows[TABLE_COLUMNS];
+uniform float u_numSpots;
+uniform float u_spotsPerRow;
+uniform float u_spotFields;
+
+/*!
+ * Last stage of the statistics computation
+ *
+ * Packs the spots of the result table into a small dense block, so only
+ * this block has to be read back by the client.
+ *
+ * @namespace GLSL
+ * @class compactShader
+ */
+
+#define STAGE_HEADER        0
+#define STAGE_GATHER        1
+
+bool isSpot(vec2 cell)
+{
+    return any( greaterThan( texture2D( s_table, table2texCoord(cell) ), vec4(ZERO) ) );
+}
+
+/*!
+  Number of spots in the table rows below \ref row, i.e. the index of the
+  first spot of \ref row if the table is read row by row.
+  The table is reduced to the bottom left, so column i has spots in the
+  rows [0, u_columnRows[i]).
+*/
+float spotsBelow(float row)
+{
+    float count = ZERO;
+    for (int i=0; i<TABLE_COLUMNS; ++i)
+    {
+        count += min(u_columnRows[i], row);
+    }
+    return count;
+}
+
+/*!
+  Header stage
+  ------------
+
+  Drawn into a TABLE_COLUMNS x 1 viewport. Each pixel counts the spots in its
+  column of the table with a binary search (the spots of a column are packed
+  to the bottom) and writes the count as the first packed short.
+
+  Gather stage
+  ------------
+
+  Drawn into a (u_spotFields*u_spotsPerRow) x ceil(u_numSpots/u_spotsPerRow)
+  viewport. Each group of u_spotFields pixels receives one spot. The spots are
+  numbered in the order in which the table is read row by row, the fields
+  of the spot are copied unchanged from the label, area and the two sum
+  columns of the table, plus the column of the 24-bit luminance sum for
+  high bit depth images (u_spotFields 5).
+*/
+void main()
+{
+    vec2 fragCoord = floor(gl_FragCoord.xy);
+
+    if (u_stage == STAGE_HEADER)
+    {
+        float column = fragCoord.x;
+        float count  = ZERO;
+        for (int k=15; k>=0; --k)
+        {
+            float next = count + exp2(float(k));
+            if (next <= u_tableRows && isSpot( vec2(column, next-ONE) ))
+            {
+                count = next;
+            }
+        }
+        gl_FragColor = pack2shorts( vec2(count, ZERO) );
+    }
+    else if (u_stage == STAGE_GATHER)
+    {
+        float spot  = fragCoord.y*u_spotsPerRow + floor(fragCoord.x/u_spotFields);
+        float field = mod(fragCoord.x, u_spotFields);
+        if (spot >= u_numSpots)
+        {
+            gl_FragColor = vec4(ZERO);
+            return;
+        }
+
+        // Binary search for the table row which holds the spot
+        float row = ZERO;
+        for (int k=15; k>=0; --k)
+        {
+            float next = row + exp2(float(k));
+            if (next < u_tableRows && spotsBelow(next) <= spot)
+            {
+                row = next;
+            }
+        }
+        float column = spot - spotsBelow(row);
+
+        gl_FragColor = texture2D( s_table, table2texCoord( vec2(column + field*float(TABLE_COLUMNS), row) ) );
+    }
+}
+
+/*!
+    @}
+*/
@@ -41,7 +41,7 @@ void main()
         // set the inital count to 1 if curLabel == curFill
         if(u_pass == -1)
         {
-            float luminance = texture2D( s_orig, v_texCoord ).r * f255 ;
+            float luminance = origTexture2D( s_orig, v_texCoord ) * origMaxValue() ;
             float area = float( all(equal(curLabel, curFill)) );
             gl_FragColor = pack2shorts( vec2( area, luminance  ) * step(ONE, curLabel) );
             return;
@@ -79,12 +79,15 @@ void main()
     }
     else if(u_stage == STAGE_BLEND)
     {
-        vec4 texReduced = texture2D( s_label, v_texCoord );
+        // Only the columns of the table are drawn at the left border, u_savingOffset
+        // is the first column of the table
+        vec2 fragCoord = floor(gl_FragCoord.xy);
+        vec2 coord = fragCoord + vec2(u_savingOffset, ZERO);
+        vec4 texReduced = texture2D( s_label, table2texCoord(coord) );
         /* NOTE: There was a problem that unpacking a long int written to during the centroiding stage
          *       here would alter its value. Therefore u_factor now has the x1 and x2 bounds within the
          *       unpacking is safe. In other words only unpack the count values but do NOT unpack centroiding values
          */
-        vec2 coord = tex2imgCoord(v_texCoord);
         if (coord.x < u_factor.x || coord.x >= u_factor.y)
         {
             // Only copy the value
@@ -92,7 +95,7 @@ void main()
             return;
         }
 
-        vec2 result   = unpack2shorts( texture2D( s_result, v_texCoord ) );
+        vec2 result   = unpack2shorts( texture2D( s_result, img2texCoord(fragCoord) ) );
         vec2 reduced  = unpack2shorts( texReduced );
 
         gl_FragColor = pack2shorts( result + reduced);
@@ -100,9 +103,9 @@ void main()
     }
     else if(u_stage == STAGE_SAVE)
     {
-        vec2 coord = tex2imgCoord(v_texCoord) - vec2(u_savingOffset, ZERO);
-        float outOfBounds = float( coord.x >= ZERO);
-        vec2  lookupLabel = unpack2shorts (BoundedTexture2D( s_label, img2texCoord( coord ) ) );
+        // The columns are drawn at the left border, i.e. they are those of the labels in the table
+        vec2 coord = floor(gl_FragCoord.xy);
+        vec2  lookupLabel = unpack2shorts (BoundedTexture2D( s_label, table2texCoord( coord ) ) );
 
         if( all(equal(lookupLabel, vec2(ZERO) )) )
         {
@@ -110,7 +113,7 @@ void main()
             return;
         }
         vec2 offset = clamp(-u_factor, ZERO, ONE);
-        gl_FragColor = BoundedTexture2D( s_result,   img2texCoord( lookupLabel - ONE + offset) ) * outOfBounds;
+        gl_FragColor = BoundedTexture2D( s_result,   img2texCoord( lookupLabel - ONE + offset) );
 
     }
 }
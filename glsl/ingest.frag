@@ -0,0 +1,27 @@
+/*!
+    \ingroup labeling
+    @{
+*/
+
+//////////////////////////////  BEGIN SHADER //////////////////////////
+
+varying vec2 v_texCoord;        /*!< Texture coordinates of the current pixel */
+uniform sampler2D s_frame;      /*!< Sampler holding the camera frame (uploaded or imported) */
+
+/*!
+  \brief Converts a camera frame into the original image of the labeling
+
+  The frame starts with the top row, while OpenGL-textures start in the
+  bottom left corner, so the rows are flipped. The greyscale value is in the
+  red channel (luminance texture or R8 EGLImage) and written as (c,c,c,255)
+  like the images loaded from a file.
+*/
+void main()
+{
+    float value = texture2D( s_frame, vec2(v_texCoord.x, ONE - v_texCoord.y) ).r;
+    gl_FragColor = vec4(value, value, value, ONE);
+}
+
+/*!
+    @}
+*/
@@ -4,9 +4,11 @@
 */
 varying vec2 v_texCoord;        /*!< texture coordinates of the current pixel */
 uniform sampler2D s_texture;    /*!< Sampler holding the input image */
+uniform sampler2D s_prevTexture; /*!< Sampler holding the labels of the last convergence check (only used by STAGE_COMPARE) */
 uniform int u_pass;             /*!< The number of the pass this algorithm is in */
 uniform float u_factor;         /*!< The factor for the displacement */
 uniform float u_threshold;      /*!< Threshold value for the threshold operation */
+uniform float u_tileSize;       /*!< Edge length of the tiles which are labeled independently, ZERO for no tiles */
 
 
 
@@ -21,6 +23,10 @@ uniform float u_threshold;      /*!< Threshold value for the threshold operation
 
 #define STAGE_INITIAL_LABELING   0
 #define STAGE_HIGHEST_LABEL      1
+#define STAGE_COMPARE           -1
+#define STAGE_ANY_CHANGED       -2
+
+#define COMPARE_BLOCK            8 /*!< Edge length of the block of flags which is reduced per fragment */
 
 
 /*!
@@ -42,14 +48,48 @@ uniform float u_threshold;      /*!< Threshold value for the threshold operation
   all one-pixel spots and thereby greatly reducing the number of spots which have
   to be considered in subsequent steps.
 
+  Highest label stage
+  -------------------
+
+  Each pixel takes the highest label of itself and its 4 neighbors in the
+  direction of u_factor. If u_tileSize is set, only neighbors inside the
+  same tile are considered, i.e. every tile is labeled on its own and the
+  number of passes depends on the tile size instead of the image size.
+
+  Compare stage
+  -------------
+
+  Not part of the labeling itself, but used to detect its convergence. Each
+  fragment is set to ONE if its label in \ref s_texture differs from the one
+  in \ref s_prevTexture, else ZERO.
+
+  Any changed stage
+  -----------------
+
+  Reduces the flags of the compare stage in \ref s_texture (u_texDimensions
+  is the size of the flag texture then): each fragment is set to the maximum
+  of a block of COMPARE_BLOCK x COMPARE_BLOCK flags. Repeated until a single
+  flag is left, which is read back.
+
 
 */
+vec4 TileTexture2D(sampler2D s, vec2 curCoord, vec2 neighborCoord)
+{
+    // Labels of other tiles are merged later on the CPU, so they are treated as background
+    if (u_tileSize > ZERO && any(notEqual(floor(neighborCoord/u_tileSize), floor(curCoord/u_tileSize))))
+    {
+        return vec4(ZERO);
+    }
+
+    return BoundedTexture2D(s, img2texCoord(neighborCoord));
+}
+
 void main()
 {
     // First pass thresholding and initial labeling
     if (u_pass == STAGE_INITIAL_LABELING)
     {
-        float curPixelCol = texture2D( s_texture, v_texCoord ).r;
+        float curPixelCol = origTexture2D( s_texture, v_texCoord );
         // Threshold operation)
         curPixelCol = step(u_threshold, curPixelCol);
 
@@ -66,15 +106,15 @@ void main()
         vec4 forwardPixels;   // values of the pixels which are behind current pixel
         vec4 backwardPixels;  // values of the pixels which are before current pixel
 
-        forwardPixels[0] = BoundedTexture2D( s_texture, img2texCoord( imgCoord + vec2(ONE, ZERO) ) ).r;
-        forwardPixels[1] = BoundedTexture2D( s_texture, img2texCoord( imgCoord + vec2(-ONE, ONE) ) ).r;
-        forwardPixels[2] = BoundedTexture2D( s_texture, img2texCoord( imgCoord + vec2(ZERO, ONE) ) ).r;
-        forwardPixels[3] = BoundedTexture2D( s_texture, img2texCoord( imgCoord + vec2(ONE,  ONE) ) ).r;
+        forwardPixels[0] = origTexture2D( s_texture, img2texCoord( imgCoord + vec2(ONE, ZERO) ) );
+        forwardPixels[1] = origTexture2D( s_texture, img2texCoord( imgCoord + vec2(-ONE, ONE) ) );
+        forwardPixels[2] = origTexture2D( s_texture, img2texCoord( imgCoord + vec2(ZERO, ONE) ) );
+        forwardPixels[3] = origTexture2D( s_texture, img2texCoord( imgCoord + vec2(ONE,  ONE) ) );
 
-        backwardPixels[0] = BoundedTexture2D( s_texture, img2texCoord( imgCoord - vec2(ONE, ZERO) ) ).r;
-        backwardPixels[1] = BoundedTexture2D( s_texture, img2texCoord( imgCoord - vec2(-ONE, ONE) ) ).r;
-        backwardPixels[2] = BoundedTexture2D( s_texture, img2texCoord( imgCoord - vec2(ZERO, ONE) ) ).r;
-        backwardPixels[3] = BoundedTexture2D( s_texture, img2texCoord( imgCoord - vec2(ONE,  ONE) ) ).r;
+        backwardPixels[0] = origTexture2D( s_texture, img2texCoord( imgCoord - vec2(ONE, ZERO) ) );
+        backwardPixels[1] = origTexture2D( s_texture, img2texCoord( imgCoord - vec2(-ONE, ONE) ) );
+        backwardPixels[2] = origTexture2D( s_texture, img2texCoord( imgCoord - vec2(ZERO, ONE) ) );
+        backwardPixels[3] = origTexture2D( s_texture, img2texCoord( imgCoord - vec2(ONE,  ONE) ) );
 
         // Threshold the values of the neighboring pixels
         forwardPixels  = step(u_threshold, forwardPixels);
@@ -97,22 +137,22 @@ void main()
 
         // Get neighbor pixel
         vec4 xValues, yValues;
-        vec4 tempCol   = BoundedTexture2D(s_texture, img2texCoord(curCoord + u_factor*vec2(ONE, 0.0)) );
+        vec4 tempCol   = TileTexture2D(s_texture, curCoord, curCoord + u_factor*vec2(ONE, 0.0));
         vec2 tempLabel = unpack2shorts(tempCol);
         xValues[0] = tempLabel.x;
         yValues[0] = tempLabel.y;
 
-        tempCol = BoundedTexture2D(s_texture, img2texCoord(curCoord + u_factor*vec2(-ONE, ONE)) );
+        tempCol = TileTexture2D(s_texture, curCoord, curCoord + u_factor*vec2(-ONE, ONE));
         tempLabel  = unpack2shorts(tempCol);
         xValues[1] = tempLabel.x;
         yValues[1] = tempLabel.y;
 
-        tempCol = BoundedTexture2D(s_texture, img2texCoord(curCoord + u_factor*vec2(0.0, ONE)) );
+        tempCol = TileTexture2D(s_texture, curCoord, curCoord + u_factor*vec2(0.0, ONE));
         tempLabel = unpack2shorts(tempCol);
         xValues[2] = tempLabel.x;
         yValues[2] = tempLabel.y;
 
-        tempCol = BoundedTexture2D(s_texture, img2texCoord(curCoord + u_factor*vec2(ONE, ONE)) );
+        tempCol = TileTexture2D(s_texture, curCoord, curCoord + u_factor*vec2(ONE, ONE));
         tempLabel = unpack2shorts(tempCol);
         xValues[3] = tempLabel.x;
         yValues[3] = tempLabel.y;
@@ -151,6 +191,26 @@ void main()
 
         gl_FragColor = pack2shorts(vec2(maxX, maxY)) * isZero ;
     }
+    // Flag the blocks in which the last pass changed any label
+    else if (u_pass == STAGE_COMPARE)
+    {
+        vec4 diff = texture2D(s_texture, v_texCoord) - texture2D(s_prevTexture, v_texCoord);
+        gl_FragColor = vec4(step(ONE/512.0, dot(abs(diff), vec4(ONE))));
+    }
+    // Reduce the flags of the compare stage
+    else if (u_pass == STAGE_ANY_CHANGED)
+    {
+        vec2 blockStart = floor(gl_FragCoord.xy) * float(COMPARE_BLOCK);
+        float changed = ZERO;
+        for (int j = 0; j < COMPARE_BLOCK; ++j)
+        {
+            for (int i = 0; i < COMPARE_BLOCK; ++i)
+            {
+                changed = max(changed, BoundedTexture2D(s_texture, img2texCoord(blockStart + vec2(float(i), float(j)))).r);
+            }
+        }
+        gl_FragColor = vec4(changed);
+    }
     else
     {
         vec2 curLabel = unpack2shorts( texture2D(s_texture, v_texCoord) );
@@ -0,0 +1,56 @@
+/*!
+    \ingroup labeling
+    @{
+*/
+uniform sampler2D s_texture;    /*!< Sampler holding the original image (first level) or the previous level */
+uniform int u_pass;             /*!< STAGE_THRESHOLD for the first level, else STAGE_MAX */
+uniform float u_factor;         /*!< Edge length of the block of the previous level which is pooled (1 to MAX_FACTOR) */
+uniform float u_threshold;      /*!< Threshold value for the threshold operation */
+
+/*!
+ * Max-pool pyramid of the occupied tiles
+ * @namespace GLSL
+ * @class pyramidShader
+ */
+
+#define STAGE_THRESHOLD          0
+#define STAGE_MAX                1
+
+#define MAX_FACTOR               4 /*!< Largest edge length of a pooled block */
+
+/*!
+  \brief Main program of the pyramid shader
+
+  Each fragment covers a block of u_factor x u_factor pixels of the level
+  below (u_texDimensions is the size of that level). The first level
+  thresholds the original image with \ref u_threshold, i.e. a fragment is
+  ONE if any pixel of its block is above the threshold. All further levels
+  take the maximum of the flags of their block, so the last level has one
+  flag per tile of the \ref RegionSet.
+
+  There is no hot pixel rule, the occupied tiles are a superset of those
+  which the label shader finds.
+*/
+void main()
+{
+    vec2 blockStart = floor(gl_FragCoord.xy) * u_factor;
+    float occupied = ZERO;
+    for (int j = 0; j < MAX_FACTOR; ++j)
+    {
+        for (int i = 0; i < MAX_FACTOR; ++i)
+        {
+            if (float(i) < u_factor && float(j) < u_factor)
+            {
+                vec2 texCoord = img2texCoord(blockStart + vec2(float(i), float(j)));
+                if (u_pass == STAGE_THRESHOLD)
+                    occupied = max(occupied, step(u_threshold, origTexture2D(s_texture, texCoord)));
+                else
+                    occupied = max(occupied, BoundedTexture2D(s_texture, texCoord).r);
+            }
+        }
+    }
+    gl_FragColor = vec4(occupied);
+}
+/*!
+    @}
+*/
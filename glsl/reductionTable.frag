@@ -0,0 +1,75 @@
+/*!
+    \ingroup reduction
+    @{
+*/
+varying vec2 v_texCoord;        /*!< texture coordinates of the current pixel */
+uniform sampler2D s_texture;    /*!< Sampler holding the result of the horizontal or vertical reduction */
+uniform int u_stage;            /*!< The stage this algorithm is currently in */
+
+/*!
+ * Table size shader of the reduction phase
+ *
+ * A program of its own, the loop would slow down the passes of the
+ * reduction shader on some drivers.
+ *
+ * @namespace GLSL
+ * @class reductionTableShader
+ */
+
+#define STAGE_TABLE     0
+#define STAGE_ROWS      1
+
+/*!
+  Counts the cells of the reduced list along direction, starting at origin.
+  The roots are packed to the bottom left, so the cells are occupied up to
+  the count and a binary search is used.
+*/
+float countCells(vec2 origin, vec2 direction)
+{
+    float size  = dot(direction, u_texDimensions - origin);
+    float count = ZERO;
+    for (int k=15; k>=0; --k)
+    {
+        float next = count + exp2(float(k));
+        if (next <= size && length( texture2D(s_texture, img2texCoord(origin + direction*(next-ONE))) ) > ZERO)
+        {
+            count = next;
+        }
+    }
+    return count;
+}
+
+/*!
+  \brief Main program of the table size shader
+
+  Table stage
+  -----------
+
+  Drawn into a 2x1 viewport after the vertical reduction. The first pixel
+  gets the number of rows of the list (the occupied cells of the first
+  column), the second one the number of columns (the cells of the first row),
+  both as the first packed short. They give the size of the table texture.
+
+  Rows stage
+  ----------
+
+  Drawn into a 1 x height viewport after the horizontal reduction. Each pixel
+  gets the number of roots of its row as the first packed short. They give
+  the number of passes and the columns of the vertical reduction.
+*/
+void main()
+{
+    if (u_stage == STAGE_TABLE)
+    {
+        vec2 direction = floor(gl_FragCoord.x) < ONE ? vec2(ZERO, ONE) : vec2(ONE, ZERO);
+        gl_FragColor = pack2shorts( vec2(countCells(vec2(ZERO), direction), ZERO) );
+    }
+    else if (u_stage == STAGE_ROWS)
+    {
+        vec2 origin = vec2(ZERO, floor(gl_FragCoord.y));
+        gl_FragColor = pack2shorts( vec2(countCells(origin, vec2(ONE, ZERO)), ZERO) );
+    }
+}
+/*!
+    @}
+*/
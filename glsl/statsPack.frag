@@ -0,0 +1,52 @@
+/*!
+    \ingroup stats
+    @{
+*/
+
+//////////////////////////////  BEGIN SHADER //////////////////////////
+
+// Number of spots in a row of the result table (has to match OFFSET in statsPhase.cpp)
+#define TABLE_COLUMNS       10
+
+uniform sampler2D s_sums;       /*!< Float sums of the accumulate stage of \ref statsScatterShader */
+uniform vec2  u_sumsDimensions; /*!< Dimensions of the texture in s_sums */
+
+/*!
+ * Converts the float sums of the scatter engine into the result table
+ *
+ * Drawn into the columns of the table next to the labels (TABLE_COLUMNS
+ * columns per block, from the bottom left corner). The blocks get the same
+ * content as after the count and centroiding stages of the quadrant engine,
+ * so the compaction stage reads both the same way:
+ *
+ *   1. area and luminance as packed shorts
+ *   2. weighted sum in x-direction as packed sum (\ref packSum)
+ *   3. weighted sum in y-direction as packed sum
+ *   4. luminance as packed sum (only read for high bit depth images or wide sums)
+ *
+ * The labels in block 0 are not drawn. Float sums above 2^24 are rounded,
+ * but with u_wideSums set they do not overflow.
+ *
+ * @namespace GLSL
+ * @class statsPackShader
+ */
+void main()
+{
+    vec2 coord = floor(gl_FragCoord.xy);
+    float block = floor(coord.x / float(TABLE_COLUMNS));
+    vec2 cell = vec2(coord.x - block*float(TABLE_COLUMNS), coord.y);
+    vec4 sums = texture2D( s_sums, (TWO*cell + ONE)/(TWO*u_sumsDimensions) );
+
+    if (block < TWO)
+        gl_FragColor = pack2shorts( sums.xy );
+    else if (block < 3.0)
+        gl_FragColor = packSum( splitWide(sums.z) );
+    else if (block < 4.0)
+        gl_FragColor = packSum( splitWide(sums.w) );
+    else
+        gl_FragColor = packSum( splitWide(sums.y) );
+}
+
+/*!
+    @}
+*/
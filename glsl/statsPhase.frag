@@ -103,7 +103,7 @@ void main()
 
         if(u_pass == -1)
         {
-            float luminance = texture2D( s_orig, v_texCoord ).r * 255.0 ;
+            float luminance = origTexture2D( s_orig, v_texCoord ) * 255.0 ;
             float area = float( all(equal(curLabel, curFill)) );
             gl_FragColor = pack2shorts( vec2( area, luminance  ) * step(ONE, curLabel) );
             return;
@@ -144,7 +144,7 @@ void main()
 
         if(u_pass == CENTROID_X_COORD) // x-coordinate
         {
-            float luminance = texture2D( s_orig, v_texCoord ).r * 255.0;
+            float luminance = origTexture2D( s_orig, v_texCoord ) * 255.0;
             float weightedCoord = (curLabel.x-ONE-curCoord.x) * luminance;
             gl_FragColor.xyz = packSignedLong( weightedCoord * step(ONE, curLabel.x) );
             gl_FragColor.w   = ZERO;
@@ -152,7 +152,7 @@ void main()
         }
         else if(u_pass == CENTROID_Y_COORD) // y-coordinate
         {
-            float luminance = texture2D( s_orig, v_texCoord ).r * 255.0;
+            float luminance = origTexture2D( s_orig, v_texCoord ) * 255.0;
             float weightedCoord = (curLabel.y-ONE-curCoord.y) * luminance;
             gl_FragColor.xyz = packSignedLong( weightedCoord * step(ONE, curLabel.y) );
             gl_FragColor.w   = ZERO;
@@ -0,0 +1,23 @@
+/*!
+    \ingroup stats
+    @{
+*/
+
+//////////////////////////////  BEGIN SHADER //////////////////////////
+
+varying vec4 v_value;
+
+/*!
+ * Writes the value of the scattered point, see \ref statsScatterShader
+ *
+ * @namespace GLSL
+ * @class statsScatterFragShader
+ */
+void main()
+{
+    gl_FragColor = v_value;
+}
+
+/*!
+    @}
+*/
@@ -0,0 +1,87 @@
+/*!
+    \ingroup stats
+    @{
+*/
+
+//////////////////////////////  BEGIN SHADER //////////////////////////
+
+uniform sampler2D s_table;      /*!< Result table of the reduction phase (STAGE_CELLS) */
+uniform sampler2D s_label;      /*!< Labels of the labeling phase (STAGE_ACCUMULATE) */
+uniform sampler2D s_cells;      /*!< Table cell of each root pixel, written by STAGE_CELLS */
+uniform sampler2D s_orig;       /*!< Original image (STAGE_ACCUMULATE) */
+uniform int   u_stage;
+uniform vec2  u_targetDimensions; /*!< Dimensions of the viewport the points are scattered into */
+
+attribute vec2 a_position;      /*!< Image coordinates of the table cell or pixel of this vertex */
+varying vec4 v_value;
+
+/*!
+ * Single pass alternative to the fill, count and centroiding stages
+ *
+ * Every vertex is drawn as one point which is moved to the pixel it
+ * contributes to (a scatter, like the lookup shader).
+ *
+ * @namespace GLSL
+ * @class statsScatterShader
+ */
+
+#define STAGE_CELLS         0
+#define STAGE_ACCUMULATE    1
+
+const vec4 OUT = vec4(-1000.0, -1000.0, ZERO, ZERO);
+
+/*!
+  Clip space position of the centre of a pixel of the viewport
+*/
+vec4 targetPosition(vec2 coord)
+{
+    return vec4( (TWO*coord + ONE)/u_targetDimensions - ONE, ZERO, ONE );
+}
+
+/*!
+  Cells stage
+  -----------
+
+  One vertex per cell of the result table. The vertex moves to the root
+  pixel of its label and writes the coordinates of the cell (plus ONE, to
+  distinguish them from background) as packed shorts. Empty cells are
+  moved out of the viewport.
+
+  Accumulate stage
+  ----------------
+
+  One vertex per pixel. A labeled pixel looks up the table cell of its root
+  and moves there. With additive blending into a float texture of the size
+  of the table each cell receives
+
+    (area, luminance, sum((root.x-x)*p), sum((root.y-y)*p))
+
+  i.e. the same values as the count and the two centroiding stages, which
+  sum them up in four quadrants around the root. Pixels of background or of
+  labels which are not in the table are moved out of the viewport.
+*/
+void main()
+{
+    gl_PointSize = ONE;
+
+    if (u_stage == STAGE_CELLS)
+    {
+        vec2 label = unpack2shorts( texture2D( s_table, table2texCoord(a_position) ) );
+        float isEmpty = ONE - step(ONE, label.x);
+        gl_Position = targetPosition(label - ONE) + isEmpty * OUT;
+        v_value = pack2shorts(a_position + ONE);
+    }
+    else
+    {
+        vec2 label = unpack2shorts( texture2D( s_label, img2texCoord(a_position) ) );
+        vec2 cell  = unpack2shorts( texture2D( s_cells, img2texCoord(label - ONE) ) );
+        float luminance = origTexture2D( s_orig, img2texCoord(a_position) ) * origMaxValue();
+        float isEmpty = ONE - step(ONE, label.x) * step(ONE, cell.x);
+        gl_Position = targetPosition(cell - ONE) + isEmpty * OUT;
+        v_value = vec4( ONE, luminance, (label - ONE - a_position) * luminance );
+    }
+}
+
+/*!
+    @}
+*/
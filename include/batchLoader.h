@@ -0,0 +1,145 @@
+#ifndef BATCHLOADER_H
+#define BATCHLOADER_H
+
+#include "ingestPhase.h"
+#include "threadPool.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*!
+ \brief Decodes a list of image files ahead on worker threads
+
+ With the streaming mode of \ref Ogles, offline processing of archived
+ nights is limited by decoding the image files. The loader
+ keeps up to \ref numPrefetch files in flight on a \ref ThreadPool, so the
+ next files are decoded while \ref Ogles processes the current one. The
+ images are returned in the order of the list as greyscale frames for
+ \ref Ogles::processFrame.
+
+*/
+class BatchLoader
+{
+public:
+    /*!
+     \brief Decoded image file
+    */
+    struct Image
+    {
+        std::string filename; /*!< Path of the file */
+        int width; /*!< Width in pixels, 0 if the file could not be decoded */
+        int height; /*!< Height in pixels */
+        int bitDepth; /*!< Bits per pixel, see \ref IngestPhase::Frame::bitDepth */
+        std::vector<uint8_t> pixels; /*!< First channel, top row first, 2 bytes per pixel above 8 bits */
+        std::string error; /*!< Reason why the file could not be decoded, empty on success */
+
+        Image();
+
+        /*!
+         \brief Returns the pixels as frame, valid as long as the image is not changed
+
+         \return IngestPhase::Frame
+        */
+        IngestPhase::Frame frame() const;
+    };
+
+    /*!
+     \brief Constructor, starts to decode the first files
+
+     \param filenames   Files to decode, see \ref expandInputs
+     \param bitDepth    Bits per pixel of the frames, above 8 the files are read with 16 bits per channel
+     \param numThreads  Number of decoder threads, 0 uses the number of available cores
+     \param numPrefetch Number of files decoded ahead, 0 uses twice the number of threads
+    */
+    BatchLoader(const std::vector<std::string> &filenames, int bitDepth = 8,
+                unsigned numThreads = 0, unsigned numPrefetch = 0);
+
+    /*!
+     \brief Destructor, waits for the files which are being decoded
+    */
+    virtual ~BatchLoader();
+
+    /*!
+     \brief Returns the next image of the list, waits until it is decoded
+
+     Files which can not be decoded are returned as well, with an empty
+     image and \ref Image::error set.
+
+     \param image Receives the image
+     \return bool false if all files have been returned
+    */
+    bool next(Image &image);
+
+    /*!
+     \brief Returns the number of files in the list
+
+     \return size_t
+    */
+    size_t size() const;
+
+    /*!
+     \brief Returns the number of decoder threads
+
+     \return unsigned
+    */
+    unsigned numThreads() const;
+
+    /*!
+     \brief Returns the number of files which are decoded ahead
+
+     \return unsigned
+    */
+    unsigned numPrefetch() const;
+
+    /*!
+     \brief Expands the command line inputs into a sorted list of files
+
+     Each input is either a directory (all files in it), a file starting
+     with '@' (one path per line), a glob pattern which was not expanded
+     by the shell (quoted, as hundreds of thousands of files exceed the
+     length of a command line) or a single file.
+
+     \param inputs The inputs
+     \return std::vector<std::string> Files in the order of the inputs, sorted per input
+    */
+    static std::vector<std::string> expandInputs(const std::vector<std::string> &inputs);
+
+    /*!
+     \brief Decodes one image file
+
+     \param filename Path of the file
+     \param bitDepth Bits per pixel of the frame
+     \param image    Receives the image
+    */
+    static void decode(const std::string &filename, int bitDepth, Image &image);
+
+private:
+    /*!
+     \brief Image of the list, shared with the decoder thread
+    */
+    struct Slot
+    {
+        Image image;
+        bool done;
+    };
+
+    /*!
+     \brief Queues the decoding of the file with the index if it exists
+    */
+    void enqueue(size_t index);
+
+    std::vector<std::string> mFilenames; /*!< Files to decode */
+    int mBitDepth; /*!< Bits per pixel of the frames */
+    unsigned mNumPrefetch; /*!< Number of files decoded ahead */
+    size_t mNext; /*!< Index of the file returned by the next call of \ref next */
+    std::vector< std::shared_ptr<Slot> > mSlots; /*!< Ring of \ref mNumPrefetch slots, index modulo its size */
+    std::mutex mMutex; /*!< Protects the done flags of the slots */
+    std::condition_variable mDone; /*!< Signals decoded slots */
+    ThreadPool mPool; /*!< Decoder threads, declared last to be destroyed first */
+};
+
+#endif // BATCHLOADER_H
@@ -0,0 +1,209 @@
+#ifndef CPUPHASE_H
+#define CPUPHASE_H
+
+#include "phase.h"
+#include "regionSet.h"
+#include "statsPhase.h"
+#include "threadPool.h"
+#include "thresholdKernel.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/*!
+ \brief CPU implementation of the complete label, reduction and stats pipeline
+
+ This class computes the same star spots as the combination of \ref LabelPhase,
+ \ref ReductionPhase and \ref StatsPhase, but without OpenGL. It is used as
+ fallback on devices without usable GPU and as reference to validate the
+ results of the GPU.
+
+ The image is split into horizontal bands of \ref mBandHeight rows which are
+ processed in parallel on a \ref ThreadPool:
+
+    1. Thresholding: a pixel is foreground if it is above the threshold and
+       at least one of its 8 neighbours is above the threshold as well
+       (same hot pixel rule as the label shader). The foreground is stored
+       as bitmask by the \ref ThresholdKernel.
+    2. Labeling: the foreground of each row is encoded as runs and a
+       union-find joins the runs of neighbouring rows with 8-connectivity.
+    3. Merging: the runs at the borders of neighbouring bands are joined
+       (serially). Only the border rows are visited, so the work of the
+       labeling does not grow with the height of the image.
+    4. Statistics: area, luminance and the luminance weighted coordinates
+       are summed per band and merged afterwards. Like on the GPU the root
+       of a spot is its top-right pixel (in OpenGL orientation).
+
+ Empty 64-bit words of the mask are skipped and the union-find works on runs
+ instead of pixels, so the cost scales with the number of lit pixels rather
+ than with the size of the frame.
+
+ With \ref mRegions only the 64-bit words and rows of the boxes are
+ thresholded and run-length encoded, the foreground outside of the boxes
+ is cleared like the GPU phases leave it at 0.
+
+ The spots are sorted in the same order as the table which is read back by
+ \ref StatsPhase. The sums are computed with exact integers though, so
+ large spots which overflow the 8-bit channels on the GPU are correct here.
+
+*/
+class CpuPhase : public Phase
+{
+public:
+    std::vector<StatsPhase::Spot> mSpots; /*!< The spots found by the last \ref run */
+
+    int mWidth; /*!< Width of the scene*/
+    int mHeight; /*!< Height of the scene*/
+
+    float u_threshold; /*!< Threshold value (normalized to [0,1]) like in \ref LabelPhase */
+    unsigned mTableColumns; /*!< Maximum number of spots per row, same limit as the table read back by \ref StatsPhase */
+    unsigned mBandHeight; /*!< Number of rows per band, 0 uses one band per thread (default 64) */
+    const RegionSet *mRegions; /*!< If set and active, only the foreground inside its boxes is labeled (default NULL) */
+
+    /*!
+     \brief Constructor
+
+     \param width      Width of the scene
+     \param height     Height of the scene
+     \param numThreads Number of worker threads, 0 uses the number of available cores
+    */
+    CpuPhase(int width = 0, int height = 0, unsigned numThreads = 0);
+
+    /*!
+     \brief Destructor
+
+    */
+    virtual ~CpuPhase();
+
+    /*!
+     \brief Sets the image which is evaluated by the next call of \ref run
+
+     The first row has to be the bottom row of the image (OpenGL orientation).
+     A negative row stride allows to pass images which start with the top row
+     without copying them. The data is not copied and has to stay valid during
+     \ref run.
+
+     \param pixels      Pointer to the first channel of the bottom left pixel
+     \param rowStride   Distance in bytes from one row to the next one above
+     \param pixelStride Distance in bytes between neighbouring pixels of a row
+    */
+    void setImage(const uint8_t *pixels, ptrdiff_t rowStride, int pixelStride = 1);
+
+    /*!
+     \brief Computes the spots of the image set by \ref setImage
+
+     \return double The time (in ms) the computation took
+    */
+    virtual double run();
+
+    /*!
+     \brief Nothing to do, the CPU phase does not hold any OpenGL objects
+
+    */
+    virtual void releaseGlResources();
+
+    /*!
+     \brief Returns the number of worker threads
+
+     \return unsigned
+    */
+    unsigned numThreads() const;
+
+private:
+    /*!
+     \brief Sums of one label
+    */
+    struct Accum
+    {
+        uint32_t area;
+        uint64_t luminance;
+        int64_t  sumX; /*!< Sum of x*luminance */
+        int64_t  sumY; /*!< Sum of y*luminance */
+        int32_t  topRight; /*!< Highest pixel index of the label */
+    };
+
+    /*!
+     \brief Horizontal run of foreground pixels
+    */
+    struct Run
+    {
+        int32_t y;
+        int32_t x0; /*!< First pixel of the run */
+        int32_t x1; /*!< Last pixel of the run (inclusive) */
+    };
+
+    /*!
+     \brief Words [first, end) of the mask rows [rowStart, rowEnd)
+    */
+    struct Span
+    {
+        int first;
+        int end;
+        int rowStart;
+        int rowEnd;
+        unsigned firstBox; /*!< First box of the span in Band::boxes */
+        unsigned endBox; /*!< Box after the last box of the span */
+    };
+
+    /*!
+     \brief Rows which are processed by one thread
+    */
+    struct Band
+    {
+        int rowStart; /*!< First row of the band */
+        int rowEnd; /*!< Row after the last row of the band */
+        std::vector<Span> spans; /*!< Parts of the mask which are computed, sorted by their first word and apart within a row */
+        std::vector<RegionSet::Rect> boxes; /*!< Boxes of \ref mRegions which cross the band, grouped by their span */
+        std::vector<uint64_t> clip; /*!< Bits of the boxes of a span in the current row */
+        std::vector<Run> runs; /*!< Runs of all rows of the band */
+        std::vector<uint32_t> rowFirstRun; /*!< Index of the first run of each row (plus the end) */
+        std::vector<int32_t> parent; /*!< Union-find forest of the runs (indices within the band) */
+        uint32_t offset; /*!< Index of the first run of the band within \ref mParent */
+        std::vector< std::pair<int32_t, Accum> > stats; /*!< Statistics per root */
+    };
+
+    /*!
+     \brief Thresholding, run-length encoding and labeling of the runs of a band
+    */
+    void labelBand(Band &band);
+
+    /*!
+     \brief Thresholds a band only in the words of the boxes of \ref mRegions
+
+     Sets the spans of the band to the words and rows of the boxes which
+     cross it and clears the foreground outside of the boxes within them.
+     Nothing else of the band is read or written.
+    */
+    void clipBand(Band &band);
+
+    /*!
+     \brief Joins the labels of the first row of upper with the last row of lower
+    */
+    void mergeBands(const Band &lower, const Band &upper);
+
+    /*!
+     \brief Sums up the statistics of all labels of a band
+    */
+    void statsBand(Band &band);
+
+    /*!
+     \brief Sorts the labels like the table of the GPU and fills \ref mSpots
+    */
+    void createSpots(std::vector< std::pair<int32_t, Accum> > &labels);
+
+    const uint8_t *mPixels; /*!< Bottom left pixel of the image */
+    ptrdiff_t mRowStride; /*!< Distance in bytes between two rows */
+    int mPixelStride; /*!< Distance in bytes between two pixels */
+    int mThresholdValue; /*!< Smallest 8-bit value which passes \ref u_threshold (256 if none) */
+
+    unsigned mWordsPerRow; /*!< Number of 64-bit words per row of \ref mMask */
+    std::vector<uint64_t> mMask; /*!< Foreground bitmask computed by the \ref ThresholdKernel */
+    std::vector<Band> mBands; /*!< Bands of the last run */
+    std::vector<int32_t> mParent; /*!< Union-find forest of the runs of all bands */
+
+    ThreadPool mPool; /*!< Worker threads */
+};
+
+#endif // CPUPHASE_H
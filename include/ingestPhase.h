@@ -0,0 +1,282 @@
+#ifndef INGESTPHASE_H
+#define INGESTPHASE_H
+
+#include "phase.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2ext.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*!
+    \ingroup labeling
+    @{
+*/
+
+/*!
+ \brief Brings external camera frames into the texture of the original image
+
+ A frame is either given as pointer to the pixels in program memory or as
+ dmabuf file descriptor (e.g. exported by a V4L2 camera driver). Both are
+ greyscale frames which start with the top row and may have padding at the
+ end of each row. Frames with more than 8 bits per pixel (12-bit or 16-bit
+ sensors) have 2 bytes per pixel in little endian and are uploaded into a
+ GL_LUMINANCE_ALPHA texture, packed formats like RAW12 have to be unpacked
+ first (see \ref PackKernel).
+
+ If EGL supports EGL_EXT_image_dma_buf_import, 8-bit dmabuf frames are imported as
+ EGLImage and sampled by the GPU directly, i.e. without any copy by the CPU.
+ The imported images are kept, because camera drivers recycle a small set of
+ buffers. Otherwise (e.g. Mesa's software renderer) and for pointer frames,
+ the frame is uploaded into a single-channel texture with one
+ glTexSubImage2D call. Rows with padding are packed first, unless
+ GL_EXT_unpack_subimage allows to upload them with their stride.
+
+ If the texture of the original image is RGBA, a single pass renders the
+ frame into it and flips the rows, as OpenGL-textures start in the bottom
+ left corner. If it is a luminance (alpha) texture (\ref mTargetFormat), there is no
+ such pass: uploads go directly into the texture of the original image and
+ imported frames are sampled directly. The phases then read the frame
+ starting with the top row (see \ref isFrameTopDown).
+
+*/
+class IngestPhase: public Phase
+{
+public:
+    /*!
+     \brief Description of an external frame
+    */
+    struct Frame
+    {
+        const uint8_t *pixels; /*!< Pixels in program memory or NULL if the frame is a dmabuf */
+        int fd; /*!< dmabuf file descriptor, only used if \ref pixels is NULL */
+        int width; /*!< Width of the frame in pixels */
+        int height; /*!< Height of the frame in pixels */
+        int stride; /*!< Bytes from the start of one row to the start of the next one */
+        int offset; /*!< Offset of the first row in the dmabuf (in bytes) */
+        int bitDepth; /*!< Bits per pixel, 8 or up to 16 with 2 bytes per pixel (little endian) */
+
+        /*!
+         \brief Frame in program memory
+        */
+        Frame(const uint8_t *pixels, int width, int height, int stride, int bitDepth = 8);
+
+        /*!
+         \brief Frame in a dmabuf
+        */
+        Frame(int fd, int width, int height, int stride, int offset = 0, int bitDepth = 8);
+
+        /*!
+         \brief Number of bytes of a pixel, 1 or 2 depending on \ref bitDepth
+
+         \return int
+        */
+        int bytesPerPixel() const;
+
+        /*!
+         \brief Size of the memory holding the frame (including \ref offset)
+
+         \return size_t
+        */
+        size_t size() const;
+    };
+
+    /*!
+     \brief Read-only CPU access to the pixels of a frame
+
+     Pointer frames are used as they are, dmabuf frames are mapped into
+     program memory for the lifetime of the object.
+    */
+    class Mapping
+    {
+    public:
+        /*!
+         \brief Maps the frame, throws std::runtime_error if this fails
+
+         \param frame
+        */
+        Mapping(const Frame &frame);
+
+        /*!
+         \brief Unmaps the frame
+        */
+        ~Mapping();
+
+        /*!
+         \brief Returns the first pixel of the top row
+
+         \return const uint8_t *
+        */
+        const uint8_t *pixels() const;
+
+    private:
+        Mapping(const Mapping &);
+        Mapping &operator=(const Mapping &);
+
+        void  *mAddress; /*!< Start of the mapping, NULL for pointer frames */
+        size_t mSize; /*!< Size of the mapping */
+        int    mFd; /*!< Mapped dmabuf */
+        const uint8_t *mPixels; /*!< First pixel of the top row */
+    };
+
+    // Vertex and fragment shader files
+    const char * mVertFilename; /*!< Path to the vertex shader file */
+    const char * mFragFilename; /*!< Path to the fragment shader file */
+
+    // Handle to a program object
+    GLuint mProgramObject; /*!< Handle to the program object */
+
+    int mWidth; /*!< Width of the scene*/
+    int mHeight; /*!< Height of the scene */
+
+    // Attribute locations
+    GLint  mPositionLoc; /*!< Handle for the attribute a_position*/
+    GLint  mTexCoordLoc; /*!< Handle for the attribute a_texCoord */
+
+    // Vertices
+    GLfloat mVertices[20]; /*!< Vertex and texture coordinates for the plain quad*/
+    GLushort mIndices[6]; /*!< Indices for the quad scene*/
+
+    // Uniform and sampler locations
+    GLint  u_texDimLoc; /*!< Handle to the uniform u_texDimensions */
+    GLint  mSamplerLoc; /*!< Handle to the sampler s_frame */
+
+    GLuint mTexFrameId; /*!< Handle to the single-channel texture for uploaded frames (only for a GL_RGBA target) */
+    GLuint mTexSourceId; /*!< Handle to the texture which is rendered by \ref run (uploaded or imported frame) */
+    GLint  mTextureUnit; /*!< Texture unit of the frame textures */
+    GLuint mTexTargetId; /*!< Handle to the texture of the original image, set by the parent */
+    GLenum mTargetFormat; /*!< Format of \ref mTexTargetId, GL_RGBA (default), GL_LUMINANCE or GL_LUMINANCE_ALPHA (high bit depth), set by the parent */
+    GLuint mFboId; /*!< Handle to the FBO used to render into \ref mTexTargetId */
+
+    bool mUseDmaBuf; /*!< Import dmabuf frames if EGL supports it (default true) */
+    bool mLastImported; /*!< True if the last frame was imported without a CPU copy */
+
+    /*!
+     \brief Constructor
+
+     \param width  Width of the scene
+     \param height Height of the scene
+    */
+    IngestPhase(int width = 0, int height = 0);
+
+    /*!
+     \brief Destructor
+    */
+    virtual ~IngestPhase();
+
+    /*!
+     \brief Initializes the program, the texture for uploads and checks the extensions
+
+     \ref mTexTargetId has to be set before \ref run is called.
+
+     \param fbos[] The 2 framebuffers of the phases, the first one is used
+     \param bfUsedTextures The bitfield to determine which texture units are already used
+     \return GLint Returns GL_TRUE on success
+    */
+    GLint init(GLuint fbos[], GLuint &bfUsedTextures);
+
+    /*!
+     \brief Imports or uploads a frame and renders it into \ref mTexTargetId if necessary
+
+     \param frame The frame, has to have the size of the scene and more than
+                  8 bits per pixel exactly if the target is GL_LUMINANCE_ALPHA
+     \return double The time (in ms) the ingest took
+    */
+    double ingest(const Frame &frame);
+
+    /*!
+     \brief Renders the last frame into \ref mTexTargetId
+
+     \return double The time (in ms) the computation took
+    */
+    virtual double run();
+
+    /*!
+     \brief Returns the texture which holds the last frame
+
+     This is \ref mTexTargetId, unless the frame was imported into a
+     luminance target.
+
+     \return GLuint
+    */
+    GLuint getFrameTexture() const;
+
+    /*!
+     \brief Returns true if the texture of the last frame starts with the top row
+
+     \return bool
+    */
+    bool isFrameTopDown() const;
+
+    /*!
+     \brief Returns true if dmabuf frames can be imported without a copy
+
+     Only valid after \ref init.
+
+     \return bool
+    */
+    bool supportsDmaBuf() const;
+
+    /*!
+     \brief Destroys the EGLImages of all imported dmabufs
+
+     Has to be called before the dmabufs of the camera are freed, as their
+     file descriptors may be reused for other buffers.
+    */
+    void releaseImports();
+
+    virtual void releaseGlResources();
+
+private:
+    /*!
+     \brief Imported dmabuf
+    */
+    struct Import
+    {
+        int fd; /*!< File descriptor of the dmabuf */
+        int offset; /*!< Offset of the frame in the dmabuf */
+        int stride; /*!< Stride of the frame */
+        EGLImageKHR image; /*!< EGLImage of the dmabuf */
+        GLuint texture; /*!< Texture bound to \ref image */
+    };
+
+    /*!
+     \brief Returns the texture of the imported dmabuf, imports it if necessary
+
+     \param frame
+     \return GLuint The texture or 0 if the import failed
+    */
+    GLuint importDmaBuf(const Frame &frame);
+
+    /*!
+     \brief Uploads the frame into \ref mTexFrameId (or \ref mTexTargetId for a luminance (alpha) target)
+
+     \param frame
+    */
+    void upload(const Frame &frame);
+
+    /*!
+     \brief Returns the texture which receives the uploaded frames
+
+     \return GLuint
+    */
+    GLuint uploadTexture() const;
+
+    bool mHasDmaBufImport; /*!< EGL_EXT_image_dma_buf_import and GL_OES_EGL_image are available */
+    bool mHasUnpackSubimage; /*!< GL_EXT_unpack_subimage is available */
+    std::vector<Import> mImports; /*!< All imported dmabufs */
+    std::vector<uint8_t> mPacked; /*!< Buffer for frames which have to be packed before the upload */
+
+    PFNEGLCREATEIMAGEKHRPROC  mCreateImage; /*!< Pointer to eglCreateImageKHR */
+    PFNEGLDESTROYIMAGEKHRPROC mDestroyImage; /*!< Pointer to eglDestroyImageKHR */
+    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC mImageTargetTexture2D; /*!< Pointer to glEGLImageTargetTexture2DOES */
+};
+
+/*!
+    @}
+*/
+
+#endif // INGESTPHASE_H
@@ -5,6 +5,7 @@
 using namespace cimg_library;
 
 #include <stdio.h>
+#include <vector>
 
 #include "phase.h"
 #include "getTime.h"
@@ -54,25 +55,47 @@ public:
     GLint  u_thresholdLoc; /*!< Handle to the uniform u_threshold */
     GLint  u_passLoc; /*!< Handle to the uniform u_pass*/
     GLint  u_factorLoc; /*!< Handle to the uniform u_factor*/
+    GLint  u_tileSizeLoc; /*!< Handle to the uniform u_tileSize*/
+    GLint  u_origTopDownLoc; /*!< Handle to the uniform u_origTopDown*/
+    GLint  u_origMaxValueLoc; /*!< Handle to the uniform u_origMaxValue*/
 
     // Uniform values
     float u_threshold; /*!< threshold value for the thresholding operation*/
     GLint u_pass; /*!< Number of the current iteration */
     GLint u_factor; /*!< determines if forward mask (1.0) or backward mask (-1.0)*/
+    int mTileSize; /*!< Edge length of the tiles which are labeled independently, 0 labels the whole frame at once (default 0) */
 
     // Sampler location
     GLint mSamplerLoc; /*!< Handle to the sampler s_texture */
+    GLint mPrevSamplerLoc; /*!< Handle to the sampler s_prevTexture */
 
     // Texture handle
     /// TODO: image somewhere else?
-    CImg<unsigned char> mImage;
+    CImg<unsigned char> mImage; /*!< Original image, interleaved with 1 (\ref mOrigFormat GL_LUMINANCE) or 4 channels (GL_RGBA), 2 bytes (low, high) per pixel above 8 bits */
+    GLenum mOrigFormat; /*!< Format of the texture of the original image, GL_LUMINANCE (default) or GL_RGBA */
+    int mOrigBitDepth; /*!< Bits per pixel of the original image, 8 (default) up to 16. Above 8 bits the texture is GL_LUMINANCE_ALPHA */
 
     // Texture to attach to the frambuffers
     GLuint mTexOrigId; /*!< Handle to the texture which holdes the original image*/
+    GLuint mTexSourceId; /*!< Handle to the texture which is sampled as original image, see \ref setOrigSource */
+    bool   mOrigTopDown; /*!< True if \ref mTexSourceId starts with the top row */
     GLuint mTexPiPoId[2]; /*!< Handle to the two textures which are used for ping-pong-method*/
     GLuint mFboId[2]; /*!< Handles to the two FBOs for ping-pong method*/
     GLint  mTextureUnits[3]; /*!< Handles to the texture units for the above textures*/
 
+    // Convergence check
+    bool mCheckConvergence; /*!< Stop the iterations as soon as the labels do not change anymore (default true) */
+    int mNumPasses; /*!< Number of passes of the last \ref run (including the initial labeling) */
+    GLuint mTexSavedId; /*!< Handle to the copy of the labels at the last convergence check */
+    GLuint mTexChangedId[2]; /*!< Handles to the two small textures with the changed flags of the compare stage and their reduction */
+    GLuint mFboChangedId[2]; /*!< Handles to the FBOs of \ref mTexChangedId */
+    int mChangedWidth; /*!< Width of \ref mTexChangedId */
+    int mChangedHeight; /*!< Height of \ref mTexChangedId */
+
+    std::vector<GLubyte> mLabels; /*!< Readback of the labels at the tile borders for their merge */
+
+    const RegionSet *mRegions; /*!< Occupied regions of the frame, NULL or inactive to draw the full frame */
+
     int mWrite; /*!< Holds the index of the FBO/texture which is written to */
     int mRead; /*!< Holds the index of the texture which is read from */
 
@@ -111,7 +134,10 @@ public:
 
      This init-function is used if the phase should be run without the need
      of the results of any previous stages or input. The image data of the
-     original image is copied from \ref mTgaData
+     original image is copied from \ref mImage into a texture of
+     \ref mOrigFormat. The shaders only read the grey value, so
+     GL_LUMINANCE needs a quarter of the upload and texture memory of
+     GL_RGBA.
 
      \param fbos[] The 2 framebuffers necessary for rendering
      \param bfUsedTextures The bitfield to determine which texture units are already used
@@ -119,15 +145,69 @@ public:
     */
     GLint initIndependent(GLuint fbos[], GLuint &bfUsedTextures);
 
+    /*!
+     \brief Returns the texture format of the original image
+
+     GL_LUMINANCE_ALPHA for more than 8 bits per pixel (low byte in the
+     luminance, high byte in the alpha channel), otherwise \ref mOrigFormat.
+
+     \return GLenum
+    */
+    GLenum origTextureFormat() const;
+
+    /*!
+     \brief Returns the largest value of a pixel of the original image, (2^\ref mOrigBitDepth)-1
+
+     \return unsigned
+    */
+    unsigned origMaxValue() const;
+
+    /*!
+     \brief Sets \ref u_threshold to an integer sensor value
+
+     The threshold is placed half a step below the value, so that the
+     comparison in the shader is exact for all bit depths. \ref mOrigBitDepth
+     has to be set before.
+
+     \param value Smallest value of a foreground pixel
+    */
+    void setThreshold(unsigned value);
+
+    /*!
+     \brief Uploads the content of \ref mImage into the texture of the original image
+
+     The texture is not reallocated, hence the size of \ref mImage has to be
+     the same as during \ref initIndependent.
+    */
     void updateOrigTexture();
 
     /*!
-     \brief Return the handle to the texture holding the original image
+     \brief Samples another texture of the same size as original image
+
+     Used for camera frames, which are uploaded or imported starting with the
+     top row (see \ref IngestPhase). The texture is bound to the texture unit
+     of the original image. \ref updateOrigTexture switches back to
+     \ref mTexOrigId.
+
+     \param texture Texture with the grey values in the red channel
+     \param topDown True if the first row of the texture is the top row
+    */
+    void setOrigSource(GLuint texture, bool topDown);
+
+    /*!
+     \brief Return the handle to the texture which is sampled as original image
 
      \return GLuint
     */
     GLuint getOrigTexture();
 
+    /*!
+     \brief Return true if the original image starts with the top row
+
+     \return bool
+    */
+    bool isOrigTopDown();
+
     /*!
      \brief Return the index of the texture unit the original texture is assinged to
 
@@ -181,14 +261,57 @@ public:
     /*!
      \brief Runs the labeling algorithm
 
+     The passes alternate between propagating the highest label of the
+     neighbours (forward and backward in turns) and a lookup of the label of
+     the label. At most logBase2(mHeight)+10 passes are run. With
+     \ref mCheckConvergence the labels are compared every 4 passes (after a
+     backward pass) with a copy of them from the last check and the loop
+     stops as soon as they did not change. The number of passes is stored
+     in \ref mNumPasses.
+
+     With \ref mTileSize the labels only propagate inside of the tiles and at
+     most logBase2(mTileSize)+10 passes are run. The tiles are joined
+     afterwards by \ref mergeTileBorders.
+
      TODO: Cleanup the code and comments
-     TODO: Write short explanation here?
      TODO: refere to the general explanation and GLSL docu
 
      \return double The time (in ms) the computation took
     */
     virtual double run();
 
+    /*!
+     \brief Copies the labels of \ref mRead into \ref mTexSavedId
+
+     With active regions only their boxes are copied.
+    */
+    void saveLabels();
+
+    /*!
+     \brief Checks if any label changed since the last \ref saveLabels
+
+     Renders the compare stage of the label shader (only in the regions, if
+     any) into the free texture \ref mWrite, i.e. one flag per label, and
+     reduces the flags on the GPU via \ref mTexChangedId (blocks of
+     COMPARE_BLOCK x COMPARE_BLOCK flags) until a single flag is left. Only
+     this flag is read back.
+
+     \return bool True if the textures \ref mRead and \ref mTexSavedId differ
+    */
+    bool labelsChanged();
+
+    /*!
+     \brief Joins the labels of neighboring tiles
+
+     The labels of the 2 rows and columns at each tile border are read back
+     and the labels which touch across a tile border are joined with a
+     union-find on the CPU. The root of each tile-local label
+     is then overwritten with the label of the complete spot (the highest
+     label, i.e. its top-right pixel) and one lookup pass spreads it to all
+     pixels of the spot.
+    */
+    void mergeTileBorders();
+
     virtual void releaseGlResources();
 };
 
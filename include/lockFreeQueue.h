@@ -0,0 +1,133 @@
+#ifndef LOCKFREEQUEUE_H
+#define LOCKFREEQUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+/*!
+ \brief Bounded multi-producer multi-consumer queue without locks
+
+ Ring buffer of D. Vyukov: every cell carries a sequence number which tells
+ producers and consumers whether the cell is free for the position they
+ claimed with a compare-and-swap. Neither \ref push nor \ref pop ever
+ blocks, they return false if the queue is full or empty.
+
+ \tparam T Type of the elements, has to be default constructible
+*/
+template <typename T>
+class LockFreeQueue
+{
+public:
+    /*!
+     \brief Constructor
+
+     \param capacity Maximum number of elements, rounded up to a power of 2
+    */
+    explicit LockFreeQueue(size_t capacity)
+        : mEnqueuePos(0), mDequeuePos(0)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        mMask = size-1;
+
+        mCells.resize(size);
+        for (size_t i=0; i<size; ++i)
+            mCells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    LockFreeQueue(const LockFreeQueue &) = delete;
+    LockFreeQueue &operator=(const LockFreeQueue &) = delete;
+
+    /*!
+     \brief Appends an element
+
+     \param value The element
+     \return bool false if the queue is full
+    */
+    bool push(const T &value)
+    {
+        Cell *cell;
+        size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &mCells[pos & mMask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+            if (diff == 0)
+            {
+                if (mEnqueuePos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+        }
+        cell->value = value;
+        cell->sequence.store(pos+1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+     \brief Removes the oldest element
+
+     \param value Receives the element
+     \return bool false if the queue is empty
+    */
+    bool pop(T &value)
+    {
+        Cell *cell;
+        size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &mCells[pos & mMask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)(pos+1);
+            if (diff == 0)
+            {
+                if (mDequeuePos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = mDequeuePos.load(std::memory_order_relaxed);
+        }
+        value = cell->value;
+        cell->sequence.store(pos+mMask+1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+     \brief Returns the maximum number of elements
+
+     \return size_t
+    */
+    size_t capacity() const
+    {
+        return mMask+1;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence; /*!< Position the cell is free for (pos) or filled for (pos+1) */
+        T value; /*!< The element */
+
+        Cell() : sequence(0) {}
+        Cell(const Cell &other) : sequence(other.sequence.load()), value(other.value) {}
+    };
+
+    std::vector<Cell> mCells; /*!< The ring buffer */
+    size_t mMask; /*!< Size of the ring buffer - 1 */
+    // Separate cache lines, producers and consumers do not disturb each other
+    char mPad0[64];
+    std::atomic<size_t> mEnqueuePos; /*!< Next position to push to */
+    char mPad1[64];
+    std::atomic<size_t> mDequeuePos; /*!< Next position to pop from */
+    char mPad2[64];
+};
+
+#endif // LOCKFREEQUEUE_H
@@ -0,0 +1,119 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stddef.h>
+#include <iostream>
+
+/*!
+ \brief Log levels, a message is written if its level is at most the current level
+*/
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1 /*!< Failures, written to stderr */
+#define LOG_LEVEL_WARN  2 /*!< Fallbacks and recoverable problems, written to stderr */
+#define LOG_LEVEL_INFO  3 /*!< One line summaries per frame, e.g. timings and number of spots */
+#define LOG_LEVEL_DEBUG 4 /*!< Phase banners and every single spot */
+#define LOG_LEVEL_TRACE 5 /*!< Readbacks and image dumps of the intermediate passes */
+
+/*!
+ \brief Highest level which is compiled in
+
+ Messages above this level are removed by the compiler, including the
+ formatting of their arguments and the debug readbacks of \ref LOG_ENABLED
+ blocks. Can be set with -DLOG_MAX_LEVEL=..., otherwise release builds
+ (NDEBUG) keep warnings and errors only, debug builds (_DEBUG) keep
+ everything.
+*/
+#ifndef LOG_MAX_LEVEL
+    #if defined(_DEBUG)
+        #define LOG_MAX_LEVEL LOG_LEVEL_TRACE
+    #elif defined(NDEBUG)
+        #define LOG_MAX_LEVEL LOG_LEVEL_WARN
+    #else
+        #define LOG_MAX_LEVEL LOG_LEVEL_DEBUG
+    #endif
+#endif
+
+/*!
+ \brief True if messages of the level are compiled in and enabled at runtime
+*/
+#define LOG_ENABLED(messageLevel) ((messageLevel) <= LOG_MAX_LEVEL && (messageLevel) <= Log::level())
+
+/*!
+ \brief Writes a message composed with operator<<, e.g. LOG_INFO("Found " << n << " spots")
+*/
+#define LOG_MESSAGE(messageLevel, message) do { \
+        if (LOG_ENABLED(messageLevel)) { \
+            Log::stream(messageLevel) << message << std::endl; \
+        } \
+    } while (0)
+
+#define LOG_ERROR(message) LOG_MESSAGE(LOG_LEVEL_ERROR, message)
+#define LOG_WARN(message)  LOG_MESSAGE(LOG_LEVEL_WARN,  message)
+#define LOG_INFO(message)  LOG_MESSAGE(LOG_LEVEL_INFO,  message)
+#define LOG_DEBUG(message) LOG_MESSAGE(LOG_LEVEL_DEBUG, message)
+#define LOG_TRACE(message) LOG_MESSAGE(LOG_LEVEL_TRACE, message)
+
+/*!
+ \brief Runtime part of the logging
+
+ The runtime level is LOG_LEVEL_INFO, unless the environment variable
+ GPULABELING_LOG_LEVEL holds another level (0 to 5). It can not enable
+ messages above \ref LOG_MAX_LEVEL.
+
+ The messages and the readbacks of the debug output are counted, so a
+ release build can be checked to have a hot path without any of them.
+
+*/
+class Log
+{
+public:
+    /*!
+     \brief Returns the current runtime level
+
+     \return int
+    */
+    static int level();
+
+    /*!
+     \brief Sets the runtime level
+
+     \param level One of the LOG_LEVEL_* values
+    */
+    static void setLevel(int level);
+
+    /*!
+     \brief Returns the stream for a message of the level and counts the message
+
+     \param level Level of the message
+     \return std::ostream& std::cerr for errors and warnings, std::cout otherwise
+    */
+    static std::ostream &stream(int level);
+
+    /*!
+     \brief Counts a readback which is only done for the debug output
+
+     \param bytes Size of the readback
+    */
+    static void countDebugReadback(size_t bytes);
+
+    /*!
+     \brief Returns the number of messages written since the last \ref resetCounters
+
+     \return size_t
+    */
+    static size_t numMessages();
+
+    /*!
+     \brief Returns the number of debug readbacks since the last \ref resetCounters
+
+     \return size_t
+    */
+    static size_t numDebugReadbacks();
+
+    /*!
+     \brief Sets the counters of messages and debug readbacks to 0
+    */
+    static void resetCounters();
+};
+
+#endif // LOG_H
@@ -3,14 +3,20 @@
 #include "CImg.h"
 using namespace cimg_library;
 #include "phase.h"
+#include "ingestPhase.h"
 #include "labelPhase.h"
 #include "reductionPhase.h"
 #include "statsPhase.h"
+#include "cpuPhase.h"
+#include "pyramidPhase.h"
+#include "regionSet.h"
 
 #include <GLES2/gl2.h>
 #include <EGL/egl.h>
 
-#include<string>
+#include <string>
+#include <vector>
+#include <stdint.h>
 
 /*!
  \brief Class which manages all the OpenGL handling for gpulabeling
@@ -46,13 +52,43 @@ public:
        EGLSurface  eglSurface; /*!< Handle to the EGLSurface*/
     } esContext; /*!< TODO */
 
+    /*!
+     \brief Implementation which is used to extract the spots
+    */
+    enum Backend
+    {
+        BACKEND_GPU, /*!< OpenGL ES 2.0 phases (default) */
+        BACKEND_CPU  /*!< Multithreaded CPU implementation, see \ref CpuPhase */
+    };
+
+    /*!
+     \brief Pre-pass which finds the occupied tiles for \ref mRegions
+    */
+    enum RegionDetection
+    {
+        REGIONS_MASK, /*!< Foreground mask with the hot pixel rule on the CPU, see \ref ThresholdKernel::computeMask (default) */
+        REGIONS_TILE_MAX, /*!< Maximum of each tile on the CPU, see \ref ThresholdKernel::computeTileMax */
+        REGIONS_PYRAMID_GPU /*!< Max-pool pyramid on the GPU, see \ref PyramidPhase */
+    };
+
 // Phases:
+    //0. Camera frames of the streaming mode
+    IngestPhase mIngestPhase; /*!< Object which brings external frames into the texture of the original image*/
     //1. LabelPhase
     LabelPhase mLabelPhase; /*!< Object which takes care of thresholding and labeling of the Image*/
     //2. ReductionPhase
     ReductionPhase mReductionPhase; /*!< Object which creates a list of all identified spots*/
     //3. Compute the statistics of the labels
     StatsPhase mStatsPhase; /*!< Object which computes the statistics for each identified spot*/
+    //Occupied tiles for the regions on the GPU
+    PyramidPhase mPyramidPhase; /*!< Object which finds the occupied tiles if \ref REGIONS_PYRAMID_GPU is selected */
+    //Alternative: all phases on the CPU
+    CpuPhase mCpuPhase; /*!< Object which does all phases on the CPU if \ref BACKEND_CPU is selected*/
+
+    RegionSet mRegions; /*!< Occupied regions of the current frame, the GPU phases only draw those */
+    bool mUseRegions; /*!< Restrict the GPU phases to the occupied regions (default: true) */
+    RegionDetection mRegionDetection; /*!< How the occupied tiles of \ref mRegions are found (default: \ref REGIONS_MASK) */
+    unsigned mAcquisitionInterval; /*!< Maximum number of frames \ref trackFrame processes in windows before it acquires a full frame again (default 25, 0 only on lost spots) */
 
     /*!
      \brief Constructor
@@ -61,8 +97,9 @@ public:
 
      \param width
      \param height
+     \param backend Implementation used to extract the spots
     */
-    Ogles(int width = 0, int height = 0);
+    Ogles(int width = 0, int height = 0, Backend backend = BACKEND_GPU);
 
     /*!
      \brief Destructor
@@ -78,18 +115,161 @@ public:
      texture and will be used as a starting point for the computation.
 
      \param imageFilename Path to the file which is to be evaluated
+     \param backend Implementation used to extract the spots
     */
-    Ogles(std::string imageFilename);
+    Ogles(std::string imageFilename, Backend backend = BACKEND_GPU);
 
     /*!
      \brief Function which does all the computation
 
      Runs through all phases and makes sure each phase receives
-     the necessary information of previous phases.
+     the necessary information of previous phases. A pending frame of
+     \ref processFramePipelined is finished first and its spots are dropped,
+     call \ref flushPipeline before to get them.
 
     */
     void extractSpots();
 
+    /*!
+     \brief Processes one camera frame in streaming mode
+
+      The first call creates the EGLContext, the FBOs, the shader programs and
+      all textures for the given frame size. Every further call only uploads
+      the new frame into the already existing texture of the original image
+      and runs all phases again, i.e. there is no per-frame setup cost.
+      All frames of a stream have to have the same size. The first call
+      throws std::runtime_error if no EGLContext can be created, the frame
+      exceeds the maximum texture size of the context or a phase can't be
+      initialized (e.g. a shader does not compile).
+
+      A pending frame of \ref processFramePipelined is finished first and its
+      spots are dropped, call \ref flushPipeline before to get them.
+
+     \param pixels 8-bit greyscale pixels, row by row starting with the top row
+     \param width  Width of the frame in pixels
+     \param height Height of the frame in pixels
+     \return Reference to the spots found in the frame (valid until the next call)
+    */
+    const std::vector<StatsPhase::Spot>& processFrame(const uint8_t *pixels, int width, int height);
+
+    /*!
+     \brief Processes one external camera frame in streaming mode
+
+      Like \ref processFrame, but the frame may have padded rows and may be
+      given as dmabuf. The GPU backend imports dmabufs without a copy if EGL
+      supports it, else the frame is uploaded once (see \ref IngestPhase).
+      The CPU backend and the occupied regions read the pixels in place,
+      dmabufs are mapped for this.
+
+      The bit depth of the first frame is used for the whole stream. Frames
+      with more than 8 bits per pixel are only supported by the GPU backend,
+      the threshold is best set with \ref LabelPhase::setThreshold then.
+
+     \param frame The frame
+     \return Reference to the spots found in the frame (valid until the next call)
+    */
+    const std::vector<StatsPhase::Spot>& processFrame(const IngestPhase::Frame &frame);
+
+    /*!
+     \brief Processes one camera frame with one frame latency
+
+      Like \ref processFrame, but the spots of the frame are read back during
+      the next call. The passes of the frame are issued and flushed, then the
+      call returns and the GPU works on them while the client captures the
+      next frame or evaluates the spots. The next call first thresholds its
+      frame on the CPU (for \ref mRegions), then waits for the passes of this
+      frame and reads back its spots, and only then issues its own passes.
+
+      Nothing else of the frame is read back: the labeling runs the fixed
+      number of passes without the convergence check of
+      \ref LabelPhase::mCheckConvergence and without the tiles of
+      \ref LabelPhase::mTileSize (both read back), and the reduction does
+      not read back the size of its table. So all passes overlap with the
+      client and the throughput approaches the maximum of the GPU and the
+      CPU time instead of their sum, at the cost of more label passes. Only
+      \ref REGIONS_PYRAMID_GPU reads back its tiles before the passes are
+      issued, the pyramid itself does not overlap.
+
+      If EGL supports EGL_KHR_fence_sync, the wait is a fence which is placed
+      behind the last pass. Otherwise the readback itself waits for the GPU.
+      ES2 has no pixel buffer objects, hence the final table of the
+      statistics stays in its texture until it is read back.
+
+      The pixels (or the dmabuf) of the frame have to stay unchanged until the
+      next call returns, as the GPU may still read them. Frames of the CPU
+      backend are processed immediately but are returned with the same
+      latency.
+
+     \param frame The frame
+     \return Reference to the spots of the previous frame, empty for the first
+             frame (valid until the next call)
+    */
+    const std::vector<StatsPhase::Spot>& processFramePipelined(const IngestPhase::Frame &frame);
+
+    /*!
+     \brief Reads back the spots of the last frame of \ref processFramePipelined
+
+     \return Reference to the spots of the last frame, empty if there is none
+    */
+    const std::vector<StatsPhase::Spot>& flushPipeline();
+
+    /*!
+     \brief Processes one camera frame only inside windows around predicted spots
+
+      Tracking mode: once the spots are known, the client predicts where they
+      will be in the next frame and passes one window per spot. Thresholding,
+      labeling and the statistics only run inside the windows (the windows
+      become the boxes of \ref mRegions), and the CPU threshold of the full
+      frame which normally builds \ref mRegions is skipped. Spots outside of
+      all windows are not found. The CPU backend only thresholds and encodes
+      the 64-bit words and rows of the boxes. On small frames the boxes span
+      most words of a row though, and building them costs about as much as
+      it saves (tracking 512 x 384 is slower than the full frame).
+
+      A full frame is processed like \ref processFrame instead (acquisition)
+      if there are no windows, after \ref mAcquisitionInterval frames in
+      windows or if a spot was lost in the previous frame, i.e. a window did
+      not contain the centre of any spot. New spots only appear at
+      acquisitions. Like \ref processFrame, the spots of a pending frame of
+      \ref processFramePipelined are dropped.
+
+     \param frame   The frame
+     \param windows Predicted positions and radii (coordinates of \ref StatsPhase::Spot)
+     \return Reference to the spots found in the frame (valid until the next call)
+    */
+    const std::vector<StatsPhase::Spot>& trackFrame(const IngestPhase::Frame &frame,
+                                                    const std::vector<RegionSet::Window> &windows);
+
+    /*!
+     \brief Returns if the last call of \ref trackFrame processed the full frame
+
+     \return bool
+    */
+    bool wasAcquisition() const;
+
+    /*!
+     \brief Returns the spots found by the last run of the selected backend
+
+     \return const std::vector<StatsPhase::Spot>&
+    */
+    const std::vector<StatsPhase::Spot>& getSpots() const;
+
+    /*!
+     \brief Returns the backend selected in the constructor
+
+     \return Backend
+    */
+    Backend getBackend() const;
+
+    /*!
+     \brief Loads the original image from a file
+
+     Above 8 bits per pixel (\ref LabelPhase::mOrigBitDepth has to be set
+     before) the file is read with 16 bits per channel, e.g. a 16-bit PNG.
+
+     \param imageFilename Path to the image file
+     \param updateTexture Upload the image into the existing texture of the original image
+    */
     void loadImageFromFile(std::string imageFilename, bool updateTexture = true);
 
     bool isInitialized();
@@ -97,6 +277,90 @@ public:
 private:
     void initialize();
 
+    /*!
+     \brief Initializes the phases in the EGLContext created by \ref initEGL
+
+     Throws std::runtime_error if the frame exceeds the texture size or a
+     phase can't be initialized.
+    */
+    void initContext();
+
+    /*!
+     \brief Checks the frame and initializes everything with the first frame
+    */
+    void prepareFrame(const IngestPhase::Frame &frame);
+
+    /*!
+     \brief Makes the EGLContext of this object current if it is not
+
+     Several objects may be used by the same thread, so each call which
+     issues OpenGL commands binds its own context first.
+    */
+    void makeCurrent();
+
+    /*!
+     \brief Extracts the spots of a frame with the \ref CpuPhase
+    */
+    void processFrameCpu(const IngestPhase::Frame &frame);
+
+    /*!
+     \brief Builds \ref mRegions from the frame (or resets them if \ref mUseRegions is false)
+    */
+    void buildFrameRegions(const IngestPhase::Frame &frame);
+
+    /*!
+     \brief Brings the frame into the texture of the original image
+    */
+    void ingestFrame(const IngestPhase::Frame &frame);
+
+    /*!
+     \brief Waits for the passes of the pending pipelined frame and reads back its spots
+    */
+    void collectPendingFrame();
+
+    /*!
+     \brief Loads a high bit depth image into \ref LabelPhase::mImage with 2 bytes per pixel
+    */
+    void loadDeepImageFromFile(std::string imageFilename, bool updateTexture);
+
+    /*!
+     \brief Throws std::runtime_error if the CPU backend does not support the bit depth
+
+     \param bitDepth Bits per pixel of the image
+    */
+    void checkCpuBitDepth(int bitDepth);
+
+    /*!
+     \brief Thresholds an image on the CPU and builds \ref mRegions from it
+
+     Depending on \ref mRegionDetection with the foreground mask or the
+     maximum of each tile.
+
+     \param pixels      First pixel of the bottom row (OpenGL orientation), the high
+                        byte of the pixel for more than 8 bits per pixel
+     \param rowStride   Bytes from one row to the next row above (may be negative)
+     \param pixelStride Bytes from one pixel to the next
+    */
+    void updateRegions(const uint8_t *pixels, ptrdiff_t rowStride, int pixelStride);
+
+    /*!
+     \brief Builds \ref mRegions with the \ref PyramidPhase from the texture of the original image
+    */
+    void updateRegionsGpu();
+
+    /*!
+     \brief Runs the GPU phases on the texture of the original image and prints the timing
+
+     \param readBack Read back the spots, otherwise the final table is left
+                     for \ref StatsPhase::readSpots
+    */
+    void extractSpotsGpu(bool readBack = true);
+
+    /*!
+     \brief Runs the \ref CpuPhase on the image set before and prints the timing
+    */
+    void extractSpotsCpu();
+
     /*!
      \brief Initializes an EGLContext
 
@@ -113,6 +377,14 @@ private:
     */
     int initEGL(int width, int height);
 
+    /*!
+     \brief Destroys the EGLContext and the surface of \ref initEGL
+
+     Also works after a failed \ref initEGL. The last object which uses the
+     display terminates it.
+    */
+    void releaseEGL();
+
     /*!
      \brief Checks if the EGL error flag is set and prints an error message
 
@@ -132,8 +404,26 @@ private:
     int mHeight; /*!< Height of the scene*/
     unsigned mUsedTexUnits; /*!< Bitfield of used texture units */
     bool mIsInitialized;
+    Backend mBackend; /*!< Implementation used to extract the spots */
 
     GLuint mFboId[2] ; /*!< Handles to the two framebuffer objects*/
+
+    std::vector<uint64_t> mMask; /*!< Foreground mask used to build \ref mRegions */
+    std::vector<uint8_t> mTileMax; /*!< Maximum of each tile used to build \ref mRegions */
+
+    // Tracking mode
+    unsigned mFramesSinceAcquisition; /*!< Frames \ref trackFrame processed in windows since the last acquisition */
+    bool mSpotLost; /*!< A window of the last tracked frame contained no spot */
+    bool mWasAcquisition; /*!< The last tracked frame was a full frame */
+
+    // Pipelined mode
+    bool mPipelinePending; /*!< A frame of \ref processFramePipelined has not been read back yet */
+    std::vector<StatsPhase::Spot> mPipelineSpots; /*!< Spots of the pending frame of the CPU backend */
+    bool mHasFenceSync; /*!< EGL_KHR_fence_sync is available */
+    EGLSyncKHR mPendingFence; /*!< Fence behind the passes of the pending frame */
+    PFNEGLCREATESYNCKHRPROC mCreateSync; /*!< eglCreateSyncKHR */
+    PFNEGLCLIENTWAITSYNCKHRPROC mClientWaitSync; /*!< eglClientWaitSyncKHR */
+    PFNEGLDESTROYSYNCKHRPROC mDestroySync; /*!< eglDestroySyncKHR */
 };
 
 #endif // OGLES_H
@@ -0,0 +1,130 @@
+#ifndef OGLESPOOL_H
+#define OGLESPOOL_H
+
+#include "ogles.h"
+#include "lockFreeQueue.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ \brief Runs several frames concurrently, each one in its own EGLContext
+
+ Without a GPU the phases run on Mesa's software renderer, where a single
+ context leaves most of the cores idle while it waits for its draw calls.
+ The pool starts one thread per context and each thread owns a complete
+ \ref Ogles object, i.e. its own context (with a 1x1 pbuffer surface, all
+ phases render into FBOs) with its own set of phases, textures and programs. The contexts share nothing but the EGL
+ display and the \ref ProgramCache.
+
+ Frames are handed to the threads through a \ref LockFreeQueue, a thread
+ which finds the queue empty sleeps until the next \ref submit. Every
+ frame goes to the next free context, so the results arrive out of order
+ and are identified by the index returned by \ref submit.
+
+ llvmpipe starts its own rasterizer threads per context, with several
+ contexts LP_NUM_THREADS should be reduced accordingly. The \ref Profiler
+ is not thread safe and has to stay disabled while the pool runs.
+
+*/
+class OglesPool
+{
+public:
+    /*!
+     \brief Called once by each thread with its \ref Ogles object before the first frame
+    */
+    typedef std::function<void(Ogles &ogles)> SetupFunc;
+
+    /*!
+     \brief Called by the thread which processed a frame, concurrently for different frames
+
+     The spots are only valid during the call.
+    */
+    typedef std::function<void(uint64_t index, const std::vector<StatsPhase::Spot> &spots)> ResultFunc;
+
+    /*!
+     \brief Constructor, starts the threads
+
+     The contexts are created with the first frame of each thread.
+
+     \param numContexts Number of contexts (and threads), 0 uses the number of available cores
+     \param result      Receives the spots of each frame
+     \param setup       Configures the \ref Ogles objects, e.g. the threshold (optional)
+     \param queueSize   Number of frames which may wait for a context, 0 uses 4 per context
+    */
+    OglesPool(unsigned numContexts, const ResultFunc &result, const SetupFunc &setup = SetupFunc(),
+              size_t queueSize = 0);
+
+    /*!
+     \brief Destructor, finishes all submitted frames and destroys the contexts on their threads
+    */
+    virtual ~OglesPool();
+
+    /*!
+     \brief Queues a frame for the next free context
+
+     Waits while the queue is full. The pixels of the frame have to stay
+     valid until its \ref ResultFunc was called.
+
+     \param frame The frame, all frames have to have the same size
+     \return uint64_t Index of the frame, counted from 0
+    */
+    uint64_t submit(const IngestPhase::Frame &frame);
+
+    /*!
+     \brief Waits until the results of all submitted frames were delivered
+    */
+    void wait();
+
+    /*!
+     \brief Returns the number of contexts
+
+     \return unsigned
+    */
+    unsigned numContexts() const;
+
+    /*!
+     \brief Returns the number of frames processed by each context
+
+     \return std::vector<uint64_t>
+    */
+    std::vector<uint64_t> framesPerContext() const;
+
+private:
+    /*!
+     \brief Frame waiting for a context
+    */
+    struct Job
+    {
+        uint64_t index;
+        IngestPhase::Frame frame;
+
+        Job() : index(0), frame((const uint8_t *)NULL, 0, 0, 0) {}
+        Job(uint64_t index, const IngestPhase::Frame &frame) : index(index), frame(frame) {}
+    };
+
+    /*!
+     \brief Thread function, owns one \ref Ogles object
+    */
+    void worker(unsigned id);
+
+    ResultFunc mResult; /*!< Receives the spots */
+    SetupFunc mSetup; /*!< Configures the Ogles objects */
+    LockFreeQueue<Job> mQueue; /*!< Frames waiting for a context */
+    std::atomic<uint64_t> mNumSubmitted; /*!< Frames given to \ref submit */
+    std::atomic<uint64_t> mNumQueued; /*!< Frames in \ref mQueue, counted before they are pushed */
+    std::atomic<uint64_t> mNumDone; /*!< Frames whose result was delivered */
+    std::atomic<unsigned> mNumSleeping; /*!< Threads waiting for \ref mWakeup */
+    std::atomic<bool> mStop; /*!< Set by the destructor to stop the threads */
+    std::mutex mMutex; /*!< Only for sleeping threads and \ref wait */
+    std::condition_variable mWakeup; /*!< Signals new frames to sleeping threads */
+    std::condition_variable mAllDone; /*!< Signals that all submitted frames are done */
+    std::vector<std::atomic<uint64_t> > mFramesPerContext; /*!< Frames processed by each context, counted by its thread */
+    std::vector<std::thread> mThreads; /*!< One thread per context */
+};
+
+#endif // OGLESPOOL_H
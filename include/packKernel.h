@@ -0,0 +1,80 @@
+#ifndef PACKKERNEL_H
+#define PACKKERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ \brief CPU kernel which brings packed sensor data into the two-byte layout of the original image
+
+ High bit depth frames are uploaded with 2 bytes per pixel (little endian,
+ low byte first), see \ref IngestPhase::Frame. Many 12-bit cameras deliver
+ MIPI CSI-2 RAW12 instead, i.e. 2 pixels in 3 bytes:
+
+     byte 0: bits 11..4 of pixel 0
+     byte 1: bits 11..4 of pixel 1
+     byte 2: bits 3..0 of pixel 1 (high nibble), bits 3..0 of pixel 0 (low nibble)
+
+ The unpacking is vectorized with SSSE3 or NEON, the instruction set is
+ selected at runtime.
+
+*/
+class PackKernel
+{
+public:
+    /*!
+     \brief Instruction sets of the unpacking
+    */
+    enum Isa
+    {
+        ISA_SCALAR,
+        ISA_SSSE3,
+        ISA_NEON
+    };
+
+    /*!
+     \brief Returns the instruction set used on this CPU
+
+     \return Isa
+    */
+    static Isa isa();
+
+    /*!
+     \brief Returns the name of \ref isa for log output
+
+     \return const char *
+    */
+    static const char *isaName();
+
+    /*!
+     \brief Number of bytes of a RAW12 row
+
+     \param width Width of the row (even)
+     \return size_t
+    */
+    static size_t raw12RowSize(int width) { return (size_t)width/2*3; }
+
+    /*!
+     \brief Unpacks one RAW12 row into 12-bit values
+
+     \param src   First byte of the packed row
+     \param dst   First pixel of the unpacked row
+     \param width Number of pixels, has to be even
+    */
+    static void unpackRaw12Row(const uint8_t *src, uint16_t *dst, int width);
+
+    /*!
+     \brief Unpacks a RAW12 image into 12-bit values
+
+     \param src       First byte of the packed image
+     \param srcStride Bytes from one packed row to the next one
+     \param dst       First pixel of the unpacked image
+     \param dstStride Pixels from one unpacked row to the next one
+     \param width     Width of the image, has to be even
+     \param height    Height of the image
+    */
+    static void unpackRaw12(const uint8_t *src, size_t srcStride, uint16_t *dst, size_t dstStride,
+                            int width, int height);
+};
+
+#endif // PACKKERNEL_H
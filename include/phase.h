@@ -7,6 +7,8 @@ using namespace cimg_library;
 #include <EGL/egl.h>
 #include <string>
 
+#include "regionSet.h"
+
 #ifdef _DEBUG
     #define GL_CHECK(stmt) do { \
             stmt; \
@@ -72,6 +74,9 @@ public:
     /*!
      \brief Loads a shader program from a shader file
 
+     The sources are taken from the \ref ShaderSources, i.e. the shaders of
+     glsl/ are found by their file name without any file access.
+
      \param vertShaderFile Path to the file with the vertex shader
      \param fragShaderFile Path to the file with the fragment shader
      \return GLuint The index of the newly created shader program
@@ -79,6 +84,18 @@ public:
     static GLuint loadProgramFromFile(const std::string vertShaderFile,
                                       const std::string fragShaderFile);
 
+    /*!
+     \brief Creates a shader program from in-memory sources
+
+     The content of common.glsl is put in front of both sources. The program
+     is created by the \ref ProgramCache.
+
+     \param vertSource Source of the vertex shader
+     \param fragSource Source of the fragment shader
+     \return GLuint The index of the newly created shader program
+    */
+    static GLuint loadProgram(const std::string &vertSource, const std::string &fragSource);
+
     /*!
      \brief Creates and compiles a shader source
 
@@ -164,6 +181,24 @@ public:
     */
     void printSignedLabels(int width, int height, GLubyte *pixels);
 
+    /*!
+     \brief Draws the full frame quad or only the quads of the occupied regions
+
+     If regions is NULL or inactive, the full frame quad given by vertices and
+     indices is drawn. Otherwise the quads of the regions are drawn.
+     In both cases the attribute pointers are set by this function.
+
+     \param regions     Occupied regions of the frame, can be NULL
+     \param shape       Shape of the regions to draw
+     \param positionLoc Location of the attribute a_position
+     \param texCoordLoc Location of the attribute a_texCoord, -1 if the shader does not use it
+     \param vertices    Vertex and texture coordinates of the full frame quad
+     \param indices     Indices of the full frame quad
+    */
+    static void drawScene(const RegionSet *regions, RegionSet::Shape shape,
+                          GLint positionLoc, GLint texCoordLoc,
+                          const GLfloat *vertices, const GLushort *indices);
+
     /*!
      \brief Returns the logarithm of base 2 of n
 
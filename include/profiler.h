@@ -0,0 +1,135 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stddef.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*!
+ \brief Timing of named scopes of the hot path, aggregated over many frames
+
+ The phases mark their passes with a \ref Scope, e.g. "label.init",
+ "label.pass[3]", "reduction.horizontal" or "stats.quadrant[2].count".
+ By default profiling is disabled and a scope costs a single branch.
+
+ If profiling is enabled, each scope calls glFinish when it starts and when it
+ ends (if an EGL context is current), so the time of the scope is the time
+ the GPU needed for its commands and not only the submission by the CPU.
+ This serializes CPU and GPU, i.e. the total time of a profiled frame is
+ larger than without profiling. Nested scopes are allowed, the outer scope
+ contains the time of the inner ones.
+
+ The samples of all scopes are kept until \ref reset, so min, median and
+ 99th percentile over many frames can be exported as CSV or JSON.
+
+*/
+class Profiler
+{
+public:
+    /*!
+     \brief Timer of a named scope, records the time from construction to destruction
+    */
+    class Scope
+    {
+    public:
+        /*!
+         \brief Starts the scope
+
+         \param name Name of the scope
+        */
+        explicit Scope(const char *name);
+
+        /*!
+         \brief Starts the scope with an index in the name
+
+         The name is only formatted if profiling is enabled.
+
+         \param format printf format of the name with one %d, e.g. "label.pass[%d]"
+         \param index  Index which is put into the name
+        */
+        Scope(const char *format, int index);
+
+        /*!
+         \brief Ends the scope and records its time
+        */
+        ~Scope();
+
+    private:
+        Scope(const Scope &);
+        Scope &operator=(const Scope &);
+
+        void start();
+
+        bool mActive; /*!< Profiling was enabled when the scope started */
+        char mName[64]; /*!< Name of the scope */
+        double mStartTime; /*!< Start of the scope in seconds */
+    };
+
+    /*!
+     \brief Aggregated times of one scope (all times in ms)
+    */
+    struct Summary
+    {
+        std::string name; /*!< Name of the scope */
+        size_t count; /*!< Number of samples */
+        double min; /*!< Shortest sample */
+        double median; /*!< Median of the samples */
+        double p99; /*!< 99th percentile of the samples (nearest rank) */
+        double max; /*!< Longest sample */
+        double mean; /*!< Mean of the samples */
+        double total; /*!< Sum of all samples */
+    };
+
+    /*!
+     \brief Enables or disables the profiling (default disabled)
+
+     \param enabled
+    */
+    static void setEnabled(bool enabled);
+
+    /*!
+     \brief Returns true if the scopes are timed
+
+     \return bool
+    */
+    static bool isEnabled();
+
+    /*!
+     \brief Adds a sample to a scope
+
+     Used by \ref Scope, can also be used for times measured elsewhere.
+
+     \param name Name of the scope
+     \param ms   Time in ms
+    */
+    static void record(const char *name, double ms);
+
+    /*!
+     \brief Returns the aggregated times of all scopes in the order they were recorded first
+
+     \return std::vector<Summary>
+    */
+    static std::vector<Summary> summary();
+
+    /*!
+     \brief Writes \ref summary as CSV with a header line
+
+     \param out Stream to write to
+    */
+    static void writeCsv(std::ostream &out);
+
+    /*!
+     \brief Writes \ref summary as JSON array of objects
+
+     \param out Stream to write to
+    */
+    static void writeJson(std::ostream &out);
+
+    /*!
+     \brief Drops all samples
+    */
+    static void reset();
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,76 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <GLES2/gl2.h>
+
+#include <stdint.h>
+#include <string>
+
+/*!
+ \brief Cache for compiled shaders and linked program objects
+
+ Compiling the shaders dominates the start up time on embedded boards, while
+ most phases share the same sources (e.g. quad.vert and common.glsl).
+
+ Within a process each shader source is compiled only once per EGL context,
+ the shader objects are kept and attached to every program which uses them.
+ Only the map of the shaders is locked, so the contexts of several threads
+ (see \ref OglesPool) compile and link their programs concurrently.
+
+ If a cache directory is set and the driver supports
+ GL_OES_get_program_binary, the linked programs are stored in the directory
+ as well. The file name is the hash of both sources, the renderer and the
+ driver version, so a changed source or driver never loads a stale binary.
+ If the binary can not be loaded, the program is compiled from source and
+ the binary is written again.
+
+*/
+class ProgramCache
+{
+public:
+    /*!
+     \brief Sets the directory for the program binaries
+
+     The directory is created if it does not exist (only the last level).
+
+     \param directory Path to the directory, empty to disable the binaries (default)
+    */
+    static void setDirectory(const std::string &directory);
+
+    /*!
+     \brief Returns the directory for the program binaries
+
+     \return std::string
+    */
+    static std::string directory();
+
+    /*!
+     \brief Returns a linked program object of the given sources
+
+     The program object belongs to the caller and has to be deleted with
+     glDeleteProgram as usual.
+
+     \param vertSource Complete source of the vertex shader
+     \param fragSource Complete source of the fragment shader
+     \return GLuint The program object or 0 on error
+    */
+    static GLuint createProgram(const std::string &vertSource, const std::string &fragSource);
+
+    /*!
+     \brief Deletes the cached shader objects of the current EGL context
+
+     Has to be called before the context is destroyed.
+    */
+    static void releaseContext();
+
+    /*!
+     \brief 64-bit FNV-1a hash
+
+     \param data Data to hash
+     \param seed Hash of the preceding data, to hash several strings in a row
+     \return uint64_t
+    */
+    static uint64_t hash(const std::string &data, uint64_t seed = 14695981039346656037ULL);
+};
+
+#endif // PROGRAMCACHE_H
@@ -0,0 +1,136 @@
+#ifndef PYRAMIDPHASE_H
+#define PYRAMIDPHASE_H
+
+#include "phase.h"
+
+#include <stdint.h>
+#include <vector>
+
+/*!
+    \ingroup labeling
+    @{
+*/
+
+/*!
+ \brief Finds the occupied tiles of the original image with a max-pool pyramid on the GPU
+
+ Coarse pre-pass for the occupied regions (\ref RegionSet) which does not
+ need CPU access to the pixels, e.g. for imported dmabuf frames. The first
+ level thresholds the original image and pools blocks of up to 4 x 4 pixels,
+ every further level pools blocks of the level below until one pixel covers
+ one tile. Only this last level is read back, i.e. one byte per tile.
+
+ A tile is occupied if any of its pixels is above the threshold. The hot
+ pixel rule of the label shader is not applied, so the occupied tiles are a
+ superset of those of the foreground mask.
+
+ The readback waits for all passes which were issued before, i.e. in the
+ pipelined mode it waits for the previous frame as well.
+
+*/
+class PyramidPhase: public Phase
+{
+public:
+    // Vertex and fragment shader files
+    const char * mVertFilename; /*!< Path to the vertex shader file */
+    const char * mFragFilename; /*!< Path to the fragment shader file */
+
+    // Handle to a program object
+    GLuint mProgramObject; /*!< Handle to the program object */
+
+    int mWidth; /*!< Width of the scene*/
+    int mHeight; /*!< Height of the scene */
+
+    // Attribute locations
+    GLint  mPositionLoc; /*!< Handle for the attribute a_position*/
+    GLint  mTexCoordLoc; /*!< Handle for the attribute a_texCoord, -1 if the shader does not use it */
+
+    // Vertices
+    GLfloat mVertices[20]; /*!< Vertex and texture coordinates for the plain quad*/
+    GLushort mIndices[6]; /*!< Indices for the quad scene*/
+
+    // Uniform locations
+    GLint  u_texDimLoc; /*!< Handle to the uniform u_texDimensions */
+    GLint  u_thresholdLoc; /*!< Handle to the uniform u_threshold */
+    GLint  u_passLoc; /*!< Handle to the uniform u_pass*/
+    GLint  u_factorLoc; /*!< Handle to the uniform u_factor*/
+    GLint  u_origTopDownLoc; /*!< Handle to the uniform u_origTopDown*/
+    GLint  u_origMaxValueLoc; /*!< Handle to the uniform u_origMaxValue*/
+    GLint  mSamplerLoc; /*!< Handle to the sampler s_texture */
+
+    float u_threshold; /*!< Threshold value (normalized to [0,1]), set by the parent */
+    GLint mOrigTexUnit; /*!< Texture unit of the original image, set by the parent */
+    bool mOrigTopDown; /*!< The original image starts with the top row, set by the parent */
+    unsigned mOrigMaxValue; /*!< Largest grey value of the original image, set by the parent */
+
+    std::vector<uint8_t> mTiles; /*!< Occupancy of the tiles after \ref run, see \ref RegionSet::buildFromTiles */
+
+    /*!
+     \brief Constructor
+
+     \param width  Width of the scene
+     \param height Height of the scene
+    */
+    PyramidPhase(int width = 0, int height = 0);
+
+    /*!
+     \brief Destructor
+    */
+    virtual ~PyramidPhase();
+
+    /*!
+     \brief Initializes the program and takes a texture unit for the levels
+
+     \param fbos[] The 2 framebuffers of the phases, the first one is used
+     \param bfUsedTextures The bitfield to determine which texture units are already used
+     \return GLint Returns GL_TRUE on success
+    */
+    GLint init(GLuint fbos[], GLuint &bfUsedTextures);
+
+    /*!
+     \brief Sets the edge length of the tiles and creates the textures of the levels
+
+     Does nothing if the tile size did not change.
+
+     \param tileSize Edge length of the tiles, a power of 2
+    */
+    void setTileSize(unsigned tileSize);
+
+    /*!
+     \brief Renders all levels and reads the occupancy of the tiles back into \ref mTiles
+
+     \return double The time (in ms) the computation took
+    */
+    virtual double run();
+
+    virtual void releaseGlResources();
+
+private:
+    /*!
+     \brief One level of the pyramid
+    */
+    struct Level
+    {
+        int width; /*!< Width in pixels */
+        int height; /*!< Height in pixels */
+        int factor; /*!< Edge length of the block of the level below per pixel */
+        GLuint texture; /*!< Handle to the texture of the level */
+    };
+
+    /*!
+     \brief Deletes the textures of all levels
+    */
+    void releaseLevels();
+
+    GLuint mFboId; /*!< Handle to the FBO used to render the levels */
+    GLint  mTextureUnit; /*!< Texture unit of the levels */
+    unsigned mTileSize; /*!< Tile size of the current levels */
+    std::vector<Level> mLevels; /*!< The levels, the last one has one pixel per tile */
+    std::vector<GLubyte> mPixels; /*!< RGBA pixels of the last level */
+};
+
+/*!
+    @}
+*/
+
+#endif // PYRAMIDPHASE_H
@@ -5,6 +5,8 @@
 using namespace cimg_library;
 #include "phase.h"
 
+#include <vector>
+
 /*!
     \ingroup reduction
     @{
@@ -17,7 +19,15 @@ using namespace cimg_library;
  creates an intermediate texture which only contains the root pixel of each
  label. Then a reduction operation is performed first horizontally then
  vertically. In other words a (2-dimensional) list of all root pixels is
- created in the top-left corner of the resulting texture.
+ created in the top-left corner of the resulting texture. Finally the list
+ is copied into a table texture which is sized from the number of rows and
+ columns of the list, so the next phase does not have to work on a texture
+ of the size of the frame.
+
+ Both reductions need logBase2 of the length of the rows (columns) running
+ sum passes and as many binary search passes. In the adaptive mode
+ (\ref mAdaptivePasses) the numbers of passes are taken from the extent of
+ the roots instead, see \ref run.
  A more elaborate explanation of the GLSL-algorithm can be found in \ref reduction..
 
  NOTE: The handles for shader-, texture-, fbo-objects etc. are public at the moment
@@ -32,9 +42,11 @@ public:
     // Vertex and fragment shader files
     const char * mVertFilename; /*!< Path to the vertex shader file */
     const char * mFragFilename; /*!< Path to the fragment shader file */
+    const char * mTableFragFilename; /*!< Path to the fragment shader file which counts the rows and columns of the list */
 
     // Handle to a program object
     GLuint mProgramObject; /*!< Handle to the program object */
+    GLuint mTableProgramObject; /*!< Handle to the program object of the table size stage */
 
     int mWidth; /*!< Width of the scene*/
     int mHeight; /*!< Height of the scene*/
@@ -42,6 +54,8 @@ public:
     // Attribute locations
     GLint  mPositionLoc; /*!< Handle for the attribute a_position*/
     GLint  mTexCoordLoc; /*!< Handle for the attribute a_texCoord */
+    GLint  mTablePositionLoc; /*!< Handle for the attribute a_position of the table size stage */
+    GLint  mTableTexCoordLoc; /*!< Handle for the attribute a_texCoord of the table size stage */
 
     // Vertices
     GLfloat  mVertices[20]; /*!< Vertex and texture coordinates for the plain quad*/
@@ -52,6 +66,8 @@ public:
     GLint  u_passLoc; /*!< Handle to the uniform u_pass*/
     GLint  u_stageLoc; /*!< Handle to the uniform u_stage */
     GLint  u_directionLoc; /*!< Handle to the uniform u_direction*/
+    GLint  u_tableTexDimLoc; /*!< Handle to the uniform u_texDimensions of the table size stage */
+    GLint  u_tableStageLoc; /*!< Handle to the uniform u_stage of the table size stage */
 
     // Uniform values
     GLint u_pass; /*!< Number of the current iteration */
@@ -60,6 +76,7 @@ public:
     // Sampler locations
     GLint s_reductionLoc; /*!< Handle to the sampler holding intermediate results*/
     GLint s_valuesLoc; /*!< Handle to sampler holding the label information */
+    GLint s_tableLoc; /*!< Handle to the sampler of the table size stage holding the reduced list */
 
     /// TODO: tga somewhere else?
     CImg<unsigned char> mImage; /*!< Handle for the loaded image */
@@ -69,9 +86,20 @@ public:
     GLuint mTexPiPoId[2]; /*!< Handle to the two textures which are used for ping-pong-method*/
     GLuint mTexLabelId; /*!< Handle to the texture which holds the labeling results*/
     GLuint mTexRootId; /*!< Handle to the texture which holds only the root pixels of the labels*/
+    GLuint mTexTableId; /*!< Handle to the texture which holds the list of root pixels (see \ref getTableTexture) */
 
     GLuint mFboId[2]; /*!< Handles to the two FBOs for ping-pong method*/
-    GLint  mTextureUnits[4]; /*!< Handles to the texture units for the above textures*/
+    GLint  mTextureUnits[5]; /*!< Handles to the texture units for the above textures*/
+
+    GLuint mOwnTexPiPoId[2]; /*!< Ping-pong textures allocated by this phase (run swaps them with textures of other phases) */
+    GLint  mOwnTextureUnits[2]; /*!< Texture units of \ref mOwnTexPiPoId */
+
+    const RegionSet *mRegions; /*!< Occupied regions of the frame, NULL or inactive to draw the full frame */
+
+    unsigned mTableWidth; /*!< Width of the table texture, 0 for the number of columns of the list. Columns of the list beyond are not copied, columns beyond the frame are cleared */
+    bool mCountTable; /*!< Read back the size of the list (default), otherwise the table keeps all rows of the frame and the GPU is not waited for */
+    bool mAdaptivePasses; /*!< Run only as many passes as the extent of the roots needs (default false), see \ref run */
+    int  mNumPasses; /*!< Number of running sum and binary search passes of the last \ref run (both directions) */
 
     int mWrite; /*!< Holds the index of the FBO/texture which is written to */
     int mRead; /*!< Holds the index of the texture which is read from */
@@ -132,6 +160,8 @@ public:
      It is assumed that a previous phase (i.e. the \ref labeling) has already
      allocated VRAM for textures and texture units which can be reused in this
      phase as well. Only additional textures have to be allocated.
+     The ping-pong textures are reset to the ones allocated in \ref init, so
+     the phase can be run again for the next frame.
 
      \param labelTex  TextureId holding the handle to the texture with the labeling results
      \param labelTexUnit Holds the Id of the texture unit corresponding to labelTex
@@ -143,9 +173,22 @@ public:
     /*!
      \brief Runs the reduction algorithm
 
-     TODO: Write short explanation here?
      TODO: refer to the general explanation and GLSL docu
 
+     In the adaptive mode (\ref mAdaptivePasses) the passes only cover the
+     extent of the roots:
+     - Horizontal: the roots lie in the boxes of \ref mRegions, the running
+       sums only have to reach the right edge of the rightmost box. Without
+       active regions the full number of passes is run.
+     - Vertical: a coarse pass counts the roots of each row after the
+       horizontal reduction and the counts are read back (\ref mCountTable
+       has to be set, otherwise the full number of passes is run). The passes
+       only have to reach the top row with roots and only the columns up to
+       the maximum number of roots in a row are drawn. The counts also give
+       the size of the table, so the table size stage is not drawn.
+
+     The number of passes is stored in \ref mNumPasses.
+
      \return double The time (in ms) the computation took
     */
     virtual double run();
@@ -170,6 +213,51 @@ public:
     */
     GLint getLastTexUnit();
 
+    /*!
+     \brief Return the handle to the table texture
+
+     The table holds the list of all root pixels in its bottom-left corner,
+     the cells of the rows of the list beyond its end are zero. Its size is
+     \ref getTableWidth x \ref getTableHeight, of which only the first
+     \ref getTableRows rows are written by the last run.
+
+     \return GLuint
+    */
+    GLint getTableTexture();
+
+    /*!
+     \brief Return the index of the texture unit the table texture is assinged to
+
+     \return GLint
+    */
+    GLint getTableTexUnit();
+
+    /*!
+     \brief Width of the table texture
+
+     \return int
+    */
+    int getTableWidth() const { return mTableTexWidth; }
+
+    /*!
+     \brief Height of the table texture
+
+     The texture only grows (to the next power of 2 of the rows of the list),
+     so it is not reallocated for every frame.
+
+     \return int
+    */
+    int getTableHeight() const { return mTableTexHeight; }
+
+    /*!
+     \brief Number of rows of the list found by the last run
+
+     Is the height of the frame if \ref mCountTable is not set.
+
+     \return int
+    */
+    int getTableRows() const { return mTableRows; }
+
     /*!
      \brief Return the handle to the texture which holds no important data and can be reused
 
@@ -210,9 +298,40 @@ private:
     /*!
      \brief Funtion doing the reduction stage
 
-     \param length Length of the row or column to be reduced
+     \param numPasses Number of running sum passes (and binary search passes),
+                      the running sums reach 2^numPasses pixels
+     \param regions Rows to draw, NULL to draw the full frame
+    */
+    void reduce(int numPasses, const RegionSet *regions);
+
+    /*!
+     \brief Number of passes to reduce the rows horizontally
+
+     \return int logBase2 of the width or of the right edge of the regions
+    */
+    int horizontalPasses() const;
+
+    /*!
+     \brief Counts the roots of each row after the horizontal reduction (adaptive mode)
+
+     Sets \ref mListRows, \ref mListColumns and \ref mTopRow.
     */
-    void reduce(int length);
+    void countRows();
+
+    /*!
+     \brief Sizes the table texture from the rows and columns of the list and copies the list into it
+    */
+    void copyTable();
+
+    int mTableTexWidth;  /*!< Width of the allocated table texture */
+    int mTableTexHeight; /*!< Height of the allocated table texture */
+    int mTableRows;      /*!< Number of rows of the list of the last run */
+    GLubyte mTableSize[8]; /*!< Read back rows and columns of the list (packed shorts) */
+
+    std::vector<GLubyte> mRowCounts; /*!< Read back number of roots of each row (packed shorts) */
+    int mListRows;    /*!< Number of rows with roots, counted by \ref countRows (-1 if not counted) */
+    int mListColumns; /*!< Maximum number of roots in a row, counted by \ref countRows */
+    int mTopRow;      /*!< Index of the top row with roots, counted by \ref countRows */
 
     void debugImage(const char * text, const char * filename);
 };
@@ -0,0 +1,179 @@
+#ifndef REGIONSET_H
+#define REGIONSET_H
+
+#include <GLES2/gl2.h>
+
+#include <stdint.h>
+#include <vector>
+
+/*!
+ \brief Occupied regions of a frame, used to restrict the draws of the phases
+
+ Star field frames are mostly black. The foreground mask of the
+ \ref ThresholdKernel is divided into tiles and the occupied tiles are
+ grouped into 8-connected clusters. Each cluster gives one box: its bounding
+ box (in tiles) grown by \ref mMarginTiles. A spot lies completely inside one
+ cluster, so the box also holds the rectangle which the stats phase fills
+ around the spot.
+
+ The phases draw one quad per box instead of the full frame quad and clear
+ their targets once, i.e. the pixels outside the boxes stay 0 (background).
+ Passes which move data across the frame (e.g. the horizontal reduction)
+ use \ref SHAPE_ROWS instead: full width rows covering all boxes.
+
+ If the boxes cover more than \ref mMaxCoverage of the frame, the set is
+ inactive and the phases draw the full frame quad as before.
+
+ In the tracking mode (\ref Ogles::trackFrame) the occupied tiles are not
+ taken from a mask but from windows around the predicted spots.
+
+*/
+class RegionSet
+{
+public:
+    /*!
+     \brief Rectangle in pixels (OpenGL orientation)
+    */
+    struct Rect
+    {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    /*!
+     \brief Circular window around the predicted position of a spot (OpenGL orientation)
+    */
+    struct Window
+    {
+        float x; /*!< Centre, in the coordinates of \ref StatsPhase::Spot */
+        float y;
+        float radius; /*!< Radius in pixels, the spot has to lie completely inside */
+    };
+
+    /*!
+     \brief Geometry to draw
+    */
+    enum Shape
+    {
+        SHAPE_BOXES = 0, /*!< One quad per cluster of occupied tiles */
+        SHAPE_ROWS  = 1  /*!< Full width quads over all rows covered by a box */
+    };
+
+    unsigned mTileSize; /*!< Edge length of a tile in pixels (8, 16, 32 or 64, default 16) */
+    unsigned mMarginTiles; /*!< Number of tiles each box is grown by (default 1) */
+    float mMaxCoverage; /*!< Maximum fraction of the frame covered by boxes to stay active (default 0.5) */
+
+    /*!
+     \brief Constructor
+
+     Creates an inactive set, i.e. the full frame is drawn.
+    */
+    RegionSet();
+
+    /*!
+     \brief Computes the boxes of a foreground mask
+
+     \param mask   Foreground mask as computed by \ref ThresholdKernel::computeMask
+     \param width  Width of the frame
+     \param height Height of the frame
+    */
+    void build(const uint64_t *mask, int width, int height);
+
+    /*!
+     \brief Computes the boxes of windows around predicted spots
+
+     Used by the tracking mode instead of a foreground mask: all tiles touched
+     by a window are occupied, overlapping or neighbouring windows are merged
+     into one box like the clusters of \ref build.
+
+     \param windows The windows, parts outside of the frame are ignored
+     \param width   Width of the frame
+     \param height  Height of the frame
+    */
+    void build(const std::vector<Window> &windows, int width, int height);
+
+    /*!
+     \brief Computes the boxes of a coarse occupancy map with one entry per tile
+
+     Used with the max-pool pyramid of \ref PyramidPhase or
+     \ref ThresholdKernel::computeTileMax, which give the occupied tiles
+     directly instead of a mask with one bit per pixel.
+
+     \param tiles  One byte per tile (\ref mTileSize), row by row starting
+                   with the bottom row, not 0 if the tile is occupied
+     \param width  Width of the frame
+     \param height Height of the frame
+    */
+    void buildFromTiles(const uint8_t *tiles, int width, int height);
+
+    /*!
+     \brief Removes all boxes and deactivates the set (full frame is drawn)
+    */
+    void reset();
+
+    /*!
+     \brief Returns if the draws are restricted to the boxes
+
+     \return bool
+    */
+    bool isActive() const;
+
+    /*!
+     \brief Returns the boxes of the last \ref build
+
+     \return const std::vector<Rect>&
+    */
+    const std::vector<Rect>& boxes() const;
+
+    /*!
+     \brief Returns the full width rows of the last \ref build
+
+     \return const std::vector<Rect>&
+    */
+    const std::vector<Rect>& rows() const;
+
+    /*!
+     \brief Fraction of the frame covered by the boxes of the last \ref build
+
+     Also set if the set got inactive because of \ref mMaxCoverage.
+
+     \return float
+    */
+    float coverage() const;
+
+    /*!
+     \brief Draws one quad per box or row with the currently bound program
+
+     The attribute pointers are set to the vertices of the set, i.e. they have
+     to be set again before drawing other geometry.
+
+     \param shape       Boxes or rows
+     \param positionLoc Location of the attribute a_position
+     \param texCoordLoc Location of the attribute a_texCoord, -1 if the shader does not use it
+    */
+    void draw(Shape shape, GLint positionLoc, GLint texCoordLoc) const;
+
+private:
+    /*!
+     \brief Computes the boxes, rows and the geometry from the occupancy of the tiles in \ref mTiles
+    */
+    void buildBoxes(int tilesX, int tilesY);
+
+    void appendQuad(std::vector<GLfloat> &vertices, const Rect &rect) const;
+
+    int mWidth; /*!< Width of the frame of the last build */
+    int mHeight; /*!< Height of the frame of the last build */
+    bool mIsActive; /*!< True if the draws are restricted */
+    float mCoverage; /*!< Fraction of the frame covered by the boxes */
+
+    std::vector<uint8_t> mTiles; /*!< Occupancy of the tiles, later the cluster visited flag */
+    std::vector<int> mStack; /*!< Stack for the flood fill of the clusters */
+    std::vector<Rect> mBoxes; /*!< Boxes around the clusters */
+    std::vector<Rect> mRows; /*!< Rows covered by the boxes */
+    std::vector<GLfloat> mVertices[2]; /*!< Vertex and texture coordinates per shape */
+    std::vector<GLushort> mIndices; /*!< Indices of the quads (the same for all shapes) */
+};
+
+#endif // REGIONSET_H
@@ -0,0 +1,58 @@
+#ifndef SHADERSOURCES_H
+#define SHADERSOURCES_H
+
+#include <stddef.h>
+#include <string>
+
+/*!
+ \brief Access to the GLSL sources which are compiled into the binary
+
+ All files of glsl/ are embedded as string table by the CMake step in
+ cmake/EmbedShaders.cmake. The shaders are looked up by their file name
+ only, i.e. "../glsl/labelPhase.frag" and "labelPhase.frag" both give the
+ embedded labelPhase.frag, independent of the working directory.
+
+ During development the environment variable GPULABELING_GLSL_DIR can be set
+ to a directory (e.g. the glsl/ folder of the source tree). The files in this
+ directory are then used instead of the embedded sources, so the shaders can
+ be changed without rebuilding.
+
+*/
+class ShaderSources
+{
+public:
+    /*!
+     \brief Entry of the table of embedded sources
+    */
+    struct Entry
+    {
+        const char *name; /*!< File name without directory */
+        const char *source; /*!< Content of the file */
+    };
+
+    /*!
+     \brief Returns the embedded source of a shader file
+
+     \param filename Name of the shader file, the directory is ignored
+     \return const char * The source or NULL if the file is not embedded
+    */
+    static const char *embedded(const std::string &filename);
+
+    /*!
+     \brief Loads the source of a shader file
+
+     The source is taken from the directory in GPULABELING_GLSL_DIR (if set),
+     else from the embedded sources. Files which are not embedded are read
+     from the given path.
+
+     \param filename Name or path of the shader file
+     \param source   Receives the source
+     \return bool True on success
+    */
+    static bool load(const std::string &filename, std::string &source);
+
+private:
+    static const Entry mEmbedded[]; /*!< Table of all embedded files, terminated by a NULL entry */
+};
+
+#endif // SHADERSOURCES_H
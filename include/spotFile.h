@@ -0,0 +1,309 @@
+#ifndef SPOTFILE_H
+#define SPOTFILE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*!
+ \brief Binary spot list of a capture
+
+ The file is append-only and little endian:
+
+     SpotFileHeader                        16 bytes
+     per frame:
+         SpotFrameHeader                   24 bytes
+         SpotRecord * numSpots             16 bytes each
+     index (written when the file is closed):
+         uint64_t offset * numFrames       offset of each SpotFrameHeader
+         SpotFileTrailer                   24 bytes
+
+ The index at the end allows to seek to any frame in O(1). If a capture is
+ interrupted before the file is closed, the index is missing and the
+ frames are found by walking the frame headers instead, which start with
+ a magic of their own so that the bytes of a partly written index are not
+ taken for frames. \ref SpotFileWriter
+ removes the index when it appends to an existing file and writes it again
+ when it is closed.
+
+ This header only depends on POSIX, so the downstream tools can read the
+ files with \ref SpotFileReader without linking gpulabeling.
+
+*/
+
+#define SPOTFILE_MAGIC   "GPUSPOT"  /*!< Magic of \ref SpotFileHeader, including the terminating 0 */
+#define SPOTFILE_FRAME   "SPOTFRM"  /*!< Magic of \ref SpotFrameHeader, including the terminating 0 */
+#define SPOTFILE_INDEX   "SPOTIDX"  /*!< Magic of \ref SpotFileTrailer, including the terminating 0 */
+#define SPOTFILE_VERSION 2
+
+/*!
+ \brief First bytes of a spot file
+*/
+struct SpotFileHeader
+{
+    char magic[8]; /*!< \ref SPOTFILE_MAGIC */
+    uint32_t version; /*!< \ref SPOTFILE_VERSION */
+    uint32_t recordSize; /*!< sizeof(SpotRecord), allows to add fields at the end of a record */
+};
+
+/*!
+ \brief Header of the spots of one frame
+*/
+struct SpotFrameHeader
+{
+    char magic[8]; /*!< \ref SPOTFILE_FRAME */
+    uint64_t timestamp; /*!< Capture time in nanoseconds, e.g. since the epoch */
+    uint32_t frameNumber; /*!< Number of the frame in the capture */
+    uint32_t numSpots; /*!< Number of \ref SpotRecord following the header */
+};
+
+/*!
+ \brief One spot, see \ref StatsPhase::Spot
+*/
+struct SpotRecord
+{
+    float x; /*!< Centroid in x-direction (pixels) */
+    float y; /*!< Centroid in y-direction (pixels) */
+    uint32_t area; /*!< Number of pixels */
+    uint32_t luminance; /*!< Sum of the pixel values */
+};
+
+/*!
+ \brief Last bytes of a closed spot file
+*/
+struct SpotFileTrailer
+{
+    uint64_t indexOffset; /*!< Offset of the first frame offset of the index */
+    uint64_t numFrames; /*!< Number of frames in the file and the index */
+    char magic[8]; /*!< \ref SPOTFILE_INDEX */
+};
+
+/*!
+ \brief Read-only view of a spot file
+
+ The file is mapped into memory, the frames are returned as pointers into
+ the mapping, i.e. nothing is copied or parsed besides the headers. The
+ frames are valid until the reader is closed or destroyed.
+
+*/
+class SpotFileReader
+{
+public:
+    /*!
+     \brief Spots of one frame, pointing into the mapped file
+    */
+    struct Frame
+    {
+        uint64_t timestamp; /*!< See \ref SpotFrameHeader::timestamp */
+        uint32_t frameNumber; /*!< See \ref SpotFrameHeader::frameNumber */
+        const SpotRecord *spots; /*!< First spot */
+        size_t numSpots; /*!< Number of spots */
+
+        const SpotRecord *begin() const { return spots; }
+        const SpotRecord *end() const { return spots + numSpots; }
+        size_t size() const { return numSpots; }
+        const SpotRecord &operator[](size_t i) const { return spots[i]; }
+    };
+
+    SpotFileReader()
+        : mData(NULL), mSize(0), mIndex(NULL), mNumFrames(0), mDataEnd(0)
+    {
+    }
+
+    /*!
+     \brief Constructor which opens the file, see \ref isOpen
+
+     \param filename Path to the spot file
+    */
+    explicit SpotFileReader(const std::string &filename)
+        : mData(NULL), mSize(0), mIndex(NULL), mNumFrames(0), mDataEnd(0)
+    {
+        open(filename);
+    }
+
+    virtual ~SpotFileReader()
+    {
+        close();
+    }
+
+    SpotFileReader(const SpotFileReader &) = delete;
+    SpotFileReader &operator=(const SpotFileReader &) = delete;
+
+    /*!
+     \brief Maps the file and locates its frames
+
+     \param filename Path to the spot file
+     \return bool false if the file can not be mapped or is no spot file
+    */
+    bool open(const std::string &filename)
+    {
+        close();
+
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SpotFileHeader))
+        {
+            ::close(fd);
+            return false;
+        }
+        void *data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+            return false;
+        mData = (const uint8_t *)data;
+        mSize = info.st_size;
+
+        const SpotFileHeader *header = (const SpotFileHeader *)mData;
+        if (memcmp(header->magic, SPOTFILE_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != SPOTFILE_VERSION || header->recordSize != sizeof(SpotRecord))
+        {
+            close();
+            return false;
+        }
+
+        if (!readIndex())
+            scanFrames();
+        return true;
+    }
+
+    /*!
+     \brief Unmaps the file
+    */
+    void close()
+    {
+        if (mData != NULL)
+            munmap((void *)mData, mSize);
+        mData = NULL;
+        mSize = 0;
+        mIndex = NULL;
+        mScannedIndex.clear();
+        mNumFrames = 0;
+        mDataEnd = 0;
+    }
+
+    bool isOpen() const
+    {
+        return mData != NULL;
+    }
+
+    /*!
+     \brief Returns the number of complete frames
+
+     \return size_t
+    */
+    size_t numFrames() const
+    {
+        return mNumFrames;
+    }
+
+    /*!
+     \brief Returns a frame in O(1)
+
+     \param i Index of the frame in the file, has to be below \ref numFrames
+     \return Frame
+    */
+    Frame frame(size_t i) const
+    {
+        const SpotFrameHeader *header = (const SpotFrameHeader *)(mData + frameOffset(i));
+        Frame frame;
+        frame.timestamp   = header->timestamp;
+        frame.frameNumber = header->frameNumber;
+        frame.spots       = (const SpotRecord *)(header + 1);
+        frame.numSpots    = header->numSpots;
+        return frame;
+    }
+
+    /*!
+     \brief Returns the offset of the header of a frame in the file
+
+     \param i Index of the frame, has to be below \ref numFrames
+     \return uint64_t
+    */
+    uint64_t frameOffset(size_t i) const
+    {
+        return mIndex ? mIndex[i] : mScannedIndex[i];
+    }
+
+    /*!
+     \brief Returns the offset behind the last complete frame
+
+     \return uint64_t
+    */
+    uint64_t dataEnd() const
+    {
+        return mDataEnd;
+    }
+
+    /*!
+     \brief Returns whether the index of the file was used
+
+     \return bool false if the file was not closed and the frames were scanned
+    */
+    bool hasIndex() const
+    {
+        return mIndex != NULL;
+    }
+
+private:
+    /*!
+     \brief Uses the index at the end of the file if it is complete
+    */
+    bool readIndex()
+    {
+        if (mSize < sizeof(SpotFileHeader) + sizeof(SpotFileTrailer))
+            return false;
+        const SpotFileTrailer *trailer = (const SpotFileTrailer *)(mData + mSize - sizeof(SpotFileTrailer));
+        if (memcmp(trailer->magic, SPOTFILE_INDEX, sizeof(trailer->magic)) != 0 ||
+            trailer->indexOffset < sizeof(SpotFileHeader) ||
+            trailer->indexOffset + trailer->numFrames*sizeof(uint64_t) + sizeof(SpotFileTrailer) != mSize ||
+            trailer->indexOffset % sizeof(uint64_t) != 0)
+            return false;
+
+        mIndex = (const uint64_t *)(mData + trailer->indexOffset);
+        mNumFrames = trailer->numFrames;
+        mDataEnd = trailer->indexOffset;
+        return true;
+    }
+
+    /*!
+     \brief Builds the index by walking the frame headers, stops at an incomplete frame
+
+     Also stops at bytes without the magic of a frame, e.g. the index of a
+     file whose close failed.
+    */
+    void scanFrames()
+    {
+        uint64_t offset = sizeof(SpotFileHeader);
+        while (offset + sizeof(SpotFrameHeader) <= mSize)
+        {
+            const SpotFrameHeader *header = (const SpotFrameHeader *)(mData + offset);
+            if (memcmp(header->magic, SPOTFILE_FRAME, sizeof(header->magic)) != 0)
+                break;
+            uint64_t end = offset + sizeof(SpotFrameHeader) + (uint64_t)header->numSpots*sizeof(SpotRecord);
+            if (end > mSize)
+                break;
+            mScannedIndex.push_back(offset);
+            offset = end;
+        }
+        mNumFrames = mScannedIndex.size();
+        mDataEnd = offset;
+    }
+
+    const uint8_t *mData; /*!< Mapped file */
+    size_t mSize; /*!< Size of the mapped file */
+    const uint64_t *mIndex; /*!< Index in the mapped file, NULL if the frames were scanned */
+    std::vector<uint64_t> mScannedIndex; /*!< Offsets of the frames if the file has no index */
+    size_t mNumFrames; /*!< Number of complete frames */
+    uint64_t mDataEnd; /*!< Offset behind the last complete frame */
+};
+
+#endif // SPOTFILE_H
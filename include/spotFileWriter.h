@@ -0,0 +1,84 @@
+#ifndef SPOTFILEWRITER_H
+#define SPOTFILEWRITER_H
+
+#include "spotFile.h"
+#include "statsPhase.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/*!
+ \brief Appends the spots of each frame to a binary spot file
+
+ See \ref spotFile.h for the format. The frames are written with buffered
+ I/O as they come, the index is kept in memory and written by \ref close.
+
+*/
+class SpotFileWriter
+{
+public:
+    SpotFileWriter();
+
+    /*!
+     \brief Constructor which opens the file, see \ref open
+    */
+    SpotFileWriter(const std::string &filename, bool append = false);
+
+    /*!
+     \brief Destructor, closes the file and ignores errors of \ref close
+    */
+    virtual ~SpotFileWriter();
+
+    /*!
+     \brief Opens a spot file
+
+     When appending to an existing file, its index is removed and written
+     again by \ref close. A file which was not closed is cut behind its last
+     complete frame.
+
+     Throws std::runtime_error if the file can not be opened or is no spot file.
+
+     \param filename Path to the spot file
+     \param append   Append to the frames of an existing file instead of replacing it
+    */
+    void open(const std::string &filename, bool append = false);
+
+    /*!
+     \brief Appends the spots of a frame
+
+     \param timestamp   Capture time in nanoseconds
+     \param frameNumber Number of the frame in the capture
+     \param spots       Spots of the frame
+    */
+    void writeFrame(uint64_t timestamp, uint32_t frameNumber, const std::vector<StatsPhase::Spot> &spots);
+
+    /*!
+     \brief Writes the index and closes the file
+
+     Throws std::runtime_error if the index can not be written completely.
+     The file is closed anyway, the frames are still found by the scan of
+     \ref SpotFileReader.
+    */
+    void close();
+
+    bool isOpen() const;
+
+    /*!
+     \brief Returns the number of frames in the file
+
+     \return size_t
+    */
+    size_t numFrames() const;
+
+private:
+    SpotFileWriter(const SpotFileWriter &) = delete;
+    SpotFileWriter &operator=(const SpotFileWriter &) = delete;
+
+    FILE *mFile; /*!< The spot file */
+    uint64_t mOffset; /*!< Offset of the next frame */
+    std::vector<uint64_t> mIndex; /*!< Offsets of all frames */
+    std::vector<SpotRecord> mRecords; /*!< Records of the current frame */
+};
+
+#endif // SPOTFILEWRITER_H
@@ -32,6 +32,16 @@ public:
         float x;
         float y;
         unsigned area;
+        unsigned luminance; /*!< Sum of the pixel values of the spot */
+    };
+
+    /*!
+     \brief Implementation of the passes of \ref runPasses
+    */
+    enum Engine
+    {
+        ENGINE_QUADRANTS, /*!< Fill, count and centroiding stages for each of the 4 directions (default) */
+        ENGINE_SCATTER    /*!< Scatter of all pixels into a float table with additive blending, see \ref runScatter */
     };
 
     std::vector<Spot> mSpots;
@@ -77,7 +87,10 @@ public:
         GLint u_passLoc; /*!< Handle to the uniform u_pass*/
         GLint u_stageLoc; /*!< Handle to the uniform u_stage*/
         GLint u_savingOffsetLoc; /*!< Handle to the uniform u_savingOffset. Holds the column from where to write the results*/
+        GLint u_tableDimLoc; /*!< Handle to the uniform u_tableDimensions */
         GLint u_factorLoc; /*!< Handle to the uniform u_factor */
+        GLint u_origTopDownLoc; /*!< Handle to the uniform u_origTopDown */
+        GLint u_origMaxValueLoc; /*!< Handle to the uniform u_origMaxValue */
 
         // Attribute locations
         GLint  positionLoc; /*!< Handle for the attribute a_position*/
@@ -102,12 +115,81 @@ public:
         GLint u_passLoc; /*!< Handle to the uniform u_pass*/
         GLint u_stageLoc; /*!< Handle to the uniform u_stage*/
         GLint u_savingOffsetLoc; /*!< Handle to the uniform u_savingOffset. Holds the column from where to write the results*/
+        GLint u_tableDimLoc; /*!< Handle to the uniform u_tableDimensions */
         GLint u_factorLoc; /*!< Handle to the uniform u_factor */
+        GLint u_origTopDownLoc; /*!< Handle to the uniform u_origTopDown */
+        GLint u_origMaxValueLoc; /*!< Handle to the uniform u_origMaxValue */
+        GLint u_wideSumsLoc; /*!< Handle to the uniform u_wideSums */
         // Attribute locations
         GLint  positionLoc; /*!< Handle for the attribute a_position*/
         GLint  texCoordLoc; /*!< Handle for the attribute a_texCoord */
     } mProgCentroid;
 
+    /*!
+     \brief Struct which holds all handles for the compaction stage
+    */
+    struct
+    {
+        std::string filename; /*!< Filename of the fragment shader */
+        GLuint program; /*!< Handle to the program object */
+        // Sampler locations
+        GLint s_tableLoc; /*!< Handle holding the texture with the final result table */
+        // Uniform locations
+        GLint u_texDimLoc; /*!< Handle to the uniform u_texDimensions */
+        GLint u_stageLoc; /*!< Handle to the uniform u_stage*/
+        GLint u_tableDimLoc; /*!< Handle to the uniform u_tableDimensions */
+        GLint u_tableRowsLoc; /*!< Handle to the uniform u_tableRows */
+        GLint u_columnRowsLoc; /*!< Handle to the uniform array u_columnRows */
+        GLint u_numSpotsLoc; /*!< Handle to the uniform u_numSpots */
+        GLint u_spotsPerRowLoc; /*!< Handle to the uniform u_spotsPerRow */
+        GLint u_spotFieldsLoc; /*!< Handle to the uniform u_spotFields */
+        // Attribute locations
+        GLint  positionLoc; /*!< Handle for the attribute a_position*/
+        GLint  texCoordLoc; /*!< Handle for the attribute a_texCoord, -1 if the shader does not use it */
+    } mProgCompact;
+
+    /*!
+     \brief Struct which holds all handles for the scatter stages of \ref ENGINE_SCATTER
+    */
+    struct
+    {
+        std::string vertFilename; /*!< Filename of the vertex shader */
+        std::string filename; /*!< Filename of the fragment shader */
+        GLuint program; /*!< Handle to the program object */
+        // Sampler locations
+        GLint s_tableLoc; /*!< Handle holding the texture with the results from \ref reduction */
+        GLint s_labelLoc; /*!< Handle holding the texture with the results from \ref labeling */
+        GLint s_cellsLoc; /*!< Handle holding the texture with the table cell of each root pixel */
+        GLint s_origLoc; /*!< Handle holding the texture with the original image */
+        // Uniform locations
+        GLint u_texDimLoc; /*!< Handle to the uniform u_texDimensions */
+        GLint u_stageLoc; /*!< Handle to the uniform u_stage*/
+        GLint u_targetDimLoc; /*!< Handle to the uniform u_targetDimensions */
+        GLint u_tableDimLoc; /*!< Handle to the uniform u_tableDimensions */
+        GLint u_origTopDownLoc; /*!< Handle to the uniform u_origTopDown */
+        GLint u_origMaxValueLoc; /*!< Handle to the uniform u_origMaxValue */
+        // Attribute locations
+        GLint  positionLoc; /*!< Handle for the attribute a_position*/
+    } mProgScatter;
+
+    /*!
+     \brief Struct which holds all handles for the packing stage of \ref ENGINE_SCATTER
+    */
+    struct
+    {
+        std::string filename; /*!< Filename of the fragment shader */
+        GLuint program; /*!< Handle to the program object */
+        // Sampler locations
+        GLint s_sumsLoc; /*!< Handle holding the float texture with the sums of the scatter stage */
+        // Uniform locations
+        GLint u_texDimLoc; /*!< Handle to the uniform u_texDimensions */
+        GLint u_sumsDimLoc; /*!< Handle to the uniform u_sumsDimensions */
+        GLint u_wideSumsLoc; /*!< Handle to the uniform u_wideSums */
+        // Attribute locations
+        GLint  positionLoc; /*!< Handle for the attribute a_position*/
+        GLint  texCoordLoc; /*!< Handle for the attribute a_texCoord, -1 if the shader does not use it */
+    } mProgPack;
+
     int mWidth; /*!< Width of the scene*/
     int mHeight; /*!< Height of the scene*/
 
@@ -122,20 +204,34 @@ public:
 
     // Texture to attach to the frambuffers
     GLuint mTexOrigId; /*!< Handle to the texture with the original image */
+    bool   mOrigTopDown; /*!< True if \ref mTexOrigId starts with the top row (camera frames) */
     GLuint mTexLabelId; /*!< Handle to the texture with the labeling results*/
-    GLuint mTexReducedId; /*!< Handle to the texture with the reduction results*/
+    GLuint mTexReducedId; /*!< Handle to the table texture with the reduction results, the results of this phase are added to it */
     GLuint mTexFillId; /*!< Handle to the texture with results from filling stage*/
     GLuint mTexPiPoId[2]; /*!< Handle to the two textures which are used for ping-pong-method*/
     GLuint mFboId[2]; /*!< Handles to the two FBOs for ping-pong method*/
     GLint  mTextureUnits[6]; /*!< Handles to the texture units for the above textures*/
 
+    GLuint mOwnTexPiPoId; /*!< Ping-pong texture allocated by this phase (run swaps it with textures of other phases) */
+    GLint  mOwnTextureUnit; /*!< Texture unit of \ref mOwnTexPiPoId */
+
     int mWrite; /*!< Holds the index of the FBO/texture which is written to */
     int mRead; /*!< Holds the index of the texture which is read from */
 
-    unsigned mStatsAreaWidth;  /*!< Width of the area extracted at the end of the statistics computation */
-    unsigned mStatsAreaHeight; /*!< Height of the area extracted at the end of the statistics computation */
+    unsigned mStatsAreaWidth;  /*!< Width of the result table (all columns of the statistics) */
+    unsigned mStatsAreaHeight; /*!< Maximum number of rows of the result table which are searched for spots */
+    unsigned mCompactWidth; /*!< Number of spots per row of the compacted block which is read back (default is 64) */
+    size_t   mReadbackSize; /*!< Number of bytes read back by the last \ref run */
+    std::vector<GLubyte> mHeader; /*!< Buffer for the header with the number of spots per table column */
+    std::vector<GLubyte> mCompact; /*!< Buffer for the compacted block of spots */
 
     unsigned mNumFillIterations;  /*!< Sets the number of iteration in the filling stage (default is 2) */
+    int mBitDepth; /*!< Bits per pixel of the original image (default 8). Above 8 the spots are weighted with the full sensor value and the luminance is summed with 24 bits */
+    bool mWideSums; /*!< Pack the weighted sums and the luminance sums with 32 bits instead of 24 (default false), has to be set before \ref init. See \ref wideLuminance */
+
+    const RegionSet *mRegions; /*!< Occupied regions of the frame, NULL or inactive to draw the full frame */
+
+    Engine mEngine; /*!< Implementation of the passes (default \ref ENGINE_QUADRANTS), \ref ENGINE_SCATTER falls back to it if \ref hasScatter is false */
 
     /*!
      \brief Constructor
@@ -185,6 +281,9 @@ public:
     /*!
      \brief Hand over the results of previous phases for further processing
 
+     Also resets the second ping-pong texture to the one allocated in \ref init,
+     so the phase can be run again for the next frame.
+
      \param origTex      Texture holding the original image
      \param origTexUnit  Corresponding texture unit of \ref origTex
      \param labelTex     Texture holding the results of the labeling phase
@@ -195,12 +294,26 @@ public:
      \param freeTexUnit  Corresponding texture unit of \ref freeTex
      \param freeTex2     Texture which is already allocated and free to use
      \param freeTexUnit2 Corresponding texture unit of \ref freeTex2
+     \param origTopDown  True if \ref origTex starts with the top row
     */
     void updateTextures(GLuint origTex   , GLint origTexUnit,
                         GLuint labelTex  , GLint labelTexUnit,
                         GLuint reducedTex, GLint reducedTexUnit,
                         GLuint freeTex   , GLint freeTexUnit,
-                        GLuint freeTex2   , GLint freeTexUnit2);
+                        GLuint freeTex2   , GLint freeTexUnit2,
+                        bool origTopDown = false);
+
+    /*!
+     \brief Sets the size of the table texture handed over by \ref updateTextures
+
+     The save and blend stages only draw the rows of the table, i.e. their
+     costs do not depend on the size of the frame.
+
+     \param width  Width of the table texture, at least \ref mStatsAreaWidth
+     \param height Height of the table texture
+     \param rows   Number of rows of the table which hold labels
+    */
+    void setTableSize(int width, int height, int rows);
 
     /*!
      \brief Sets up the Viewport and the quad scene
@@ -213,9 +326,12 @@ public:
 
      Internally calls \ref fillStage, \ref countStage and
      \ref centroidingStage for each of the 4 directions and sums the
-     results. The results are written into the same texture which already
+     results (\ref ENGINE_QUADRANTS), or \ref runScatter for
+     \ref ENGINE_SCATTER. The results are written into the same texture which already
      holds the results of the reduction phase and with the same layout
-     but with an offset in x-direction
+     but with an offset in x-direction (only the rows of the table set by
+     \ref setTableSize are drawn). Finally \ref readSpots transfers
+     the spots of this table into \ref mSpots.
 
      TODO: Cleanup the code and comments
      TODO: Write short explanation here?
@@ -224,9 +340,61 @@ public:
      \return double The time (in ms) the computation took for the computation*/
     virtual double run();
 
+    /*!
+     \brief Issues all passes of \ref run but does not read the spots back
+
+     The final table stays in the reduced texture until \ref readSpots is
+     called, i.e. the GPU can work on the passes while the client does other
+     work. No other phase may draw in between.
+
+     \return double The time (in ms) it took to issue the passes
+    */
+    double runPasses();
+
+    /*!
+     \brief Packs the spots of the result table into a dense block and reads it back
+
+     First the number of spots of each table column is computed into a small
+     header, which is read back. Then the spots are gathered into a block of
+     ceil(N/\ref mCompactWidth) rows and only this block is read back, i.e.
+     the transfer depends on the number of spots, not the image height.
+     Fills \ref mSpots.
+    */
+    void readSpots();
+
+    /*!
+     \brief Returns true if the context supports \ref ENGINE_SCATTER
+
+     The scatter needs float textures which can be rendered to and blended
+     (GL_OES_texture_float, GL_EXT_color_buffer_float, GL_EXT_float_blend)
+     and texture access in the vertex shader. Known after \ref init.
+    */
+    bool hasScatter() const { return mHasScatter; }
+
+    /*!
+     \brief Returns true if the luminance sums are saved as a fifth block of the table
+
+     The count stage sums the luminance with 16 bits next to the area. High
+     bit depth images and \ref mWideSums need more bits, the luminance is
+     summed by another centroiding stage then (24 bits, 32 bits with
+     \ref mWideSums). The weighted sums are packed as 32-bit two's
+     complement with \ref mWideSums, i.e. they do not overflow for bright,
+     large spots. The number of passes does not change.
+    */
+    bool wideLuminance() const { return mBitDepth > 8 || mWideSums; }
+
     virtual void releaseGlResources();
 
 private:
+    /*!
+     \brief Runs the fill, count and centroiding stages for one of the 4 directions
+
+     \param quadrant Index of the direction, used for the names of the \ref Profiler scopes
+     \param factorX X-direction of the filling process
+     \param factorY Y-direction of the filling process
+    */
+    void runQuadrant(int quadrant, float factorX, float factorY);
+
     /*!
      \brief Function taking care of the execution of the fill stage
 
@@ -253,7 +421,80 @@ private:
      \param offset  Starting column to write the results into
     */
     void centroidingStage(float factorX, float factorY, int coordinate, int offset);
+
+    /*!
+     \brief Copies the result of a blend stage into the columns of the table
+
+     The blend stage reads the table, so it is drawn into the ping-pong
+     texture first. The save and blend stages draw their columns at the left
+     border of the ping-pong texture, so they fit into frames which are
+     narrower than the table.
+
+     \param offset Starting column of the results
+    */
+    void copyIntoTable(int offset);
+
+    /*!
+     \brief Number of rows of the table which are drawn and searched for spots
+    */
+    int tableRows() const;
+
+    /*!
+     \brief Number of columns of the table which can hold labels
+
+     The reduction phase packs the labels of a frame narrower than
+     TABLE_COLUMNS into fewer columns, the other ones stay empty.
+    */
+    int tableColumns() const;
+
+    /*!
+     \brief Loads the programs of \ref ENGINE_SCATTER and creates its float table if supported
+
+     \param bfUsedTextures The bitfield to determine which texture units are already used
+    */
+    void initScatter(GLuint &bfUsedTextures);
+
+    /*!
+     \brief Computes the statistics of all spots with three draws instead of the quadrant sweep
+
+     1. Cells: every cell of the reduction table is scattered to its root
+        pixel and leaves its coordinates there (into the fill texture,
+        which is not needed by this engine).
+     2. Accumulate: every pixel of the regions is scattered to the table cell
+        of its root. Additive blending into a float texture of the size of
+        the table sums area, luminance and the first moments.
+     3. Pack: the sums are written into the table next to the labels with
+        the layout of the count and centroiding stages, so \ref readSpots
+        is the same for both engines.
+
+     The sums are exact as long as they fit into the 24 bit mantissa of a
+     float, i.e. in the same range as the packed longs of the table.
+    */
+    void runScatter();
+
+    /*!
+     \brief Uploads one point per pixel of the regions (or the full frame) for the accumulate draw
+
+     Boxes may overlap, every pixel must only be scattered once. Therefore
+     the boxes are merged into spans per row.
+    */
+    void updateScatterPoints();
+
     void debugImage(const char *text, const char *filename);
+
+    int    mTableWidth;  /*!< Width of the texture in \ref mTexReducedId */
+    int    mTableHeight; /*!< Height of the texture in \ref mTexReducedId */
+    int    mTableRows;   /*!< Number of rows of the table which hold labels */
+
+    bool   mHasScatter; /*!< The context supports \ref ENGINE_SCATTER */
+    bool   mWarnedScatter; /*!< The fallback to \ref ENGINE_QUADRANTS was logged */
+    GLuint mTexSumsId; /*!< Float texture of the accumulate stage (one pixel per table cell) */
+    GLint  mSumsTextureUnit; /*!< Texture unit of \ref mTexSumsId */
+    GLuint mCellVboId; /*!< One vertex per table cell, row by row */
+    GLuint mPointVboId; /*!< One vertex per pixel which is scattered, unsigned shorts (4 bytes per pixel) */
+    GLsizei mNumPoints; /*!< Number of vertices in \ref mPointVboId */
+    bool   mPointsAreFullFrame; /*!< \ref mPointVboId holds all pixels of the frame */
+    std::vector<GLushort> mPoints; /*!< Client copy of the points of the regions */
 };
 
 /*!
@@ -0,0 +1,71 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/*!
+ \brief Simple pool of worker threads for the CPU code paths
+
+ The threads are created once in the constructor and wait for jobs until
+ the pool is destroyed. Jobs can either be queued one by one with
+ \ref enqueue or as a set of numbered tasks with \ref run, which blocks
+ until all tasks are done.
+
+*/
+class ThreadPool
+{
+public:
+    /*!
+     \brief Constructor
+
+     \param numThreads Number of worker threads, 0 uses the number of available cores
+    */
+    ThreadPool(unsigned numThreads = 0);
+
+    /*!
+     \brief Destructor
+
+     Finishes all queued jobs and joins the worker threads.
+    */
+    virtual ~ThreadPool();
+
+    /*!
+     \brief Returns the number of worker threads
+
+     \return unsigned
+    */
+    unsigned size() const;
+
+    /*!
+     \brief Queues a job which is executed by the next free worker thread
+
+     \param job Function to execute
+    */
+    void enqueue(const std::function<void()> &job);
+
+    /*!
+     \brief Executes numTasks tasks on the worker threads and waits for them
+
+     The task function is called once with every index in [0, numTasks).
+
+     \param numTasks Number of tasks
+     \param task     Function which is called with the index of the task
+    */
+    void run(unsigned numTasks, const std::function<void(unsigned)> &task);
+
+private:
+    void worker();
+
+    std::vector<std::thread> mThreads; /*!< The worker threads */
+    std::queue< std::function<void()> > mJobs; /*!< Jobs waiting for a free worker */
+    std::mutex mMutex; /*!< Protects mJobs and mStop */
+    std::condition_variable mCondition; /*!< Signals new jobs to the workers */
+    bool mStop; /*!< Set by the destructor to stop the workers */
+};
+
+#endif // THREADPOOL_H
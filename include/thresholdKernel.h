@@ -0,0 +1,119 @@
+#ifndef THRESHOLDKERNEL_H
+#define THRESHOLDKERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ \brief CPU kernels for the thresholding and the hot pixel rejection
+
+ Computes the same foreground as the initial labeling stage of the label
+ shader: a pixel is foreground if it is above the threshold and at least one
+ of its 8 neighbours is above the threshold as well.
+
+ The result is a packed bitmask with one bit per pixel. Each row starts with
+ a new 64-bit word, bit b of word w holds the pixel x = 64*w + b. Later
+ stages can skip all pixels of a word which is 0.
+
+ The comparison of the pixels is vectorized with AVX2, SSE2 or NEON, the
+ instruction set is selected at runtime. The neighbourhood is combined on
+ whole 64-bit words while streaming over the rows, i.e. every pixel is read
+ exactly once.
+
+*/
+class ThresholdKernel
+{
+public:
+    /*!
+     \brief Instruction sets of the comparison
+    */
+    enum Isa
+    {
+        ISA_SCALAR,
+        ISA_SSE2,
+        ISA_AVX2,
+        ISA_NEON
+    };
+
+    /*!
+     \brief Returns the instruction set used on this CPU
+
+     \return Isa
+    */
+    static Isa isa();
+
+    /*!
+     \brief Returns the name of \ref isa for log output
+
+     \return const char *
+    */
+    static const char *isaName();
+
+    /*!
+     \brief Converts a normalized threshold into the smallest pixel value above it
+
+     Uses the same comparison as step(u_threshold, value) in the label shader.
+
+     \param threshold Threshold normalized to [0,1]
+     \param maxValue  Largest pixel value, i.e. 255 for 8 bits per pixel
+     \return int Smallest value with value/maxValue >= threshold or maxValue+1 if there is none
+    */
+    static int thresholdValue(float threshold, int maxValue = 255);
+
+    /*!
+     \brief Number of 64-bit words per row of the mask
+
+     \param width Width of the image
+     \return unsigned
+    */
+    static unsigned wordsPerRow(int width) { return (width + 63) / 64; }
+
+    /*!
+     \brief Computes the foreground mask of the rows [rowStart, rowEnd)
+
+     The rows rowStart-1 and rowEnd are read as well (if inside the image)
+     for the neighbourhood. Only the mask rows [rowStart, rowEnd) are written,
+     so bands of rows can be computed by different threads.
+
+     With a range of words only the words [wordStart, wordEnd) of each row
+     are written. Their pixels and the neighbour on each side are read.
+
+     \param pixels         Pointer to the first channel of pixel (0,0)
+     \param rowStride      Distance in bytes from row y to row y+1, can be negative
+     \param pixelStride    Distance in bytes between neighbouring pixels of a row
+     \param width          Width of the image
+     \param height         Height of the image
+     \param rowStart       First row to compute
+     \param rowEnd         Row after the last row to compute
+     \param thresholdValue Smallest value of a pixel above the threshold (256: no pixel)
+     \param mask           Mask with \ref wordsPerRow words per row for all rows of the image
+     \param wordStart      First word of each row to compute
+     \param wordEnd        Word after the last word of each row to compute, -1 for \ref wordsPerRow
+    */
+    static void computeMask(const uint8_t *pixels, ptrdiff_t rowStride, int pixelStride,
+                            int width, int height, int rowStart, int rowEnd,
+                            int thresholdValue, uint64_t *mask,
+                            int wordStart = 0, int wordEnd = -1);
+
+    /*!
+     \brief Computes the maximum of each tile of the image (max-pool)
+
+     Coarse pre-pass for the occupied regions: a tile contains a pixel above
+     the threshold if its maximum is. Unlike \ref computeMask there is no hot
+     pixel rule, so the occupied tiles are a superset of those of the mask.
+     The rows of a tile are combined with vector maxima, only the final
+     maximum of each tile is scalar.
+
+     \param pixels      Pointer to the first channel of pixel (0,0)
+     \param rowStride   Distance in bytes from row y to row y+1, can be negative
+     \param pixelStride Distance in bytes between neighbouring pixels of a row
+     \param width       Width of the image
+     \param height      Height of the image
+     \param tileSize    Edge length of the tiles
+     \param tileMax     Receives the maxima, ceil(width/tileSize) per row of tiles
+    */
+    static void computeTileMax(const uint8_t *pixels, ptrdiff_t rowStride, int pixelStride,
+                               int width, int height, int tileSize, uint8_t *tileMax);
+};
+
+#endif // THRESHOLDKERNEL_H
@@ -0,0 +1,205 @@
+#include "batchLoader.h"
+#include "CImg.h"
+using namespace cimg_library;
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <glob.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+
+BatchLoader::Image::Image()
+    : width(0), height(0), bitDepth(8)
+{
+}
+
+IngestPhase::Frame BatchLoader::Image::frame() const
+{
+    int bytesPerPixel = (bitDepth > 8) ? 2 : 1;
+    return IngestPhase::Frame(pixels.data(), width, height, width*bytesPerPixel, bitDepth);
+}
+
+BatchLoader::BatchLoader(const std::vector<std::string> &filenames, int bitDepth,
+                         unsigned numThreads, unsigned numPrefetch)
+    : mFilenames(filenames), mBitDepth(bitDepth), mNumPrefetch(numPrefetch), mNext(0),
+      mPool(numThreads)
+{
+    if (mNumPrefetch == 0)
+        mNumPrefetch = 2*mPool.size();
+
+    mSlots.resize(mNumPrefetch);
+    for (size_t i=0; i<mNumPrefetch; ++i)
+    {
+        enqueue(i);
+    }
+}
+
+BatchLoader::~BatchLoader()
+{
+}
+
+bool BatchLoader::next(Image &image)
+{
+    if (mNext >= mFilenames.size())
+        return false;
+
+    std::shared_ptr<Slot> slot = mSlots[mNext % mNumPrefetch];
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!slot->done)
+            mDone.wait(lock);
+    }
+    image = std::move(slot->image);
+
+    enqueue(mNext + mNumPrefetch);
+    ++mNext;
+    return true;
+}
+
+size_t BatchLoader::size() const
+{
+    return mFilenames.size();
+}
+
+unsigned BatchLoader::numThreads() const
+{
+    return mPool.size();
+}
+
+unsigned BatchLoader::numPrefetch() const
+{
+    return mNumPrefetch;
+}
+
+void BatchLoader::enqueue(size_t index)
+{
+    if (index >= mFilenames.size())
+        return;
+
+    std::shared_ptr<Slot> slot(new Slot());
+    slot->done = false;
+    mSlots[index % mNumPrefetch] = slot;
+
+    const std::string &filename = mFilenames[index];
+    int bitDepth = mBitDepth;
+    mPool.enqueue( [this, slot, filename, bitDepth]()
+    {
+        decode(filename, bitDepth, slot->image);
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        slot->done = true;
+        mDone.notify_all();
+    });
+}
+
+void BatchLoader::decode(const std::string &filename, int bitDepth, Image &image)
+{
+    image.filename = filename;
+    image.bitDepth = bitDepth;
+    image.width    = 0;
+    image.height   = 0;
+    image.error.clear();
+
+    try
+    {
+        if (bitDepth > 8)
+        {
+            // Two bytes per pixel, low byte first
+            CImg<unsigned short> file(filename.c_str());
+            size_t numPixels = (size_t)file.width()*file.height();
+            image.pixels.resize(2*numPixels);
+            const unsigned short *values = file.data();
+            for (size_t i=0; i<numPixels; ++i)
+            {
+                image.pixels[2*i]   = values[i] & 0xff;
+                image.pixels[2*i+1] = values[i] >> 8;
+            }
+            image.width  = file.width();
+            image.height = file.height();
+        }
+        else
+        {
+            // The first channel is stored first, starting with the top row
+            CImg<unsigned char> file(filename.c_str());
+            size_t numPixels = (size_t)file.width()*file.height();
+            image.pixels.assign(file.data(), file.data() + numPixels);
+            image.width  = file.width();
+            image.height = file.height();
+        }
+    }
+    catch (CImgException &e)
+    {
+        image.pixels.clear();
+        image.error = e.what();
+    }
+}
+
+static bool isDirectory(const std::string &path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+static bool exists(const std::string &path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0;
+}
+
+std::vector<std::string> BatchLoader::expandInputs(const std::vector<std::string> &inputs)
+{
+    std::vector<std::string> filenames;
+    for (size_t i=0; i<inputs.size(); ++i)
+    {
+        const std::string &input = inputs[i];
+        std::vector<std::string> files;
+        bool sortFiles = true;
+
+        if (input.size() > 1 && input[0] == '@')
+        {
+            // List file, the order of the list is kept
+            std::ifstream list(input.c_str()+1);
+            std::string line;
+            while (std::getline(list, line))
+            {
+                if (!line.empty() && line[0] != '#')
+                    files.push_back(line);
+            }
+            sortFiles = false;
+        }
+        else if (isDirectory(input))
+        {
+            DIR *dir = opendir(input.c_str());
+            struct dirent *entry;
+            while (dir != NULL && (entry = readdir(dir)) != NULL)
+            {
+                std::string path = input + "/" + entry->d_name;
+                if (entry->d_name[0] != '.' && !isDirectory(path))
+                    files.push_back(path);
+            }
+            if (dir != NULL)
+                closedir(dir);
+        }
+        else if (!exists(input) && input.find_first_of("*?[") != std::string::npos)
+        {
+            glob_t matches;
+            if (glob(input.c_str(), 0, NULL, &matches) == 0)
+            {
+                for (size_t m=0; m<matches.gl_pathc; ++m)
+                    files.push_back(matches.gl_pathv[m]);
+            }
+            globfree(&matches);
+        }
+        else
+        {
+            files.push_back(input);
+        }
+
+        if (sortFiles)
+            std::sort(files.begin(), files.end());
+        filenames.insert(filenames.end(), files.begin(), files.end());
+    }
+    return filenames;
+}
@@ -0,0 +1,495 @@
+#include "cpuPhase.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "getTime.h"
+
+#define JOIN_WORDS 4 // Largest gap (in words) between two spans which are joined
+
+CpuPhase::CpuPhase(int width, int height, unsigned numThreads)
+    : mWidth(width), mHeight(height),
+      u_threshold(64.3 / 255.0), mTableColumns(10), mBandHeight(64), mRegions(NULL),
+      mPixels(NULL), mRowStride(0), mPixelStride(1), mThresholdValue(256), mWordsPerRow(0),
+      mPool(numThreads)
+{
+}
+
+CpuPhase::~CpuPhase()
+{
+}
+
+void CpuPhase::setImage(const uint8_t *pixels, ptrdiff_t rowStride, int pixelStride)
+{
+    mPixels      = pixels;
+    mRowStride   = rowStride;
+    mPixelStride = pixelStride;
+}
+
+void CpuPhase::releaseGlResources()
+{
+}
+
+unsigned CpuPhase::numThreads() const
+{
+    return mPool.size();
+}
+
+double CpuPhase::run()
+{
+    double startTime, endTime;
+
+    startTime = getRealTime();
+
+    mSpots.clear();
+    if (mPixels == NULL || mWidth <= 0 || mHeight <= 0)
+        return 0.0;
+
+    mThresholdValue = ThresholdKernel::thresholdValue(u_threshold);
+
+    mWordsPerRow = ThresholdKernel::wordsPerRow(mWidth);
+    mMask.resize((size_t)mWordsPerRow*mHeight);
+
+    // Split the image into bands of a fixed height, the threads of the pool
+    // take the bands in turns
+    unsigned numBands;
+    if (mBandHeight > 0)
+        numBands = (mHeight + mBandHeight - 1) / mBandHeight;
+    else
+        numBands = std::min<unsigned>(mPool.size(), mHeight);
+    mBands.resize(numBands);
+    for (unsigned b=0; b<numBands; ++b)
+    {
+        if (mBandHeight > 0)
+        {
+            mBands[b].rowStart = b*mBandHeight;
+            mBands[b].rowEnd   = std::min<int>((b+1)*mBandHeight, mHeight);
+        }
+        else
+        {
+            mBands[b].rowStart = (int)((long)mHeight*b/numBands);
+            mBands[b].rowEnd   = (int)((long)mHeight*(b+1)/numBands);
+        }
+    }
+
+    mPool.run(numBands, [&](unsigned b)
+    {
+        labelBand(mBands[b]);
+    });
+
+    // Combine the forests of the bands into one, the indices of the runs are
+    // shifted by the number of runs of the bands below
+    uint32_t numRuns = 0;
+    for (unsigned b=0; b<numBands; ++b)
+    {
+        mBands[b].offset = numRuns;
+        numRuns += mBands[b].runs.size();
+    }
+    mParent.resize(numRuns);
+    for (unsigned b=0; b<numBands; ++b)
+    {
+        const Band &band = mBands[b];
+        for (size_t i=0; i<band.parent.size(); ++i)
+        {
+            mParent[band.offset + i] = band.offset + band.parent[i];
+        }
+    }
+
+    // The borders are merged serially, as labels can span several bands
+    for (unsigned b=1; b<numBands; ++b)
+    {
+        mergeBands(mBands[b-1], mBands[b]);
+    }
+
+    mPool.run(numBands, [&](unsigned b)
+    {
+        statsBand(mBands[b]);
+    });
+
+    // Labels which span several bands have partial sums in each of them
+    std::vector< std::pair<int32_t, Accum> > labels;
+    for (unsigned b=0; b<numBands; ++b)
+    {
+        labels.insert(labels.end(), mBands[b].stats.begin(), mBands[b].stats.end());
+    }
+    createSpots(labels);
+
+    endTime = getRealTime();
+
+    return (endTime-startTime)*1000;
+}
+
+static int32_t findRoot(const std::vector<int32_t> &parent, int32_t index)
+{
+    while (parent[index] != index)
+        index = parent[index];
+    return index;
+}
+
+static int32_t findRootCompress(std::vector<int32_t> &parent, int32_t index)
+{
+    // Path halving
+    while (parent[index] != index)
+    {
+        parent[index] = parent[parent[index]];
+        index = parent[index];
+    }
+    return index;
+}
+
+static void unite(std::vector<int32_t> &parent, int32_t a, int32_t b)
+{
+    a = findRootCompress(parent, a);
+    b = findRootCompress(parent, b);
+
+    // Link to the lower index: the runs of the current row are attached
+    // directly to the existing tree, which keeps the trees flat
+    if (a < b)
+        parent[b] = a;
+    else if (b < a)
+        parent[a] = b;
+}
+
+void CpuPhase::clipBand(Band &band)
+{
+    // Words and rows of the boxes which cross the band
+    band.spans.clear();
+    band.boxes.clear();
+    const std::vector<RegionSet::Rect> &boxes = mRegions->boxes();
+    for (size_t i=0; i<boxes.size(); ++i)
+    {
+        const RegionSet::Rect &box = boxes[i];
+        if (box.y < band.rowEnd && band.rowStart < box.y + box.height)
+        {
+            Span span = { box.x/64, (box.x + box.width - 1)/64 + 1,
+                          std::max(box.y, band.rowStart), std::min(box.y + box.height, band.rowEnd), 0, 0 };
+            band.boxes.push_back(box);
+            band.spans.push_back(span);
+        }
+    }
+
+    // Spans which share rows are joined if their words touch, so that a run
+    // is never split between two of them. A few words between them cost less
+    // to threshold than the rows of another span, so close ones are joined
+    // as well. Spans without a common row are never read in the same row.
+    for (size_t i=0; i<band.spans.size(); )
+    {
+        Span &span = band.spans[i];
+        size_t j = i + 1;
+        for (; j<band.spans.size(); ++j)
+        {
+            const Span &other = band.spans[j];
+            if (span.rowStart < other.rowEnd && other.rowStart < span.rowEnd &&
+                std::max(span.first, other.first) <= std::min(span.end, other.end) + JOIN_WORDS)
+                break;
+        }
+        if (j == band.spans.size())
+        {
+            ++i;
+            continue;
+        }
+
+        // The joined span can reach others which were apart, so start over
+        span.first    = std::min(span.first, band.spans[j].first);
+        span.end      = std::max(span.end, band.spans[j].end);
+        span.rowStart = std::min(span.rowStart, band.spans[j].rowStart);
+        span.rowEnd   = std::max(span.rowEnd, band.spans[j].rowEnd);
+        band.spans.erase(band.spans.begin() + j);
+        i = 0;
+    }
+
+    // The runs of a row are encoded from left to right
+    std::sort(band.spans.begin(), band.spans.end(),
+              [](const Span &a, const Span &b) { return a.first < b.first; });
+
+    // Group the boxes by their span, it holds their words and rows
+    std::vector<RegionSet::Rect> spanBoxes;
+    spanBoxes.reserve(band.boxes.size());
+    for (size_t s=0; s<band.spans.size(); ++s)
+    {
+        Span &span = band.spans[s];
+        span.firstBox = spanBoxes.size();
+        for (size_t i=0; i<band.boxes.size(); ++i)
+        {
+            const RegionSet::Rect &box = band.boxes[i];
+            if (box.x/64 >= span.first && box.x/64 < span.end &&
+                box.y < span.rowEnd && span.rowStart < box.y + box.height)
+                spanBoxes.push_back(box);
+        }
+        span.endBox = spanBoxes.size();
+    }
+    band.boxes.swap(spanBoxes);
+
+    band.clip.resize(mWordsPerRow);
+    for (size_t s=0; s<band.spans.size(); ++s)
+    {
+        const Span &span = band.spans[s];
+        ThresholdKernel::computeMask(mPixels, mRowStride, mPixelStride, mWidth, mHeight,
+                                     span.rowStart, span.rowEnd, mThresholdValue, mMask.data(),
+                                     span.first, span.end);
+
+        // Clear the pixels of the span which are outside of its boxes
+        for (int y=span.rowStart; y<span.rowEnd; ++y)
+        {
+            std::fill(band.clip.begin() + span.first, band.clip.begin() + span.end, 0);
+            for (unsigned i=span.firstBox; i<span.endBox; ++i)
+            {
+                const RegionSet::Rect &box = band.boxes[i];
+                if (y < box.y || y >= box.y + box.height)
+                    continue;
+                int x1 = box.x + box.width - 1;
+                for (int w=box.x/64; w<=x1/64; ++w)
+                {
+                    // Bits of the box within the word
+                    int first = std::max(box.x - 64*w, 0);
+                    int last  = std::min(x1 - 64*w, 63);
+                    band.clip[w] |= (~(uint64_t)0 << first) & (~(uint64_t)0 >> (63-last));
+                }
+            }
+
+            uint64_t *mask = mMask.data() + (size_t)y*mWordsPerRow;
+            for (int w=span.first; w<span.end; ++w)
+                mask[w] &= band.clip[w];
+        }
+    }
+}
+
+// Unites the overlapping runs of two neighbouring rows, i.e. the runs
+// [lowerFirst, lowerEnd) and [upperFirst, upperEnd) of the same forest.
+// Runs touch with 8-connectivity if they overlap or meet diagonally.
+template <typename Runs>
+static void uniteRows(std::vector<int32_t> &parent,
+                      const Runs &lower, uint32_t lowerFirst, uint32_t lowerEnd, int32_t lowerOffset,
+                      const Runs &upper, uint32_t upperFirst, uint32_t upperEnd, int32_t upperOffset)
+{
+    uint32_t i = lowerFirst;
+    uint32_t j = upperFirst;
+    while (i < lowerEnd && j < upperEnd)
+    {
+        if (lower[i].x0 <= upper[j].x1 + 1 && upper[j].x0 <= lower[i].x1 + 1)
+            unite(parent, lowerOffset + i, upperOffset + j);
+
+        // Advance the run which ends first, the other one can still touch the next run
+        if (lower[i].x1 < upper[j].x1)
+            ++i;
+        else
+            ++j;
+    }
+}
+
+void CpuPhase::labelBand(Band &band)
+{
+    if (mRegions != NULL && mRegions->isActive())
+    {
+        clipBand(band);
+    }
+    else
+    {
+        Span span = { 0, (int)mWordsPerRow, band.rowStart, band.rowEnd, 0, 0 };
+        band.spans.assign(1, span);
+        ThresholdKernel::computeMask(mPixels, mRowStride, mPixelStride, mWidth, mHeight,
+                                     band.rowStart, band.rowEnd, mThresholdValue, mMask.data());
+    }
+
+    band.runs.clear();
+    band.rowFirstRun.clear();
+
+    ///---------- RUN-LENGTH ENCODING --------------------
+
+    for (int y=band.rowStart; y<band.rowEnd; ++y)
+    {
+        band.rowFirstRun.push_back(band.runs.size());
+
+        // Only the spans are computed, the rest of the mask is not read
+        const uint64_t *mask = mMask.data() + (size_t)y*mWordsPerRow;
+        for (size_t s=0; s<band.spans.size(); ++s)
+        {
+            const Span &span = band.spans[s];
+            if (y < span.rowStart || y >= span.rowEnd)
+                continue;
+
+            int runStart = -1; // Start of the run which continues from the previous word
+            for (int w=span.first; w<span.end; ++w)
+            {
+                uint64_t bits = mask[w];
+                if (bits == 0 && runStart < 0)
+                    continue;
+
+                int base = 64*w;
+                int pos = 0;
+                for (;;)
+                {
+                    if (runStart < 0)
+                    {
+                        uint64_t ones = bits & (~(uint64_t)0 << pos);
+                        if (ones == 0)
+                            break;
+                        pos = __builtin_ctzll(ones);
+                        runStart = base + pos;
+                    }
+
+                    uint64_t zeros = ~bits & (~(uint64_t)0 << pos);
+                    if (zeros == 0)
+                        break; // The run continues in the next word
+
+                    pos = __builtin_ctzll(zeros);
+                    Run run = { y, runStart, base + pos - 1 };
+                    band.runs.push_back(run);
+                    runStart = -1;
+                }
+            }
+            if (runStart >= 0)
+            {
+                Run run = { y, runStart, std::min(64*span.end, mWidth) - 1 };
+                band.runs.push_back(run);
+            }
+        }
+    }
+    band.rowFirstRun.push_back(band.runs.size());
+
+    ///---------- UNION-FIND OVER THE RUNS --------------------
+
+    band.parent.resize(band.runs.size());
+    for (size_t i=0; i<band.parent.size(); ++i)
+    {
+        band.parent[i] = i;
+    }
+
+    for (int r=1; r<band.rowEnd-band.rowStart; ++r)
+    {
+        uniteRows(band.parent,
+                  band.runs, band.rowFirstRun[r-1], band.rowFirstRun[r], 0,
+                  band.runs, band.rowFirstRun[r], band.rowFirstRun[r+1], 0);
+    }
+}
+
+void CpuPhase::mergeBands(const Band &lower, const Band &upper)
+{
+    size_t lowerRows = lower.rowFirstRun.size() - 1;
+    uniteRows(mParent,
+              lower.runs, lower.rowFirstRun[lowerRows-1], lower.rowFirstRun[lowerRows], lower.offset,
+              upper.runs, upper.rowFirstRun[0], upper.rowFirstRun[1], upper.offset);
+}
+
+void CpuPhase::statsBand(Band &band)
+{
+    std::unordered_map<int32_t, Accum> sums;
+    int32_t lastRoot = -1;
+    Accum *accum = NULL;
+
+    for (size_t i=0; i<band.runs.size(); ++i)
+    {
+        const Run &run = band.runs[i];
+
+        // Only reading, the forest is shared by all threads at this point
+        int32_t root = findRoot(mParent, band.offset + i);
+        if (root != lastRoot)
+        {
+            Accum &entry = sums[root];
+            accum = &entry;
+            lastRoot = root;
+        }
+
+        const uint8_t *row = mPixels + run.y*mRowStride;
+        uint64_t luminance = 0;
+        int64_t sumX = 0;
+        for (int x=run.x0; x<=run.x1; ++x)
+        {
+            unsigned value = row[x*mPixelStride];
+            luminance += value;
+            sumX      += (int64_t)x*value;
+        }
+
+        accum->area      += run.x1 - run.x0 + 1;
+        accum->luminance += luminance;
+        accum->sumX      += sumX;
+        accum->sumY      += (int64_t)run.y*luminance;
+        accum->topRight   = std::max(accum->topRight, run.y*mWidth + run.x1);
+    }
+
+    band.stats.assign(sums.begin(), sums.end());
+}
+
+void CpuPhase::createSpots(std::vector< std::pair<int32_t, Accum> > &labels)
+{
+    std::sort(labels.begin(), labels.end(),
+              [](const std::pair<int32_t, Accum> &a, const std::pair<int32_t, Accum> &b)
+              { return a.first < b.first; });
+
+    // Sum up the parts of labels which span several bands
+    std::vector< std::pair<int32_t, Accum> > roots;
+    for (size_t k=0; k<labels.size(); ++k)
+    {
+        if (!roots.empty() && roots.back().first == labels[k].first)
+        {
+            Accum &accum = roots.back().second;
+            accum.area      += labels[k].second.area;
+            accum.luminance += labels[k].second.luminance;
+            accum.sumX      += labels[k].second.sumX;
+            accum.sumY      += labels[k].second.sumY;
+            accum.topRight   = std::max(accum.topRight, labels[k].second.topRight);
+        }
+        else
+        {
+            roots.push_back(labels[k]);
+        }
+    }
+
+    // The GPU uses the top-right pixel as root
+    for (size_t k=0; k<roots.size(); ++k)
+    {
+        roots[k].first = roots[k].second.topRight;
+    }
+    std::sort(roots.begin(), roots.end(),
+              [](const std::pair<int32_t, Accum> &a, const std::pair<int32_t, Accum> &b)
+              { return a.first < b.first; });
+
+    // Same layout as the reduction phase: the roots of each row are packed to
+    // the left, then each column is packed to the bottom. The table is read
+    // row by row and only the first mTableColumns roots of a row fit in it.
+    std::vector< std::vector<size_t> > columns(mTableColumns);
+    int currentRow = -1;
+    unsigned column = 0;
+    for (size_t k=0; k<roots.size(); ++k)
+    {
+        int y = roots[k].first / mWidth;
+        if (y != currentRow)
+        {
+            currentRow = y;
+            column = 0;
+        }
+        if (column < mTableColumns)
+            columns[column].push_back(k);
+        ++column;
+    }
+
+    size_t numRows = columns.empty() ? 0 : columns[0].size();
+    for (size_t j=0; j<numRows; ++j)
+    {
+        for (unsigned i=0; i<mTableColumns; ++i)
+        {
+            if (j >= columns[i].size())
+                continue;
+
+            int32_t root = roots[columns[i][j]].first;
+            const Accum &accum = roots[columns[i][j]].second;
+            if (accum.area <= 2)
+                continue;
+
+            StatsPhase::Spot spot;
+            spot.area = accum.area;
+            spot.luminance = (unsigned)std::min<uint64_t>(accum.luminance, UINT32_MAX);
+            spot.x = root % mWidth;
+            spot.y = root / mWidth;
+            if (accum.luminance > 0)
+            {
+                // Same as the GPU: luminance weighted distance to the root
+                int64_t sumX = (int64_t)(root % mWidth)*accum.luminance - accum.sumX;
+                int64_t sumY = (int64_t)(root / mWidth)*accum.luminance - accum.sumY;
+                spot.x -= (float)sumX / (float)accum.luminance;
+                spot.y -= (float)sumY / (float)accum.luminance;
+            }
+            mSpots.push_back(spot);
+        }
+    }
+}
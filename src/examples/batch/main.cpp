@@ -0,0 +1,152 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <vector>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include "batchLoader.h"
+#include "getTime.h"
+#include "log.h"
+#include "ogles.h"
+#include "../starField.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Batch mode with the BatchLoader
+ *
+ * Usage: example_batch [number of frames] [directory]
+ *
+ * Writes generated star fields (512 x 384, the stars drift from frame to
+ * frame) as PNG files and a broken file into the directory (default
+ * batch_frames). The directory, a glob pattern and a list file have to
+ * expand to the files, all files have to be decoded to the generated
+ * pixels and the broken one has to be reported. Then the spots of the
+ * decoded frames are extracted with the pipelined mode of the GPU backend
+ * and compared to the spots of the generated frames. The program returns 1
+ * if anything differs.
+ */
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    int numFrames = (argc > 1) ? atoi(argv[1]) : 6;
+    std::string directory = (argc > 2) ? argv[2] : "batch_frames";
+    if (numFrames < 1)
+        numFrames = 1;
+
+    const int width  = 512;
+    const int height = 384;
+    unsigned numErrors = 0;
+
+    mkdir(directory.c_str(), 0755);
+    std::vector< std::vector<uint8_t> > frames(numFrames);
+    std::ofstream list((directory + ".list").c_str());
+    for (int i=0; i<numFrames; ++i)
+    {
+        // Drift of (1/4, 1/8) pixels per frame, the margin of 32 pixels leaves room for it
+        StarField field(width, height, 30);
+        field.mMargin = 16;
+        field.mAreaWidth  = width-16;
+        field.mAreaHeight = height-16;
+        field.mOffsetX = i/4.0f;
+        field.mOffsetY = i/8.0f;
+        field.generate(frames[i]);
+        char filename[256];
+        snprintf(filename, sizeof(filename), "%s/frame%04d.png", directory.c_str(), i);
+        CImg<unsigned char>(frames[i].data(), width, height).save_png(filename);
+        list << filename << endl;
+    }
+    std::string brokenFile = directory + "/frame9999.png";
+    std::ofstream(brokenFile.c_str()) << "not a PNG";
+
+    // All three inputs expand to the same files
+    std::vector<std::string> files = BatchLoader::expandInputs(std::vector<std::string>(1, directory));
+    std::vector<std::string> globbed = BatchLoader::expandInputs(std::vector<std::string>(1, directory + "/frame*.png"));
+    list << brokenFile << endl;
+    list.close();
+    std::vector<std::string> listed = BatchLoader::expandInputs(std::vector<std::string>(1, "@" + directory + ".list"));
+    if (files.size() != (size_t)numFrames+1 || files != globbed || files != listed)
+    {
+        printf("Expanded inputs differ: %lu files, %lu globbed, %lu listed\n", (unsigned long)files.size(),
+               (unsigned long)globbed.size(), (unsigned long)listed.size());
+        ++numErrors;
+    }
+
+    // Decoding on 2 threads with 3 files ahead
+    {
+        BatchLoader loader(files, 8, 2, 3);
+        BatchLoader::Image image;
+        size_t index = 0;
+        double startTime = getRealTime();
+        while (loader.next(image))
+        {
+            bool broken = (index == (size_t)numFrames);
+            bool isOk = broken ? !image.error.empty()
+                               : (image.width == width && image.height == height && image.pixels == frames[index]);
+            if (!isOk || image.filename != files[index])
+            {
+                printf("Frame %lu (%s) is not decoded as expected: %s\n", (unsigned long)index,
+                       image.filename.c_str(), image.error.c_str());
+                ++numErrors;
+            }
+            ++index;
+        }
+        printf("Decoded %lu files in %.2f ms\n", (unsigned long)index, (getRealTime()-startTime)*1000);
+        if (index != files.size())
+            ++numErrors;
+    }
+
+    // Spots of the decoded files in the pipelined mode
+    Log::setLevel(LOG_LEVEL_WARN);
+    Ogles reference(width, height, Ogles::BACKEND_GPU);
+    Ogles batch(width, height, Ogles::BACKEND_GPU);
+    std::vector< std::vector<StatsPhase::Spot> > results;
+    {
+        files.pop_back();
+        BatchLoader loader(files);
+        BatchLoader::Image images[2];
+        int current = 0;
+        bool pending = false;
+        double startTime = getRealTime();
+        while (loader.next(images[current]))
+        {
+            const std::vector<StatsPhase::Spot> &spots = batch.processFramePipelined(images[current].frame());
+            if (pending)
+                results.push_back(spots);
+            pending = true;
+            current = 1-current;
+        }
+        results.push_back(batch.flushPipeline());
+        double time = getRealTime()-startTime;
+        printf("%lu frames in %.2f s: %.2f frames/s, %u decoder threads, %u prefetched\n",
+               (unsigned long)files.size(), time, files.size()/time, loader.numThreads(), loader.numPrefetch());
+    }
+
+    unsigned numDiffs = 0;
+    for (int i=0; i<numFrames; ++i)
+    {
+        const std::vector<StatsPhase::Spot> &spots = reference.processFrame(frames[i].data(), width, height);
+        if (i >= (int)results.size() || !isEqual(spots, results[i]))
+        {
+            printf("Frame %d: spots of the decoded file differ\n", i);
+            ++numDiffs;
+        }
+    }
+    printf("%u frames differ\n", numDiffs);
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return (numErrors || numDiffs) ? 1 : 0;
+}
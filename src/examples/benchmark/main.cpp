@@ -0,0 +1,146 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "getTime.h"
+#include "log.h"
+#include "ogles.h"
+#include "../starField.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Centroid accuracy and speed on synthetic star fields
+ *
+ * Usage: example_benchmark [number of frames]
+ *
+ * Renders star fields with Gaussian PSFs at known sub-pixel positions,
+ * background noise and hot pixels for several image sizes and star
+ * densities. Each field is processed by the GPU backend (both engines of
+ * StatsPhase) and the CPU backend. For every configuration the RMS error of
+ * the centroids, the detection rate, the number of false spots and the
+ * frames per second are printed. A star is detected if a spot lies within
+ * 1.5 pixels of its position. The program returns 1 if a detection rate is
+ * below 95% or an RMS error above 0.2 pixels.
+ */
+
+struct Config
+{
+    int width;
+    int height;
+    int numStars;
+};
+
+struct Result
+{
+    double rmsError;
+    double detectionRate;
+    unsigned numFalse;
+    double fps;
+};
+
+// Stars with a minimum distance of 10 pixels, background noise and one hot pixel per 10000 pixels
+static std::vector<StarField::Star> generateField(std::vector<uint8_t> &frame, const Config &config)
+{
+    StarField field(config.width, config.height, config.numStars);
+    field.mSeed = config.numStars + config.width;
+    field.mMinDistance = 10.0f;
+    field.mPeakRange = 100;
+    field.mSigma2 = 0.6f;
+    field.mSigma2Range = 1.0f;
+    field.mNoise = 3.0f;
+    field.mNumHotPixels = config.width*config.height/10000;
+    return field.generate(frame);
+}
+
+static Result evaluate(const std::vector<StarField::Star> &stars, const std::vector<StatsPhase::Spot> &spots)
+{
+    Result result = Result();
+    unsigned numDetected = 0;
+    std::vector<bool> isMatched(spots.size(), false);
+    for (size_t i=0; i<stars.size(); ++i)
+    {
+        float bestDist2 = 1.5f*1.5f;
+        int best = -1;
+        for (size_t j=0; j<spots.size(); ++j)
+        {
+            float dx = spots[j].x - stars[i].x;
+            float dy = spots[j].y - stars[i].y;
+            if (dx*dx + dy*dy < bestDist2)
+            {
+                bestDist2 = dx*dx + dy*dy;
+                best = (int)j;
+            }
+        }
+        if (best < 0)
+            continue;
+        isMatched[best] = true;
+        result.rmsError += bestDist2;
+        ++numDetected;
+    }
+
+    for (size_t j=0; j<spots.size(); ++j)
+        result.numFalse += !isMatched[j];
+    result.rmsError = numDetected ? sqrt(result.rmsError / numDetected) : 0.0;
+    result.detectionRate = stars.empty() ? 1.0 : (double)numDetected / stars.size();
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    int numFrames = (argc > 1) ? atoi(argv[1]) : 3;
+    if (numFrames < 1)
+        numFrames = 1;
+
+    Log::setLevel(LOG_LEVEL_WARN);
+
+    const Config configs[] = { {512, 384, 10}, {512, 384, 50}, {512, 384, 200},
+                               {1024, 768, 50}, {1024, 768, 400} };
+    const char *backends[] = { "gpu quadrants", "gpu scatter", "cpu" };
+
+    unsigned numErrors = 0;
+    printf("%-10s %6s  %-14s %10s %10s %6s %8s\n", "size", "stars", "backend", "rms [px]", "detected", "false", "fps");
+    for (size_t c=0; c<sizeof(configs)/sizeof(configs[0]); ++c)
+    {
+        const Config &config = configs[c];
+        std::vector<uint8_t> frame;
+        std::vector<StarField::Star> stars = generateField(frame, config);
+
+        for (int b=0; b<3; ++b)
+        {
+            Ogles ogles(config.width, config.height, b == 2 ? Ogles::BACKEND_CPU : Ogles::BACKEND_GPU);
+            ogles.mStatsPhase.mEngine = b == 1 ? StatsPhase::ENGINE_SCATTER : StatsPhase::ENGINE_QUADRANTS;
+
+            // The first frame creates the context and the textures
+            std::vector<StatsPhase::Spot> spots = ogles.processFrame(frame.data(), config.width, config.height);
+            if (b == 1 && !ogles.mStatsPhase.hasScatter())
+                continue;
+
+            double startTime = getRealTime();
+            for (int i=0; i<numFrames; ++i)
+                spots = ogles.processFrame(frame.data(), config.width, config.height);
+
+            Result result = evaluate(stars, spots);
+            result.fps = numFrames / (getRealTime()-startTime);
+            printf("%4dx%-5d %6lu  %-14s %10.4f %9.1f%% %6u %8.2f\n", config.width, config.height,
+                   (unsigned long)stars.size(), backends[b], result.rmsError, 100*result.detectionRate,
+                   result.numFalse, result.fps);
+            numErrors += result.detectionRate < 0.95 || result.rmsError > 0.2;
+        }
+    }
+
+    printf("%u errors\n", numErrors);
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return numErrors ? 1 : 0;
+}
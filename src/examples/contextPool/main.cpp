@@ -0,0 +1,117 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "getTime.h"
+#include "log.h"
+#include "ogles.h"
+#include "../starField.h"
+#include "oglesPool.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Several frames concurrently in a pool of contexts with OglesPool
+ *
+ * Usage: example_contextPool [maximum number of contexts] [number of frames]
+ *
+ * Extracts the spots of generated star fields (512 x 384) with 1, 2, ...
+ * contexts (default up to the number of cores) and prints the frame rate
+ * and the speedup against a single context. The spots of every frame are
+ * compared with those of a single Ogles object, the program returns 1 if
+ * a frame differs.
+ */
+
+static const int sNumImages = 4;
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    unsigned maxContexts = (argc > 1) ? atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    int numFrames = (argc > 2) ? atoi(argv[2]) : 16;
+    if (maxContexts < 1)
+        maxContexts = 1;
+
+    const int width  = 512;
+    const int height = 384;
+    Log::setLevel(LOG_LEVEL_WARN);
+
+    std::vector< std::vector<uint8_t> > images(sNumImages);
+    std::vector< std::vector<StatsPhase::Spot> > reference(sNumImages);
+    {
+        Ogles ogles(width, height, Ogles::BACKEND_GPU);
+        for (int i=0; i<sNumImages; ++i)
+        {
+            StarField field(width, height, 30);
+            field.mSeed = i+1;
+            field.mMargin = 16;
+            field.generate(images[i]);
+            reference[i] = ogles.processFrame(images[i].data(), width, height);
+        }
+    }
+
+    unsigned numDiffs = 0;
+    double singleFps = 0;
+    for (unsigned numContexts=1; numContexts<=maxContexts; ++numContexts)
+    {
+        // Results by index, the warm up frames come first
+        std::mutex mutex;
+        std::vector<int> imageOfIndex;
+        std::vector< std::vector<StatsPhase::Spot> > spots(numContexts+numFrames);
+        OglesPool pool(numContexts, [&](uint64_t index, const std::vector<StatsPhase::Spot> &result) {
+            std::lock_guard<std::mutex> lock(mutex);
+            spots[index] = result;
+        });
+
+        // Warm up: every context creates its textures and programs with its first frame
+        for (unsigned i=0; i<numContexts; ++i)
+        {
+            imageOfIndex.push_back(i % sNumImages);
+            pool.submit(IngestPhase::Frame(images[imageOfIndex.back()].data(), width, height, width));
+        }
+        pool.wait();
+
+        double startTime = getRealTime();
+        for (int i=0; i<numFrames; ++i)
+        {
+            imageOfIndex.push_back(i % sNumImages);
+            pool.submit(IngestPhase::Frame(images[imageOfIndex.back()].data(), width, height, width));
+        }
+        pool.wait();
+        double elapsed = getRealTime()-startTime;
+
+        for (size_t i=0; i<spots.size(); ++i)
+        {
+            if (!isEqual(spots[i], reference[imageOfIndex[i]]))
+            {
+                printf("%u contexts: frame %lu differs\n", numContexts, (unsigned long)i);
+                ++numDiffs;
+            }
+        }
+
+        double fps = numFrames/elapsed;
+        if (numContexts == 1)
+            singleFps = fps;
+        printf("%u contexts: %.2f frames/s, speedup %.2f, frames per context", numContexts, fps, fps/singleFps);
+        std::vector<uint64_t> framesPerContext = pool.framesPerContext();
+        for (size_t i=0; i<framesPerContext.size(); ++i)
+            printf(" %lu", (unsigned long)framesPerContext[i]);
+        printf("\n");
+    }
+
+    printf("%u frames differ\n", numDiffs);
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return numDiffs ? 1 : 0;
+}
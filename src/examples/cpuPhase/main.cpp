@@ -0,0 +1,104 @@
+#include "CImg.h"
+using namespace cimg_library;
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include "getTime.h"
+#include "ogles.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Compares the spots of the CPU backend with the ones of the GPU backend
+ *
+ * Usage: example_cpuPhase [image] [max. difference in pixel]
+ *
+ * The CPU implementation serves as reference for the GPU results. Both
+ * backends are run on the same greyscale frame and each spot is compared with
+ * the spot at the same position of the other list. The program returns 1 if
+ * the lists differ.
+ */
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    const char *filename = (argc > 1) ? argv[1] : "test1.png";
+    float maxDiff = (argc > 2) ? atof(argv[2]) : 0.01;
+
+    // Use the first channel of the image as greyscale camera frame
+    CImg<unsigned char> image(filename);
+    int width  = image.width();
+    int height = image.height();
+    std::vector<uint8_t> frame(image.data(), image.data() + (size_t)width*height);
+
+    Ogles gpu(width, height, Ogles::BACKEND_GPU);
+    gpu.mLabelPhase.mVertFilename     = "quad.vert";
+    gpu.mLabelPhase.mFragFilename     = "labelPhase.frag";
+    gpu.mReductionPhase.mVertFilename = "quad.vert";
+    gpu.mReductionPhase.mFragFilename = "reductionPhase.frag";
+    gpu.mStatsPhase.mVertFilename     = "quad.vert";
+    gpu.mStatsPhase.mProgFill.filename     = "fillStage.frag";
+    gpu.mStatsPhase.mProgCount.filename    = "countStage.frag";
+    gpu.mStatsPhase.mProgCentroid.filename = "centroidStage.frag";
+
+    Ogles cpu(width, height, Ogles::BACKEND_CPU);
+
+    double startTime, endTime;
+
+    startTime = getRealTime();
+    std::vector<StatsPhase::Spot> gpuSpots = gpu.processFrame(frame.data(), width, height);
+    endTime = getRealTime();
+    double gpuTime = (endTime-startTime)*1000;
+
+    startTime = getRealTime();
+    std::vector<StatsPhase::Spot> cpuSpots = cpu.processFrame(frame.data(), width, height);
+    endTime = getRealTime();
+    double cpuTime = (endTime-startTime)*1000;
+
+    unsigned numDiffs = 0;
+    size_t numSpots = std::max(gpuSpots.size(), cpuSpots.size());
+    printf("   i | CPU: area        x        y | GPU: area        x        y\n");
+    for (size_t i=0; i<numSpots; ++i)
+    {
+        bool hasCpu = i < cpuSpots.size();
+        bool hasGpu = i < gpuSpots.size();
+        bool isEqual = hasCpu && hasGpu &&
+                cpuSpots[i].area == gpuSpots[i].area &&
+                fabs(cpuSpots[i].x - gpuSpots[i].x) <= maxDiff &&
+                fabs(cpuSpots[i].y - gpuSpots[i].y) <= maxDiff;
+        if (!isEqual)
+            ++numDiffs;
+
+        printf("%4lu | ", (unsigned long)i);
+        if (hasCpu)
+            printf("%9u %8.3f %8.3f | ", cpuSpots[i].area, cpuSpots[i].x, cpuSpots[i].y);
+        else
+            printf("%9s %8s %8s | ", "-", "-", "-");
+        if (hasGpu)
+            printf("%9u %8.3f %8.3f", gpuSpots[i].area, gpuSpots[i].x, gpuSpots[i].y);
+        else
+            printf("%9s %8s %8s", "-", "-", "-");
+        printf("%s\n", isEqual ? "" : "   <- differs");
+    }
+
+    cout << "Frame size: " << width << " x " << height << endl;
+    cout << "CPU: " << cpuSpots.size() << " spots in " << cpuTime << " ms" << endl;
+    cout << "GPU: " << gpuSpots.size() << " spots in " << gpuTime << " ms (incl. setup)" << endl;
+    cout << numDiffs << " spots differ" << endl;
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return numDiffs ? 1 : 0;
+}
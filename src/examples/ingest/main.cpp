@@ -0,0 +1,231 @@
+#include "CImg.h"
+using namespace cimg_library;
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/udmabuf.h>
+#include <vector>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include "ogles.h"
+#include "../starField.h"
+#include "packKernel.h"
+#include "getTime.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Checks the ingest paths of Ogles::processFrame
+ *
+ * Usage: example_ingest [image] [max. difference in pixel]
+ *
+ * Without an image a star field is generated. The same frame is processed by
+ * the GPU backend as
+ *   - tightly packed pointer frame
+ *   - pointer frame with padded rows
+ *   - file descriptor frame with padded rows and an offset
+ * The file descriptor is a real dmabuf if /dev/udmabuf is available, which
+ * is imported without a copy if EGL supports EGL_EXT_image_dma_buf_import.
+ * Otherwise it is a memfd and the frame is mapped and uploaded (fallback).
+ * All GPU results have to be identical and are compared with the CPU backend
+ * on the file descriptor frame.
+ *
+ * The frame is also scaled to 12 bits and processed as 16-bit pointer frame,
+ * as 16-bit file descriptor frame and as RAW12 frame unpacked by the
+ * PackKernel. With the same threshold these have to give the same spots as
+ * the 8-bit frame. The program returns 1 if any list differs.
+ */
+
+static const int PADDING = 64; // Bytes at the end of each row of the padded frames
+static const int OFFSET  = 4096; // Offset of the frame in the file descriptor
+
+// Creates a file descriptor with the padded frame at OFFSET, a dmabuf if possible
+static int createFrameFd(const std::vector<uint8_t> &padded, bool &isDmaBuf)
+{
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t size = ((OFFSET + padded.size() + pageSize-1)/pageSize)*pageSize;
+
+    int memfd = memfd_create("frame", MFD_ALLOW_SEALING);
+    if (memfd < 0 || ftruncate(memfd, size) != 0)
+        return -1;
+
+    uint8_t *data = (uint8_t *)mmap(NULL, size, PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (data == MAP_FAILED)
+        return -1;
+    memcpy(data + OFFSET, padded.data(), padded.size());
+    munmap(data, size);
+
+    isDmaBuf = false;
+    int device = open("/dev/udmabuf", O_RDWR);
+    if (device < 0)
+        return memfd;
+
+    // udmabuf needs a memfd which can not shrink
+    struct udmabuf_create create = {};
+    create.memfd  = memfd;
+    create.flags  = UDMABUF_FLAGS_CLOEXEC;
+    create.offset = 0;
+    create.size   = size;
+    int dmabuf = -1;
+    if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) == 0)
+        dmabuf = ioctl(device, UDMABUF_CREATE, &create);
+    close(device);
+    if (dmabuf < 0)
+        return memfd;
+
+    close(memfd);
+    isDmaBuf = true;
+    return dmabuf;
+}
+
+// Packs 12-bit pixels into MIPI RAW12 (2 pixels in 3 bytes)
+static void packRaw12(const std::vector<uint16_t> &pixels, std::vector<uint8_t> &packed)
+{
+    packed.resize(pixels.size()/2*3);
+    for (size_t i=0; i<pixels.size()/2; ++i)
+    {
+        uint16_t p0 = pixels[2*i];
+        uint16_t p1 = pixels[2*i+1];
+        packed[3*i]   = p0 >> 4;
+        packed[3*i+1] = p1 >> 4;
+        packed[3*i+2] = ((p1 & 0x0f) << 4) | (p0 & 0x0f);
+    }
+}
+
+static unsigned compareSpots(const char *name, const std::vector<StatsPhase::Spot> &reference,
+                             const std::vector<StatsPhase::Spot> &spots, float maxDiff)
+{
+    unsigned numDiffs = 0;
+    size_t numSpots = std::max(reference.size(), spots.size());
+    for (size_t i=0; i<numSpots; ++i)
+    {
+        bool isEqual = i < reference.size() && i < spots.size() &&
+                reference[i].area == spots[i].area &&
+                fabs(reference[i].x - spots[i].x) <= maxDiff &&
+                fabs(reference[i].y - spots[i].y) <= maxDiff;
+        if (!isEqual)
+            ++numDiffs;
+    }
+    printf("%-28s %4lu spots, %u differ\n", name, (unsigned long)spots.size(), numDiffs);
+    return numDiffs;
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    float maxDiff = (argc > 2) ? atof(argv[2]) : 0.01;
+
+    int width  = 512;
+    int height = 384;
+    std::vector<uint8_t> frame;
+    if (argc > 1)
+    {
+        // Use the first channel of the image as greyscale camera frame
+        CImg<unsigned char> image(argv[1]);
+        width  = image.width();
+        height = image.height();
+        frame.assign(image.data(), image.data() + (size_t)width*height);
+    }
+    else
+    {
+        StarField(width, height, 30).generate(frame);
+    }
+
+    int stride = width + PADDING;
+    std::vector<uint8_t> padded((size_t)stride*height, 0);
+    for (int j=0; j<height; ++j)
+        memcpy(&padded[(size_t)j*stride], &frame[(size_t)j*width], width);
+
+    bool isDmaBuf = false;
+    int fd = createFrameFd(padded, isDmaBuf);
+    if (fd < 0)
+    {
+        perror("Failed to create the file descriptor of the frame");
+        return 1;
+    }
+
+    Ogles gpu(width, height, Ogles::BACKEND_GPU);
+    Ogles cpu(width, height, Ogles::BACKEND_CPU);
+
+    std::vector<StatsPhase::Spot> tight  = gpu.processFrame(frame.data(), width, height);
+    std::vector<StatsPhase::Spot> strided = gpu.processFrame(IngestPhase::Frame(padded.data(), width, height, stride));
+    std::vector<StatsPhase::Spot> fromFd = gpu.processFrame(IngestPhase::Frame(fd, width, height, stride, OFFSET));
+    bool imported = gpu.mIngestPhase.mLastImported;
+    std::vector<StatsPhase::Spot> cpuSpots = cpu.processFrame(IngestPhase::Frame(fd, width, height, stride, OFFSET));
+
+    // 12-bit version of the frame, the default threshold 64.3/255 accepts the values >= 65
+    std::vector<uint16_t> frame12(frame.size());
+    for (size_t i=0; i<frame.size(); ++i)
+        frame12[i] = frame[i] << 4;
+
+    int stride16 = 2*width + PADDING;
+    std::vector<uint8_t> padded16((size_t)stride16*height, 0);
+    for (int j=0; j<height; ++j)
+        memcpy(&padded16[(size_t)j*stride16], &frame12[(size_t)j*width], 2*width);
+
+    bool isDmaBuf16 = false;
+    int fd16 = createFrameFd(padded16, isDmaBuf16);
+    if (fd16 < 0)
+    {
+        perror("Failed to create the file descriptor of the 16-bit frame");
+        return 1;
+    }
+
+    std::vector<uint8_t> raw12;
+    packRaw12(frame12, raw12);
+    std::vector<uint16_t> unpacked((size_t)width*height);
+    double unpackTime = getRealTime();
+    PackKernel::unpackRaw12(raw12.data(), PackKernel::raw12RowSize(width), unpacked.data(), width, width, height);
+    unpackTime = (getRealTime() - unpackTime)*1000;
+    unsigned numUnpackDiffs = 0;
+    for (size_t i=0; i<frame12.size(); ++i)
+        numUnpackDiffs += unpacked[i] != frame12[i];
+
+    Ogles gpu12(width, height, Ogles::BACKEND_GPU);
+    gpu12.mLabelPhase.mOrigBitDepth = 12;
+    gpu12.mLabelPhase.setThreshold(65 << 4);
+    std::vector<StatsPhase::Spot> deep = gpu12.processFrame(
+                IngestPhase::Frame((const uint8_t *)frame12.data(), width, height, 2*width, 12));
+    std::vector<StatsPhase::Spot> deepFd = gpu12.processFrame(IngestPhase::Frame(fd16, width, height, stride16, OFFSET, 12));
+    std::vector<StatsPhase::Spot> deepRaw = gpu12.processFrame(
+                IngestPhase::Frame((const uint8_t *)unpacked.data(), width, height, 2*width, 12));
+
+    cout << "Frame size: " << width << " x " << height << endl;
+    cout << "File descriptor: " << (isDmaBuf ? "udmabuf" : "memfd") << ", EGL dmabuf import "
+         << (gpu.mIngestPhase.supportsDmaBuf() ? "supported" : "not supported") << endl;
+
+    unsigned numDiffs = 0;
+    numDiffs += compareSpots("GPU pointer (reference)", tight, tight, 0);
+    numDiffs += compareSpots("GPU pointer with stride", tight, strided, 0);
+    numDiffs += compareSpots(imported ? "GPU fd (dmabuf import)" : "GPU fd (mapped upload)", tight, fromFd, 0);
+    numDiffs += compareSpots("CPU fd", tight, cpuSpots, maxDiff);
+    numDiffs += compareSpots("GPU 12-bit pointer", tight, deep, maxDiff);
+    numDiffs += compareSpots("GPU 12-bit fd (upload)", tight, deepFd, maxDiff);
+    numDiffs += compareSpots("GPU RAW12 unpacked", tight, deepRaw, maxDiff);
+
+    cout << "RAW12 unpack (" << PackKernel::isaName() << "): " << unpackTime << " ms, "
+         << numUnpackDiffs << " pixels differ" << endl;
+    numDiffs += numUnpackDiffs;
+
+    close(fd);
+    close(fd16);
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return numDiffs ? 1 : 0;
+}
@@ -142,6 +142,7 @@ int main()
     int height = labelPhase.mImage.height();
     labelPhase.mWidth  = width;
     labelPhase.mHeight = height;
+    labelPhase.mImage.channel(0);
     labelPhase.mImage.mirror("y");
     labelPhase.mImage.permute_axes("cxyz");
 
@@ -161,7 +162,7 @@ int main()
     labelPhase.setupGeometry();
     labelTime = labelPhase.run();
 
-    cout << "Label time: " << labelTime << endl;
+    cout << "Label time: " << labelTime << " (" << labelPhase.mNumPasses << " passes)" << endl;
 
 
 #ifdef _RPI
@@ -0,0 +1,118 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include "getTime.h"
+#include "ogles.h"
+#include "../starField.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Throughput of Ogles::processFramePipelined
+ *
+ * Usage: example_pipeline [number of frames] [client work per frame in ms]
+ *
+ * A sequence of generated star fields (512 x 384, the stars drift from frame
+ * to frame) is processed twice by the GPU backend, after each frame the
+ * client is busy for the given time (e.g. the star identification):
+ *   - with processFrame, i.e. GPU and client work one after the other
+ *   - with processFramePipelined, i.e. the GPU works on frame N while the
+ *     client works on the spots of frame N-1
+ * The spots of every frame have to be the same in both modes. The program
+ * returns 1 if any list differs.
+ */
+
+// Stands in for the work of the client on the spots of a frame
+static void clientWork(double ms)
+{
+    double endTime = getRealTime() + ms/1000;
+    while (getRealTime() < endTime)
+        ;
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    int numFrames   = (argc > 1) ? atoi(argv[1]) : 10;
+    double workTime = (argc > 2) ? atof(argv[2]) : 20;
+    if (numFrames < 1)
+        numFrames = 1;
+
+    const int width  = 512;
+    const int height = 384;
+    std::vector< std::vector<uint8_t> > frames(numFrames);
+    for (int i=0; i<numFrames; ++i)
+    {
+        // Drift of (1/4, 1/8) pixels per frame, the margin of 32 pixels leaves room for it
+        StarField field(width, height, 30);
+        field.mMargin = 16;
+        field.mAreaWidth  = width-16;
+        field.mAreaHeight = height-16;
+        field.mOffsetX = i/4.0f;
+        field.mOffsetY = i/8.0f;
+        field.generate(frames[i]);
+    }
+
+    // One frame to create the context and all textures, not timed
+    Ogles sequential(width, height, Ogles::BACKEND_GPU);
+    Ogles pipelined(width, height, Ogles::BACKEND_GPU);
+    sequential.processFrame(frames[0].data(), width, height);
+    pipelined.processFrame(frames[0].data(), width, height);
+
+    std::vector< std::vector<StatsPhase::Spot> > reference(numFrames);
+    double startTime = getRealTime();
+    for (int i=0; i<numFrames; ++i)
+    {
+        reference[i] = sequential.processFrame(frames[i].data(), width, height);
+        clientWork(workTime);
+    }
+    double sequentialTime = (getRealTime()-startTime)*1000;
+
+    std::vector< std::vector<StatsPhase::Spot> > results(numFrames);
+    startTime = getRealTime();
+    for (int i=0; i<numFrames; ++i)
+    {
+        IngestPhase::Frame frame(frames[i].data(), width, height, width);
+        const std::vector<StatsPhase::Spot> &spots = pipelined.processFramePipelined(frame);
+        if (i > 0)
+        {
+            results[i-1] = spots;
+            clientWork(workTime);
+        }
+    }
+    results[numFrames-1] = pipelined.flushPipeline();
+    clientWork(workTime);
+    double pipelinedTime = (getRealTime()-startTime)*1000;
+
+    unsigned numDiffs = 0;
+    for (int i=0; i<numFrames; ++i)
+    {
+        if (!isEqual(reference[i], results[i]))
+        {
+            printf("Frame %d: %lu spots sequential, %lu spots pipelined\n", i,
+                   (unsigned long)reference[i].size(), (unsigned long)results[i].size());
+            ++numDiffs;
+        }
+    }
+
+    printf("\n%d frames, %.1f ms client work per frame\n", numFrames, workTime);
+    printf("%-12s %8.2f ms per frame\n", "sequential", sequentialTime/numFrames);
+    printf("%-12s %8.2f ms per frame\n", "pipelined", pipelinedTime/numFrames);
+    printf("%d frames differ\n", numDiffs);
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return numDiffs ? 1 : 0;
+}
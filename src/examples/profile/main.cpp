@@ -0,0 +1,97 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <vector>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include "ogles.h"
+#include "../starField.h"
+#include "profiler.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Per-pass timing of the GPU backend with the Profiler
+ *
+ * Usage: example_profile [number of frames] [JSON file]
+ *
+ * Processes a generated star field (512 x 384) several times, first with
+ * profiling disabled (no scope may be recorded), then enabled. The aggregated
+ * times of all scopes are printed as CSV and written as JSON to the file
+ * (default profile.json). The program returns 1 if the disabled run recorded
+ * a scope or if a pass is missing in the enabled run.
+ */
+
+static bool hasScope(const std::vector<Profiler::Summary> &entries, const char *name, size_t count)
+{
+    for (size_t i=0; i<entries.size(); ++i)
+    {
+        if (entries[i].name == name)
+            return entries[i].count == count;
+    }
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    int numFrames = (argc > 1) ? atoi(argv[1]) : 10;
+    const char *jsonFile = (argc > 2) ? argv[2] : "profile.json";
+    if (numFrames < 1)
+        numFrames = 1;
+
+    const int width  = 512;
+    const int height = 384;
+    std::vector<uint8_t> frame;
+    StarField(width, height, 30).generate(frame);
+
+    Ogles ogles(width, height, Ogles::BACKEND_GPU);
+    ogles.mLabelPhase.mTileSize = 64;
+
+    Profiler::setEnabled(false);
+    ogles.processFrame(frame.data(), width, height);
+    unsigned numErrors = 0;
+    if (!Profiler::summary().empty())
+    {
+        printf("Scopes were recorded with disabled profiling\n");
+        ++numErrors;
+    }
+
+    Profiler::setEnabled(true);
+    for (int i=0; i<numFrames; ++i)
+        ogles.processFrame(frame.data(), width, height);
+    Profiler::setEnabled(false);
+
+    std::vector<Profiler::Summary> entries = Profiler::summary();
+    const char *expected[] = { "regions", "ingest", "label", "label.init", "label.pass[1]", "label.merge",
+                               "reduction", "reduction.root", "reduction.horizontal", "reduction.vertical",
+                               "stats", "stats.quadrant[0].fill", "stats.quadrant[3].centroid", "stats.readback" };
+    for (size_t i=0; i<sizeof(expected)/sizeof(expected[0]); ++i)
+    {
+        if (!hasScope(entries, expected[i], numFrames))
+        {
+            printf("Scope %s is missing or has not %d samples\n", expected[i], numFrames);
+            ++numErrors;
+        }
+    }
+
+    cout << endl;
+    Profiler::writeCsv(cout);
+    std::ofstream json(jsonFile);
+    Profiler::writeJson(json);
+    cout << endl << "Written to " << jsonFile << endl;
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return numErrors ? 1 : 0;
+}
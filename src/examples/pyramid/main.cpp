@@ -0,0 +1,145 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "getTime.h"
+#include "log.h"
+#include "ogles.h"
+#include "../starField.h"
+#include "thresholdKernel.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Pre-passes which find the occupied regions of a frame
+ *
+ * Usage: example_pyramid [number of GPU frames] [repetitions of the CPU kernels]
+ *
+ * Generates a star field (512 x 384) with some hot pixels and compares the
+ * three ways to find the occupied tiles of Ogles::mRegions:
+ *   - mask:     foreground mask with the hot pixel rule (ThresholdKernel::computeMask)
+ *   - tile max: maximum of each tile on the CPU (ThresholdKernel::computeTileMax)
+ *   - pyramid:  max-pool pyramid on the GPU (PyramidPhase)
+ * The CPU kernels are timed on their own, the GPU frames include all phases.
+ * The program returns 1 if the tiles of the pyramid differ from the tile
+ * maxima, if a tile of the mask is missing in them or if the spots differ.
+ */
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    int numFrames = (argc > 1) ? atoi(argv[1]) : 2;
+    int numRepetitions = (argc > 2) ? atoi(argv[2]) : 200;
+    if (numRepetitions < 1)
+        numRepetitions = 1;
+
+    const int width  = 512;
+    const int height = 384;
+    Log::setLevel(LOG_LEVEL_WARN);
+
+    std::vector<uint8_t> frame;
+    // Hot pixels, only the tile maxima see them
+    StarField field(width, height, 30);
+    field.mMargin = 16;
+    field.mNumHotPixels = 5;
+    field.generate(frame);
+    unsigned numErrors = 0;
+
+    // OpenGL orientation: bottom row first
+    const uint8_t *bottomRow = frame.data() + (size_t)(height-1)*width;
+    int thresholdValue = ThresholdKernel::thresholdValue(64.3 / 255.0);
+
+    ///---------- CPU KERNELS --------------------
+
+    RegionSet maskRegions, tileRegions;
+    std::vector<uint64_t> mask((size_t)ThresholdKernel::wordsPerRow(width)*height);
+    double startTime = getRealTime();
+    for (int i=0; i<numRepetitions; ++i)
+    {
+        ThresholdKernel::computeMask(bottomRow, -width, 1, width, height, 0, height, thresholdValue, mask.data());
+        maskRegions.build(mask.data(), width, height);
+    }
+    double maskTime = (getRealTime()-startTime)*1000/numRepetitions;
+
+    const int tileSize = tileRegions.mTileSize;
+    const int tilesX = (width  + tileSize - 1) / tileSize;
+    const int tilesY = (height + tileSize - 1) / tileSize;
+    std::vector<uint8_t> tileMax((size_t)tilesX*tilesY), tiles(tileMax.size());
+    startTime = getRealTime();
+    for (int i=0; i<numRepetitions; ++i)
+    {
+        ThresholdKernel::computeTileMax(bottomRow, -width, 1, width, height, tileSize, tileMax.data());
+        for (size_t t=0; t<tileMax.size(); ++t)
+            tiles[t] = tileMax[t] >= thresholdValue;
+        tileRegions.buildFromTiles(tiles.data(), width, height);
+    }
+    double tileMaxTime = (getRealTime()-startTime)*1000/numRepetitions;
+
+    printf("CPU (%s): mask %.3f ms (%lu boxes, %.1f%%), tile max %.3f ms (%lu boxes, %.1f%%)\n",
+           ThresholdKernel::isaName(),
+           maskTime, (unsigned long)maskRegions.boxes().size(), maskRegions.coverage()*100,
+           tileMaxTime, (unsigned long)tileRegions.boxes().size(), tileRegions.coverage()*100);
+
+    // Every tile with foreground has to be found by the tile maxima
+    for (int y=0; y<height; ++y)
+    {
+        for (int x=0; x<width; ++x)
+        {
+            bool isForeground = (mask[(size_t)y*ThresholdKernel::wordsPerRow(width) + x/64] >> (x%64)) & 1;
+            if (isForeground && !tiles[(size_t)(y/tileSize)*tilesX + x/tileSize])
+            {
+                printf("Foreground pixel (%d, %d) is not in an occupied tile\n", x, y);
+                ++numErrors;
+            }
+        }
+    }
+
+    ///---------- ALL PHASES WITH THE THREE PRE-PASSES --------------------
+
+    const char *names[3] = { "mask", "tile max", "pyramid" };
+    Ogles::RegionDetection detections[3] = { Ogles::REGIONS_MASK, Ogles::REGIONS_TILE_MAX, Ogles::REGIONS_PYRAMID_GPU };
+    std::vector<StatsPhase::Spot> reference;
+    for (int d=0; d<3 && numFrames>0; ++d)
+    {
+        Ogles ogles(width, height, Ogles::BACKEND_GPU);
+        ogles.mRegionDetection = detections[d];
+        std::vector<StatsPhase::Spot> spots = ogles.processFrame(frame.data(), width, height);
+
+        startTime = getRealTime();
+        for (int i=0; i<numFrames; ++i)
+            spots = ogles.processFrame(frame.data(), width, height);
+        double frameTime = (getRealTime()-startTime)*1000/numFrames;
+
+        printf("GPU %-8s: %.1f ms per frame, %lu boxes (%.1f%%), %lu spots\n", names[d], frameTime,
+               (unsigned long)ogles.mRegions.boxes().size(), ogles.mRegions.coverage()*100,
+               (unsigned long)spots.size());
+
+        if (d == 0)
+            reference = spots;
+        else if (!isEqual(spots, reference))
+        {
+            printf("Spots of %s differ from those of the mask\n", names[d]);
+            ++numErrors;
+        }
+
+        if (detections[d] == Ogles::REGIONS_PYRAMID_GPU && ogles.mPyramidPhase.mTiles != tiles)
+        {
+            printf("Tiles of the pyramid differ from the tile maxima\n");
+            ++numErrors;
+        }
+    }
+
+    printf("%u errors\n", numErrors);
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return numErrors ? 1 : 0;
+}
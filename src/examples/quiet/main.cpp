@@ -0,0 +1,92 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include "getTime.h"
+#include "log.h"
+#include "ogles.h"
+#include "../starField.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Hot path of a build with LOG_MAX_LEVEL=LOG_LEVEL_WARN, i.e. a release build
+ *
+ * Usage: example_quiet [number of frames]
+ *
+ * Processes a generated star field (512 x 384) with the GPU backend, in the
+ * pipelined mode and with the CPU backend. The runtime level is set to
+ * LOG_LEVEL_TRACE, which must not bring back anything that was compiled out.
+ * The program returns 1 if a message was written or a debug readback was done
+ * while processing the frames, or if a backend misses the stars.
+ */
+
+// Checks the counters after the frames of one mode and resets them
+static unsigned checkQuiet(const char *mode, size_t numSpots, double time, int numFrames)
+{
+    unsigned numErrors = 0;
+    printf("%-10s %8.2f ms per frame, %3lu spots, %lu messages, %lu debug readbacks\n", mode, time/numFrames,
+           (unsigned long)numSpots, (unsigned long)Log::numMessages(), (unsigned long)Log::numDebugReadbacks());
+    if (Log::numMessages() != 0 || Log::numDebugReadbacks() != 0 || numSpots == 0)
+        ++numErrors;
+    Log::resetCounters();
+    return numErrors;
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    static_assert(LOG_MAX_LEVEL == LOG_LEVEL_WARN, "example_quiet has to be compiled with LOG_MAX_LEVEL=LOG_LEVEL_WARN");
+
+    int numFrames = (argc > 1) ? atoi(argv[1]) : 10;
+    if (numFrames < 1)
+        numFrames = 1;
+
+    const int width  = 512;
+    const int height = 384;
+    std::vector<uint8_t> frame;
+    StarField(width, height, 30).generate(frame);
+
+    Log::setLevel(LOG_LEVEL_TRACE);
+
+    // One frame to create the context and all textures, not checked
+    Ogles gpu(width, height, Ogles::BACKEND_GPU);
+    Ogles cpu(width, height, Ogles::BACKEND_CPU);
+    gpu.processFrame(frame.data(), width, height);
+    cpu.processFrame(frame.data(), width, height);
+    Log::resetCounters();
+
+    unsigned numErrors = 0;
+    size_t numSpots = 0;
+    double startTime = getRealTime();
+    for (int i=0; i<numFrames; ++i)
+        numSpots = gpu.processFrame(frame.data(), width, height).size();
+    numErrors += checkQuiet("gpu", numSpots, (getRealTime()-startTime)*1000, numFrames);
+
+    startTime = getRealTime();
+    IngestPhase::Frame ingestFrame(frame.data(), width, height, width);
+    for (int i=0; i<numFrames; ++i)
+        gpu.processFramePipelined(ingestFrame);
+    numSpots = gpu.flushPipeline().size();
+    numErrors += checkQuiet("pipelined", numSpots, (getRealTime()-startTime)*1000, numFrames);
+
+    startTime = getRealTime();
+    for (int i=0; i<numFrames; ++i)
+        numSpots = cpu.processFrame(frame.data(), width, height).size();
+    numErrors += checkQuiet("cpu", numSpots, (getRealTime()-startTime)*1000, numFrames);
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return numErrors ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "log.h"
+#include "ogles.h"
+#include "../starField.h"
+#include "profiler.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Adaptive number of reduction passes against the full number
+ *
+ * Usage: example_reductionPasses [number of frames]
+ *
+ * Processes generated star fields (512 x 384) with and without
+ * ReductionPhase::mAdaptivePasses: stars all over the frame, stars in the
+ * bottom left quarter and a few stars only, each with and without regions.
+ * The number of reduction passes and the time of the "reduction" scope are
+ * printed for both. The program returns 1 if the spots differ.
+ */
+
+static double reductionTime()
+{
+    std::vector<Profiler::Summary> entries = Profiler::summary();
+    for (size_t i=0; i<entries.size(); ++i)
+    {
+        if (entries[i].name == "reduction")
+            return entries[i].mean;
+    }
+    return 0.0;
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    int numFrames = (argc > 1) ? atoi(argv[1]) : 2;
+    if (numFrames < 1)
+        numFrames = 1;
+
+    const int width  = 512;
+    const int height = 384;
+    Log::setLevel(LOG_LEVEL_WARN);
+
+    struct Case
+    {
+        const char *name;
+        int areaWidth;
+        int areaHeight;
+        int numStars;
+        bool useRegions;
+    } cases[] = {
+        { "full frame, regions",    width,   height,   40, true  },
+        { "full frame",             width,   height,   40, false },
+        { "quarter, regions",       width/2, height/2, 20, true  },
+        { "quarter",                width/2, height/2, 20, false },
+        { "few stars, regions",     width/4, height/4,  3, true  }
+    };
+
+    unsigned numErrors = 0;
+    for (size_t c=0; c<sizeof(cases)/sizeof(cases[0]); ++c)
+    {
+        std::vector<uint8_t> frame;
+        StarField field(width, height, cases[c].numStars);
+        field.mAreaWidth  = cases[c].areaWidth;
+        field.mAreaHeight = cases[c].areaHeight;
+        field.generate(frame);
+
+        std::vector<StatsPhase::Spot> spots[2];
+        int numPasses[2];
+        double times[2];
+        for (int a=0; a<2; ++a)
+        {
+            Ogles ogles(width, height, Ogles::BACKEND_GPU);
+            ogles.mUseRegions = cases[c].useRegions;
+            ogles.mReductionPhase.mAdaptivePasses = a == 1;
+            ogles.processFrame(frame.data(), width, height);
+
+            Profiler::reset();
+            Profiler::setEnabled(true);
+            for (int i=0; i<numFrames; ++i)
+                spots[a] = ogles.processFrame(frame.data(), width, height);
+            Profiler::setEnabled(false);
+            numPasses[a] = ogles.mReductionPhase.mNumPasses;
+            times[a] = reductionTime();
+        }
+
+        bool equal = isEqual(spots[0], spots[1]);
+        printf("%-20s: %2lu spots, passes %d -> %d, reduction %.1f ms -> %.1f ms%s\n", cases[c].name,
+               (unsigned long)spots[0].size(), numPasses[0], numPasses[1], times[0], times[1],
+               equal ? "" : ", spots differ");
+        numErrors += !equal;
+    }
+
+    printf("%u errors\n", numErrors);
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return numErrors ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <vector>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include "getTime.h"
+#include "log.h"
+#include "ogles.h"
+#include "../starField.h"
+#include "spotFile.h"
+#include "spotFileWriter.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Binary spot file with SpotFileWriter and SpotFileReader
+ *
+ * Usage: example_spotFile [number of frames] [spot file]
+ *
+ * Extracts the spots of generated star fields (512 x 384, the stars drift
+ * from frame to frame) with the CPU backend and writes them into the spot
+ * file (default spots.bin), the first half in a new file, the second half
+ * appended to it. The file is read back by the memory-mapped reader, once
+ * with its index and once cut off like an interrupted capture, which has
+ * to end with the last complete frame, and once with half of its index
+ * like a failed close. The program returns 1 if a frame is not read back
+ * as written.
+ */
+
+static uint64_t timestamp(int frameIndex)
+{
+    // 20 frames per second
+    return 1500000000000000000ull + (uint64_t)frameIndex*50000000;
+}
+
+// Compares the frames of the file with the spots which were written
+static unsigned checkFrames(const SpotFileReader &reader, const std::vector< std::vector<StatsPhase::Spot> > &spots,
+                            size_t numFrames)
+{
+    unsigned numDiffs = 0;
+    if (reader.numFrames() != numFrames)
+    {
+        printf("%lu frames instead of %lu\n", (unsigned long)reader.numFrames(), (unsigned long)numFrames);
+        return 1;
+    }
+    for (size_t i=0; i<numFrames; ++i)
+    {
+        SpotFileReader::Frame frame = reader.frame(i);
+        bool isEqual = frame.timestamp == timestamp(i) && frame.frameNumber == i && frame.size() == spots[i].size();
+        for (size_t n=0; isEqual && n<frame.size(); ++n)
+        {
+            isEqual = frame[n].x == spots[i][n].x && frame[n].y == spots[i][n].y &&
+                      frame[n].area == spots[i][n].area && frame[n].luminance == spots[i][n].luminance;
+        }
+        if (!isEqual)
+        {
+            printf("Frame %lu differs\n", (unsigned long)i);
+            ++numDiffs;
+        }
+    }
+    return numDiffs;
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    int numFrames = (argc > 1) ? atoi(argv[1]) : 200;
+    std::string filename = (argc > 2) ? argv[2] : "spots.bin";
+    if (numFrames < 2)
+        numFrames = 2;
+
+    const int width  = 512;
+    const int height = 384;
+    Log::setLevel(LOG_LEVEL_WARN);
+    Ogles ogles(width, height, Ogles::BACKEND_CPU);
+    std::vector<uint8_t> frame;
+    std::vector< std::vector<StatsPhase::Spot> > spots(numFrames);
+    size_t numSpots = 0;
+    for (int i=0; i<numFrames; ++i)
+    {
+        // Drift of (1/4, 1/8) pixels per frame (restarting every 64 frames), the margin of 32 pixels leaves room for it
+        StarField field(width, height, 30);
+        field.mMargin = 16;
+        field.mAreaWidth  = width-16;
+        field.mAreaHeight = height-16;
+        field.mOffsetX = (i % 64)/4.0f;
+        field.mOffsetY = (i % 64)/8.0f;
+        field.generate(frame);
+        spots[i] = ogles.processFrame(frame.data(), width, height);
+        numSpots += spots[i].size();
+    }
+
+    // First half into a new file, second half appended
+    double startTime = getRealTime();
+    {
+        SpotFileWriter writer(filename);
+        for (int i=0; i<numFrames/2; ++i)
+            writer.writeFrame(timestamp(i), i, spots[i]);
+    }
+    {
+        SpotFileWriter writer(filename, true);
+        for (int i=numFrames/2; i<numFrames; ++i)
+            writer.writeFrame(timestamp(i), i, spots[i]);
+    }
+    double writeTime = (getRealTime()-startTime)*1000;
+
+    unsigned numErrors = 0;
+    startTime = getRealTime();
+    SpotFileReader reader(filename);
+    double openTime = (getRealTime()-startTime)*1000;
+    if (!reader.isOpen() || !reader.hasIndex())
+    {
+        printf("%s is not opened with its index\n", filename.c_str());
+        ++numErrors;
+    }
+    numErrors += checkFrames(reader, spots, numFrames);
+
+    // All spots through the mapping
+    startTime = getRealTime();
+    double sumX = 0;
+    for (size_t i=0; i<reader.numFrames(); ++i)
+    {
+        SpotFileReader::Frame frame = reader.frame(i);
+        for (const SpotRecord *spot=frame.begin(); spot!=frame.end(); ++spot)
+            sumX += spot->x;
+    }
+    double readTime = (getRealTime()-startTime)*1000;
+
+    // Interrupted capture: no index and half of the last frame
+    size_t fileSize = reader.dataEnd() - (spots[numFrames-1].size()/2 + 1)*sizeof(SpotRecord);
+    std::string cutFilename = filename + ".cut";
+    {
+        std::ifstream in(filename.c_str(), std::ios::binary);
+        std::vector<char> bytes(fileSize);
+        in.read(bytes.data(), bytes.size());
+        std::ofstream(cutFilename.c_str(), std::ios::binary).write(bytes.data(), bytes.size());
+    }
+    SpotFileReader cutReader(cutFilename);
+    if (!cutReader.isOpen() || cutReader.hasIndex())
+    {
+        printf("%s is not opened without index\n", cutFilename.c_str());
+        ++numErrors;
+    }
+    numErrors += checkFrames(cutReader, spots, numFrames-1);
+    cutReader.close();
+
+    // Appending to the interrupted capture continues behind its last complete frame
+    {
+        SpotFileWriter writer(cutFilename, true);
+        writer.writeFrame(timestamp(numFrames-1), numFrames-1, spots[numFrames-1]);
+    }
+    cutReader.open(cutFilename);
+    if (!cutReader.hasIndex())
+        ++numErrors;
+    numErrors += checkFrames(cutReader, spots, numFrames);
+    cutReader.close();
+
+    // Failed close: half of the index and no trailer, the scan has to stop at the index
+    fileSize = reader.dataEnd() + numFrames/2*sizeof(uint64_t);
+    {
+        std::ifstream in(filename.c_str(), std::ios::binary);
+        std::vector<char> bytes(fileSize);
+        in.read(bytes.data(), bytes.size());
+        std::ofstream(cutFilename.c_str(), std::ios::binary).write(bytes.data(), bytes.size());
+    }
+    cutReader.open(cutFilename);
+    if (!cutReader.isOpen() || cutReader.hasIndex())
+        ++numErrors;
+    numErrors += checkFrames(cutReader, spots, numFrames);
+
+    printf("%d frames, %lu spots, %lu bytes\n", numFrames, (unsigned long)numSpots, (unsigned long)reader.dataEnd());
+    printf("write %.3f ms, open %.3f ms, read all spots %.3f ms (sum x %.1f)\n", writeTime, openTime, readTime, sumX);
+    printf("%u errors\n", numErrors);
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return numErrors ? 1 : 0;
+}
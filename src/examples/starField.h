@@ -0,0 +1,204 @@
+#ifndef STARFIELD_H
+#define STARFIELD_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "statsPhase.h"
+
+/*!
+ \brief Synthetic star fields and spot comparisons shared by the examples
+
+ Only included by the examples, each example is its own executable.
+*/
+
+/*!
+ \brief Generator of star fields with Gaussian PSFs at known sub-pixel positions
+
+ The stars lie in the area of \ref mAreaWidth x \ref mAreaHeight pixels at
+ the bottom left of the frame, at least \ref mMargin pixels from its edges.
+ Their positions are relative to the pixel centers and y counts from the
+ bottom row like the spots (OpenGL orientation), the generated frame starts
+ with the top row. The same parameters give the same frame, rand() is seeded
+ with \ref mSeed.
+*/
+struct StarField
+{
+    /*!
+     \brief Position of a generated star
+    */
+    struct Star
+    {
+        float x;
+        float y;
+    };
+
+    StarField(int width, int height, int numStars)
+        : mWidth(width), mHeight(height), mNumStars(numStars), mSeed(1),
+          mAreaWidth(width), mAreaHeight(height), mMargin(8), mOffsetX(0.0f), mOffsetY(0.0f),
+          mMinDistance(0.0f), mPeak(120.0f), mPeakRange(120), mSigma2(1.0f), mSigma2Range(0.0f),
+          mBackground(10.0f), mNoise(0.0f), mNumHotPixels(0)
+    {
+    }
+
+    /*!
+     \brief Renders the stars into an 8-bit frame
+     \return Positions of the stars
+    */
+    std::vector<Star> generate(std::vector<uint8_t> &frame) const
+    {
+        std::vector<float> image;
+        std::vector<Star> stars = render(image);
+        frame.resize(image.size());
+        for (size_t i=0; i<image.size(); ++i)
+            frame[i] = (uint8_t)quantize(image[i], 255.0f);
+        addHotPixels(frame, (uint8_t)255);
+        return stars;
+    }
+
+    /*!
+     \brief Renders the stars into a frame of bitDepth bits
+
+     All intensities are given for 8 bits and scaled to the bit depth.
+     \return Positions of the stars
+    */
+    std::vector<Star> generate(std::vector<uint16_t> &frame, int bitDepth) const
+    {
+        const float maxValue = (float)((1 << bitDepth) - 1);
+        std::vector<float> image;
+        std::vector<Star> stars = render(image);
+        frame.resize(image.size());
+        for (size_t i=0; i<image.size(); ++i)
+            frame[i] = (uint16_t)quantize(image[i]*maxValue/255.0f, maxValue);
+        addHotPixels(frame, (uint16_t)maxValue);
+        return stars;
+    }
+
+    int mWidth;
+    int mHeight;
+    int mNumStars;          /*!< Number of stars, less if \ref mMinDistance can't be kept */
+    unsigned mSeed;         /*!< Seed of rand() */
+    int mAreaWidth;         /*!< Width of the area of the stars, default: frame width */
+    int mAreaHeight;        /*!< Height of the area of the stars, default: frame height */
+    int mMargin;            /*!< Minimum distance of the stars to the edges of the area */
+    float mOffsetX;         /*!< Shift of all stars, e.g. the drift of a frame sequence */
+    float mOffsetY;
+    float mMinDistance;     /*!< Minimum distance of the stars in x or y, 0 if they may overlap */
+    float mPeak;            /*!< Peaks are random in [mPeak, mPeak+mPeakRange) */
+    int mPeakRange;
+    float mSigma2;          /*!< Variances of the PSFs are random in [mSigma2, mSigma2+mSigma2Range) */
+    float mSigma2Range;
+    float mBackground;
+    float mNoise;           /*!< Standard deviation of the background noise, 0 for none */
+    int mNumHotPixels;      /*!< Saturated single pixels */
+
+private:
+    // Normally distributed random number (Box-Muller)
+    static float gaussNoise()
+    {
+        float u1 = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+        float u2 = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+        return sqrtf(-2.0f*logf(u1)) * cosf(6.2831853f*u2);
+    }
+
+    float quantize(float value, float maxValue) const
+    {
+        if (mNoise > 0.0f)
+            value += mNoise*gaussNoise();
+        return std::max(0.0f, std::min(floorf(value+0.5f), maxValue));
+    }
+
+    std::vector<Star> render(std::vector<float> &image) const
+    {
+        image.assign((size_t)mWidth*mHeight, mBackground);
+        std::vector<Star> stars;
+        srand(mSeed);
+
+        // 3.5 sigma of the widest PSF
+        const int radius = (int)ceilf(3.5f*sqrtf(mSigma2 + mSigma2Range));
+        for (int tries=0; (int)stars.size() < mNumStars && tries < 100*mNumStars; ++tries)
+        {
+            Star star;
+            star.x = mMargin + rand() % (mAreaWidth-2*mMargin) + (rand() % 1000)/1000.0f + mOffsetX;
+            star.y = mMargin + rand() % (mAreaHeight-2*mMargin) + (rand() % 1000)/1000.0f + mOffsetY;
+            bool isFree = true;
+            for (size_t i=0; i<stars.size() && isFree && mMinDistance > 0.0f; ++i)
+                isFree = fabsf(stars[i].x - star.x) > mMinDistance || fabsf(stars[i].y - star.y) > mMinDistance;
+            if (!isFree)
+                continue;
+            stars.push_back(star);
+
+            float peak = mPeak + rand() % mPeakRange;
+            float sigma2 = mSigma2 + mSigma2Range*(rand() % 100)/100.0f;
+            for (int y=std::max((int)star.y-radius, 0); y<=std::min((int)star.y+radius, mHeight-1); ++y)
+            {
+                for (int x=std::max((int)star.x-radius, 0); x<=std::min((int)star.x+radius, mWidth-1); ++x)
+                {
+                    float r2 = (x-star.x)*(x-star.x) + (y-star.y)*(y-star.y);
+                    image[(size_t)(mHeight-1-y)*mWidth+x] += peak*expf(-r2/(2*sigma2));
+                }
+            }
+        }
+        return stars;
+    }
+
+    template<typename T>
+    void addHotPixels(std::vector<T> &frame, T maxValue) const
+    {
+        for (int h=0; h<mNumHotPixels; ++h)
+            frame[(size_t)(rand() % mHeight)*mWidth + rand() % mWidth] = maxValue;
+    }
+};
+
+/*!
+ \brief Compares two spots exactly
+*/
+inline bool isEqual(const StatsPhase::Spot &a, const StatsPhase::Spot &b)
+{
+    return a.x == b.x && a.y == b.y && a.area == b.area && a.luminance == b.luminance;
+}
+
+/*!
+ \brief Compares two lists of spots exactly, including their order
+*/
+inline bool isEqual(const std::vector<StatsPhase::Spot> &a, const std::vector<StatsPhase::Spot> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i=0; i<a.size(); ++i)
+    {
+        if (!isEqual(a[i], b[i]))
+            return false;
+    }
+    return true;
+}
+
+/*!
+ \brief Number of spots of the reference which are not in spots, in any order
+
+ \param luminanceScale Factor between the luminances of spots and reference,
+                       e.g. 257 for a 16-bit version of an 8-bit frame
+ \param maxDiff Tolerance of the positions
+ \return Number of missing spots, plus 1 if the numbers of spots differ
+*/
+inline unsigned countMissing(const std::vector<StatsPhase::Spot> &reference, const std::vector<StatsPhase::Spot> &spots,
+                             unsigned luminanceScale = 1, float maxDiff = 0.0f)
+{
+    unsigned numMissing = 0;
+    for (size_t i=0; i<reference.size(); ++i)
+    {
+        bool found = false;
+        for (size_t j=0; j<spots.size() && !found; ++j)
+        {
+            found = spots[j].area == reference[i].area && spots[j].luminance == luminanceScale*reference[i].luminance
+                    && fabsf(spots[j].x - reference[i].x) <= maxDiff && fabsf(spots[j].y - reference[i].y) <= maxDiff;
+        }
+        numMissing += !found;
+    }
+    return numMissing + (reference.size() != spots.size());
+}
+
+#endif // STARFIELD_H
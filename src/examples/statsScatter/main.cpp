@@ -0,0 +1,172 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "log.h"
+#include "ogles.h"
+#include "../starField.h"
+#include "profiler.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Scatter engine of the stats phase against the quadrant sweep
+ *
+ * Usage: example_statsScatter [number of frames]
+ *
+ * Processes generated star fields (512 x 384) with both engines of
+ * StatsPhase: 8 bits with and without regions, and 12 bits. The time of the
+ * "stats" scope is printed for both. The spots of the scatter engine have to
+ * be identical to those of the CPU backend (8 bits), the quadrants may only
+ * miss pixels of large spots. The program returns 1 otherwise. Without
+ * float render targets the scatter engine is not available and nothing is
+ * compared.
+ */
+
+static double statsTime()
+{
+    std::vector<Profiler::Summary> entries = Profiler::summary();
+    for (size_t i=0; i<entries.size(); ++i)
+    {
+        if (entries[i].name == "stats")
+            return entries[i].mean;
+    }
+    return 0.0;
+}
+
+/*
+ * The quadrants only see the pixels within 2^mNumFillIterations of the root
+ * pixel, so they may miss pixels of large spots but never add any. A spot of
+ * the quadrants has to be identical to a spot of the scatter engine or has
+ * to have a smaller area than the spot at its position. The scatter engine
+ * may find additional spots which the quadrants dropped because of missed
+ * pixels.
+ */
+static unsigned compareQuadrants(const std::vector<StatsPhase::Spot> &quadrants, const std::vector<StatsPhase::Spot> &scatter,
+                                 unsigned &numIdentical)
+{
+    unsigned numErrors = 0;
+    numIdentical = 0;
+    for (size_t i=0; i<quadrants.size(); ++i)
+    {
+        const StatsPhase::Spot *nearest = NULL;
+        float nearestDist2 = 1.0f;
+        for (size_t j=0; j<scatter.size(); ++j)
+        {
+            float dx = scatter[j].x - quadrants[i].x;
+            float dy = scatter[j].y - quadrants[i].y;
+            if (dx*dx + dy*dy < nearestDist2)
+            {
+                nearest = &scatter[j];
+                nearestDist2 = dx*dx + dy*dy;
+            }
+        }
+
+        if (nearest != NULL && isEqual(*nearest, quadrants[i]))
+        {
+            ++numIdentical;
+        }
+        else if (nearest == NULL || nearest->area <= quadrants[i].area)
+        {
+            printf("  spot (%.3f, %.3f) area %u luminance %u of the quadrants differs\n",
+                   quadrants[i].x, quadrants[i].y, quadrants[i].area, quadrants[i].luminance);
+            ++numErrors;
+        }
+    }
+    return numErrors;
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    int numFrames = (argc > 1) ? atoi(argv[1]) : 2;
+    if (numFrames < 1)
+        numFrames = 1;
+
+    const int width  = 512;
+    const int height = 384;
+    Log::setLevel(LOG_LEVEL_WARN);
+
+    struct Case
+    {
+        const char *name;
+        int bitDepth;
+        bool useRegions;
+    } cases[] = {
+        { "8 bit, regions",    8, true  },
+        { "8 bit, full frame", 8, false },
+        { "12 bit, regions",  12, true  }
+    };
+
+    unsigned numErrors = 0;
+    for (size_t c=0; c<sizeof(cases)/sizeof(cases[0]); ++c)
+    {
+        std::vector<uint16_t> frame16;
+        StarField field(width, height, 40);
+        field.mSigma2Range = 2.0f;
+        field.generate(frame16, cases[c].bitDepth);
+        std::vector<uint8_t> frame8(frame16.begin(), frame16.end());
+        IngestPhase::Frame frame = cases[c].bitDepth > 8
+                ? IngestPhase::Frame((const uint8_t *)frame16.data(), width, height, 2*width, cases[c].bitDepth)
+                : IngestPhase::Frame(frame8.data(), width, height, width);
+
+        std::vector<StatsPhase::Spot> spots[2];
+        double times[2];
+        bool hasScatter = true;
+        for (int e=0; e<2; ++e)
+        {
+            Ogles ogles(width, height, Ogles::BACKEND_GPU);
+            ogles.mUseRegions = cases[c].useRegions;
+            ogles.mStatsPhase.mEngine = e == 0 ? StatsPhase::ENGINE_QUADRANTS : StatsPhase::ENGINE_SCATTER;
+            if (cases[c].bitDepth > 8)
+            {
+                ogles.mLabelPhase.mOrigBitDepth = cases[c].bitDepth;
+                ogles.mLabelPhase.setThreshold(65 << (cases[c].bitDepth-8));
+            }
+            ogles.processFrame(frame);
+            hasScatter = ogles.mStatsPhase.hasScatter();
+
+            Profiler::reset();
+            Profiler::setEnabled(true);
+            for (int i=0; i<numFrames; ++i)
+                spots[e] = ogles.processFrame(frame);
+            Profiler::setEnabled(false);
+            times[e] = statsTime();
+        }
+
+        if (!hasScatter)
+        {
+            printf("Scatter engine is not supported by this context\n");
+            break;
+        }
+
+        unsigned numIdentical = 0;
+        numErrors += compareQuadrants(spots[0], spots[1], numIdentical);
+        printf("%-18s: %lu spots, %u identical, stats quadrants %.1f ms, scatter %.1f ms\n", cases[c].name,
+               (unsigned long)spots[1].size(), numIdentical, times[0], times[1]);
+
+        // The CPU backend finds all pixels of a spot as well
+        if (cases[c].bitDepth == 8)
+        {
+            Ogles cpu(width, height, Ogles::BACKEND_CPU);
+            unsigned numMissing = countMissing(cpu.processFrame(frame), spots[1]);
+            if (numMissing)
+                printf("  %u spots of the CPU backend differ\n", numMissing);
+            numErrors += numMissing;
+        }
+    }
+
+    printf("%u errors\n", numErrors);
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return numErrors ? 1 : 0;
+}
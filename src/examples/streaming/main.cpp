@@ -0,0 +1,92 @@
+#include "CImg.h"
+using namespace cimg_library;
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include "getTime.h"
+#include "ogles.h"
+#include "programCache.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Benchmark for the streaming mode of Ogles
+ *
+ * Usage: example_streaming [image] [number of frames] [gpu|cpu] [program cache directory]
+ *
+ * The image (default: test1.png) is converted to an 8-bit greyscale frame and
+ * fed to Ogles::processFrame repeatedly, like frames coming from a camera.
+ * The first frame includes the creation of the EGLContext, FBOs, programs and
+ * textures, all further frames only upload the new pixels.
+ * With "cpu" the frames are processed by the multithreaded CpuPhase instead.
+ * With a program cache directory the linked programs are stored there and
+ * loaded by the next start (see ProgramCache).
+ */
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    const char *filename = (argc > 1) ? argv[1] : "test1.png";
+    int numFrames = (argc > 2) ? atoi(argv[2]) : 20;
+    if (numFrames < 2)
+        numFrames = 2;
+    Ogles::Backend backend = (argc > 3 && strcmp(argv[3], "cpu") == 0) ? Ogles::BACKEND_CPU
+                                                                        : Ogles::BACKEND_GPU;
+    if (argc > 4)
+        ProgramCache::setDirectory(argv[4]);
+
+    // Use the first channel of the image as greyscale camera frame
+    CImg<unsigned char> image(filename);
+    int width  = image.width();
+    int height = image.height();
+    std::vector<uint8_t> frame(image.data(), image.data() + (size_t)width*height);
+
+    Ogles ogles(width, height, backend);
+    ogles.mLabelPhase.mVertFilename     = "quad.vert";
+    ogles.mLabelPhase.mFragFilename     = "labelPhase.frag";
+    ogles.mReductionPhase.mVertFilename = "quad.vert";
+    ogles.mReductionPhase.mFragFilename = "reductionPhase.frag";
+    ogles.mStatsPhase.mVertFilename     = "quad.vert";
+    ogles.mStatsPhase.mProgFill.filename     = "fillStage.frag";
+    ogles.mStatsPhase.mProgCount.filename    = "countStage.frag";
+    ogles.mStatsPhase.mProgCentroid.filename = "centroidStage.frag";
+
+    double startTime, endTime;
+
+    // First frame: setup of the context and all OpenGL objects
+    startTime = getRealTime();
+    size_t numSpots = ogles.processFrame(frame.data(), width, height).size();
+    endTime = getRealTime();
+    double firstTime = (endTime-startTime)*1000;
+
+    // Steady state: only upload and processing
+    startTime = getRealTime();
+    for (int i=1; i<numFrames; ++i)
+    {
+        numSpots = ogles.processFrame(frame.data(), width, height).size();
+    }
+    endTime = getRealTime();
+    double steadyTime = (endTime-startTime)*1000 / (numFrames-1);
+
+    cout << "Backend: " << (backend == Ogles::BACKEND_CPU ? "CPU" : "GPU") << endl;
+    cout << "Frame size: " << width << " x " << height << endl;
+    cout << "Spots per frame: " << numSpots << endl;
+    cout << "First frame (incl. setup): " << firstTime << " ms" << endl;
+    cout << "Steady state: " << steadyTime << " ms per frame, "
+         << 1000.0/steadyTime << " frames per second" << endl;
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "log.h"
+#include "ogles.h"
+#include "../starField.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Tile-local labeling with the border merge against the labeling of the whole frame
+ *
+ * Usage: example_tileMerge
+ *
+ * Generates a star field (512 x 384) with spots on the corners of the tiles,
+ * a trail across several tiles and a U-shaped spot whose arms are only
+ * connected through a third tile. The frame is labeled as a whole and with
+ * LabelPhase::mTileSize of 16 and 64, with and without regions. The spots of
+ * the tiles have to be identical to the ones of the whole frame, the program
+ * returns 1 otherwise. The number of label passes is printed for both.
+ */
+
+static void addStar(std::vector<float> &image, int width, float cx, float cy, float peak, float sigma2)
+{
+    for (int y=(int)cy-6; y<=(int)cy+6; ++y)
+    {
+        for (int x=(int)cx-6; x<=(int)cx+6; ++x)
+        {
+            float r2 = (x-cx)*(x-cx) + (y-cy)*(y-cy);
+            image[(size_t)y*width+x] += peak*expf(-r2/(2*sigma2));
+        }
+    }
+}
+
+static void generateField(std::vector<uint8_t> &frame, int width, int height)
+{
+    std::vector<float> image((size_t)width*height, 10.0f);
+    srand(1);
+    for (int s=0; s<30; ++s)
+        addStar(image, width, 8 + rand() % (width-16) + (rand() % 100)/100.0f,
+                8 + rand() % (height-16) + (rand() % 100)/100.0f, 120 + rand() % 100, 1.0f + (rand() % 100)/100.0f);
+
+    // On the corners of 4 tiles (for tile sizes up to 64)
+    for (int y=64; y<height; y+=128)
+        for (int x=64; x<width; x+=128)
+            addStar(image, width, x-0.5f, y-0.5f, 200, 3.0f);
+
+    // Trail across several tiles
+    for (int i=0; i<150; ++i)
+    {
+        int x = 150 + i;
+        int y = 200 + i/2;
+        image[(size_t)y*width+x]     += 150;
+        image[(size_t)(y+1)*width+x] += 150;
+    }
+
+    // U-shape (rows counted from the bottom like the labels): the arms at
+    // x = 52 and 60 are in the same tile of size 16 above row 48, but are only
+    // joined by the bar in row 40 of the tile below
+    for (int y=40; y<63; ++y)
+    {
+        image[(size_t)(height-1-y)*width+52] += 150;
+        image[(size_t)(height-1-y)*width+60] += 150;
+    }
+    for (int x=52; x<=60; ++x)
+        image[(size_t)(height-1-40)*width+x] += 150;
+
+    frame.resize(image.size());
+    for (size_t i=0; i<image.size(); ++i)
+        frame[i] = (uint8_t)std::min(image[i], 255.0f);
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    const int width  = 512;
+    const int height = 384;
+    Log::setLevel(LOG_LEVEL_WARN);
+
+    std::vector<uint8_t> frame;
+    generateField(frame, width, height);
+
+    unsigned numErrors = 0;
+    for (int r=0; r<2; ++r)
+    {
+        std::vector<StatsPhase::Spot> reference;
+        int referencePasses = 0;
+        const int tileSizes[3] = { 0, 16, 64 };
+        for (int t=0; t<3; ++t)
+        {
+            Ogles ogles(width, height, Ogles::BACKEND_GPU);
+            ogles.mUseRegions = r == 1;
+            ogles.mLabelPhase.mTileSize = tileSizes[t];
+            std::vector<StatsPhase::Spot> spots = ogles.processFrame(frame.data(), width, height);
+            if (t == 0)
+            {
+                reference = spots;
+                referencePasses = ogles.mLabelPhase.mNumPasses;
+                continue;
+            }
+
+            unsigned numMissing = countMissing(reference, spots);
+            printf("%-15s tiles %2d: %lu spots, %u of %lu spots of the whole frame differ, %d passes instead of %d\n",
+                   r == 1 ? "regions" : "full frame", tileSizes[t], (unsigned long)spots.size(), numMissing,
+                   (unsigned long)reference.size(), ogles.mLabelPhase.mNumPasses, referencePasses);
+            numErrors += numMissing;
+        }
+    }
+
+    printf("%u errors\n", numErrors);
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return numErrors ? 1 : 0;
+}
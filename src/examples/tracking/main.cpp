@@ -0,0 +1,157 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "getTime.h"
+#include "log.h"
+#include "ogles.h"
+#include "../starField.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Tracking mode of Ogles::trackFrame
+ *
+ * Usage: example_tracking [number of frames] [cpu|gpu]
+ *
+ * Generates star fields (512 x 384) whose stars drift slowly, with a jump
+ * of the whole field in the middle of the sequence. The tracker predicts
+ * the position of each star from the spots of the last frame and processes
+ * only windows around them. Every frame is also processed completely by a
+ * second Ogles object: each spot found in the windows has to be identical to
+ * a spot of the full frame, the jump has to trigger an acquisition in the
+ * next frame and afterwards all stars have to be tracked again. The program
+ * returns 1 otherwise.
+ */
+
+static const int sNumStars = 30;
+static const float sWindowRadius = 5.0f;
+
+static bool containsSpot(const std::vector<StatsPhase::Spot> &spots, const StatsPhase::Spot &spot)
+{
+    for (size_t i=0; i<spots.size(); ++i)
+    {
+        if (spots[i].x == spot.x && spots[i].y == spot.y && spots[i].area == spot.area &&
+            spots[i].luminance == spot.luminance)
+            return true;
+    }
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    int numFrames = (argc > 1) ? atoi(argv[1]) : 100;
+    Ogles::Backend backend = (argc > 2 && strcmp(argv[2], "gpu") == 0) ? Ogles::BACKEND_GPU : Ogles::BACKEND_CPU;
+    if (numFrames < 4)
+        numFrames = 4;
+    int jumpFrame = numFrames/2;
+
+    const int width  = 512;
+    const int height = 384;
+    Log::setLevel(LOG_LEVEL_WARN);
+    Ogles tracker(width, height, backend);
+    Ogles reference(width, height, backend);
+    // Windows are small, finer tiles keep their boxes tight
+    tracker.mRegions.mTileSize = 8;
+
+    std::vector<uint8_t> frame;
+    std::vector<RegionSet::Window> windows;
+    std::vector<StatsPhase::Spot> previous;
+    unsigned numErrors = 0;
+    int numAcquisitions = 0;
+    double trackTime = 0, fullTime = 0;
+    for (int i=0; i<numFrames; ++i)
+    {
+        // Drift of (1/4, 1/8) pixels per frame and a jump of 20 pixels, the margin leaves room for both
+        StarField field(width, height, sNumStars);
+        field.mMargin = 16;
+        field.mAreaWidth  = width-64;
+        field.mAreaHeight = height-64;
+        field.mOffsetX = i/4.0f + (i >= jumpFrame ? 20 : 0);
+        field.mOffsetY = i/8.0f + (i >= jumpFrame ? 20 : 0);
+        field.generate(frame);
+
+        // Constant velocity from the last two frames
+        windows.clear();
+        const std::vector<StatsPhase::Spot> &last = tracker.getSpots();
+        for (size_t n=0; n<last.size(); ++n)
+        {
+            RegionSet::Window window = { last[n].x, last[n].y, sWindowRadius };
+            for (size_t p=0; p<previous.size(); ++p)
+            {
+                float dx = last[n].x - previous[p].x;
+                float dy = last[n].y - previous[p].y;
+                if (dx*dx + dy*dy < sWindowRadius*sWindowRadius)
+                {
+                    window.x += dx;
+                    window.y += dy;
+                    break;
+                }
+            }
+            windows.push_back(window);
+        }
+        previous = last;
+
+        double startTime = getRealTime();
+        const std::vector<StatsPhase::Spot> &spots = tracker.trackFrame(
+                    IngestPhase::Frame(frame.data(), width, height, width), windows);
+        double middleTime = getRealTime();
+        const std::vector<StatsPhase::Spot> &full = reference.processFrame(frame.data(), width, height);
+        double endTime = getRealTime();
+
+        if (tracker.wasAcquisition())
+        {
+            ++numAcquisitions;
+        }
+        else
+        {
+            trackTime += middleTime-startTime;
+            fullTime  += endTime-middleTime;
+        }
+
+        // The frame after the jump has to be an acquisition, the jump frame itself may lose stars
+        bool expectAcquisition = i == 0 || i == jumpFrame+1;
+        if (expectAcquisition && !tracker.wasAcquisition())
+        {
+            printf("Frame %d: no acquisition\n", i);
+            ++numErrors;
+        }
+        if (i == jumpFrame)
+            continue;
+
+        if (spots.size() != full.size())
+        {
+            printf("Frame %d: %lu spots instead of %lu\n", i, (unsigned long)spots.size(), (unsigned long)full.size());
+            ++numErrors;
+        }
+        for (size_t n=0; n<spots.size(); ++n)
+        {
+            if (!containsSpot(full, spots[n]))
+            {
+                printf("Frame %d: spot (%.2f, %.2f) differs from the full frame\n", i, spots[n].x, spots[n].y);
+                ++numErrors;
+            }
+        }
+    }
+
+    int numTracked = numFrames - numAcquisitions;
+    printf("%d frames, %d acquisitions, %lu stars\n", numFrames, numAcquisitions, (unsigned long)tracker.getSpots().size());
+    if (numTracked > 0)
+        printf("tracked %.3f ms per frame, full frame %.3f ms per frame\n",
+               trackTime*1000/numTracked, fullTime*1000/numTracked);
+    printf("%u errors\n", numErrors);
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return numErrors ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include "getTime.h"
+#include "ogles.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * Benchmark for the upload of the original image
+ *
+ * Usage: example_upload [width] [height] [number of uploads]
+ *
+ * Compares the texture formats of the original image (LabelPhase::mOrigFormat)
+ * for a generated frame (default 2048 x 2048):
+ *   - LabelPhase::updateOrigTexture with the interleaved image of mImage
+ *   - IngestPhase::ingest of a camera frame, which needs an extra render
+ *     pass into the RGBA texture but none into the luminance texture
+ * Each upload is followed by glFinish, so the time includes the transfer.
+ */
+
+static double timeUploads(Ogles &ogles, int numUploads)
+{
+    double startTime = getRealTime();
+    for (int i=0; i<numUploads; ++i)
+    {
+        ogles.mLabelPhase.updateOrigTexture();
+        GL_CHECK( glFinish() );
+    }
+    return (getRealTime()-startTime)*1000 / numUploads;
+}
+
+static double timeIngest(Ogles &ogles, const std::vector<uint8_t> &frame, int width, int height, int numUploads)
+{
+    IngestPhase::Frame ingestFrame(frame.data(), width, height, width);
+    double startTime = getRealTime();
+    for (int i=0; i<numUploads; ++i)
+    {
+        ogles.mIngestPhase.ingest(ingestFrame);
+        GL_CHECK( glFinish() );
+    }
+    return (getRealTime()-startTime)*1000 / numUploads;
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    int width      = (argc > 1) ? atoi(argv[1]) : 2048;
+    int height     = (argc > 2) ? atoi(argv[2]) : 2048;
+    int numUploads = (argc > 3) ? atoi(argv[3]) : 20;
+    if (numUploads < 1)
+        numUploads = 1;
+
+    // Dark sky with a gradient, no stars needed for the upload
+    std::vector<uint8_t> frame((size_t)width*height);
+    for (int j=0; j<height; ++j)
+        for (int i=0; i<width; ++i)
+            frame[(size_t)j*width+i] = (uint8_t)((i+j) & 0x3f);
+
+    const GLenum formats[2] = { GL_RGBA, GL_LUMINANCE };
+    const char  *names[2]   = { "RGBA", "LUMINANCE" };
+    double uploadTimes[2], ingestTimes[2];
+
+    for (int f=0; f<2; ++f)
+    {
+        Ogles ogles(width, height, Ogles::BACKEND_GPU);
+        ogles.mLabelPhase.mOrigFormat = formats[f];
+        // The first frame creates the context and all textures
+        ogles.processFrame(frame.data(), width, height);
+
+        int channels = (formats[f] == GL_RGBA) ? 4 : 1;
+        ogles.mLabelPhase.mImage.assign(channels, width, height, 1);
+        unsigned char *data = ogles.mLabelPhase.mImage.data();
+        for (size_t p=0; p<frame.size(); ++p)
+            memset(data + p*channels, frame[p], channels);
+
+        uploadTimes[f] = timeUploads(ogles, numUploads);
+        ingestTimes[f] = timeIngest(ogles, frame, width, height, numUploads);
+    }
+
+    cout << "Frame size: " << width << " x " << height << ", " << numUploads << " uploads" << endl;
+    for (int f=0; f<2; ++f)
+    {
+        int channels = (formats[f] == GL_RGBA) ? 4 : 1;
+        cout << names[f] << ": updateOrigTexture " << uploadTimes[f] << " ms ("
+             << (double)channels*width*height/(uploadTimes[f]*1000) << " MB/s), ingest "
+             << ingestTimes[f] << " ms" << endl;
+    }
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "log.h"
+#include "ogles.h"
+#include "../starField.h"
+#include "profiler.h"
+
+#ifdef _RPI
+#include "bcm_host.h"
+#endif
+
+/*
+ * 32-bit sums of bright, large spots
+ *
+ * Usage: example_wideSums [number of frames]
+ *
+ * Generates a star field (512 x 384) with large, bright spots and scales it
+ * to 16 bits (x257). The weighted sums of these spots do not fit into the 24
+ * bits of the packed longs. The 16-bit frame is processed by both engines of
+ * StatsPhase with and without mWideSums and the spots are compared with the
+ * spots of the same engine on the 8-bit frame, whose sums are 257 times
+ * smaller: same area and position, 257 times the luminance. The program
+ * returns 1 if a spot of the wide sums differs. Without float render
+ * targets only the quadrants are run.
+ */
+
+static double statsTime()
+{
+    std::vector<Profiler::Summary> entries = Profiler::summary();
+    for (size_t i=0; i<entries.size(); ++i)
+    {
+        if (entries[i].name == "stats")
+            return entries[i].mean;
+    }
+    return 0.0;
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _RPI
+    bcm_host_init();
+#endif
+
+    int numFrames = (argc > 1) ? atoi(argv[1]) : 2;
+    if (numFrames < 1)
+        numFrames = 1;
+
+    const int width  = 512;
+    const int height = 384;
+    Log::setLevel(LOG_LEVEL_WARN);
+
+    std::vector<uint8_t> frame8;
+    // Large bright spots, their sums need more than 16 bits
+    StarField field(width, height, 12);
+    field.mMargin = 16;
+    field.mPeak = 220.0f;
+    field.mPeakRange = 200;
+    field.mSigma2 = 6.0f;
+    field.mSigma2Range = 5.0f;
+    field.generate(frame8);
+    std::vector<uint16_t> frame16(frame8.size());
+    for (size_t i=0; i<frame8.size(); ++i)
+        frame16[i] = 257*frame8[i];
+    IngestPhase::Frame frame((const uint8_t *)frame16.data(), width, height, 2*width, 16);
+
+    unsigned numErrors = 0;
+    for (int e=0; e<2; ++e)
+    {
+        std::vector<StatsPhase::Spot> reference;
+        for (int w=0; w<2; ++w)
+        {
+            Ogles ogles(width, height, Ogles::BACKEND_GPU);
+            ogles.mLabelPhase.mOrigBitDepth = 16;
+            ogles.mLabelPhase.setThreshold(65*257);
+            ogles.mStatsPhase.mEngine = e == 0 ? StatsPhase::ENGINE_QUADRANTS : StatsPhase::ENGINE_SCATTER;
+            ogles.mStatsPhase.mWideSums = w == 1;
+            ogles.processFrame(frame);
+            if (e == 1 && !ogles.mStatsPhase.hasScatter())
+            {
+                printf("Scatter engine is not supported by this context\n");
+                break;
+            }
+
+            if (w == 0)
+            {
+                Ogles ogles8(width, height, Ogles::BACKEND_GPU);
+                ogles8.mStatsPhase.mEngine = ogles.mStatsPhase.mEngine;
+                reference = ogles8.processFrame(frame8.data(), width, height);
+            }
+
+            std::vector<StatsPhase::Spot> spots;
+            Profiler::reset();
+            Profiler::setEnabled(true);
+            for (int i=0; i<numFrames; ++i)
+                spots = ogles.processFrame(frame);
+            Profiler::setEnabled(false);
+
+            unsigned numMissing = countMissing(reference, spots, 257, 1e-3f);
+            printf("%-9s %-8s: %lu spots, %u of %lu spots of the 8-bit frame differ, stats %.1f ms\n",
+                   e == 0 ? "quadrants" : "scatter", w == 1 ? "32 bits" : "24 bits", (unsigned long)spots.size(),
+                   numMissing, (unsigned long)reference.size(), statsTime());
+            if (w == 1)
+                numErrors += numMissing;
+        }
+    }
+
+    printf("%u errors\n", numErrors);
+
+#ifdef _RPI
+    bcm_host_deinit();
+#endif
+
+    return numErrors ? 1 : 0;
+}
@@ -0,0 +1,346 @@
+#include "ingestPhase.h"
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/dma-buf.h>
+#include <errno.h>
+#include <string.h>
+
+#include <stdexcept>
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+#include "getTime.h"
+#include "log.h"
+
+// Single 8-bit channel, see drm_fourcc.h
+#define DRM_FORMAT_R8  (  (uint32_t)'R' | ((uint32_t)'8' << 8) | ((uint32_t)' ' << 16) | ((uint32_t)' ' << 24) )
+
+IngestPhase::Frame::Frame(const uint8_t *pixels, int width, int height, int stride, int bitDepth)
+    : pixels(pixels), fd(-1), width(width), height(height), stride(stride), offset(0), bitDepth(bitDepth)
+{
+}
+
+IngestPhase::Frame::Frame(int fd, int width, int height, int stride, int offset, int bitDepth)
+    : pixels(NULL), fd(fd), width(width), height(height), stride(stride), offset(offset), bitDepth(bitDepth)
+{
+}
+
+int IngestPhase::Frame::bytesPerPixel() const
+{
+    return bitDepth > 8 ? 2 : 1;
+}
+
+size_t IngestPhase::Frame::size() const
+{
+    return (size_t)offset + (size_t)stride*(height-1) + (size_t)width*bytesPerPixel();
+}
+
+IngestPhase::Mapping::Mapping(const Frame &frame)
+    : mAddress(NULL), mSize(0), mFd(-1), mPixels(frame.pixels)
+{
+    if (mPixels != NULL)
+        return;
+
+    mSize = frame.size();
+    mAddress = mmap(NULL, mSize, PROT_READ, MAP_SHARED, frame.fd, 0);
+    if (mAddress == MAP_FAILED)
+    {
+        mAddress = NULL;
+        throw std::runtime_error(std::string("OGLES: Failed to map the dmabuf of the frame: ") + strerror(errno));
+    }
+    mFd = frame.fd;
+    mPixels = (const uint8_t *)mAddress + frame.offset;
+
+    // Make the content written by the device visible to the CPU (no-op for other files)
+    struct dma_buf_sync sync = { DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ };
+    ioctl(mFd, DMA_BUF_IOCTL_SYNC, &sync);
+}
+
+IngestPhase::Mapping::~Mapping()
+{
+    if (mAddress == NULL)
+        return;
+
+    struct dma_buf_sync sync = { DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ };
+    ioctl(mFd, DMA_BUF_IOCTL_SYNC, &sync);
+    munmap(mAddress, mSize);
+}
+
+const uint8_t *IngestPhase::Mapping::pixels() const
+{
+    return mPixels;
+}
+
+IngestPhase::IngestPhase(int width, int height)
+    : mVertFilename("../glsl/quad.vert"), mFragFilename("../glsl/ingest.frag"),
+      mProgramObject(0), mWidth(width), mHeight(height),
+      mVertices {-1.0f, -1.0f, 0.0f,  // Position 0
+                  0.0f,  0.0f,        // TexCoord 0
+                 -1.0f,  1.0f, 0.0f,  // Position 1
+                  0.0f,  1.0f,        // TexCoord 1
+                  1.0f,  1.0f, 0.0f,  // Position 2
+                  1.0f,  1.0f,        // TexCoord 2
+                  1.0f, -1.0f, 0.0f,  // Position 3
+                  1.0f,  0.0f         // TexCoord 3
+                },
+      mIndices { 0, 1, 2, 0, 2, 3 },
+      mTexFrameId(0), mTexSourceId(0), mTextureUnit(0), mTexTargetId(0), mTargetFormat(GL_RGBA), mFboId(0),
+      mUseDmaBuf(true), mLastImported(false),
+      mHasDmaBufImport(false), mHasUnpackSubimage(false),
+      mCreateImage(NULL), mDestroyImage(NULL), mImageTargetTexture2D(NULL)
+{
+}
+
+IngestPhase::~IngestPhase()
+{
+}
+
+GLint IngestPhase::init(GLuint fbos[], GLuint &bfUsedTextures)
+{
+    mFboId = fbos[0];
+
+    // Load the shaders and get a linked program object
+    mProgramObject = loadProgramFromFile( mVertFilename, mFragFilename);
+    if (mProgramObject == 0)
+    {
+        cerr << "Failed to generate Program object for ingest phase" << endl;
+        return GL_FALSE;
+    }
+
+    mPositionLoc = glGetAttribLocation ( mProgramObject, "a_position" );
+    mTexCoordLoc = glGetAttribLocation ( mProgramObject, "a_texCoord" );
+    u_texDimLoc  = glGetUniformLocation ( mProgramObject, "u_texDimensions" );
+    mSamplerLoc  = glGetUniformLocation ( mProgramObject, "s_frame" );
+
+    // Texture unit for the imported frames and the texture of the uploaded
+    // frames, a luminance (alpha) target takes the uploads itself
+    int i = 0;
+    while( (1<<i) & bfUsedTextures) ++i;
+
+    GL_CHECK( glActiveTexture( GL_TEXTURE0 + i) );
+    if (mTargetFormat != GL_RGBA)
+        mTexFrameId = 0;
+    else
+        mTexFrameId = createSimpleTexture2D(mWidth, mHeight, NULL, GL_LUMINANCE);
+    bfUsedTextures |= (1<<i);
+    mTextureUnit = i;
+    mTexSourceId = uploadTexture();
+
+    // Extensions
+    const char *eglExtensions = eglQueryString(eglGetCurrentDisplay(), EGL_EXTENSIONS);
+    const char *glExtensions  = (const char *)glGetString(GL_EXTENSIONS);
+    mHasUnpackSubimage = glExtensions != NULL && strstr(glExtensions, "GL_EXT_unpack_subimage") != NULL;
+
+    mCreateImage          = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
+    mDestroyImage         = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
+    mImageTargetTexture2D = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)eglGetProcAddress("glEGLImageTargetTexture2DOES");
+    mHasDmaBufImport = eglExtensions != NULL && strstr(eglExtensions, "EGL_EXT_image_dma_buf_import") != NULL
+                       && glExtensions != NULL && strstr(glExtensions, "GL_OES_EGL_image") != NULL
+                       && mCreateImage != NULL && mDestroyImage != NULL && mImageTargetTexture2D != NULL;
+
+    return GL_TRUE;
+}
+
+double IngestPhase::ingest(const Frame &frame)
+{
+    double startTime, endTime;
+
+    startTime = getRealTime();
+
+    if (frame.width != mWidth || frame.height != mHeight)
+    {
+        throw std::runtime_error(std::string("OGLES: Frame size does not match the size of the stream"));
+    }
+    if ((frame.bitDepth > 8) != (mTargetFormat == GL_LUMINANCE_ALPHA))
+    {
+        throw std::runtime_error(std::string("OGLES: Bit depth of the frame does not match the stream"));
+    }
+
+    mLastImported = false;
+    GLuint texture = 0;
+    // There is no single-channel 16-bit DRM format which ES2 could sample
+    if (frame.pixels == NULL && frame.bitDepth <= 8 && mUseDmaBuf && mHasDmaBufImport)
+    {
+        texture = importDmaBuf(frame);
+    }
+
+    if (texture != 0)
+    {
+        mTexSourceId  = texture;
+        mLastImported = true;
+    }
+    else
+    {
+        upload(frame);
+        mTexSourceId = uploadTexture();
+    }
+
+    // The phases sample a luminance (alpha) target as it is
+    if (mTargetFormat == GL_RGBA)
+        run();
+
+    endTime = getRealTime();
+
+    return (endTime-startTime)*1000;
+}
+
+double IngestPhase::run()
+{
+    double startTime, endTime;
+
+    startTime = getRealTime();
+
+    GL_CHECK( glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0) );
+    GL_CHECK( glBindBuffer(GL_ARRAY_BUFFER, 0) );
+    GL_CHECK( glViewport ( 0, 0, mWidth, mHeight ) );
+
+    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId) );
+    GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexTargetId, 0) );
+    CHECK_FBO();
+
+    GL_CHECK( glUseProgram ( mProgramObject ) );
+    GL_CHECK( glUniform2f ( u_texDimLoc, mWidth, mHeight) );
+    GL_CHECK( glActiveTexture( GL_TEXTURE0 + mTextureUnit) );
+    GL_CHECK( glBindTexture ( GL_TEXTURE_2D, mTexSourceId ) );
+    GL_CHECK( glUniform1i ( mSamplerLoc, mTextureUnit ) );
+
+    GL_CHECK( glEnableVertexAttribArray ( mPositionLoc ) );
+    GL_CHECK( glEnableVertexAttribArray ( mTexCoordLoc ) );
+    drawScene(NULL, RegionSet::SHAPE_BOXES, mPositionLoc, mTexCoordLoc, mVertices, mIndices);
+    GL_CHECK( glDisableVertexAttribArray ( mPositionLoc ) );
+    GL_CHECK( glDisableVertexAttribArray ( mTexCoordLoc ) );
+
+    // The following phases clear the bound framebuffer during their setup
+    GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0) );
+    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, 0) );
+
+    endTime = getRealTime();
+
+    return (endTime-startTime)*1000;
+}
+
+GLuint IngestPhase::getFrameTexture() const
+{
+    return isFrameTopDown() ? mTexSourceId : mTexTargetId;
+}
+
+bool IngestPhase::isFrameTopDown() const
+{
+    return mTargetFormat != GL_RGBA;
+}
+
+GLuint IngestPhase::uploadTexture() const
+{
+    return (mTargetFormat != GL_RGBA) ? mTexTargetId : mTexFrameId;
+}
+
+bool IngestPhase::supportsDmaBuf() const
+{
+    return mHasDmaBufImport;
+}
+
+GLuint IngestPhase::importDmaBuf(const Frame &frame)
+{
+    for (size_t i=0; i<mImports.size(); ++i)
+    {
+        if (mImports[i].fd == frame.fd && mImports[i].offset == frame.offset && mImports[i].stride == frame.stride)
+            return mImports[i].texture;
+    }
+
+    EGLint attribs[] = { EGL_WIDTH                     , frame.width,
+                         EGL_HEIGHT                    , frame.height,
+                         EGL_LINUX_DRM_FOURCC_EXT      , (EGLint)DRM_FORMAT_R8,
+                         EGL_DMA_BUF_PLANE0_FD_EXT     , frame.fd,
+                         EGL_DMA_BUF_PLANE0_OFFSET_EXT , frame.offset,
+                         EGL_DMA_BUF_PLANE0_PITCH_EXT  , frame.stride,
+                         EGL_NONE
+                       };
+    Import import;
+    import.fd     = frame.fd;
+    import.offset = frame.offset;
+    import.stride = frame.stride;
+    import.image  = mCreateImage(eglGetCurrentDisplay(), EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
+    if (import.image == EGL_NO_IMAGE_KHR)
+    {
+        LOG_WARN("Failed to import dmabuf " << frame.fd << " (EGL error " << std::hex << eglGetError() << std::dec
+                 << "), uploading the frames instead");
+        // The driver does not support the format, do not try again for every frame
+        mHasDmaBufImport = false;
+        return 0;
+    }
+
+    GL_CHECK( glActiveTexture( GL_TEXTURE0 + mTextureUnit) );
+    GL_CHECK( glGenTextures ( 1, &import.texture ) );
+    GL_CHECK( glBindTexture ( GL_TEXTURE_2D, import.texture ) );
+    mImageTargetTexture2D(GL_TEXTURE_2D, (GLeglImageOES)import.image);
+    if (glGetError() != GL_NO_ERROR)
+    {
+        LOG_WARN("Failed to bind the dmabuf " << frame.fd << " to a texture, uploading the frames instead");
+        GL_CHECK( glDeleteTextures(1, &import.texture) );
+        mDestroyImage(eglGetCurrentDisplay(), import.image);
+        mHasDmaBufImport = false;
+        return 0;
+    }
+    GL_CHECK( glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST ) );
+    GL_CHECK( glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST ) );
+    GL_CHECK( glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE ) );
+    GL_CHECK( glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE ) );
+
+    mImports.push_back(import);
+    return import.texture;
+}
+
+void IngestPhase::upload(const Frame &frame)
+{
+    Mapping mapping(frame);
+    const uint8_t *pixels = mapping.pixels();
+
+    // Low byte into the luminance, high byte into the alpha channel
+    int bytesPerPixel = frame.bytesPerPixel();
+    GLenum format = bytesPerPixel == 2 ? GL_LUMINANCE_ALPHA : GL_LUMINANCE;
+    size_t rowSize = (size_t)mWidth*bytesPerPixel;
+
+    GL_CHECK( glActiveTexture( GL_TEXTURE0 + mTextureUnit) );
+    GL_CHECK( glBindTexture ( GL_TEXTURE_2D, uploadTexture() ) );
+    GL_CHECK( glPixelStorei ( GL_UNPACK_ALIGNMENT, 1 ) );
+
+    if ((size_t)frame.stride != rowSize && frame.stride % bytesPerPixel == 0 && mHasUnpackSubimage)
+    {
+        GL_CHECK( glPixelStorei ( GL_UNPACK_ROW_LENGTH_EXT, frame.stride / bytesPerPixel ) );
+        GL_CHECK( glTexSubImage2D ( GL_TEXTURE_2D, 0, 0, 0, mWidth, mHeight, format, GL_UNSIGNED_BYTE, pixels) );
+        GL_CHECK( glPixelStorei ( GL_UNPACK_ROW_LENGTH_EXT, 0 ) );
+        return;
+    }
+
+    if ((size_t)frame.stride != rowSize)
+    {
+        // Remove the padding of the rows
+        mPacked.resize(rowSize*mHeight);
+        for (int j=0; j<mHeight; ++j)
+            memcpy(&mPacked[(size_t)j*rowSize], pixels + (size_t)j*frame.stride, rowSize);
+        pixels = mPacked.data();
+    }
+
+    GL_CHECK( glTexSubImage2D ( GL_TEXTURE_2D, 0, 0, 0, mWidth, mHeight, format, GL_UNSIGNED_BYTE, pixels) );
+}
+
+void IngestPhase::releaseImports()
+{
+    for (size_t i=0; i<mImports.size(); ++i)
+    {
+        GL_CHECK( glDeleteTextures(1, &mImports[i].texture) );
+        mDestroyImage(eglGetCurrentDisplay(), mImports[i].image);
+    }
+    mImports.clear();
+    mTexSourceId = uploadTexture();
+}
+
+void IngestPhase::releaseGlResources()
+{
+    releaseImports();
+    GL_CHECK( glDeleteProgram(mProgramObject) );
+    if (mTexFrameId != 0)
+        GL_CHECK( glDeleteTextures(1, &mTexFrameId) );
+}
@@ -1,6 +1,10 @@
 #include "labelPhase.h"
+#include "profiler.h"
+#include "log.h"
 
+#include <algorithm>
 #include <iostream>
+#include <unordered_map>
 using std::cerr;
 using std::endl;
 
@@ -9,6 +13,14 @@ using std::endl;
 
 #define STAGE_INITIAL_LABELING   0
 #define STAGE_HIGHEST_LABEL      1
+#define STAGE_COMPARE           -1
+#define STAGE_ANY_CHANGED       -2
+#define STAGE_LABEL_LOOKUP       2 // Every pass >= 2 looks up the label of the label
+
+// Has to match COMPARE_BLOCK of the label shader
+#define COMPARE_BLOCK            8
+// Number of passes between two convergence checks
+#define CHECK_PASSES             4
 
 
 LabelPhase::LabelPhase(int width, int height)
@@ -23,7 +35,10 @@ LabelPhase::LabelPhase(int width, int height)
                   1.0f, -1.0f, 0.0f,  // Position 3
                   1.0f,  0.0f         // TexCoord 3
                 },
-      mIndices { 0, 1, 2, 0, 2, 3 }, u_threshold(64.3 / 255.0)
+      mIndices { 0, 1, 2, 0, 2, 3 }, u_threshold(64.3 / 255.0), mTileSize(0),
+      mOrigFormat(GL_LUMINANCE), mOrigBitDepth(8), mTexOrigId(0), mTexSourceId(0), mOrigTopDown(false),
+      mCheckConvergence(true), mNumPasses(0), mTexSavedId(0), mTexChangedId {0, 0}, mFboChangedId {0, 0},
+      mChangedWidth(0), mChangedHeight(0), mRegions(NULL)
 {
 }
 
@@ -58,10 +73,14 @@ GLint LabelPhase::init(GLuint fbos[2], GLuint &bfUsedTextures)
 
     // Get the sampler locations
     mSamplerLoc     = glGetUniformLocation( mProgramObject,  "s_texture" );
+    mPrevSamplerLoc = glGetUniformLocation( mProgramObject,  "s_prevTexture" );
     u_texDimLoc     = glGetUniformLocation ( mProgramObject, "u_texDimensions" );
     u_thresholdLoc  = glGetUniformLocation ( mProgramObject, "u_threshold" );
     u_passLoc       = glGetUniformLocation ( mProgramObject, "u_pass" );
     u_factorLoc     = glGetUniformLocation ( mProgramObject, "u_factor" );
+    u_tileSizeLoc   = glGetUniformLocation ( mProgramObject, "u_tileSize" );
+    u_origTopDownLoc = glGetUniformLocation ( mProgramObject, "u_origTopDown" );
+    u_origMaxValueLoc = glGetUniformLocation ( mProgramObject, "u_origMaxValue" );
 
     // 2. and 3. texture for ping-pong
     for(int j=0; j<2; ++j)
@@ -76,6 +95,23 @@ GLint LabelPhase::init(GLuint fbos[2], GLuint &bfUsedTextures)
         GL_CHECK( glBindTexture(GL_TEXTURE_2D, mTexPiPoId[j]) );
     }
 
+    // Copy of the labels and small textures for the reduction of the flags
+    // of the convergence check. They are only sampled during the check, so
+    // they do not need texture units of their own.
+    mChangedWidth  = (mWidth  + COMPARE_BLOCK - 1) / COMPARE_BLOCK;
+    mChangedHeight = (mHeight + COMPARE_BLOCK - 1) / COMPARE_BLOCK;
+    GL_CHECK( glActiveTexture( GL_TEXTURE0 + mTextureUnits[TEX_PIPO]) );
+    mTexSavedId = createSimpleTexture2D(mWidth, mHeight);
+    GL_CHECK( glGenFramebuffers(2, mFboChangedId) );
+    for(int j=0; j<2; ++j)
+    {
+        mTexChangedId[j] = createSimpleTexture2D(mChangedWidth, mChangedHeight);
+        GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboChangedId[j]) );
+        GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexChangedId[j], 0) );
+        CHECK_FBO();
+    }
+    GL_CHECK( glBindTexture(GL_TEXTURE_2D, mTexPiPoId[0]) );
+
     GL_CHECK( glClearColor ( 0.0f, 0.0f, 0.0f, 0.0f ) );
 
     return GL_TRUE;
@@ -87,10 +123,12 @@ GLint LabelPhase::initIndependent(GLuint fbos[], GLuint &bfUsedTextures)
     while( (1<<i) & bfUsedTextures) ++i;
 
     GL_CHECK( glActiveTexture( GL_TEXTURE0 + i) );
-    mTexOrigId = createSimpleTexture2D(mWidth, mHeight, mImage.data());
+    mTexOrigId = createSimpleTexture2D(mWidth, mHeight, mImage.data(), origTextureFormat());
     bfUsedTextures |= (1<<i);
     mTextureUnits[TEX_ORIG] = i;
     GL_CHECK( glBindTexture(GL_TEXTURE_2D, mTexOrigId) );
+    mTexSourceId = mTexOrigId;
+    mOrigTopDown = false;
 
     // Setup 2 Textures for Ping-Pong and
     // the program object
@@ -99,13 +137,47 @@ GLint LabelPhase::initIndependent(GLuint fbos[], GLuint &bfUsedTextures)
 
 void LabelPhase::updateOrigTexture()
 {
+    // The texture already has the right size, so only replace its content
+    // instead of reallocating the storage with glTexImage2D
+    GL_CHECK( glActiveTexture( GL_TEXTURE0 + mTextureUnits[TEX_ORIG]) );
     GL_CHECK( glBindTexture ( GL_TEXTURE_2D, mTexOrigId ) );
-    GL_CHECK( glTexImage2D ( GL_TEXTURE_2D, 0, GL_RGBA, mWidth, mHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, mImage.data()) );
+    GL_CHECK( glPixelStorei ( GL_UNPACK_ALIGNMENT, 1 ) );
+    GL_CHECK( glTexSubImage2D ( GL_TEXTURE_2D, 0, 0, 0, mWidth, mHeight, origTextureFormat(), GL_UNSIGNED_BYTE, mImage.data()) );
+    mTexSourceId = mTexOrigId;
+    mOrigTopDown = false;
+}
+
+GLenum LabelPhase::origTextureFormat() const
+{
+    return mOrigBitDepth > 8 ? GL_LUMINANCE_ALPHA : mOrigFormat;
+}
+
+unsigned LabelPhase::origMaxValue() const
+{
+    return (1u << mOrigBitDepth) - 1;
+}
+
+void LabelPhase::setThreshold(unsigned value)
+{
+    u_threshold = (value - 0.5f) / origMaxValue();
+}
+
+void LabelPhase::setOrigSource(GLuint texture, bool topDown)
+{
+    GL_CHECK( glActiveTexture( GL_TEXTURE0 + mTextureUnits[TEX_ORIG]) );
+    GL_CHECK( glBindTexture ( GL_TEXTURE_2D, texture ) );
+    mTexSourceId = texture;
+    mOrigTopDown = topDown;
 }
 
 GLuint LabelPhase::getOrigTexture()
 {
-    return mTexOrigId;
+    return mTexSourceId;
+}
+
+bool LabelPhase::isOrigTopDown()
+{
+    return mOrigTopDown;
 }
 
 GLint LabelPhase::getOrigTexUnit()
@@ -168,6 +240,9 @@ double LabelPhase::run()
         GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[i]) );
         GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexPiPoId[i], 0) );
         CHECK_FBO();
+        // Only the occupied regions are drawn, everything else has to be background
+        if (mRegions != NULL && mRegions->isActive())
+            GL_CHECK( glClear( GL_COLOR_BUFFER_BIT ) );
     }
 
     // Use the program object
@@ -176,6 +251,9 @@ double LabelPhase::run()
     // Set the uniforms
     GL_CHECK( glUniform2f ( u_texDimLoc, mWidth, mHeight) );
     GL_CHECK( glUniform1f ( u_thresholdLoc, u_threshold) );
+    GL_CHECK( glUniform1f ( u_tileSizeLoc, mTileSize) );
+    GL_CHECK( glUniform1f ( u_origTopDownLoc, mOrigTopDown ? 1.0f : 0.0f) );
+    GL_CHECK( glUniform1f ( u_origMaxValueLoc, origMaxValue()) );
 
     // Do the runs
     u_factor = -1.0;
@@ -184,33 +262,44 @@ double LabelPhase::run()
 
     ///---------- 1. THRESHOLD AND INITIAL LABELING --------------------
 
-    // Bind the FBO to write to
-    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mWrite]) );
-    // Set the sampler texture to use the original image
-    GL_CHECK( glUniform1i ( mSamplerLoc, mTextureUnits[TEX_ORIG] ) );
-    // Set the pass index
-    GL_CHECK( glUniform1i ( u_passLoc,  STAGE_INITIAL_LABELING) );
-    GL_CHECK( glUniform1f ( u_factorLoc, u_factor) );
-    // Draw scene
-    GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, mIndices ) );
-    std::swap(mRead, mWrite);
+    {
+        Profiler::Scope scope("label.init");
+        // Bind the FBO to write to
+        GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mWrite]) );
+        // Set the sampler texture to use the original image
+        GL_CHECK( glUniform1i ( mSamplerLoc, mTextureUnits[TEX_ORIG] ) );
+        // Set the pass index
+        GL_CHECK( glUniform1i ( u_passLoc,  STAGE_INITIAL_LABELING) );
+        GL_CHECK( glUniform1f ( u_factorLoc, u_factor) );
+        // Draw scene
+        drawScene(mRegions, RegionSet::SHAPE_BOXES, mPositionLoc, mTexCoordLoc, mVertices, mIndices);
+        std::swap(mRead, mWrite);
+    }
 
-#ifdef _DEBUG
-{
+    if (LOG_ENABLED(LOG_LEVEL_TRACE))
+    {
         CImg<unsigned char> image(4, mWidth, mHeight, 1, 0);
         GL_CHECK( glReadPixels(0, 0, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, image.data()) );
+        Log::countDebugReadback(image.size());
         printf("Pixels after pass %d:\n", 0);
         printLabels(mWidth, mHeight, image.data());
         char filename[50];
         sprintf(filename, "outl%03d.png", 0);
         writeImage(mWidth, mHeight, filename, image);
-}
-#endif
+    }
 
     ///---------- 2. CONNECTED COMPONENT LABELING  --------------------
 
-    for (int i = 1; i < logBase2(mHeight)+10; i++)
+    // Labels only travel inside of a tile
+    int maxPasses = logBase2(mTileSize > 0 ? std::min(mTileSize, mHeight) : mHeight)+10;
+
+    mNumPasses = 1;
+    if (mCheckConvergence)
+        saveLabels();
+    for (int i = 1; i < maxPasses; i++)
     {
+        Profiler::Scope scope("label.pass[%d]", i);
+
         if( i%2 == 1)
         {
             u_pass = STAGE_HIGHEST_LABEL;
@@ -229,21 +318,42 @@ double LabelPhase::run()
         GL_CHECK( glUniform1i ( u_passLoc,  u_pass) );
         GL_CHECK( glUniform1f ( u_factorLoc, u_factor) );
         // Draw scene
-        GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, mIndices ) );
+        drawScene(mRegions, RegionSet::SHAPE_BOXES, mPositionLoc, mTexCoordLoc, mVertices, mIndices);
         std::swap(mRead, mWrite);
+        ++mNumPasses;
 
-#ifdef _DEBUG
-{
-        // Make the BYTE array, factor of 3 because it's RGBA.
-        CImg<unsigned char> image(4, mWidth, mHeight, 1, 0);
-        GL_CHECK( glReadPixels(0, 0, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, image.data()) );
-        printf("Pixels after pass %d:\n", i);
-        printLabels(mWidth, mHeight, image.data());
-        char filename[50];
-        sprintf(filename, "outl%03d.png", i);
-        writeImage(mWidth, mHeight, filename, image);
-}
-#endif
+        // Converged if the passes since the last check (at least a forward
+        // pass, the lookup and the backward pass) left all labels as they are.
+        // The labels only grow, so comparing with the saved ones is enough.
+        if (mCheckConvergence && i%CHECK_PASSES == CHECK_PASSES-1)
+        {
+            if (!labelsChanged())
+                break;
+            saveLabels();
+        }
+
+        if (LOG_ENABLED(LOG_LEVEL_TRACE))
+        {
+            // The convergence check has bound its own FBO
+            GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mRead]) );
+            // Make the BYTE array, factor of 3 because it's RGBA.
+            CImg<unsigned char> image(4, mWidth, mHeight, 1, 0);
+            GL_CHECK( glReadPixels(0, 0, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, image.data()) );
+            Log::countDebugReadback(image.size());
+            printf("Pixels after pass %d:\n", i);
+            printLabels(mWidth, mHeight, image.data());
+            char filename[50];
+            sprintf(filename, "outl%03d.png", i);
+            writeImage(mWidth, mHeight, filename, image);
+        }
+    }
+
+    ///---------- 3. MERGE OF THE TILES  --------------------
+
+    if (mTileSize > 0)
+    {
+        Profiler::Scope scope("label.merge");
+        mergeTileBorders();
     }
 
     GL_CHECK( glDisableVertexAttribArray ( mPositionLoc ) );
@@ -254,8 +364,197 @@ double LabelPhase::run()
     return (endTime-startTime)*1000;
 }
 
+void LabelPhase::saveLabels()
+{
+    // The copy is bound to the unit of the free label texture, which is not read now
+    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mRead]) );
+    GL_CHECK( glActiveTexture( GL_TEXTURE0 + mTextureUnits[TEX_PIPO+mWrite]) );
+    GL_CHECK( glBindTexture ( GL_TEXTURE_2D, mTexSavedId ) );
+    // Only the boxes are compared, the rest of the copy is not used
+    if (mRegions != NULL && mRegions->isActive())
+    {
+        const std::vector<RegionSet::Rect> &boxes = mRegions->boxes();
+        for (size_t i=0; i<boxes.size(); ++i)
+            GL_CHECK( glCopyTexSubImage2D(GL_TEXTURE_2D, 0, boxes[i].x, boxes[i].y,
+                                          boxes[i].x, boxes[i].y, boxes[i].width, boxes[i].height) );
+    }
+    else
+    {
+        GL_CHECK( glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, mWidth, mHeight) );
+    }
+    GL_CHECK( glBindTexture ( GL_TEXTURE_2D, mTexPiPoId[mWrite] ) );
+}
+
+bool LabelPhase::labelsChanged()
+{
+    // The flags are drawn into the free label texture, the saved labels are
+    // sampled by its unit instead. Outside of the regions the flags stay 0.
+    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mWrite]) );
+    GL_CHECK( glActiveTexture( GL_TEXTURE0 + mTextureUnits[TEX_PIPO+mWrite]) );
+    GL_CHECK( glBindTexture ( GL_TEXTURE_2D, mTexSavedId ) );
+    GL_CHECK( glUniform1i ( mSamplerLoc, mTextureUnits[TEX_PIPO+mRead] ) );
+    GL_CHECK( glUniform1i ( mPrevSamplerLoc, mTextureUnits[TEX_PIPO+mWrite] ) );
+    GL_CHECK( glUniform1i ( u_passLoc, STAGE_COMPARE) );
+    drawScene(mRegions, RegionSet::SHAPE_BOXES, mPositionLoc, mTexCoordLoc, mVertices, mIndices);
+    GL_CHECK( glBindTexture ( GL_TEXTURE_2D, mTexPiPoId[mWrite] ) );
+
+    // Reduce the flags (blocks of COMPARE_BLOCK x COMPARE_BLOCK) until a
+    // single one is left
+    GL_CHECK( glUniform1i ( mSamplerLoc, mTextureUnits[TEX_PIPO+mWrite] ) );
+    GL_CHECK( glUniform1i ( u_passLoc, STAGE_ANY_CHANGED) );
+    int width  = mWidth;
+    int height = mHeight;
+    int write  = 0;
+    while (width > 1 || height > 1)
+    {
+        // The first level reads the frame, all further ones the flag textures
+        if (width == mWidth && height == mHeight)
+            GL_CHECK( glUniform2f ( u_texDimLoc, mWidth, mHeight) );
+        else
+            GL_CHECK( glUniform2f ( u_texDimLoc, mChangedWidth, mChangedHeight) );
+        width  = (width  + COMPARE_BLOCK - 1) / COMPARE_BLOCK;
+        height = (height + COMPARE_BLOCK - 1) / COMPARE_BLOCK;
+        GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboChangedId[write]) );
+        // The flags beyond the viewport are read by the next level
+        GL_CHECK( glClear( GL_COLOR_BUFFER_BIT ) );
+        GL_CHECK( glViewport ( 0, 0, width, height ) );
+        drawScene(NULL, RegionSet::SHAPE_BOXES, mPositionLoc, mTexCoordLoc, mVertices, mIndices);
+        GL_CHECK( glBindTexture ( GL_TEXTURE_2D, mTexChangedId[write] ) );
+        write = 1-write;
+    }
+    GL_CHECK( glBindTexture ( GL_TEXTURE_2D, mTexPiPoId[mWrite] ) );
+    GL_CHECK( glUniform2f ( u_texDimLoc, mWidth, mHeight) );
+
+    GLubyte changed[4];
+    GL_CHECK( glReadPixels(0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, changed) );
+
+    GL_CHECK( glViewport ( 0, 0, mWidth, mHeight ) );
+
+    return changed[0] != 0;
+}
+
+void LabelPhase::mergeTileBorders()
+{
+    // Only the 2 rows and columns at each tile border are read back and
+    // looked up below, the rest of mLabels is not set. Outside of the regions
+    // the textures were cleared, so the complete rows and columns are read.
+    mLabels.resize((size_t)4*mWidth*mHeight);
+    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mRead]) );
+    for (int y = mTileSize-1; y+1 < mHeight; y += mTileSize)
+    {
+        GL_CHECK( glReadPixels(0, y, mWidth, 2, GL_RGBA, GL_UNSIGNED_BYTE, &mLabels[(size_t)4*y*mWidth]) );
+    }
+    std::vector<GLubyte> columns((size_t)4*2*mHeight);
+    for (int x = mTileSize-1; x+1 < mWidth; x += mTileSize)
+    {
+        GL_CHECK( glReadPixels(x, 0, 2, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, columns.data()) );
+        for (int y = 0; y < mHeight; ++y)
+            std::copy(&columns[(size_t)4*2*y], &columns[(size_t)4*2*(y+1)], &mLabels[(size_t)4*(y*mWidth + x)]);
+    }
+
+    // Index of the root pixel of the label at (x,y), -1 for the background
+    auto labelAt = [&](int x, int y) -> int32_t
+    {
+        if (x < 0 || x >= mWidth || y < 0 || y >= mHeight)
+            return -1;
+
+        const GLubyte *label = &mLabels[(size_t)4*(y*mWidth + x)];
+        int labelX = label[0] | (label[1] << 8);
+        int labelY = label[2] | (label[3] << 8);
+        if (labelX == 0 || labelY == 0)
+            return -1;
+        return (labelY-1)*mWidth + (labelX-1);
+    };
+
+    // Union-find over the tile-local labels at the borders
+    std::unordered_map<int32_t, int32_t> parent;
+    auto findRoot = [&](int32_t label) -> int32_t
+    {
+        std::unordered_map<int32_t, int32_t>::iterator it = parent.find(label);
+        while (it != parent.end() && it->second != label)
+        {
+            label = it->second;
+            it = parent.find(label);
+        }
+        return label;
+    };
+    auto join = [&](int32_t a, int32_t b)
+    {
+        if (a < 0 || b < 0 || a == b)
+            return;
+
+        a = findRoot(a);
+        b = findRoot(b);
+        // Link to the higher label, i.e. the top-right pixel becomes the root like in the shader
+        if (a < b)
+            parent[a] = b;
+        else if (b < a)
+            parent[b] = a;
+    };
+
+    // Vertical borders between the columns x and x+1
+    for (int x = mTileSize-1; x+1 < mWidth; x += mTileSize)
+    {
+        for (int y = 0; y < mHeight; ++y)
+        {
+            int32_t label = labelAt(x, y);
+            if (label < 0)
+                continue;
+            for (int dy = -1; dy <= 1; ++dy)
+                join(label, labelAt(x+1, y+dy));
+        }
+    }
+
+    // Horizontal borders between the rows y and y+1
+    for (int y = mTileSize-1; y+1 < mHeight; y += mTileSize)
+    {
+        for (int x = 0; x < mWidth; ++x)
+        {
+            int32_t label = labelAt(x, y);
+            if (label < 0)
+                continue;
+            for (int dx = -1; dx <= 1; ++dx)
+                join(label, labelAt(x+dx, y+1));
+        }
+    }
+
+    // Write the label of the complete spot into the root pixel of each tile-local label
+    GL_CHECK( glActiveTexture( GL_TEXTURE0 + mTextureUnits[TEX_PIPO+mRead]) );
+    GL_CHECK( glBindTexture ( GL_TEXTURE_2D, mTexPiPoId[mRead] ) );
+    GL_CHECK( glPixelStorei ( GL_UNPACK_ALIGNMENT, 1 ) );
+    int numChanged = 0;
+    for (std::unordered_map<int32_t, int32_t>::iterator it = parent.begin(); it != parent.end(); ++it)
+    {
+        int32_t root = findRoot(it->first);
+        if (root == it->first)
+            continue;
+
+        int rootX = root % mWidth + 1;
+        int rootY = root / mWidth + 1;
+        GLubyte label[4] = { (GLubyte)(rootX & 0xff), (GLubyte)(rootX >> 8),
+                             (GLubyte)(rootY & 0xff), (GLubyte)(rootY >> 8) };
+        GL_CHECK( glTexSubImage2D ( GL_TEXTURE_2D, 0, it->first % mWidth, it->first / mWidth, 1, 1,
+                                    GL_RGBA, GL_UNSIGNED_BYTE, label) );
+        ++numChanged;
+    }
+
+    if (numChanged == 0)
+        return;
+
+    // One lookup pass, every pixel takes the new label of its root
+    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mWrite]) );
+    GL_CHECK( glUniform1i ( mSamplerLoc, mTextureUnits[TEX_PIPO+mRead] ) );
+    GL_CHECK( glUniform1i ( u_passLoc, STAGE_LABEL_LOOKUP) );
+    drawScene(mRegions, RegionSet::SHAPE_BOXES, mPositionLoc, mTexCoordLoc, mVertices, mIndices);
+    std::swap(mRead, mWrite);
+    ++mNumPasses;
+}
+
 void LabelPhase::releaseGlResources()
 {
+    GL_CHECK( glDeleteFramebuffers(2, mFboChangedId) );
+    GL_CHECK( glDeleteTextures(2, mTexChangedId) );
+    GL_CHECK( glDeleteTextures(1, &mTexSavedId) );
     GL_CHECK( glDeleteProgram(mProgramObject) );
     GL_CHECK( glDeleteTextures(1, &mTexOrigId) );
     GL_CHECK( glDeleteTextures(2, mTexPiPoId) );
@@ -0,0 +1,57 @@
+#include "log.h"
+
+#include <stdlib.h>
+#include <atomic>
+
+// Several contexts may run on their own threads, see OglesPool
+static std::atomic<size_t> sNumMessages(0);
+static std::atomic<size_t> sNumDebugReadbacks(0);
+
+// Initialized once from the environment by the first call (thread-safe)
+static std::atomic<int> &currentLevel()
+{
+    static std::atomic<int> sLevel( []()
+    {
+        const char *env = getenv("GPULABELING_LOG_LEVEL");
+        return (env != NULL && *env != '\0') ? atoi(env) : (int)LOG_LEVEL_INFO;
+    }() );
+    return sLevel;
+}
+
+int Log::level()
+{
+    return currentLevel().load(std::memory_order_relaxed);
+}
+
+void Log::setLevel(int level)
+{
+    currentLevel().store(level, std::memory_order_relaxed);
+}
+
+std::ostream &Log::stream(int level)
+{
+    ++sNumMessages;
+    return (level <= LOG_LEVEL_WARN) ? std::cerr : std::cout;
+}
+
+void Log::countDebugReadback(size_t bytes)
+{
+    (void)bytes;
+    ++sNumDebugReadbacks;
+}
+
+size_t Log::numMessages()
+{
+    return sNumMessages;
+}
+
+size_t Log::numDebugReadbacks()
+{
+    return sNumDebugReadbacks;
+}
+
+void Log::resetCounters()
+{
+    sNumMessages = 0;
+    sNumDebugReadbacks = 0;
+}
@@ -1,22 +1,204 @@
 #include"ogles.h"
+#include "batchLoader.h"
+#include "getTime.h"
+#include "log.h"
+#include "spotFileWriter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
 #ifdef _RPI
 #include "bcm_host.h"
 #endif
 
+/*
+ * Batch mode: extracts the spots of a list of images with a single context
+ *
+ * Usage: gpulabeling [options] <image|directory|pattern|@list> ...
+ *   -o <file>     Spot file (default spots.bin), text if it ends with .txt
+ *   -t <value>    Smallest foreground pixel value (default: above 64.3/255 of the full scale)
+ *   -b <bits>     Bits per pixel of the images (default 8)
+ *   -j <threads>  Decoder threads (default: number of cores)
+ *   -p <frames>   Files decoded ahead (default: twice the decoder threads)
+ *   -c            Use the CPU backend
+ *   -v            Print the timing of every frame
+ *
+ * Without an image ../test.tga is processed. The next files are decoded on
+ * worker threads while the GPU works on the current one. The spots are
+ * written as binary spot file (see spotFile.h), the timestamp of a frame is
+ * the modification time of its file. In the text format each frame gets a
+ * line "F <index> <number of spots> <filename>" followed by one line
+ * "<x> <y> <area> <luminance>" per spot.
+ */
+
+static void printUsage()
+{
+    fprintf(stderr, "Usage: gpulabeling [-o spots.bin] [-t threshold] [-b bits] [-j threads] [-p frames] [-c] [-v]"
+                    " <image|directory|pattern|@list> ...\n");
+}
+
+static void writeSpots(FILE *textFile, SpotFileWriter &binaryFile, size_t index, const std::string &filename,
+                       const std::vector<StatsPhase::Spot> &spots)
+{
+    if (textFile == NULL)
+    {
+        struct stat info;
+        uint64_t timestamp = 0;
+        if (stat(filename.c_str(), &info) == 0)
+            timestamp = (uint64_t)info.st_mtim.tv_sec*1000000000 + info.st_mtim.tv_nsec;
+        binaryFile.writeFrame(timestamp, index, spots);
+        return;
+    }
 
-int main()
+    fprintf(textFile, "F %lu %lu %s\n", (unsigned long)index, (unsigned long)spots.size(), filename.c_str());
+    for (size_t i=0; i<spots.size(); ++i)
+    {
+        fprintf(textFile, "%.3f %.3f %u %u\n", spots[i].x, spots[i].y, spots[i].area, spots[i].luminance);
+    }
+}
+
+int main(int argc, char *argv[])
 {
+    std::string spotFilename = "spots.bin";
+    int threshold = -1; // -1: the default of the phases
+    int bitDepth = 8;
+    unsigned numThreads = 0;
+    unsigned numPrefetch = 0;
+    Ogles::Backend backend = Ogles::BACKEND_GPU;
+    bool verbose = false;
+    std::vector<std::string> inputs;
+
+    for (int i=1; i<argc; ++i)
+    {
+        bool hasValue = i+1 < argc;
+        if (strcmp(argv[i], "-o") == 0 && hasValue)
+            spotFilename = argv[++i];
+        else if (strcmp(argv[i], "-t") == 0 && hasValue)
+            threshold = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-b") == 0 && hasValue)
+            bitDepth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-j") == 0 && hasValue)
+            numThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-p") == 0 && hasValue)
+            numPrefetch = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0)
+            backend = Ogles::BACKEND_CPU;
+        else if (strcmp(argv[i], "-v") == 0)
+            verbose = true;
+        else if (argv[i][0] == '-')
+        {
+            printUsage();
+            return 1;
+        }
+        else
+            inputs.push_back(argv[i]);
+    }
+    if (inputs.empty())
+        inputs.push_back("../test.tga");
+
+    std::vector<std::string> filenames = BatchLoader::expandInputs(inputs);
+    if (filenames.empty())
+    {
+        fprintf(stderr, "No images found\n");
+        return 1;
+    }
+
+    bool isText = spotFilename.size() > 4 && spotFilename.compare(spotFilename.size()-4, 4, ".txt") == 0;
+    FILE *textFile = NULL;
+    SpotFileWriter binaryFile;
+    try
+    {
+        if (isText && (textFile = fopen(spotFilename.c_str(), "w")) == NULL)
+            throw std::runtime_error("Failed to open " + spotFilename);
+        if (!isText)
+            binaryFile.open(spotFilename);
+    }
+    catch (std::runtime_error &e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
 #ifdef _RPI
     bcm_host_init();
 #endif
 
-    Ogles ogles("../test.tga");
+    if (!verbose)
+        Log::setLevel(LOG_LEVEL_WARN);
+
+    Ogles ogles(0, 0, backend);
+    ogles.mLabelPhase.mOrigBitDepth = bitDepth;
+    if (threshold >= 0)
+    {
+        ogles.mLabelPhase.setThreshold(threshold);
+        ogles.mCpuPhase.u_threshold = (threshold - 0.5f) / 255;
+    }
+
+    BatchLoader loader(filenames, bitDepth, numThreads, numPrefetch);
+
+    // The pixels of the pending frame have to stay valid until the next frame is issued
+    BatchLoader::Image images[2];
+    size_t indices[2] = { 0, 0 };
+    int current = 0;
+    bool pending = false;
+    size_t numFrames = 0, numFailed = 0, numSpots = 0;
+
+    double startTime = getRealTime();
+    for (size_t index=0; loader.next(images[current]); ++index)
+    {
+        BatchLoader::Image &image = images[current];
+        if (!image.error.empty())
+        {
+            fprintf(stderr, "Skipping %s: %s\n", image.filename.c_str(), image.error.c_str());
+            ++numFailed;
+            continue;
+        }
+
+        try
+        {
+            const std::vector<StatsPhase::Spot> &spots = ogles.processFramePipelined(image.frame());
+            if (pending)
+            {
+                writeSpots(textFile, binaryFile, indices[1-current], images[1-current].filename, spots);
+                numSpots += spots.size();
+            }
+        }
+        catch (std::runtime_error &e)
+        {
+            fprintf(stderr, "Skipping %s: %s\n", image.filename.c_str(), e.what());
+            ++numFailed;
+            continue;
+        }
+
+        indices[current] = index;
+        pending = true;
+        current = 1-current;
+        ++numFrames;
+    }
+    if (pending)
+    {
+        const std::vector<StatsPhase::Spot> &spots = ogles.flushPipeline();
+        writeSpots(textFile, binaryFile, indices[1-current], images[1-current].filename, spots);
+        numSpots += spots.size();
+    }
+    double time = getRealTime() - startTime;
+    if (textFile != NULL)
+        fclose(textFile);
+    binaryFile.close();
 
-    ogles.extractSpots();
+    printf("%lu frames (%lu skipped), %lu spots in %.2f s: %.2f frames/s, %u decoder threads, %u prefetched\n",
+           (unsigned long)numFrames, (unsigned long)numFailed, (unsigned long)numSpots, time,
+           time > 0 ? numFrames/time : 0.0, loader.numThreads(), loader.numPrefetch());
+    printf("Spots written to %s\n", spotFilename.c_str());
 
 #ifdef _RPI
     bcm_host_deinit();
 #endif
 
-    return 0;
+    return numFrames ? 0 : 1;
 }
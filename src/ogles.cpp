@@ -1,17 +1,22 @@
 #include "ogles.h"
+#include "programCache.h"
 #include "phase.h"
 
 #include <GLES2/gl2.h>
 #include <EGL/egl.h>
 
+#include <string.h>
+#include <algorithm>
+#include <mutex>
 #include <stdexcept>
 #include <fstream>
 #include <iostream>
-using std::cout;
 using std::cerr;
 using std::endl;
 
 #include "getTime.h"
+#include "profiler.h"
+#include "log.h"
 
 
 
@@ -25,8 +30,16 @@ using std::endl;
 #define EGL_CHECK(stmt) stmt
 #endif
 
-Ogles::Ogles(int width, int height)
-    :mLabelPhase(width, height), mWidth(width), mHeight(height), mUsedTexUnits(0), mIsInitialized(false)
+// EGL displays are not reference counted, the last Ogles object terminates it
+static std::mutex sDisplayMutex;
+static unsigned sDisplayUsers = 0;
+
+Ogles::Ogles(int width, int height, Backend backend)
+    :mLabelPhase(width, height), mCpuPhase(width, height), mUseRegions(true), mRegionDetection(REGIONS_MASK), mAcquisitionInterval(25),
+      mWidth(width), mHeight(height), mUsedTexUnits(0), mIsInitialized(false), mBackend(backend),
+      mFramesSinceAcquisition(0), mSpotLost(false), mWasAcquisition(false),
+      mPipelinePending(false), mHasFenceSync(false), mPendingFence(EGL_NO_SYNC_KHR),
+      mCreateSync(NULL), mClientWaitSync(NULL), mDestroySync(NULL)
 {
     // Initialize structs to 0
     esContext = {};
@@ -34,17 +47,26 @@ Ogles::Ogles(int width, int height)
 
 Ogles::~Ogles()
 {
+    // Nothing to clean up if no context was ever created
+    if(!mIsInitialized || mBackend == BACKEND_CPU)
+        return;
+
     // Clean up OpenGL objects
+    makeCurrent();
+    if(mPendingFence != EGL_NO_SYNC_KHR)
+        mDestroySync(esContext.eglDisplay, mPendingFence);
+    mIngestPhase.releaseGlResources();
+    mPyramidPhase.releaseGlResources();
     GL_CHECK( glDeleteFramebuffers(2, mFboId) );
-    // Clean up EGL-context
-    EGL_CHECK ( eglMakeCurrent(esContext.eglDisplay , EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT) );
-    EGL_CHECK ( eglDestroyContext(esContext.eglDisplay, esContext.eglContext) );
-    EGL_CHECK ( eglDestroySurface(esContext.eglDisplay, esContext.eglSurface) );
-    EGL_CHECK ( eglTerminate(esContext.eglDisplay) );
+    ProgramCache::releaseContext();
+    releaseEGL();
 }
 
-Ogles::Ogles(std::string imageFilename)
-    :mLabelPhase(0, 0), mUsedTexUnits(0), mIsInitialized(false)
+Ogles::Ogles(std::string imageFilename, Backend backend)
+    :mLabelPhase(0, 0), mUseRegions(true), mRegionDetection(REGIONS_MASK), mAcquisitionInterval(25), mUsedTexUnits(0), mIsInitialized(false), mBackend(backend),
+      mFramesSinceAcquisition(0), mSpotLost(false), mWasAcquisition(false),
+      mPipelinePending(false), mHasFenceSync(false), mPendingFence(EGL_NO_SYNC_KHR),
+      mCreateSync(NULL), mClientWaitSync(NULL), mDestroySync(NULL)
 {
     // Initialize esContext to 0
     esContext = {};
@@ -59,10 +81,6 @@ Ogles::Ogles(std::string imageFilename)
 
 void Ogles::extractSpots()
 {
-    double startTime, endTime;
-    double labelTime, reductionTime;
-    double statsTime;
-
     if(mLabelPhase.mImage.is_empty())
     {
         throw std::runtime_error(std::string("OGLES: Tried to run extraction on empty image"));
@@ -72,49 +90,458 @@ void Ogles::extractSpots()
     {
         initialize();
     }
+    else if(mBackend == BACKEND_GPU)
+    {
+        makeCurrent();
+    }
+
+    // Finish a pipelined frame first, its spots are dropped
+    if(mPipelinePending)
+        flushPipeline();
+
+    if(mBackend == BACKEND_CPU)
+    {
+        checkCpuBitDepth(mLabelPhase.mOrigBitDepth);
+        // The image is interleaved (channels along the x-axis of the CImg)
+        // and already mirrored to OpenGL orientation
+        int channels = mLabelPhase.mImage.width();
+        mCpuPhase.setImage(mLabelPhase.mImage.data(), (ptrdiff_t)channels*mWidth, channels);
+        extractSpotsCpu();
+        return;
+    }
+
+    if(mUseRegions && mRegionDetection == REGIONS_PYRAMID_GPU)
+    {
+        updateRegionsGpu();
+    }
+    else if(mUseRegions)
+    {
+        // Interleaved: the channels are the x-axis of the CImg, for high bit
+        // depth images the second one is the high byte
+        int channels = mLabelPhase.mImage.width();
+        int highByte = mLabelPhase.mOrigBitDepth > 8 ? 1 : 0;
+        updateRegions(mLabelPhase.mImage.data() + highByte, (ptrdiff_t)channels*mWidth, channels);
+    }
+    else
+    {
+        mRegions.reset();
+    }
+
+    extractSpotsGpu();
+}
+
+void Ogles::extractSpotsGpu(bool readBack)
+{
+    double startTime, endTime;
+    double labelTime, reductionTime;
+    double statsTime;
 
     startTime = getRealTime();
 
-    cout << "*** LABEL PHASE START" << endl;
+    LOG_DEBUG("*** LABEL PHASE START");
     mLabelPhase.setupGeometry();
-    labelTime = mLabelPhase.run();
-    cout << "*** LABEL PHASE END" << endl;
+    {
+        Profiler::Scope scope("label");
+        // The convergence check and the tile merge read back, so the
+        // pipelined mode runs the fixed number of passes of the whole frame
+        bool checkConvergence = mLabelPhase.mCheckConvergence;
+        int tileSize = mLabelPhase.mTileSize;
+        if (!readBack)
+        {
+            mLabelPhase.mCheckConvergence = false;
+            mLabelPhase.mTileSize = 0;
+        }
+        labelTime = mLabelPhase.run();
+        mLabelPhase.mCheckConvergence = checkConvergence;
+        mLabelPhase.mTileSize = tileSize;
+    }
+    LOG_DEBUG("*** LABEL PHASE END");
 
     mReductionPhase.updateTextures(mLabelPhase.getLastTexture(), mLabelPhase.getLastTexUnit(),
                                    mLabelPhase.getFreeTexture(), mLabelPhase.getFreeTexUnit() );
     mReductionPhase.setupGeometry();
-    cout << "*** REDUCTION PHASE START" << endl;
-    reductionTime = mReductionPhase.run();
+    // Reading back the size of the table would end the overlap of the pipelined mode
+    mReductionPhase.mCountTable = readBack;
+    LOG_DEBUG("*** REDUCTION PHASE START");
+    {
+        Profiler::Scope scope("reduction");
+        reductionTime = mReductionPhase.run();
+    }
 
-    cout << "*** REDUCTION PHASE END" << endl;
+    LOG_DEBUG("*** REDUCTION PHASE END");
 
     mStatsPhase.updateTextures( mLabelPhase.getOrigTexture(), mLabelPhase.getOrigTexUnit(),
                                 mLabelPhase.getLastTexture(), mLabelPhase.getLastTexUnit(),
-                                mReductionPhase.getLastTexture(), mReductionPhase.getLastTexUnit(),
+                                mReductionPhase.getTableTexture(), mReductionPhase.getTableTexUnit(),
                                 mReductionPhase.getFreeTexture(), mReductionPhase.getFreeTexUnit(),
-                                mReductionPhase.getFreeTexture2(), mReductionPhase.getFreeTexUnit2()
+                                mReductionPhase.getFreeTexture2(), mReductionPhase.getFreeTexUnit2(),
+                                mLabelPhase.isOrigTopDown()
                                );
+    mStatsPhase.setTableSize(mReductionPhase.getTableWidth(), mReductionPhase.getTableHeight(),
+                             mReductionPhase.getTableRows());
 
     mStatsPhase.setupGeometry();
-    cout << "*** STATS PHASE START" << endl;
-    statsTime = mStatsPhase.run();
-    cout << "*** STATS PHASE END" << endl;
+    LOG_DEBUG("*** STATS PHASE START");
+    {
+        Profiler::Scope scope("stats");
+        statsTime = readBack ? mStatsPhase.run() : mStatsPhase.runPasses();
+    }
+    LOG_DEBUG("*** STATS PHASE END");
 
     endTime = getRealTime();
 
-    cout << "Label time: " << labelTime << endl;
-    cout << "Reduction time: " << reductionTime << endl;
-    cout << "Stats time: " << statsTime << endl;
-    cout << "Total time: " << (endTime-startTime)*1000 << endl;
+    LOG_INFO("Label time: " << labelTime << " (" << mLabelPhase.mNumPasses << " passes)");
+    LOG_INFO("Reduction time: " << reductionTime << " (" << mReductionPhase.mNumPasses << " passes)");
+    LOG_INFO("Stats time: " << statsTime);
+    LOG_INFO("Total time: " << (endTime-startTime)*1000);
+
+    if(readBack)
+        LOG_INFO("Found " << mStatsPhase.mSpots.size() << " spots");
+}
+
+const std::vector<StatsPhase::Spot>& Ogles::processFrame(const uint8_t *pixels, int width, int height)
+{
+    return processFrame(IngestPhase::Frame(pixels, width, height, width));
+}
+
+const std::vector<StatsPhase::Spot>& Ogles::processFrame(const IngestPhase::Frame &frame)
+{
+    // Finish a pipelined frame first, its spots are dropped
+    if(mPipelinePending)
+        flushPipeline();
+
+    prepareFrame(frame);
+
+    if(mBackend == BACKEND_CPU)
+    {
+        processFrameCpu(frame);
+        return mCpuPhase.mSpots;
+    }
+
+    buildFrameRegions(frame);
+    ingestFrame(frame);
+    if(mUseRegions && mRegionDetection == REGIONS_PYRAMID_GPU)
+        updateRegionsGpu();
+    extractSpotsGpu();
+
+    return mStatsPhase.mSpots;
+}
+
+const std::vector<StatsPhase::Spot>& Ogles::trackFrame(const IngestPhase::Frame &frame,
+                                                       const std::vector<RegionSet::Window> &windows)
+{
+    mWasAcquisition = windows.empty() || mSpotLost ||
+                      (mAcquisitionInterval > 0 && mFramesSinceAcquisition >= mAcquisitionInterval);
+    if(mWasAcquisition)
+    {
+        LOG_INFO("Tracking: full frame acquisition");
+        mFramesSinceAcquisition = 0;
+        mSpotLost = false;
+        return processFrame(frame);
+    }
+
+    // Finish a pipelined frame first, its spots are dropped
+    if(mPipelinePending)
+        flushPipeline();
+
+    prepareFrame(frame);
+    {
+        Profiler::Scope scope("regions");
+        mRegions.build(windows, mWidth, mHeight);
+    }
+    LOG_INFO("Tracking: " << windows.size() << " windows, " << mRegions.boxes().size() << " boxes, "
+             << mRegions.coverage()*100 << "% of the frame" << (mRegions.isActive() ? "" : " (inactive)"));
+
+    if(mBackend == BACKEND_CPU)
+    {
+        mCpuPhase.mRegions = &mRegions;
+        processFrameCpu(frame);
+        mCpuPhase.mRegions = NULL;
+    }
+    else
+    {
+        ingestFrame(frame);
+        extractSpotsGpu();
+    }
+    ++mFramesSinceAcquisition;
+
+    // A spot is lost if its window does not contain the centre of any spot
+    const std::vector<StatsPhase::Spot> &spots = getSpots();
+    unsigned numLost = 0;
+    for(size_t i=0; i<windows.size(); ++i)
+    {
+        const RegionSet::Window &window = windows[i];
+        bool isFound = false;
+        for(size_t n=0; n<spots.size() && !isFound; ++n)
+        {
+            float dx = spots[n].x - window.x;
+            float dy = spots[n].y - window.y;
+            isFound = dx*dx + dy*dy <= window.radius*window.radius;
+        }
+        if(!isFound)
+            ++numLost;
+    }
+    if(numLost > 0)
+    {
+        LOG_INFO("Tracking: " << numLost << " spots lost");
+        mSpotLost = true;
+    }
+
+    return spots;
+}
+
+bool Ogles::wasAcquisition() const
+{
+    return mWasAcquisition;
+}
+
+const std::vector<StatsPhase::Spot>& Ogles::processFramePipelined(const IngestPhase::Frame &frame)
+{
+    prepareFrame(frame);
+
+    if(mBackend == BACKEND_CPU)
+    {
+        // Nothing runs in parallel, only the latency is the same as on the GPU
+        processFrameCpu(frame);
+        mCpuPhase.mSpots.swap(mPipelineSpots);
+        if(!mPipelinePending)
+            mCpuPhase.mSpots.clear();
+        mPipelinePending = true;
+        return mCpuPhase.mSpots;
+    }
+
+    // The CPU part of this frame overlaps with the passes of the previous frame
+    buildFrameRegions(frame);
+
+    if(mPipelinePending)
+        collectPendingFrame();
+    else
+        mStatsPhase.mSpots.clear();
+
+    ingestFrame(frame);
+    if(mUseRegions && mRegionDetection == REGIONS_PYRAMID_GPU)
+        updateRegionsGpu();
+    extractSpotsGpu(false);
+
+    // Make sure the GPU starts on the passes before the next call
+    if(mHasFenceSync)
+        mPendingFence = mCreateSync(esContext.eglDisplay, EGL_SYNC_FENCE_KHR, NULL);
+    GL_CHECK( glFlush() );
+    mPipelinePending = true;
+
+    return mStatsPhase.mSpots;
+}
+
+const std::vector<StatsPhase::Spot>& Ogles::flushPipeline()
+{
+    if(mBackend == BACKEND_CPU)
+    {
+        mCpuPhase.mSpots.swap(mPipelineSpots);
+        if(!mPipelinePending)
+            mCpuPhase.mSpots.clear();
+        mPipelinePending = false;
+        return mCpuPhase.mSpots;
+    }
+
+    if(mPipelinePending)
+    {
+        makeCurrent();
+        collectPendingFrame();
+    }
+    else
+        mStatsPhase.mSpots.clear();
+
+    return mStatsPhase.mSpots;
+}
+
+void Ogles::collectPendingFrame()
+{
+    double startTime = getRealTime();
+
+    if(mPendingFence != EGL_NO_SYNC_KHR)
+    {
+        mClientWaitSync(esContext.eglDisplay, mPendingFence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+        mDestroySync(esContext.eglDisplay, mPendingFence);
+        mPendingFence = EGL_NO_SYNC_KHR;
+    }
+    double waitTime = getRealTime();
+
+    // Without a fence the first glReadPixels waits for the passes
+    mStatsPhase.readSpots();
+    mPipelinePending = false;
+
+    double endTime = getRealTime();
+    LOG_INFO("Pipeline wait: " << (waitTime-startTime)*1000 << " readback: " << (endTime-waitTime)*1000);
+    LOG_INFO("Found " << mStatsPhase.mSpots.size() << " spots");
+}
+
+void Ogles::prepareFrame(const IngestPhase::Frame &frame)
+{
+    if(frame.pixels == NULL && frame.fd < 0)
+    {
+        throw std::runtime_error(std::string("OGLES: Frame has neither pixels nor a dmabuf"));
+    }
+    if(frame.stride < frame.width*frame.bytesPerPixel())
+    {
+        throw std::runtime_error(std::string("OGLES: Stride of the frame is smaller than its width"));
+    }
+
+    if(!mIsInitialized)
+    {
+        mWidth  = frame.width;
+        mHeight = frame.height;
+        mLabelPhase.mWidth  = mWidth;
+        mLabelPhase.mHeight = mHeight;
+        mLabelPhase.mOrigBitDepth = frame.bitDepth;
+        initialize();
+    }
+    else if(frame.width != mWidth || frame.height != mHeight)
+    {
+        throw std::runtime_error(std::string("OGLES: Frame size does not match the size of the stream"));
+    }
+    else if(mBackend == BACKEND_GPU)
+    {
+        makeCurrent();
+    }
+}
+
+void Ogles::makeCurrent()
+{
+    if(eglGetCurrentContext() != esContext.eglContext)
+        EGL_CHECK( eglMakeCurrent(esContext.eglDisplay, esContext.eglSurface, esContext.eglSurface, esContext.eglContext) );
+}
+
+void Ogles::processFrameCpu(const IngestPhase::Frame &frame)
+{
+    checkCpuBitDepth(frame.bitDepth);
+    // Start at the bottom row with a negative stride instead of copying the frame
+    IngestPhase::Mapping mapping(frame);
+    mCpuPhase.setImage(mapping.pixels() + (size_t)(mHeight-1)*frame.stride, -(ptrdiff_t)frame.stride, 1);
+    extractSpotsCpu();
+}
+
+void Ogles::buildFrameRegions(const IngestPhase::Frame &frame)
+{
+    if(mUseRegions && mRegionDetection == REGIONS_PYRAMID_GPU)
+    {
+        // Built from the texture after the ingest
+        return;
+    }
+    if(mUseRegions)
+    {
+        // High bit depth frames are little endian, the regions are built from the high byte
+        IngestPhase::Mapping mapping(frame);
+        int bytesPerPixel = frame.bytesPerPixel();
+        updateRegions(mapping.pixels() + (size_t)(mHeight-1)*frame.stride + bytesPerPixel-1,
+                      -(ptrdiff_t)frame.stride, bytesPerPixel);
+    }
+    else
+    {
+        mRegions.reset();
+    }
+}
+
+void Ogles::ingestFrame(const IngestPhase::Frame &frame)
+{
+    Profiler::Scope scope("ingest");
+    double ingestTime = mIngestPhase.ingest(frame);
+    LOG_INFO("Ingest time: " << ingestTime << (mIngestPhase.mLastImported ? " (dmabuf import)" : " (upload)"));
+    mLabelPhase.setOrigSource(mIngestPhase.getFrameTexture(), mIngestPhase.isFrameTopDown());
+}
+
+void Ogles::updateRegions(const uint8_t *pixels, ptrdiff_t rowStride, int pixelStride)
+{
+    Profiler::Scope scope("regions");
+
+    // Above 8 bits only the high byte is compared, i.e. the mask may contain
+    // a few pixels below the threshold but never misses a foreground pixel
+    int thresholdValue = ThresholdKernel::thresholdValue(mLabelPhase.u_threshold, mLabelPhase.origMaxValue());
+    if(mLabelPhase.mOrigBitDepth > 8)
+        thresholdValue >>= 8;
+
+    if(mRegionDetection == REGIONS_TILE_MAX)
+    {
+        int tileSize = mRegions.mTileSize;
+        mTileMax.resize((size_t)((mWidth + tileSize - 1) / tileSize) * ((mHeight + tileSize - 1) / tileSize));
+        ThresholdKernel::computeTileMax(pixels, rowStride, pixelStride, mWidth, mHeight, tileSize, mTileMax.data());
+        for(size_t i=0; i<mTileMax.size(); ++i)
+            mTileMax[i] = mTileMax[i] >= thresholdValue;
+        mRegions.buildFromTiles(mTileMax.data(), mWidth, mHeight);
+    }
+    else
+    {
+        mMask.resize((size_t)ThresholdKernel::wordsPerRow(mWidth)*mHeight);
+        ThresholdKernel::computeMask(pixels, rowStride, pixelStride,
+                                     mWidth, mHeight, 0, mHeight,
+                                     thresholdValue, mMask.data());
+        mRegions.build(mMask.data(), mWidth, mHeight);
+    }
+
+    LOG_INFO("Regions: " << mRegions.boxes().size() << " boxes, " << mRegions.coverage()*100 << "% of the frame"
+             << (mRegions.isActive() ? "" : " (inactive)"));
+}
+
+void Ogles::updateRegionsGpu()
+{
+    Profiler::Scope scope("regions");
+
+    mPyramidPhase.setTileSize(mRegions.mTileSize);
+    mPyramidPhase.u_threshold  = mLabelPhase.u_threshold;
+    mPyramidPhase.mOrigTexUnit = mLabelPhase.getOrigTexUnit();
+    mPyramidPhase.mOrigTopDown = mLabelPhase.isOrigTopDown();
+    mPyramidPhase.mOrigMaxValue = mLabelPhase.origMaxValue();
+    double pyramidTime = mPyramidPhase.run();
+    mRegions.buildFromTiles(mPyramidPhase.mTiles.data(), mWidth, mHeight);
+
+    LOG_INFO("Regions (pyramid " << pyramidTime << " ms): " << mRegions.boxes().size() << " boxes, "
+             << mRegions.coverage()*100 << "% of the frame" << (mRegions.isActive() ? "" : " (inactive)"));
+}
 
-    cout << "Found " << mStatsPhase.mSpots.size() << " spots" << endl;
+void Ogles::checkCpuBitDepth(int bitDepth)
+{
+    if(bitDepth > 8)
+    {
+        throw std::runtime_error(std::string("OGLES: The CPU backend only supports 8-bit images"));
+    }
+}
+
+void Ogles::extractSpotsCpu()
+{
+    Profiler::Scope scope("cpu");
+    double cpuTime = mCpuPhase.run();
+
+    LOG_INFO("CPU time (" << mCpuPhase.numThreads() << " threads, "
+             << ThresholdKernel::isaName() << "): " << cpuTime);
+    LOG_INFO("Found " << mCpuPhase.mSpots.size() << " spots");
+}
+
+const std::vector<StatsPhase::Spot>& Ogles::getSpots() const
+{
+    if(mBackend == BACKEND_CPU)
+        return mCpuPhase.mSpots;
+    return mStatsPhase.mSpots;
+}
+
+Ogles::Backend Ogles::getBackend() const
+{
+    return mBackend;
 }
 
 void Ogles::loadImageFromFile(std::string imageFilename, bool updateTexture)
 {
+    if(mLabelPhase.mOrigBitDepth > 8)
+    {
+        loadDeepImageFromFile(imageFilename, updateTexture);
+        return;
+    }
+
     mLabelPhase.mImage.assign(imageFilename.c_str());
     mWidth  = mLabelPhase.mImage.width();
     mHeight = mLabelPhase.mImage.height();
+    if(mLabelPhase.mOrigFormat == GL_LUMINANCE)
+    {
+        mLabelPhase.mImage.channel(0);       //The shaders only read the grey value
+    }
     mLabelPhase.mImage.mirror("y");          //OpenGL-textures start in the bottom left corner (not the top-left)
     mLabelPhase.mImage.permute_axes("cxyz"); //CImg stores the image data planar -> convert it to interleaved RGB for texture
 
@@ -127,6 +554,32 @@ void Ogles::loadImageFromFile(std::string imageFilename, bool updateTexture)
     }
 }
 
+void Ogles::loadDeepImageFromFile(std::string imageFilename, bool updateTexture)
+{
+    CImg<unsigned short> image(imageFilename.c_str());
+    mWidth  = image.width();
+    mHeight = image.height();
+    image.channel(0);
+    image.mirror("y");
+
+    // Two interleaved bytes per pixel, low byte first (GL_LUMINANCE_ALPHA)
+    mLabelPhase.mImage.assign(2, mWidth, mHeight);
+    unsigned char *bytes = mLabelPhase.mImage.data();
+    for(size_t i=0; i<image.size(); ++i)
+    {
+        bytes[2*i]   = image[i] & 0xff;
+        bytes[2*i+1] = image[i] >> 8;
+    }
+
+    mLabelPhase.mWidth  = mWidth;
+    mLabelPhase.mHeight = mHeight;
+
+    if(updateTexture)
+    {
+        mLabelPhase.updateOrigTexture();
+    }
+}
+
 bool Ogles::isInitialized()
 {
     return mIsInitialized;
@@ -134,27 +587,87 @@ bool Ogles::isInitialized()
 
 void Ogles::initialize()
 {
+    if(mBackend == BACKEND_CPU)
+    {
+        // No EGLContext and no OpenGL objects necessary
+        mCpuPhase.mWidth  = mWidth;
+        mCpuPhase.mHeight = mHeight;
+        mIsInitialized = true;
+        return;
+    }
+
     // initialize EGL-context
-    initEGL(mWidth, mHeight);
+    if (!initEGL(mWidth, mHeight))
+        throw std::runtime_error(std::string("OGLES: Could not create the EGLContext"));
+
+    // The destructor only cleans up after a complete initialization, i.e.
+    // the context has to be released here if anything fails
+    try
+    {
+        initContext();
+    }
+    catch (...)
+    {
+        ProgramCache::releaseContext();
+        releaseEGL();
+        throw;
+    }
+
+    mIsInitialized = true;
+}
+
+void Ogles::initContext()
+{
+    // Fences of the pipelined mode
+    const char *eglExtensions = eglQueryString(esContext.eglDisplay, EGL_EXTENSIONS);
+    mCreateSync     = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+    mClientWaitSync = (PFNEGLCLIENTWAITSYNCKHRPROC)eglGetProcAddress("eglClientWaitSyncKHR");
+    mDestroySync    = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+    mHasFenceSync = eglExtensions != NULL && strstr(eglExtensions, "EGL_KHR_fence_sync") != NULL
+                    && mCreateSync != NULL && mClientWaitSync != NULL && mDestroySync != NULL;
+
+    // The labels and the areas have 16 bits, which is above the texture
+    // size of the drivers, i.e. the texture size is the limit
+    GLint maxTextureSize = 0;
+    GL_CHECK( glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize) );
+    if (mWidth > std::min(maxTextureSize, 65535) || mHeight > std::min(maxTextureSize, 65535))
+        throw std::runtime_error(std::string("OGLES: Frame exceeds the maximum texture size of the context"));
 
     // initialize the 2 frambuffers for ping-pong method
     GL_CHECK( glGenFramebuffers(2, mFboId) );
 
     if(!mLabelPhase.initIndependent(mFboId, mUsedTexUnits) )
-        exit(1);
+        throw std::runtime_error(std::string("OGLES: Could not initialize the label phase"));
+
+    mIngestPhase.mWidth  = mWidth;
+    mIngestPhase.mHeight = mHeight;
+    mIngestPhase.mTexTargetId = mLabelPhase.mTexOrigId;
+    mIngestPhase.mTargetFormat = mLabelPhase.origTextureFormat();
+    if (!mIngestPhase.init(mFboId, mUsedTexUnits) )
+        throw std::runtime_error(std::string("OGLES: Could not initialize the ingest phase"));
 
     mReductionPhase.mWidth   = mWidth;
     mReductionPhase.mHeight  = mHeight;
     if (!mReductionPhase.init(mFboId, mUsedTexUnits) )
-        exit(1);
+        throw std::runtime_error(std::string("OGLES: Could not initialize the reduction phase"));
 
     mStatsPhase.mWidth   = mWidth;
     mStatsPhase.mHeight  = mHeight;
     mStatsPhase.mStatsAreaHeight = mHeight;
+    mStatsPhase.mBitDepth = mLabelPhase.mOrigBitDepth;
     if (!mStatsPhase.init(mFboId, mUsedTexUnits) )
-        exit(1);
-
-    mIsInitialized = true;
+        throw std::runtime_error(std::string("OGLES: Could not initialize the stats phase"));
+    // The statistics are added to the table of the reduction phase
+    mReductionPhase.mTableWidth = mStatsPhase.mStatsAreaWidth;
+
+    mPyramidPhase.mWidth  = mWidth;
+    mPyramidPhase.mHeight = mHeight;
+    if (!mPyramidPhase.init(mFboId, mUsedTexUnits) )
+        throw std::runtime_error(std::string("OGLES: Could not initialize the pyramid phase"));
+
+    mLabelPhase.mRegions     = &mRegions;
+    mReductionPhase.mRegions = &mRegions;
+    mStatsPhase.mRegions     = &mRegions;
 }
 
 
@@ -172,6 +685,11 @@ int Ogles::initEGL(int width, int height)
 
 // Step 2 - Initialize EGL.
    EGL_CHECK(eglInitialize(eglDisplay, NULL, NULL) );
+   {
+       std::lock_guard<std::mutex> lock(sDisplayMutex);
+       ++sDisplayUsers;
+   }
+   esContext.eglDisplay = eglDisplay;
 
    EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2,
                                                           EGL_NONE };
@@ -191,6 +709,7 @@ int Ogles::initEGL(int width, int height)
 
    if (iConfigs != 1) {
        printf("Error: eglChooseConfig(): config not found.\n");
+       releaseEGL();
        return EGL_FALSE;
    }
 
@@ -207,21 +726,45 @@ int Ogles::initEGL(int width, int height)
    EGLSurface eglSurface;
    eglSurface = eglCreatePbufferSurface(eglDisplay, eglConfig, srfPbufferAttr);
    EGL_CHECK( (eglSurface != EGL_NO_SURFACE) );
+   if (eglSurface == EGL_NO_SURFACE) {
+       printf("Error: eglCreatePbufferSurface() failed.\n");
+       releaseEGL();
+       return EGL_FALSE;
+   }
+   esContext.eglSurface = eglSurface;
 
 // Step 7 - Create a context.
    EGLContext eglContext = eglCreateContext(eglDisplay, eglConfig, NULL, contextAttribs);
    EGL_CHECK( (eglContext != EGL_NO_CONTEXT) );
+   if (eglContext == EGL_NO_CONTEXT) {
+       printf("Error: eglCreateContext() failed.\n");
+       releaseEGL();
+       return EGL_FALSE;
+   }
 
 // Step 8 - Bind the context to the current thread
    EGL_CHECK( eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext) );
 
-   esContext.eglDisplay = eglDisplay;
-   esContext.eglSurface = eglSurface;
    esContext.eglContext = eglContext;
 
    return EGL_TRUE;
 }
 
+void Ogles::releaseEGL()
+{
+    EGL_CHECK ( eglMakeCurrent(esContext.eglDisplay , EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT) );
+    if (esContext.eglContext != EGL_NO_CONTEXT)
+        EGL_CHECK ( eglDestroyContext(esContext.eglDisplay, esContext.eglContext) );
+    if (esContext.eglSurface != EGL_NO_SURFACE)
+        EGL_CHECK ( eglDestroySurface(esContext.eglDisplay, esContext.eglSurface) );
+    esContext.eglContext = EGL_NO_CONTEXT;
+    esContext.eglSurface = EGL_NO_SURFACE;
+
+    std::lock_guard<std::mutex> lock(sDisplayMutex);
+    if(--sDisplayUsers == 0)
+        EGL_CHECK ( eglTerminate(esContext.eglDisplay) );
+}
+
 void Ogles::checkEGLError(const char *stmt, const char *fname, int line)
 {
     GLenum err = eglGetError();
@@ -0,0 +1,123 @@
+#include "oglesPool.h"
+#include "log.h"
+
+#include <stdexcept>
+
+OglesPool::OglesPool(unsigned numContexts, const ResultFunc &result, const SetupFunc &setup, size_t queueSize)
+    : mResult(result), mSetup(setup),
+      mQueue(queueSize ? queueSize : 4*(numContexts ? numContexts : std::max(1u, std::thread::hardware_concurrency()))),
+      mNumSubmitted(0), mNumQueued(0), mNumDone(0), mNumSleeping(0), mStop(false)
+{
+    if (numContexts == 0)
+        numContexts = std::max(1u, std::thread::hardware_concurrency());
+
+    // The counters are value-initialized to 0, atomics can not be copied by resize
+    std::vector<std::atomic<uint64_t> > framesPerContext(numContexts);
+    mFramesPerContext.swap(framesPerContext);
+    for (unsigned i=0; i<numContexts; ++i)
+    {
+        mThreads.push_back( std::thread(&OglesPool::worker, this, i) );
+    }
+}
+
+OglesPool::~OglesPool()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mWakeup.notify_all();
+
+    for (unsigned i=0; i<mThreads.size(); ++i)
+    {
+        mThreads[i].join();
+    }
+}
+
+uint64_t OglesPool::submit(const IngestPhase::Frame &frame)
+{
+    uint64_t index = mNumSubmitted++;
+
+    // Counted before the push, so mNumQueued never drops below the queue size.
+    // A thread which went to sleep before the increment sees the frame in its
+    // wait condition, otherwise it is counted in mNumSleeping below
+    ++mNumQueued;
+    while (!mQueue.push(Job(index, frame)))
+        std::this_thread::yield();
+
+    if (mNumSleeping > 0)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mWakeup.notify_one();
+    }
+    return index;
+}
+
+void OglesPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (mNumDone < mNumSubmitted)
+        mAllDone.wait(lock);
+}
+
+unsigned OglesPool::numContexts() const
+{
+    return mThreads.size();
+}
+
+std::vector<uint64_t> OglesPool::framesPerContext() const
+{
+    std::vector<uint64_t> frames;
+    for (size_t i=0; i<mFramesPerContext.size(); ++i)
+        frames.push_back(mFramesPerContext[i].load());
+    return frames;
+}
+
+void OglesPool::worker(unsigned id)
+{
+    {
+        // Created, used and destroyed on this thread, where its context is current
+        Ogles ogles(0, 0, Ogles::BACKEND_GPU);
+        if (mSetup)
+            mSetup(ogles);
+
+        while (true)
+        {
+            Job job;
+            if (!mQueue.pop(job))
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                ++mNumSleeping;
+                while (!mStop && mNumQueued == 0)
+                    mWakeup.wait(lock);
+                --mNumSleeping;
+                if (mStop && mNumQueued == 0)
+                    break;
+                continue;
+            }
+            --mNumQueued;
+
+            try
+            {
+                const std::vector<StatsPhase::Spot> &spots = ogles.processFrame(job.frame);
+                if (mResult)
+                    mResult(job.index, spots);
+            }
+            catch (std::runtime_error &e)
+            {
+                LOG_ERROR("Frame " << job.index << " failed: " << e.what());
+                if (mResult)
+                    mResult(job.index, std::vector<StatsPhase::Spot>());
+            }
+            ++mFramesPerContext[id];
+
+            if (++mNumDone == mNumSubmitted)
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mAllDone.notify_all();
+            }
+        }
+    }
+    eglReleaseThread();
+}
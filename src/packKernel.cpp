@@ -0,0 +1,129 @@
+#include "packKernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define PACK_X86
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define PACK_NEON
+#endif
+
+typedef void (*UnpackRowFunc)(const uint8_t *src, uint16_t *dst, int width);
+
+static void unpackTail(const uint8_t *src, uint16_t *dst, int start, int width)
+{
+    for (int x=start; x<width; x+=2)
+    {
+        const uint8_t *group = src + (size_t)x/2*3;
+        dst[x]   = (uint16_t)((group[0] << 4) | (group[2] & 0x0f));
+        dst[x+1] = (uint16_t)((group[1] << 4) | (group[2] >> 4));
+    }
+}
+
+static void unpackRowScalar(const uint8_t *src, uint16_t *dst, int width)
+{
+    unpackTail(src, dst, 0, width);
+}
+
+#if defined(PACK_X86)
+__attribute__((target("ssse3")))
+static void unpackRowSsse3(const uint8_t *src, uint16_t *dst, int width)
+{
+    // Every 16-bit lane gets (b0 << 8) | b2 for even pixels and (b1 << 8) | b2 for odd ones
+    const __m128i shuffle = _mm_setr_epi8( 2, 0,  2, 1,  5, 3,  5, 4,
+                                           8, 6,  8, 7, 11, 9, 11, 10);
+    // even: ((u >> 4) & 0x0ff0) | (u & 0x000f), odd: u >> 4
+    const __m128i maskShifted = _mm_setr_epi16(0x0ff0, 0x0fff, 0x0ff0, 0x0fff, 0x0ff0, 0x0fff, 0x0ff0, 0x0fff);
+    const __m128i maskLow     = _mm_setr_epi16(0x000f, 0x0000, 0x000f, 0x0000, 0x000f, 0x0000, 0x000f, 0x0000);
+
+    int x = 0;
+    // 16 bytes are loaded for the 12 bytes of 8 pixels, so stop early enough
+    for (; x+11<=width; x+=8)
+    {
+        __m128i packed = _mm_loadu_si128((const __m128i*)(src + (size_t)x/2*3));
+        __m128i u = _mm_shuffle_epi8(packed, shuffle);
+        __m128i pixels = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(u, 4), maskShifted),
+                                      _mm_and_si128(u, maskLow));
+        _mm_storeu_si128((__m128i*)(dst + x), pixels);
+    }
+    unpackTail(src, dst, x, width);
+}
+#endif
+
+#if defined(PACK_NEON)
+static void unpackRowNeon(const uint8_t *src, uint16_t *dst, int width)
+{
+    const uint8x8_t lowNibble = vdup_n_u8(0x0f);
+    int x = 0;
+    for (; x+16<=width; x+=16)
+    {
+        // De-interleaves the groups into the bytes 0, 1 and 2 of 8 pixel pairs
+        uint8x8x3_t groups = vld3_u8(src + (size_t)x/2*3);
+        uint16x8x2_t pixels;
+        pixels.val[0] = vorrq_u16(vshll_n_u8(groups.val[0], 4), vmovl_u8(vand_u8(groups.val[2], lowNibble)));
+        pixels.val[1] = vorrq_u16(vshll_n_u8(groups.val[1], 4), vmovl_u8(vshr_n_u8(groups.val[2], 4)));
+        vst2q_u16(dst + x, pixels);
+    }
+    unpackTail(src, dst, x, width);
+}
+#endif
+
+static PackKernel::Isa detectIsa()
+{
+#if defined(PACK_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3"))
+        return PackKernel::ISA_SSSE3;
+#elif defined(PACK_NEON)
+    return PackKernel::ISA_NEON;
+#endif
+    return PackKernel::ISA_SCALAR;
+}
+
+static UnpackRowFunc unpackRowFunc(PackKernel::Isa isa)
+{
+    switch (isa)
+    {
+#if defined(PACK_X86)
+    case PackKernel::ISA_SSSE3:
+        return unpackRowSsse3;
+#endif
+#if defined(PACK_NEON)
+    case PackKernel::ISA_NEON:
+        return unpackRowNeon;
+#endif
+    default:
+        return unpackRowScalar;
+    }
+}
+
+PackKernel::Isa PackKernel::isa()
+{
+    static const Isa selected = detectIsa();
+    return selected;
+}
+
+const char *PackKernel::isaName()
+{
+    switch (isa())
+    {
+    case ISA_SSSE3: return "SSSE3";
+    case ISA_NEON:  return "NEON";
+    default:        return "scalar";
+    }
+}
+
+void PackKernel::unpackRaw12Row(const uint8_t *src, uint16_t *dst, int width)
+{
+    unpackRowFunc(isa())(src, dst, width);
+}
+
+void PackKernel::unpackRaw12(const uint8_t *src, size_t srcStride, uint16_t *dst, size_t dstStride,
+                             int width, int height)
+{
+    UnpackRowFunc unpackRow = unpackRowFunc(isa());
+    for (int y=0; y<height; ++y)
+        unpackRow(src + y*srcStride, dst + y*dstStride, width);
+}
@@ -1,4 +1,6 @@
 #include "phase.h"
+#include "programCache.h"
+#include "shaderSources.h"
 #include <fstream>
 #include <stdio.h>
 #include <iostream>
@@ -33,112 +35,36 @@ GLuint Phase::createSimpleTexture2D(GLsizei width, GLsizei height, GLubyte *data
 
 GLuint Phase::loadProgramFromFile(const std::string vertShaderFile, const std::string fragShaderFile)
 {
-    GLuint vertexShader;
-    GLuint fragmentShader;
-    GLuint programObject = 0;
-    GLint linked;
-    std::string sourceString = "";
-    std::string commonSource;
-
-    std::ifstream sourceFile("common.glsl");
+    std::string vertSource;
+    std::string fragSource;
 
-    if( !sourceFile.good() )
-    {
-        cerr << "Failed to open file: common.glsl" << endl;
-        sourceFile.close();
-        goto error;
-    }
-    else
-    {
-        commonSource = std::string((std::istreambuf_iterator<char>(sourceFile)),
-                                               std::istreambuf_iterator<char>());
-    }
-
-    sourceFile.close();
-
-    sourceFile.open(vertShaderFile);
-
-    if(! sourceFile.good() )
+    if( !ShaderSources::load(vertShaderFile, vertSource) )
     {
         cerr << "Failed to open vertex shader file: " << vertShaderFile << endl;
-        sourceFile.close();
-        goto error;
+        return 0;
     }
-    sourceString = std::string((std::istreambuf_iterator<char>(sourceFile)),
-                                           std::istreambuf_iterator<char>());
-
-    sourceFile.close();
 
-    // Load the vertex/fragment shaders
-    vertexShader = loadShader( GL_VERTEX_SHADER, commonSource + sourceString );
-    if ( vertexShader == 0 )
-    {
-        cerr << "Failed to compile vertex shader!" << endl;
-        goto error;
-    }
-    sourceFile.open(fragShaderFile);
-    if(! sourceFile.good() )
+    if( !ShaderSources::load(fragShaderFile, fragSource) )
     {
         cerr << "Failed to open fragment shader file: " << fragShaderFile << endl;
-        sourceFile.close();
-        goto error;
-    }
-    sourceString = std::string((std::istreambuf_iterator<char>(sourceFile)),
-                              std::istreambuf_iterator<char>());
-    sourceFile.close();
-
-    fragmentShader = loadShader(GL_FRAGMENT_SHADER, commonSource + sourceString );
-    if ( fragmentShader == 0 )
-    {
-        cerr << "Failed to compile fragment shader" << endl;
-        goto error;
+        return 0;
     }
 
-    // Create the program object
-    programObject = glCreateProgram ( );
-    if ( programObject == 0 )
-       goto error;
-
-    GL_CHECK( glAttachShader ( programObject, vertexShader ) );
-    GL_CHECK( glAttachShader ( programObject, fragmentShader ) );
-
-    // Link the program
-    GL_CHECK( glLinkProgram ( programObject ) );
-
-    // Check the link status
-    GL_CHECK( glGetProgramiv ( programObject, GL_LINK_STATUS, &linked ) );
+    return loadProgram(vertSource, fragSource);
+}
 
-    if ( !linked )
+GLuint Phase::loadProgram(const std::string &vertSource, const std::string &fragSource)
+{
+    std::string commonSource;
+    if( !ShaderSources::load("common.glsl", commonSource) )
     {
-       GLint infoLen = 0;
-
-       GL_CHECK( glGetProgramiv ( programObject, GL_INFO_LOG_LENGTH, &infoLen ) );
-
-       if ( infoLen > 1 )
-       {
-          char* infoLog = (char*) malloc (sizeof(char) * infoLen );
-
-          GL_CHECK( glGetProgramInfoLog ( programObject, infoLen, NULL, infoLog ) );
-          cerr << "Error linking program:" << endl;
-          cerr << infoLog << endl;
-
-          free ( infoLog );
-       }
-
-       glDeleteProgram ( programObject );
-       goto error;
+        cerr << "Failed to open file: common.glsl" << endl;
+        return 0;
     }
 
-    // Free up no longer needed shader resources
-    glDeleteShader ( vertexShader );
-    glDeleteShader ( fragmentShader );
-
-    return programObject;
-
- error:
-    glDeleteShader ( vertexShader );
-    glDeleteShader ( fragmentShader );
-    return 0;
+    // Identical shaders are compiled only once and linked programs are
+    // loaded from the binary cache if possible
+    return ProgramCache::createProgram(commonSource + vertSource, commonSource + fragSource);
 }
 
 GLuint Phase::loadShader(GLenum type, const std::string &shaderSrc)
@@ -273,6 +199,24 @@ void Phase::printSignedLabels(int width, int height, GLubyte *pixels)
     }
 }
 
+void Phase::drawScene(const RegionSet *regions, RegionSet::Shape shape,
+                      GLint positionLoc, GLint texCoordLoc,
+                      const GLfloat *vertices, const GLushort *indices)
+{
+    if (regions != NULL && regions->isActive())
+    {
+        regions->draw(shape, positionLoc, texCoordLoc);
+        return;
+    }
+
+    GL_CHECK( glVertexAttribPointer ( positionLoc, 3, GL_FLOAT,
+                                      GL_FALSE, 5 * sizeof(GLfloat), vertices ) );
+    if (texCoordLoc >= 0)
+        GL_CHECK( glVertexAttribPointer ( texCoordLoc, 2, GL_FLOAT,
+                                          GL_FALSE, 5 * sizeof(GLfloat), &vertices[3] ) );
+    GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices ) );
+}
+
 int Phase::logBase2(int n)
 {
     int ret = 0;
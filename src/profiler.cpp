@@ -0,0 +1,148 @@
+#include "profiler.h"
+#include "getTime.h"
+
+#include <GLES2/gl2.h>
+#include <EGL/egl.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+
+static bool sEnabled = false;
+
+// Samples of all scopes, in the order they were recorded first
+static std::vector<std::string> sNames;
+static std::map<std::string, std::vector<double> > sSamples;
+
+// Only wait for the GPU if there is a context, the CPU backend has none
+static void finishGl()
+{
+    if (eglGetCurrentContext() != EGL_NO_CONTEXT)
+        glFinish();
+}
+
+// Nearest rank percentile of sorted samples
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    size_t rank = (size_t)(p/100.0 * sorted.size() + 0.999999);
+    rank = std::min(std::max(rank, (size_t)1), sorted.size());
+    return sorted[rank-1];
+}
+
+Profiler::Scope::Scope(const char *name)
+    : mActive(sEnabled)
+{
+    if (!mActive)
+        return;
+    snprintf(mName, sizeof(mName), "%s", name);
+    start();
+}
+
+Profiler::Scope::Scope(const char *format, int index)
+    : mActive(sEnabled)
+{
+    if (!mActive)
+        return;
+    snprintf(mName, sizeof(mName), format, index);
+    start();
+}
+
+void Profiler::Scope::start()
+{
+    // The commands issued before belong to the enclosing scope
+    finishGl();
+    mStartTime = getRealTime();
+}
+
+Profiler::Scope::~Scope()
+{
+    if (!mActive)
+        return;
+    finishGl();
+    record(mName, (getRealTime()-mStartTime)*1000);
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+    sEnabled = enabled;
+}
+
+bool Profiler::isEnabled()
+{
+    return sEnabled;
+}
+
+void Profiler::record(const char *name, double ms)
+{
+    std::map<std::string, std::vector<double> >::iterator it = sSamples.find(name);
+    if (it == sSamples.end())
+    {
+        sNames.push_back(name);
+        it = sSamples.insert(std::make_pair(std::string(name), std::vector<double>())).first;
+    }
+    it->second.push_back(ms);
+}
+
+std::vector<Profiler::Summary> Profiler::summary()
+{
+    std::vector<Summary> result;
+    for (size_t i=0; i<sNames.size(); ++i)
+    {
+        std::vector<double> sorted = sSamples[sNames[i]];
+        std::sort(sorted.begin(), sorted.end());
+
+        Summary entry;
+        entry.name   = sNames[i];
+        entry.count  = sorted.size();
+        entry.min    = sorted.front();
+        entry.median = percentile(sorted, 50);
+        entry.p99    = percentile(sorted, 99);
+        entry.max    = sorted.back();
+        entry.total  = 0;
+        for (size_t k=0; k<sorted.size(); ++k)
+            entry.total += sorted[k];
+        entry.mean   = entry.total / sorted.size();
+        result.push_back(entry);
+    }
+    return result;
+}
+
+void Profiler::writeCsv(std::ostream &out)
+{
+    std::vector<Summary> entries = summary();
+    char line[256];
+    out << "name,count,min_ms,median_ms,p99_ms,max_ms,mean_ms,total_ms\n";
+    for (size_t i=0; i<entries.size(); ++i)
+    {
+        const Summary &e = entries[i];
+        snprintf(line, sizeof(line), "%s,%lu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", e.name.c_str(),
+                 (unsigned long)e.count, e.min, e.median, e.p99, e.max, e.mean, e.total);
+        out << line;
+    }
+}
+
+void Profiler::writeJson(std::ostream &out)
+{
+    std::vector<Summary> entries = summary();
+    char line[320];
+    out << "[\n";
+    for (size_t i=0; i<entries.size(); ++i)
+    {
+        // The names are identifiers of the source code, no escaping needed
+        const Summary &e = entries[i];
+        snprintf(line, sizeof(line),
+                 "  {\"name\": \"%s\", \"count\": %lu, \"min_ms\": %.4f, \"median_ms\": %.4f, "
+                 "\"p99_ms\": %.4f, \"max_ms\": %.4f, \"mean_ms\": %.4f, \"total_ms\": %.4f}%s\n",
+                 e.name.c_str(), (unsigned long)e.count, e.min, e.median, e.p99, e.max, e.mean, e.total,
+                 i+1 < entries.size() ? "," : "");
+        out << line;
+    }
+    out << "]\n";
+}
+
+void Profiler::reset()
+{
+    sNames.clear();
+    sSamples.clear();
+}
@@ -0,0 +1,280 @@
+#include "programCache.h"
+#include "phase.h"
+
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+using std::cerr;
+using std::endl;
+
+// Magic number at the start of the binary files
+static const char BINARY_MAGIC[4] = { 'O', 'G', 'P', 'B' };
+
+// The shaders are keyed by their context, type and complete source
+typedef std::pair< EGLContext, std::pair<GLenum, std::string> > ShaderKey;
+
+// Guards sDirectory and sShaders, not the GL calls: every context is only
+// current in one thread, so the contexts of a pool compile in parallel
+static std::mutex sMutex;
+static std::string sDirectory;
+static std::map<ShaderKey, GLuint> sShaders;
+
+void ProgramCache::setDirectory(const std::string &directory)
+{
+    std::lock_guard<std::mutex> lock(sMutex);
+    sDirectory = directory;
+    if (!sDirectory.empty())
+        mkdir(sDirectory.c_str(), 0755);
+}
+
+std::string ProgramCache::directory()
+{
+    std::lock_guard<std::mutex> lock(sMutex);
+    return sDirectory;
+}
+
+uint64_t ProgramCache::hash(const std::string &data, uint64_t seed)
+{
+    uint64_t value = seed;
+    for (size_t i=0; i<data.size(); ++i)
+    {
+        value ^= (unsigned char)data[i];
+        value *= 1099511628211ULL;
+    }
+    return value;
+}
+
+// Returns the shader of the source, compiles it only if the current context has none yet
+static GLuint cachedShader(GLenum type, const std::string &source)
+{
+    ShaderKey key(eglGetCurrentContext(), std::make_pair(type, source));
+    {
+        std::lock_guard<std::mutex> lock(sMutex);
+        std::map<ShaderKey, GLuint>::iterator it = sShaders.find(key);
+        if (it != sShaders.end())
+            return it->second;
+    }
+
+    // No other thread adds shaders of the current context meanwhile
+    GLuint shader = Phase::loadShader(type, source);
+    if (shader != 0)
+    {
+        std::lock_guard<std::mutex> lock(sMutex);
+        sShaders[key] = shader;
+    }
+    return shader;
+}
+
+static PFNGLGETPROGRAMBINARYOESPROC getProgramBinary()
+{
+    static PFNGLGETPROGRAMBINARYOESPROC function =
+            (PFNGLGETPROGRAMBINARYOESPROC)eglGetProcAddress("glGetProgramBinaryOES");
+    return function;
+}
+
+static PFNGLPROGRAMBINARYOESPROC programBinary()
+{
+    static PFNGLPROGRAMBINARYOESPROC function =
+            (PFNGLPROGRAMBINARYOESPROC)eglGetProcAddress("glProgramBinaryOES");
+    return function;
+}
+
+static bool hasProgramBinary()
+{
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    if (extensions == NULL || strstr(extensions, "GL_OES_get_program_binary") == NULL)
+        return false;
+
+    GLint numFormats = 0;
+    GL_CHECK( glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &numFormats) );
+    return numFormats > 0 && getProgramBinary() != NULL && programBinary() != NULL;
+}
+
+// Creates the program from the binary file, 0 if there is none or it is not accepted
+static GLuint loadBinary(const std::string &filename)
+{
+    std::ifstream file(filename.c_str(), std::ios::binary | std::ios::ate);
+    if (!file.good())
+        return 0;
+    std::streamoff fileSize = file.tellg();
+    file.seekg(0);
+
+    char magic[4];
+    uint32_t format, length;
+    file.read(magic, 4);
+    file.read((char *)&format, sizeof(format));
+    file.read((char *)&length, sizeof(length));
+    if (!file.good() || memcmp(magic, BINARY_MAGIC, 4) != 0)
+        return 0;
+    // A corrupt length must not allocate more than the file holds
+    if (length > fileSize - (std::streamoff)file.tellg())
+        return 0;
+
+    std::vector<char> binary(length);
+    file.read(binary.data(), length);
+    if (!file.good())
+        return 0;
+
+    GLuint programObject = glCreateProgram();
+    if (programObject == 0)
+        return 0;
+
+    // The driver rejects binaries of other versions, the error is not fatal
+    // here. Clear older errors first, so that they are not taken for it.
+    while (glGetError() != GL_NO_ERROR);
+    programBinary()(programObject, format, binary.data(), length);
+    if (glGetError() != GL_NO_ERROR)
+    {
+        glDeleteProgram(programObject);
+        return 0;
+    }
+
+    GLint linked = 0;
+    GL_CHECK( glGetProgramiv(programObject, GL_LINK_STATUS, &linked) );
+    if (!linked)
+    {
+        glDeleteProgram(programObject);
+        return 0;
+    }
+
+    return programObject;
+}
+
+static void saveBinary(const std::string &filename, GLuint programObject)
+{
+    GLint length = 0;
+    GL_CHECK( glGetProgramiv(programObject, GL_PROGRAM_BINARY_LENGTH_OES, &length) );
+    if (length <= 0)
+        return;
+
+    std::vector<char> binary(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    GL_CHECK( getProgramBinary()(programObject, length, &written, &format, binary.data()) );
+
+    // Write to a temporary file first, so other processes never read half a
+    // binary. Its name is unique, the contexts of other threads may save the
+    // same program at the same time.
+    std::ostringstream tmpName;
+    tmpName << filename << "." << getpid() << "." << std::this_thread::get_id() << ".tmp";
+    std::string tmpFilename = tmpName.str();
+    std::ofstream file(tmpFilename.c_str(), std::ios::binary | std::ios::trunc);
+    uint32_t format32 = format;
+    uint32_t length32 = written;
+    file.write(BINARY_MAGIC, 4);
+    file.write((const char *)&format32, sizeof(format32));
+    file.write((const char *)&length32, sizeof(length32));
+    file.write(binary.data(), written);
+    file.close();
+
+    if (!file.good() || rename(tmpFilename.c_str(), filename.c_str()) != 0)
+    {
+        cerr << "Failed to write program binary: " << filename << endl;
+        remove(tmpFilename.c_str());
+    }
+}
+
+GLuint ProgramCache::createProgram(const std::string &vertSource, const std::string &fragSource)
+{
+    ///---------- 1. PROGRAM BINARY --------------------
+
+    std::string filename;
+    std::string cacheDirectory = directory();
+    if (!cacheDirectory.empty() && hasProgramBinary())
+    {
+        const char *renderer = (const char *)glGetString(GL_RENDERER);
+        const char *version  = (const char *)glGetString(GL_VERSION);
+        uint64_t key = hash(fragSource, hash(vertSource));
+        key = hash(std::string(renderer ? renderer : "") + (version ? version : ""), key);
+
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        filename = cacheDirectory + "/" + name;
+
+        GLuint programObject = loadBinary(filename);
+        if (programObject != 0)
+            return programObject;
+    }
+
+    ///---------- 2. COMPILE AND LINK --------------------
+
+    GLuint vertexShader = cachedShader(GL_VERTEX_SHADER, vertSource);
+    if (vertexShader == 0)
+    {
+        cerr << "Failed to compile vertex shader!" << endl;
+        return 0;
+    }
+
+    GLuint fragmentShader = cachedShader(GL_FRAGMENT_SHADER, fragSource);
+    if (fragmentShader == 0)
+    {
+        cerr << "Failed to compile fragment shader" << endl;
+        return 0;
+    }
+
+    GLuint programObject = glCreateProgram();
+    if (programObject == 0)
+        return 0;
+
+    GL_CHECK( glAttachShader(programObject, vertexShader) );
+    GL_CHECK( glAttachShader(programObject, fragmentShader) );
+    GL_CHECK( glLinkProgram(programObject) );
+    // The shaders stay in the cache for the next programs
+    GL_CHECK( glDetachShader(programObject, vertexShader) );
+    GL_CHECK( glDetachShader(programObject, fragmentShader) );
+
+    GLint linked;
+    GL_CHECK( glGetProgramiv(programObject, GL_LINK_STATUS, &linked) );
+    if (!linked)
+    {
+        GLint infoLen = 0;
+        GL_CHECK( glGetProgramiv(programObject, GL_INFO_LOG_LENGTH, &infoLen) );
+        if (infoLen > 1)
+        {
+            std::vector<char> infoLog(infoLen);
+            GL_CHECK( glGetProgramInfoLog(programObject, infoLen, NULL, infoLog.data()) );
+            cerr << "Error linking program:" << endl;
+            cerr << infoLog.data() << endl;
+        }
+
+        glDeleteProgram(programObject);
+        return 0;
+    }
+
+    if (!filename.empty())
+        saveBinary(filename, programObject);
+
+    return programObject;
+}
+
+void ProgramCache::releaseContext()
+{
+    std::lock_guard<std::mutex> lock(sMutex);
+
+    EGLContext context = eglGetCurrentContext();
+    std::map<ShaderKey, GLuint>::iterator it = sShaders.begin();
+    while (it != sShaders.end())
+    {
+        if (it->first.first == context)
+        {
+            GL_CHECK( glDeleteShader(it->second) );
+            sShaders.erase(it++);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
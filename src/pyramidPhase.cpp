@@ -0,0 +1,183 @@
+#include "pyramidPhase.h"
+
+#include <algorithm>
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+#include "getTime.h"
+
+#define STAGE_THRESHOLD          0
+#define STAGE_MAX                1
+
+// Has to match MAX_FACTOR of the pyramid shader
+#define MAX_FACTOR               4
+
+PyramidPhase::PyramidPhase(int width, int height)
+    : mVertFilename("../glsl/quad.vert"), mFragFilename("../glsl/pyramid.frag"),
+      mProgramObject(0), mWidth(width), mHeight(height),
+      mVertices {-1.0f, -1.0f, 0.0f,  // Position 0
+                  0.0f,  0.0f,        // TexCoord 0
+                 -1.0f,  1.0f, 0.0f,  // Position 1
+                  0.0f,  1.0f,        // TexCoord 1
+                  1.0f,  1.0f, 0.0f,  // Position 2
+                  1.0f,  1.0f,        // TexCoord 2
+                  1.0f, -1.0f, 0.0f,  // Position 3
+                  1.0f,  0.0f         // TexCoord 3
+                },
+      mIndices { 0, 1, 2, 0, 2, 3 },
+      u_threshold(64.3 / 255.0), mOrigTexUnit(0), mOrigTopDown(false), mOrigMaxValue(255),
+      mFboId(0), mTextureUnit(0), mTileSize(0)
+{
+}
+
+PyramidPhase::~PyramidPhase()
+{
+}
+
+GLint PyramidPhase::init(GLuint fbos[], GLuint &bfUsedTextures)
+{
+    mFboId = fbos[0];
+
+    // Load the shaders and get a linked program object
+    mProgramObject = loadProgramFromFile( mVertFilename, mFragFilename);
+    if (mProgramObject == 0)
+    {
+        cerr << "Failed to generate Program object for pyramid phase" << endl;
+        return GL_FALSE;
+    }
+
+    mPositionLoc = glGetAttribLocation ( mProgramObject, "a_position" );
+    mTexCoordLoc = glGetAttribLocation ( mProgramObject, "a_texCoord" );  // -1, pyramid.frag does not read v_texCoord
+    u_texDimLoc       = glGetUniformLocation ( mProgramObject, "u_texDimensions" );
+    u_thresholdLoc    = glGetUniformLocation ( mProgramObject, "u_threshold" );
+    u_passLoc         = glGetUniformLocation ( mProgramObject, "u_pass" );
+    u_factorLoc       = glGetUniformLocation ( mProgramObject, "u_factor" );
+    u_origTopDownLoc  = glGetUniformLocation ( mProgramObject, "u_origTopDown" );
+    u_origMaxValueLoc = glGetUniformLocation ( mProgramObject, "u_origMaxValue" );
+    mSamplerLoc       = glGetUniformLocation ( mProgramObject, "s_texture" );
+
+    // One texture unit for all levels, each level is only read by the next one
+    int i = 0;
+    while( (1<<i) & bfUsedTextures) ++i;
+    bfUsedTextures |= (1<<i);
+    mTextureUnit = i;
+
+    return GL_TRUE;
+}
+
+void PyramidPhase::setTileSize(unsigned tileSize)
+{
+    if (tileSize == mTileSize)
+        return;
+
+    releaseLevels();
+    mTileSize = tileSize;
+
+    // Pool blocks of MAX_FACTOR x MAX_FACTOR as long as possible, the last
+    // level may pool a smaller block
+    int width  = mWidth;
+    int height = mHeight;
+    GL_CHECK( glActiveTexture( GL_TEXTURE0 + mTextureUnit) );
+    for (unsigned remaining = tileSize; remaining > 1; )
+    {
+        Level level;
+        level.factor  = std::min<unsigned>(remaining, MAX_FACTOR);
+        level.width   = (width  + level.factor - 1) / level.factor;
+        level.height  = (height + level.factor - 1) / level.factor;
+        level.texture = createSimpleTexture2D(level.width, level.height);
+        mLevels.push_back(level);
+
+        remaining /= level.factor;
+        width  = level.width;
+        height = level.height;
+    }
+    mPixels.resize((size_t)4*width*height);
+    mTiles.resize((size_t)width*height);
+}
+
+double PyramidPhase::run()
+{
+    double startTime, endTime;
+
+    startTime = getRealTime();
+
+    if (mLevels.empty())
+    {
+        // Tiles of a single pixel are not supported
+        std::fill(mTiles.begin(), mTiles.end(), 1);
+        return 0.0;
+    }
+
+    GL_CHECK( glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0) );
+    GL_CHECK( glBindBuffer(GL_ARRAY_BUFFER, 0) );
+    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId) );
+
+    GL_CHECK( glUseProgram ( mProgramObject ) );
+    GL_CHECK( glUniform1f ( u_thresholdLoc, u_threshold) );
+    GL_CHECK( glUniform1f ( u_origTopDownLoc, mOrigTopDown ? 1.0f : 0.0f) );
+    GL_CHECK( glUniform1f ( u_origMaxValueLoc, mOrigMaxValue) );
+    GL_CHECK( glEnableVertexAttribArray ( mPositionLoc ) );
+    if (mTexCoordLoc >= 0)
+        GL_CHECK( glEnableVertexAttribArray ( mTexCoordLoc ) );
+
+    int sourceWidth  = mWidth;
+    int sourceHeight = mHeight;
+    for (size_t i=0; i<mLevels.size(); ++i)
+    {
+        const Level &level = mLevels[i];
+        GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, level.texture, 0) );
+        CHECK_FBO();
+        GL_CHECK( glViewport ( 0, 0, level.width, level.height ) );
+
+        if (i == 0)
+        {
+            GL_CHECK( glUniform1i ( u_passLoc, STAGE_THRESHOLD) );
+            GL_CHECK( glUniform1i ( mSamplerLoc, mOrigTexUnit ) );
+        }
+        else
+        {
+            GL_CHECK( glUniform1i ( u_passLoc, STAGE_MAX) );
+            GL_CHECK( glActiveTexture( GL_TEXTURE0 + mTextureUnit) );
+            GL_CHECK( glBindTexture ( GL_TEXTURE_2D, mLevels[i-1].texture ) );
+            GL_CHECK( glUniform1i ( mSamplerLoc, mTextureUnit ) );
+        }
+        GL_CHECK( glUniform2f ( u_texDimLoc, sourceWidth, sourceHeight) );
+        GL_CHECK( glUniform1f ( u_factorLoc, level.factor) );
+        drawScene(NULL, RegionSet::SHAPE_BOXES, mPositionLoc, mTexCoordLoc, mVertices, mIndices);
+
+        sourceWidth  = level.width;
+        sourceHeight = level.height;
+    }
+
+    GL_CHECK( glReadPixels(0, 0, sourceWidth, sourceHeight, GL_RGBA, GL_UNSIGNED_BYTE, mPixels.data()) );
+    for (size_t i=0; i<mTiles.size(); ++i)
+        mTiles[i] = mPixels[4*i] != 0;
+
+    GL_CHECK( glDisableVertexAttribArray ( mPositionLoc ) );
+    if (mTexCoordLoc >= 0)
+        GL_CHECK( glDisableVertexAttribArray ( mTexCoordLoc ) );
+
+    // The following phases clear the bound framebuffer during their setup
+    GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0) );
+    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, 0) );
+    GL_CHECK( glViewport ( 0, 0, mWidth, mHeight ) );
+
+    endTime = getRealTime();
+
+    return (endTime-startTime)*1000;
+}
+
+void PyramidPhase::releaseLevels()
+{
+    for (size_t i=0; i<mLevels.size(); ++i)
+        GL_CHECK( glDeleteTextures(1, &mLevels[i].texture) );
+    mLevels.clear();
+    mTileSize = 0;
+}
+
+void PyramidPhase::releaseGlResources()
+{
+    releaseLevels();
+    GL_CHECK( glDeleteProgram(mProgramObject) );
+}
@@ -1,6 +1,9 @@
 #include "reductionPhase.h"
 #include "getTime.h"
+#include "profiler.h"
+#include "log.h"
 
+#include <algorithm>
 #include <iostream>
 using std::cerr;
 using std::endl;
@@ -11,15 +14,20 @@ using std::endl;
 #define TEX_LABEL  0
 #define TEX_ROOT   1
 #define TEX_PIPO   2
+#define TEX_TABLE  4
 
 #define MODE_RUNNING_SUM     0
 #define MODE_BINARY_SEARCH   1
 #define MODE_ROOT_INIT       2
 
+#define STAGE_TABLE          0
+#define STAGE_ROWS           1
+
 
 
 ReductionPhase::ReductionPhase(int width, int height)
     :mVertFilename("../glsl/quad.vert"), mFragFilename("../glsl/reductionPhase.frag"),
+      mTableFragFilename("../glsl/reductionTable.frag"),
       mWidth(width), mHeight(height),
       mVertices {-1.0f, -1.0f, 0.0f,  // Position 0
                   0.0f,  0.0f,        // TexCoord 0
@@ -30,8 +38,18 @@ ReductionPhase::ReductionPhase(int width, int height)
                   1.0f, -1.0f, 0.0f,  // Position 3
                   1.0f,  0.0f         // TexCoord 3
                 },
-      mIndices { 0, 1, 2, 0, 2, 3 }
-
+      mIndices { 0, 1, 2, 0, 2, 3 },
+      mRegions(NULL),
+      mTableWidth(0),
+      mCountTable(true),
+      mAdaptivePasses(false),
+      mNumPasses(0),
+      mTableTexWidth(0),
+      mTableTexHeight(0),
+      mTableRows(0),
+      mListRows(-1),
+      mListColumns(0),
+      mTopRow(0)
 {
 }
 
@@ -71,6 +89,19 @@ GLint ReductionPhase::init(GLuint fbos[], GLuint &bfUsedTextures)
      u_stageLoc      = glGetUniformLocation ( mProgramObject, "u_stage" );
      u_directionLoc  = glGetUniformLocation ( mProgramObject, "u_direction" );
 
+     // Program of the table size stage
+     mTableProgramObject = loadProgramFromFile( mVertFilename, mTableFragFilename);
+     if (mTableProgramObject == 0)
+     {
+         cerr << "Failed to generate Program object for the table of the reduction phase" << endl;
+         return GL_FALSE;
+     }
+     mTablePositionLoc = glGetAttribLocation ( mTableProgramObject, "a_position" );
+     mTableTexCoordLoc = glGetAttribLocation ( mTableProgramObject, "a_texCoord" );  // -1, the table shader does not read v_texCoord
+     s_tableLoc        = glGetUniformLocation ( mTableProgramObject, "s_texture" );
+     u_tableTexDimLoc  = glGetUniformLocation ( mTableProgramObject, "u_texDimensions" );
+     u_tableStageLoc   = glGetUniformLocation ( mTableProgramObject, "u_stage" );
+
      // 3. and 4. texture for ping-pong
      for(int j=0; j<2; ++j)
      {
@@ -82,6 +113,22 @@ GLint ReductionPhase::init(GLuint fbos[], GLuint &bfUsedTextures)
          bfUsedTextures |= (1<<i);
          mTextureUnits[TEX_PIPO+j] = i;
          GL_CHECK( glBindTexture(GL_TEXTURE_2D, mTexPiPoId[j]) );
+
+         mOwnTexPiPoId[j]    = mTexPiPoId[j];
+         mOwnTextureUnits[j] = i;
+     }
+
+     // 5. texture for the table, it is sized by the first run
+     {
+         int i = 0;
+         while( (1<<i) & bfUsedTextures) ++i;
+
+         GL_CHECK( glActiveTexture( GL_TEXTURE0 + i) );
+         mTexTableId = createSimpleTexture2D(1, 1);
+         bfUsedTextures |= (1<<i);
+         mTextureUnits[TEX_TABLE] = i;
+         mTableTexWidth  = 1;
+         mTableTexHeight = 1;
      }
 
      GL_CHECK( glClearColor ( 0.0f, 0.0f, 0.0f, 0.0f ) );
@@ -144,6 +191,15 @@ void ReductionPhase::updateTextures(GLuint labelTex, GLint labelTexUnit, GLuint
     // 2. Texture for root pixels
     mTexRootId              = freeTex;
     mTextureUnits[TEX_ROOT] = freeTexUnit;
+
+    // 3. and 4. Ping-pong textures (the last run swapped one of them with the root texture)
+    for(int j=0; j<2; ++j)
+    {
+        mTexPiPoId[j]             = mOwnTexPiPoId[j];
+        mTextureUnits[TEX_PIPO+j] = mOwnTextureUnits[j];
+    }
+    mRead  = 0;
+    mWrite = 1;
 }
 
 double ReductionPhase::run()
@@ -154,7 +210,9 @@ double ReductionPhase::run()
      *      2. Use the PiPo-textures to reduce mTexRoot horizontally
      *      3. Use the result of 2. as new mTexRoot (switch mTexRootId with last mTexPiPoId)
      *      4. Use the PiPo-textures to reduce mTexRoot vertically
-     *TODO:(5. Render result into a smaller texture)
+     *      5. Count the rows and columns of the result and copy it into the table texture
+     *
+     *      The adaptive mode counts the roots of each row between 3. and 4.
      *
      *      Result: A texture containing a compact list of all available labels
      */
@@ -180,30 +238,38 @@ double ReductionPhase::run()
     // Image dimensions do not change
     GL_CHECK( glUniform2f ( u_texDimLoc, mWidth, mHeight) );
 
+    mNumPasses  = 0;
+    mListRows   = -1;
+
     ///---------- 1. GENERATE ROOT-TEXTURE --------------------
 
-    // Set the mode to ROOT_INIT
-    GL_CHECK( glUniform1i ( u_stageLoc, MODE_ROOT_INIT ) );
-    // Set the read only texture
-    GL_CHECK( glUniform1i ( s_valuesLoc, mTextureUnits[TEX_LABEL] ) );
-    // Just bind any texture (not used in this stage)
-    GL_CHECK( glUniform1i ( s_reductionLoc, mTextureUnits[TEX_PIPO] ) );
-    // Bind a frambuffer
-    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[0]) );
-    // Attach mTexRoot to framebuffer
-    GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexRootId, 0) );
-    CHECK_FBO();
+    {
+        Profiler::Scope scope("reduction.root");
+        // Set the mode to ROOT_INIT
+        GL_CHECK( glUniform1i ( u_stageLoc, MODE_ROOT_INIT ) );
+        // Set the read only texture
+        GL_CHECK( glUniform1i ( s_valuesLoc, mTextureUnits[TEX_LABEL] ) );
+        // Just bind any texture (not used in this stage)
+        GL_CHECK( glUniform1i ( s_reductionLoc, mTextureUnits[TEX_PIPO] ) );
+        // Bind a frambuffer
+        GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[0]) );
+        // Attach mTexRoot to framebuffer
+        GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexRootId, 0) );
+        CHECK_FBO();
+        // Roots only exist in the occupied regions, everything else has to be background
+        if (mRegions != NULL && mRegions->isActive())
+            GL_CHECK( glClear( GL_COLOR_BUFFER_BIT ) );
 
-    // Draw scene
-    GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, mIndices ) );
+        // Draw scene
+        drawScene(mRegions, RegionSet::SHAPE_BOXES, mPositionLoc, mTexCoordLoc, mVertices, mIndices);
+    }
 
-#ifdef _DEBUG
-{
-    char filename[50];
-    sprintf(filename, "outRoot.png");
-    debugImage("Pixels after root pass\n", filename);
-}
-#endif
+    if (LOG_ENABLED(LOG_LEVEL_TRACE))
+    {
+        char filename[50];
+        sprintf(filename, "outRoot.png");
+        debugImage("Pixels after root pass\n", filename);
+    }
 
     ///---------- 2. REDUCE HORIZONTALLY --------------------
 
@@ -214,6 +280,9 @@ double ReductionPhase::run()
         GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[i]) );
         GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexPiPoId[i], 0) );
         CHECK_FBO();
+        // Rows without roots are not drawn and have to stay empty
+        if (mRegions != NULL && mRegions->isActive())
+            GL_CHECK( glClear( GL_COLOR_BUFFER_BIT ) );
     }
 
     // Bind the correct framebuffer
@@ -224,15 +293,18 @@ double ReductionPhase::run()
     GL_CHECK( glUniform1i ( u_directionLoc, HORIZONTAL) );
 
 
-    reduce(mWidth);
+    // The roots are moved to the left, i.e. complete rows have to be drawn
+    {
+        Profiler::Scope scope("reduction.horizontal");
+        reduce(horizontalPasses(), mRegions);
+    }
 
-#ifdef _DEBUG
-{
-    char filename[50];
-    sprintf(filename, "outHori.png");
-    debugImage("Pixels after horizontal pass\n", filename);
-}
-#endif
+    if (LOG_ENABLED(LOG_LEVEL_TRACE))
+    {
+        char filename[50];
+        sprintf(filename, "outHori.png");
+        debugImage("Pixels after horizontal pass\n", filename);
+    }
 
     ///---------- 3. SWITCH RESULT WITH TEX_ROOT --------------------
 
@@ -247,21 +319,62 @@ double ReductionPhase::run()
     GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexPiPoId[mRead], 0) );
     CHECK_FBO();
 
+    ///---------- COUNT THE ROOTS OF THE ROWS (ADAPTIVE MODE) --------------------
+
+    int numPasses  = logBase2(mHeight);
+    int numColumns = mWidth;
+    if (mAdaptivePasses && mCountTable)
+    {
+        Profiler::Scope scope("reduction.rows");
+        countRows();
+
+        // The roots only move down from rows up to the top row with roots,
+        // only the columns up to the longest row hold roots
+        numPasses  = std::max(logBase2(mTopRow), 1);
+        numColumns = std::max(mListColumns, 1);
+
+        // The columns which are not drawn have to be empty in the result
+        for(int i=0; i<2; i++)
+        {
+            GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[i]) );
+            GL_CHECK( glClear( GL_COLOR_BUFFER_BIT ) );
+        }
+        GL_CHECK( glUseProgram ( mProgramObject ) );
+        GL_CHECK( glEnableVertexAttribArray ( mPositionLoc ) );
+        GL_CHECK( glEnableVertexAttribArray ( mTexCoordLoc ) );
+    }
+
     ///---------- 4. REDUCE VERTICALLY --------------------
 
 
     GL_CHECK( glUniform1i ( u_directionLoc, VERTICAL) );
-    reduce(mHeight);
+    // The roots of all rows are moved down, i.e. the full frame has to be drawn
+    // (the columns of the longest row in the adaptive mode)
+    {
+        Profiler::Scope scope("reduction.vertical");
+        if (numColumns < mWidth)
+        {
+            GL_CHECK( glEnable( GL_SCISSOR_TEST ) );
+            GL_CHECK( glScissor( 0, 0, numColumns, mHeight ) );
+        }
+        reduce(numPasses, NULL);
+        GL_CHECK( glDisable( GL_SCISSOR_TEST ) );
+    }
+    LOG_DEBUG("Reduction: " << mNumPasses << " passes, " << numColumns << " columns reduced vertically");
 
-#ifdef _DEBUG
-{
-    char filename[50];
-    sprintf(filename, "out.png");
-    debugImage("Pixels after vertical pass\n", filename);
-}
-#endif
+    if (LOG_ENABLED(LOG_LEVEL_TRACE))
+    {
+        char filename[50];
+        sprintf(filename, "out.png");
+        debugImage("Pixels after vertical pass\n", filename);
+    }
+
+    ///---------- 5. RENDER RESULT INTO SMALL TEXTURE --------------------
 
-    ///TODO: ---------- 5. RENDER RESULT INTO SMALL TEXTURE --------------------
+    {
+        Profiler::Scope scope("reduction.table");
+        copyTable();
+    }
 
     GL_CHECK( glDisableVertexAttribArray ( mPositionLoc ) );
     GL_CHECK( glDisableVertexAttribArray ( mTexCoordLoc ) );
@@ -274,9 +387,11 @@ double ReductionPhase::run()
 void ReductionPhase::releaseGlResources()
 {
     GL_CHECK( glDeleteProgram(mProgramObject) );
+    GL_CHECK( glDeleteProgram(mTableProgramObject) );
     GL_CHECK( glDeleteTextures(1, &mTexLabelId) );
     GL_CHECK( glDeleteTextures(1, &mTexRootId) );
     GL_CHECK( glDeleteTextures(2, mTexPiPoId) );
+    GL_CHECK( glDeleteTextures(1, &mTexTableId) );
 }
 
 GLint ReductionPhase::getLastTexture()
@@ -289,6 +404,16 @@ GLint ReductionPhase::getLastTexUnit()
     return mTextureUnits[TEX_PIPO+mRead];
 }
 
+GLint ReductionPhase::getTableTexture()
+{
+    return mTexTableId;
+}
+
+GLint ReductionPhase::getTableTexUnit()
+{
+    return mTextureUnits[TEX_TABLE];
+}
+
 GLint ReductionPhase::getFreeTexture()
 {
     return mTexPiPoId[mWrite];
@@ -309,14 +434,27 @@ GLint ReductionPhase::getFreeTexUnit()
     return mTextureUnits[TEX_PIPO+mWrite];
 }
 
-void ReductionPhase::reduce(int length)
+int ReductionPhase::horizontalPasses() const
+{
+    if (!mAdaptivePasses || mRegions == NULL || !mRegions->isActive())
+        return logBase2(mWidth);
+
+    // All roots lie in the boxes, the pixels right of them are background
+    int right = 1;
+    const std::vector<RegionSet::Rect> &boxes = mRegions->boxes();
+    for (size_t i=0; i<boxes.size(); ++i)
+        right = std::max(right, boxes[i].x + boxes[i].width);
+    return std::max(logBase2(std::min(right, mWidth)-1), 1);
+}
+
+void ReductionPhase::reduce(int numPasses, const RegionSet *regions)
 {
     // First part is RUNNING_SUM
     GL_CHECK( glUniform1i ( u_stageLoc, MODE_RUNNING_SUM ) );
 
     // Do the runs
 
-    for (int i = 0; i < logBase2(length); ++i)
+    for (int i = 0; i < numPasses; ++i)
     {
         u_pass = i;
 
@@ -328,17 +466,7 @@ void ReductionPhase::reduce(int length)
         // Set the pass index
         GL_CHECK( glUniform1i ( u_passLoc,  u_pass) );
         // Draw scene
-        GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, mIndices ) );
-
-#ifdef _DEBUG
-{
-        char filename[50];
-        char text[50];
-        sprintf(filename, "out%03d.png", i);
-        sprintf(text, "Pixels after pass %d:\n", i);
-//        debugImage(text, filename);
-}
-#endif
+        drawScene(regions, RegionSet::SHAPE_ROWS, mPositionLoc, mTexCoordLoc, mVertices, mIndices);
 
         // Switch read and write texture
         std::swap(mRead, mWrite);
@@ -347,7 +475,7 @@ void ReductionPhase::reduce(int length)
     // Second part is BINARY_SEARCH
     GL_CHECK( glUniform1i ( u_stageLoc, MODE_BINARY_SEARCH) );
 
-    for (int i = logBase2(length)-1; i >= 0; --i)
+    for (int i = numPasses-1; i >= 0; --i)
     {
         u_pass = i;
 
@@ -358,25 +486,134 @@ void ReductionPhase::reduce(int length)
         // Set the pass index
         GL_CHECK( glUniform1i ( u_passLoc,  u_pass) );
         // Draw scene
-        GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, mIndices ) );
-
-#ifdef _DEBUG
-        char filename[50];
-        char text[50];
-        sprintf(filename, "out%03d.png", i);
-        sprintf(text, "Pixels after pass %d:\n", i);
-//        debugImage(text, filename);
-#endif
+        drawScene(regions, RegionSet::SHAPE_ROWS, mPositionLoc, mTexCoordLoc, mVertices, mIndices);
 
         // Switch read and write texture
         std::swap(mRead, mWrite);
     }
+    mNumPasses += 2*numPasses;
+}
+
+void ReductionPhase::countRows()
+{
+    mRowCounts.resize(4*mHeight);
+
+    // The horizontal result is the root texture now
+    GL_CHECK( glUseProgram ( mTableProgramObject ) );
+    GL_CHECK( glEnableVertexAttribArray ( mTablePositionLoc ) );
+    if (mTableTexCoordLoc >= 0)
+        GL_CHECK( glEnableVertexAttribArray ( mTableTexCoordLoc ) );
+    GL_CHECK( glUniform2f ( u_tableTexDimLoc, mWidth, mHeight) );
+    GL_CHECK( glUniform1i ( u_tableStageLoc, STAGE_ROWS ) );
+    GL_CHECK( glUniform1i ( s_tableLoc, mTextureUnits[TEX_ROOT] ) );
+    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mWrite]) );
+    GL_CHECK( glViewport ( 0, 0, 1, mHeight ) );
+    drawScene(NULL, RegionSet::SHAPE_BOXES, mTablePositionLoc, mTableTexCoordLoc, mVertices, mIndices);
+    GL_CHECK( glReadPixels(0, 0, 1, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, mRowCounts.data()) );
+    GL_CHECK( glViewport ( 0, 0, mWidth, mHeight ) );
+    GL_CHECK( glDisableVertexAttribArray ( mTablePositionLoc ) );
+    if (mTableTexCoordLoc >= 0)
+        GL_CHECK( glDisableVertexAttribArray ( mTableTexCoordLoc ) );
+
+    mListRows    = 0;
+    mListColumns = 0;
+    mTopRow      = 0;
+    for (int y=0; y<mHeight; ++y)
+    {
+        int count = *(GLushort*) (&mRowCounts[4*y]);
+        if (count > 0)
+        {
+            ++mListRows;
+            mListColumns = std::max(mListColumns, count);
+            mTopRow      = y;
+        }
+    }
+}
+
+void ReductionPhase::copyTable()
+{
+    // The list is packed to the bottom left: the first column has the most
+    // rows and the first row the most columns
+    int rows    = mHeight;
+    int columns = mWidth;
+    if (mListRows >= 0)
+    {
+        // Counted before the vertical reduction
+        rows    = mListRows;
+        columns = mListColumns;
+    }
+    else if (mCountTable)
+    {
+        GL_CHECK( glUseProgram ( mTableProgramObject ) );
+        GL_CHECK( glEnableVertexAttribArray ( mTablePositionLoc ) );
+        if (mTableTexCoordLoc >= 0)
+            GL_CHECK( glEnableVertexAttribArray ( mTableTexCoordLoc ) );
+        GL_CHECK( glUniform2f ( u_tableTexDimLoc, mWidth, mHeight) );
+        GL_CHECK( glUniform1i ( u_tableStageLoc, STAGE_TABLE ) );
+        GL_CHECK( glUniform1i ( s_tableLoc, mTextureUnits[TEX_PIPO+mRead] ) );
+        GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mWrite]) );
+        GL_CHECK( glViewport ( 0, 0, 2, 1 ) );
+        drawScene(NULL, RegionSet::SHAPE_BOXES, mTablePositionLoc, mTableTexCoordLoc, mVertices, mIndices);
+        GL_CHECK( glReadPixels(0, 0, 2, 1, GL_RGBA, GL_UNSIGNED_BYTE, mTableSize) );
+        GL_CHECK( glViewport ( 0, 0, mWidth, mHeight ) );
+        GL_CHECK( glDisableVertexAttribArray ( mTablePositionLoc ) );
+        if (mTableTexCoordLoc >= 0)
+            GL_CHECK( glDisableVertexAttribArray ( mTableTexCoordLoc ) );
+
+        rows    = *(GLushort*) (mTableSize);
+        columns = *(GLushort*) (mTableSize + 4);
+    }
+    mTableRows = rows;
+
+    // Grow to the next power of 2, so the texture is not reallocated for every frame
+    int width  = mTableWidth > 0 ? (int)mTableWidth : 1;
+    while (width < columns && mTableWidth == 0)
+        width *= 2;
+    int height = 1;
+    while (height < rows)
+        height *= 2;
+    // A given table width does not depend on the frame, it may be wider
+    if (mTableWidth == 0)
+        width = std::min(width, mWidth);
+    height = std::min(height, mHeight);
+
+    GL_CHECK( glActiveTexture( GL_TEXTURE0 + mTextureUnits[TEX_TABLE]) );
+    GL_CHECK( glBindTexture(GL_TEXTURE_2D, mTexTableId) );
+    if (width > mTableTexWidth || height > mTableTexHeight)
+    {
+        mTableTexWidth  = std::max(width,  mTableTexWidth);
+        mTableTexHeight = std::max(height, mTableTexHeight);
+        LOG_DEBUG("Table texture " << mTableTexWidth << "x" << mTableTexHeight);
+        GL_CHECK( glTexImage2D ( GL_TEXTURE_2D, 0, GL_RGBA, mTableTexWidth, mTableTexHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL) );
+    }
+
+    // The result has zeros beyond the list, so the complete width is copied
+    if (rows > 0)
+    {
+        GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mRead]) );
+        GL_CHECK( glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, std::min(mTableTexWidth, mWidth), rows) );
+    }
+
+    // The columns of a table wider than the frame are cleared instead
+    if (rows > 0 && mTableTexWidth > mWidth)
+    {
+        GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mWrite]) );
+        GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexTableId, 0) );
+        CHECK_FBO();
+        GL_CHECK( glEnable( GL_SCISSOR_TEST ) );
+        GL_CHECK( glScissor( mWidth, 0, mTableTexWidth - mWidth, rows ) );
+        GL_CHECK( glClear( GL_COLOR_BUFFER_BIT ) );
+        GL_CHECK( glDisable( GL_SCISSOR_TEST ) );
+        GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexPiPoId[mWrite], 0) );
+        CHECK_FBO();
+    }
 }
 
 void ReductionPhase::debugImage(const char *text, const char *filename)
 {
     CImg<unsigned char> image(4, mWidth, mHeight, 1, 0);
     GL_CHECK( glReadPixels(0, 0, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, image.data()) );
+    Log::countDebugReadback(image.size());
     printf("%s", text);
     printLabels(mWidth, mHeight, image.data());
     writeRawImage(mWidth, mHeight, filename, image);
@@ -0,0 +1,258 @@
+#include "regionSet.h"
+#include "phase.h"
+#include "thresholdKernel.h"
+
+#include <algorithm>
+#include <math.h>
+
+// GLushort indices limit the number of quads per draw call
+#define MAX_QUADS_PER_DRAW 16383
+
+RegionSet::RegionSet()
+    : mTileSize(16), mMarginTiles(1), mMaxCoverage(0.5f),
+      mWidth(0), mHeight(0), mIsActive(false), mCoverage(1.0f)
+{
+}
+
+void RegionSet::reset()
+{
+    mBoxes.clear();
+    mRows.clear();
+    mVertices[SHAPE_BOXES].clear();
+    mVertices[SHAPE_ROWS].clear();
+    mIsActive = false;
+    mCoverage = 1.0f;
+}
+
+bool RegionSet::isActive() const
+{
+    return mIsActive;
+}
+
+const std::vector<RegionSet::Rect>& RegionSet::boxes() const
+{
+    return mBoxes;
+}
+
+const std::vector<RegionSet::Rect>& RegionSet::rows() const
+{
+    return mRows;
+}
+
+float RegionSet::coverage() const
+{
+    return mCoverage;
+}
+
+void RegionSet::build(const uint64_t *mask, int width, int height)
+{
+    reset();
+    mWidth  = width;
+    mHeight = height;
+
+    const int tileSize = mTileSize;
+    const int tilesX = (width  + tileSize - 1) / tileSize;
+    const int tilesY = (height + tileSize - 1) / tileSize;
+    const unsigned words = ThresholdKernel::wordsPerRow(width);
+    const uint64_t tileBits = (tileSize == 64) ? ~(uint64_t)0 : (((uint64_t)1 << tileSize) - 1);
+
+    ///---------- 1. OCCUPANCY OF THE TILES --------------------
+
+    mTiles.assign((size_t)tilesX*tilesY, 0);
+    for (int y=0; y<height; ++y)
+    {
+        const uint64_t *row = mask + (size_t)y*words;
+        uint8_t *tiles = &mTiles[(size_t)(y/tileSize)*tilesX];
+        for (unsigned w=0; w<words; ++w)
+        {
+            if (row[w] == 0)
+                continue;
+            for (int k=0; k<64; k+=tileSize)
+            {
+                if ((row[w] >> k) & tileBits)
+                    tiles[(64*w + k) / tileSize] = 1;
+            }
+        }
+    }
+
+    buildBoxes(tilesX, tilesY);
+}
+
+void RegionSet::build(const std::vector<Window> &windows, int width, int height)
+{
+    reset();
+    mWidth  = width;
+    mHeight = height;
+
+    const int tileSize = mTileSize;
+    const int tilesX = (width  + tileSize - 1) / tileSize;
+    const int tilesY = (height + tileSize - 1) / tileSize;
+
+    ///---------- 1. TILES TOUCHED BY THE WINDOWS --------------------
+
+    mTiles.assign((size_t)tilesX*tilesY, 0);
+    for (size_t i=0; i<windows.size(); ++i)
+    {
+        const Window &window = windows[i];
+        int x0 = std::max((int)floorf(window.x - window.radius), 0);
+        int y0 = std::max((int)floorf(window.y - window.radius), 0);
+        int x1 = std::min((int)ceilf(window.x + window.radius), width-1);
+        int y1 = std::min((int)ceilf(window.y + window.radius), height-1);
+        if (x0 > x1 || y0 > y1)
+            continue;
+
+        for (int ty=y0/tileSize; ty<=y1/tileSize; ++ty)
+        {
+            for (int tx=x0/tileSize; tx<=x1/tileSize; ++tx)
+                mTiles[(size_t)ty*tilesX + tx] = 1;
+        }
+    }
+
+    buildBoxes(tilesX, tilesY);
+}
+
+void RegionSet::buildFromTiles(const uint8_t *tiles, int width, int height)
+{
+    reset();
+    mWidth  = width;
+    mHeight = height;
+
+    const int tileSize = mTileSize;
+    const int tilesX = (width  + tileSize - 1) / tileSize;
+    const int tilesY = (height + tileSize - 1) / tileSize;
+
+    mTiles.resize((size_t)tilesX*tilesY);
+    for (size_t i=0; i<mTiles.size(); ++i)
+        mTiles[i] = tiles[i] ? 1 : 0;
+
+    buildBoxes(tilesX, tilesY);
+}
+
+void RegionSet::buildBoxes(int tilesX, int tilesY)
+{
+    const int tileSize = mTileSize;
+    const int width  = mWidth;
+    const int height = mHeight;
+
+    ///---------- 2. BOXES AROUND 8-CONNECTED CLUSTERS OF TILES --------------------
+
+    long boxArea = 0;
+    for (int start=0; start<tilesX*tilesY; ++start)
+    {
+        if (mTiles[start] != 1)
+            continue;
+
+        int minX = tilesX, minY = tilesY, maxX = -1, maxY = -1;
+        mStack.push_back(start);
+        mTiles[start] = 2;
+        while (!mStack.empty())
+        {
+            int tile = mStack.back();
+            mStack.pop_back();
+            int tx = tile % tilesX;
+            int ty = tile / tilesX;
+            minX = std::min(minX, tx);
+            maxX = std::max(maxX, tx);
+            minY = std::min(minY, ty);
+            maxY = std::max(maxY, ty);
+
+            for (int ny=std::max(ty-1, 0); ny<=std::min(ty+1, tilesY-1); ++ny)
+            {
+                for (int nx=std::max(tx-1, 0); nx<=std::min(tx+1, tilesX-1); ++nx)
+                {
+                    int neighbour = ny*tilesX + nx;
+                    if (mTiles[neighbour] == 1)
+                    {
+                        mTiles[neighbour] = 2;
+                        mStack.push_back(neighbour);
+                    }
+                }
+            }
+        }
+
+        Rect box;
+        box.x = std::max(minX - (int)mMarginTiles, 0) * tileSize;
+        box.y = std::max(minY - (int)mMarginTiles, 0) * tileSize;
+        box.width  = std::min((maxX + 1 + (int)mMarginTiles) * tileSize, width)  - box.x;
+        box.height = std::min((maxY + 1 + (int)mMarginTiles) * tileSize, height) - box.y;
+        mBoxes.push_back(box);
+        boxArea += (long)box.width*box.height;
+    }
+
+    float coverage = (width > 0 && height > 0) ? (float)boxArea / ((float)width*height) : 1.0f;
+    if (coverage > mMaxCoverage)
+    {
+        // Too many boxes, drawing the full frame is cheaper
+        reset();
+        mCoverage = coverage;
+        return;
+    }
+    mCoverage = coverage;
+    mIsActive = true;
+
+    ///---------- 3. ROWS COVERED BY THE BOXES --------------------
+
+    std::vector<Rect> sorted(mBoxes);
+    std::sort(sorted.begin(), sorted.end(), [](const Rect &a, const Rect &b) { return a.y < b.y; });
+    for (size_t i=0; i<sorted.size(); ++i)
+    {
+        if (!mRows.empty() && sorted[i].y <= mRows.back().y + mRows.back().height)
+        {
+            int end = std::max(mRows.back().y + mRows.back().height, sorted[i].y + sorted[i].height);
+            mRows.back().height = end - mRows.back().y;
+        }
+        else
+        {
+            Rect row = { 0, sorted[i].y, width, sorted[i].height };
+            mRows.push_back(row);
+        }
+    }
+
+    ///---------- 4. GEOMETRY --------------------
+
+    for (size_t i=0; i<mBoxes.size(); ++i)
+        appendQuad(mVertices[SHAPE_BOXES], mBoxes[i]);
+    for (size_t i=0; i<mRows.size(); ++i)
+        appendQuad(mVertices[SHAPE_ROWS], mRows[i]);
+
+    size_t numQuads = std::min<size_t>(mBoxes.size(), MAX_QUADS_PER_DRAW);
+    for (size_t i=mIndices.size()/6; i<numQuads; ++i)
+    {
+        GLushort first = 4*i;
+        GLushort quad[6] = { first, (GLushort)(first+1), (GLushort)(first+2),
+                             first, (GLushort)(first+2), (GLushort)(first+3) };
+        mIndices.insert(mIndices.end(), quad, quad+6);
+    }
+}
+
+void RegionSet::appendQuad(std::vector<GLfloat> &vertices, const Rect &rect) const
+{
+    // Same layout as the full frame quad of the phases: 3 position and 2 texture coordinates
+    GLfloat s0 = (GLfloat)rect.x / mWidth;
+    GLfloat s1 = (GLfloat)(rect.x + rect.width) / mWidth;
+    GLfloat t0 = (GLfloat)rect.y / mHeight;
+    GLfloat t1 = (GLfloat)(rect.y + rect.height) / mHeight;
+
+    GLfloat quad[20] = { 2*s0-1, 2*t0-1, 0.0f,  s0, t0,
+                         2*s0-1, 2*t1-1, 0.0f,  s0, t1,
+                         2*s1-1, 2*t1-1, 0.0f,  s1, t1,
+                         2*s1-1, 2*t0-1, 0.0f,  s1, t0 };
+    vertices.insert(vertices.end(), quad, quad+20);
+}
+
+void RegionSet::draw(Shape shape, GLint positionLoc, GLint texCoordLoc) const
+{
+    const std::vector<GLfloat> &vertices = mVertices[shape];
+    size_t numQuads = vertices.size() / 20;
+
+    for (size_t first=0; first<numQuads; first+=MAX_QUADS_PER_DRAW)
+    {
+        size_t count = std::min<size_t>(numQuads-first, MAX_QUADS_PER_DRAW);
+        GL_CHECK( glVertexAttribPointer ( positionLoc, 3, GL_FLOAT,
+                                          GL_FALSE, 5 * sizeof(GLfloat), &vertices[20*first] ) );
+        if (texCoordLoc >= 0)
+            GL_CHECK( glVertexAttribPointer ( texCoordLoc, 2, GL_FLOAT,
+                                              GL_FALSE, 5 * sizeof(GLfloat), &vertices[20*first+3] ) );
+        GL_CHECK( glDrawElements ( GL_TRIANGLES, 6*count, GL_UNSIGNED_SHORT, mIndices.data() ) );
+    }
+}
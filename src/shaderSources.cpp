@@ -0,0 +1,61 @@
+#include "shaderSources.h"
+
+#include <stdlib.h>
+
+#include <fstream>
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+// Name of the environment variable with the directory which overrides the embedded sources
+#define GLSL_DIR_VARIABLE "GPULABELING_GLSL_DIR"
+
+static std::string baseName(const std::string &filename)
+{
+    size_t separator = filename.find_last_of("/\\");
+    return (separator == std::string::npos) ? filename : filename.substr(separator+1);
+}
+
+static bool readFile(const std::string &filename, std::string &content)
+{
+    std::ifstream file(filename.c_str());
+    if( !file.good() )
+        return false;
+
+    content = std::string((std::istreambuf_iterator<char>(file)),
+                          std::istreambuf_iterator<char>());
+    return true;
+}
+
+const char *ShaderSources::embedded(const std::string &filename)
+{
+    std::string name = baseName(filename);
+    for (const Entry *entry = mEmbedded; entry->name != NULL; ++entry)
+    {
+        if (name == entry->name)
+            return entry->source;
+    }
+    return NULL;
+}
+
+bool ShaderSources::load(const std::string &filename, std::string &source)
+{
+    const char *directory = getenv(GLSL_DIR_VARIABLE);
+    if (directory != NULL && directory[0] != '\0')
+    {
+        if (readFile(std::string(directory) + "/" + baseName(filename), source))
+            return true;
+        cerr << "Shader " << baseName(filename) << " not found in " << GLSL_DIR_VARIABLE
+             << "=" << directory << ", using the embedded source" << endl;
+    }
+
+    const char *embeddedSource = embedded(filename);
+    if (embeddedSource != NULL)
+    {
+        source = embeddedSource;
+        return true;
+    }
+
+    // Shaders which are not part of glsl/
+    return readFile(filename, source);
+}
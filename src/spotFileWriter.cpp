@@ -0,0 +1,126 @@
+#include "spotFileWriter.h"
+
+#include <stdexcept>
+
+SpotFileWriter::SpotFileWriter()
+    : mFile(NULL), mOffset(0)
+{
+}
+
+SpotFileWriter::SpotFileWriter(const std::string &filename, bool append)
+    : mFile(NULL), mOffset(0)
+{
+    open(filename, append);
+}
+
+SpotFileWriter::~SpotFileWriter()
+{
+    // A destructor must not throw, call close() to get the errors
+    try
+    {
+        close();
+    }
+    catch (const std::runtime_error &)
+    {
+    }
+}
+
+void SpotFileWriter::open(const std::string &filename, bool append)
+{
+    close();
+
+    if (append && access(filename.c_str(), F_OK) == 0)
+    {
+        // Take over the frames of the existing file and cut off its index
+        {
+            SpotFileReader reader;
+            if (!reader.open(filename))
+                throw std::runtime_error(std::string("SPOTFILE: No spot file: ") + filename);
+            mIndex.resize(reader.numFrames());
+            for (size_t i=0; i<mIndex.size(); ++i)
+                mIndex[i] = reader.frameOffset(i);
+            mOffset = reader.dataEnd();
+        }
+        if (truncate(filename.c_str(), mOffset) != 0 || (mFile = fopen(filename.c_str(), "ab")) == NULL)
+        {
+            mIndex.clear();
+            throw std::runtime_error(std::string("SPOTFILE: Failed to append to ") + filename);
+        }
+        return;
+    }
+
+    mFile = fopen(filename.c_str(), "wb");
+    if (mFile == NULL)
+        throw std::runtime_error(std::string("SPOTFILE: Failed to create ") + filename);
+
+    SpotFileHeader header;
+    memcpy(header.magic, SPOTFILE_MAGIC, sizeof(header.magic));
+    header.version    = SPOTFILE_VERSION;
+    header.recordSize = sizeof(SpotRecord);
+    if (fwrite(&header, sizeof(header), 1, mFile) != 1)
+    {
+        fclose(mFile);
+        mFile = NULL;
+        throw std::runtime_error(std::string("SPOTFILE: Failed to write the header of ") + filename);
+    }
+    mOffset = sizeof(header);
+}
+
+void SpotFileWriter::writeFrame(uint64_t timestamp, uint32_t frameNumber, const std::vector<StatsPhase::Spot> &spots)
+{
+    if (mFile == NULL)
+        throw std::runtime_error(std::string("SPOTFILE: Frame written to a closed file"));
+
+    SpotFrameHeader header;
+    memcpy(header.magic, SPOTFILE_FRAME, sizeof(header.magic));
+    header.timestamp   = timestamp;
+    header.frameNumber = frameNumber;
+    header.numSpots    = spots.size();
+
+    mRecords.resize(spots.size());
+    for (size_t i=0; i<spots.size(); ++i)
+    {
+        mRecords[i].x         = spots[i].x;
+        mRecords[i].y         = spots[i].y;
+        mRecords[i].area      = spots[i].area;
+        mRecords[i].luminance = spots[i].luminance;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, mFile) != 1 ||
+        fwrite(mRecords.data(), sizeof(SpotRecord), mRecords.size(), mFile) != mRecords.size())
+        throw std::runtime_error(std::string("SPOTFILE: Failed to write a frame"));
+    mIndex.push_back(mOffset);
+    mOffset += sizeof(header) + mRecords.size()*sizeof(SpotRecord);
+}
+
+void SpotFileWriter::close()
+{
+    if (mFile == NULL)
+        return;
+
+    SpotFileTrailer trailer;
+    trailer.indexOffset = mOffset;
+    trailer.numFrames   = mIndex.size();
+    memcpy(trailer.magic, SPOTFILE_INDEX, sizeof(trailer.magic));
+    bool written = fwrite(mIndex.data(), sizeof(uint64_t), mIndex.size(), mFile) == mIndex.size() &&
+                   fwrite(&trailer, sizeof(trailer), 1, mFile) == 1 &&
+                   fflush(mFile) == 0;
+    // A partial index is no problem for the readers, the scan stops at it
+    bool closed = fclose(mFile) == 0;
+
+    mFile = NULL;
+    mOffset = 0;
+    mIndex.clear();
+    if (!written || !closed)
+        throw std::runtime_error(std::string("SPOTFILE: Failed to write the index"));
+}
+
+bool SpotFileWriter::isOpen() const
+{
+    return mFile != NULL;
+}
+
+size_t SpotFileWriter::numFrames() const
+{
+    return mIndex.size();
+}
@@ -1,4 +1,8 @@
 #include "statsPhase.h"
+#include "profiler.h"
+#include "log.h"
+#include <algorithm>
+#include <string.h>
 #include <iostream>
 using std::cout;
 using std::cerr;
@@ -16,21 +20,37 @@ using std::endl;
 #define STAGE_BLEND         3
 #define STAGE_SAVE          4
 
+#define STAGE_HEADER        0
+#define STAGE_GATHER        1
+
+#define STAGE_CELLS         0
+#define STAGE_ACCUMULATE    1
+
+// Sized float format of ES 3 (not in the ES 2 headers)
+#ifndef GL_RGBA32F
+#define GL_RGBA32F 0x8814
+#endif
+
 #define CENTROID_X_COORD   -1
 #define CENTROID_Y_COORD   -2
+#define CENTROID_LUMINANCE -3
 
 #define OFFSET 10.0
+#define TABLE_COLUMNS ((int)OFFSET)
+
+// Layout of a spot in the compacted block (4 RGBA pixels, 5 for high bit depth images)
+#define SPOT_FIELDS 4
+#define SPOT_FIELDS_WIDE 5
 #define OFFSET_Y 2
 #define OFFSET_X 0
-#define OFFSET_AREA ((size_t)OFFSET*sizeof(uint32_t))
-#define OFFSET_LUMINANCE ((size_t)OFFSET*sizeof(uint32_t)+2)
-#define OFFSET_SUM_X ((size_t)OFFSET*2*sizeof(uint32_t))
-#define OFFSET_SUM_Y ((size_t)OFFSET*3*sizeof(uint32_t))
+#define OFFSET_AREA (sizeof(uint32_t))
+#define OFFSET_LUMINANCE (sizeof(uint32_t)+2)
+#define OFFSET_SUM_X (2*sizeof(uint32_t))
+#define OFFSET_SUM_Y (3*sizeof(uint32_t))
+#define OFFSET_LUMINANCE_WIDE (4*sizeof(uint32_t))
 
 #include "getTime.h"
 
-#define _DEBUG
-
 StatsPhase::StatsPhase(int width, int height)
     : mVertFilename("../glsl/quad.vert"),
       mWidth(width), mHeight(height),
@@ -44,13 +64,35 @@ StatsPhase::StatsPhase(int width, int height)
                   1.0f,  0.0f         // TexCoord 3
                 },
       mIndices { 0, 1, 2, 0, 2, 3 },
+      mOrigTopDown(false),
       mStatsAreaWidth(OFFSET*4),
       mStatsAreaHeight(height),
-      mNumFillIterations(2)
+      mCompactWidth(64),
+      mReadbackSize(0),
+      mNumFillIterations(2),
+      mBitDepth(8),
+      mWideSums(false),
+      mRegions(NULL),
+      mEngine(ENGINE_QUADRANTS),
+      mTableWidth(width),
+      mTableHeight(height),
+      mTableRows(height),
+      mHasScatter(false),
+      mWarnedScatter(false),
+      mTexSumsId(0),
+      mSumsTextureUnit(0),
+      mCellVboId(0),
+      mPointVboId(0),
+      mNumPoints(0),
+      mPointsAreFullFrame(false)
 {
     mProgFill.filename     = "../glsl/fillStage.frag";
     mProgCount.filename    = "../glsl/countStage.frag";
     mProgCentroid.filename = "../glsl/centroidStage.frag";
+    mProgCompact.filename  = "../glsl/compactStage.frag";
+    mProgScatter.vertFilename = "../glsl/statsScatter.vert";
+    mProgScatter.filename     = "../glsl/statsScatter.frag";
+    mProgPack.filename        = "../glsl/statsPack.frag";
 }
 
 StatsPhase::~StatsPhase()
@@ -112,7 +154,11 @@ GLint StatsPhase::init(GLuint fbos[2], GLuint &bfUsedTextures)
     mProgCentroid.u_passLoc         = glGetUniformLocation ( mProgCentroid.program, "u_pass" );
     mProgCentroid.u_stageLoc        = glGetUniformLocation ( mProgCentroid.program, "u_stage" );
     mProgCentroid.u_savingOffsetLoc = glGetUniformLocation ( mProgCentroid.program, "u_savingOffset" );
+    mProgCentroid.u_tableDimLoc     = glGetUniformLocation ( mProgCentroid.program, "u_tableDimensions" );
     mProgCentroid.u_factorLoc       = glGetUniformLocation ( mProgCentroid.program, "u_factor" );
+    mProgCentroid.u_origTopDownLoc  = glGetUniformLocation ( mProgCentroid.program, "u_origTopDown" );
+    mProgCentroid.u_origMaxValueLoc = glGetUniformLocation ( mProgCentroid.program, "u_origMaxValue" );
+    mProgCentroid.u_wideSumsLoc     = glGetUniformLocation ( mProgCentroid.program, "u_wideSums" );
 
     // Setup the count stage-progam
     mProgCount.program = loadProgramFromFile( mVertFilename, mProgCount.filename);
@@ -130,13 +176,46 @@ GLint StatsPhase::init(GLuint fbos[2], GLuint &bfUsedTextures)
     mProgCount.s_fillLoc   = glGetUniformLocation( mProgCount.program,  "s_fill" );
     mProgCount.s_labelLoc  = glGetUniformLocation( mProgCount.program,  "s_label" );
     mProgCount.s_resultLoc = glGetUniformLocation( mProgCount.program,  "s_result" );
-    mProgCount.s_origLoc   = glGetUniformLocation( mProgCentroid.program,  "s_orig" );
+    mProgCount.s_origLoc   = glGetUniformLocation( mProgCount.program,  "s_orig" );
 
     mProgCount.u_texDimLoc       = glGetUniformLocation ( mProgCount.program, "u_texDimensions" );
     mProgCount.u_passLoc         = glGetUniformLocation ( mProgCount.program, "u_pass" );
     mProgCount.u_stageLoc        = glGetUniformLocation ( mProgCount.program, "u_stage" );
     mProgCount.u_savingOffsetLoc = glGetUniformLocation ( mProgCount.program, "u_savingOffset" );
+    mProgCount.u_tableDimLoc     = glGetUniformLocation ( mProgCount.program, "u_tableDimensions" );
     mProgCount.u_factorLoc       = glGetUniformLocation ( mProgCount.program, "u_factor" );
+    mProgCount.u_origTopDownLoc  = glGetUniformLocation ( mProgCount.program, "u_origTopDown" );
+    mProgCount.u_origMaxValueLoc = glGetUniformLocation ( mProgCount.program, "u_origMaxValue" );
+
+    // Setup the compaction stage-program
+    mProgCompact.program = loadProgramFromFile( mVertFilename, mProgCompact.filename);
+    if (mProgCompact.program == 0)
+    {
+        cerr << "Failed to generate Program object for compaction stage of stats phase" << endl;
+    }
+    mProgCompact.positionLoc = glGetAttribLocation ( mProgCompact.program , "a_position" );
+    mProgCompact.texCoordLoc = glGetAttribLocation ( mProgCompact.program , "a_texCoord" );  // -1, the compaction shader does not read v_texCoord
+
+    mProgCompact.s_tableLoc = glGetUniformLocation( mProgCompact.program,  "s_table" );
+
+    mProgCompact.u_texDimLoc      = glGetUniformLocation ( mProgCompact.program, "u_texDimensions" );
+    mProgCompact.u_stageLoc       = glGetUniformLocation ( mProgCompact.program, "u_stage" );
+    mProgCompact.u_tableDimLoc    = glGetUniformLocation ( mProgCompact.program, "u_tableDimensions" );
+    mProgCompact.u_tableRowsLoc   = glGetUniformLocation ( mProgCompact.program, "u_tableRows" );
+    mProgCompact.u_columnRowsLoc  = glGetUniformLocation ( mProgCompact.program, "u_columnRows" );
+    mProgCompact.u_numSpotsLoc    = glGetUniformLocation ( mProgCompact.program, "u_numSpots" );
+    mProgCompact.u_spotsPerRowLoc = glGetUniformLocation ( mProgCompact.program, "u_spotsPerRow" );
+    mProgCompact.u_spotFieldsLoc  = glGetUniformLocation ( mProgCompact.program, "u_spotFields" );
+
+    // The 24-bit (32-bit) luminance sums are saved as a fifth block of the table
+    unsigned spotFields = wideLuminance() ? SPOT_FIELDS_WIDE : SPOT_FIELDS;
+    mStatsAreaWidth = OFFSET*spotFields;
+    // The readback gathers the fields of a spot into one row of the frame
+    if (mWidth < (int)spotFields)
+    {
+        cerr << "Frame is narrower than the " << spotFields << " fields of a spot" << endl;
+        return GL_FALSE;
+    }
 
     // missing texture for ping-pong
     int i = 0;
@@ -148,9 +227,105 @@ GLint StatsPhase::init(GLuint fbos[2], GLuint &bfUsedTextures)
     mTextureUnits[TEX_PIPO+1] = i;
     GL_CHECK( glBindTexture(GL_TEXTURE_2D, mTexPiPoId[1]) );
 
+    mOwnTexPiPoId   = mTexPiPoId[1];
+    mOwnTextureUnit = i;
+
+    initScatter(bfUsedTextures);
+
     return GL_TRUE;
 }
 
+void StatsPhase::initScatter(GLuint &bfUsedTextures)
+{
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    const char *version    = (const char *)glGetString(GL_VERSION);
+    // Drivers may return an ES 3 context, which renders only into sized float formats
+    bool isEs3 = version != NULL && strncmp(version, "OpenGL ES 3", 11) == 0;
+    GLint vertexTextureUnits = 0;
+    GL_CHECK( glGetIntegerv(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, &vertexTextureUnits) );
+    mHasScatter = extensions != NULL
+                  && (isEs3 || strstr(extensions, "GL_OES_texture_float") != NULL)
+                  && strstr(extensions, "GL_EXT_color_buffer_float") != NULL
+                  && strstr(extensions, "GL_EXT_float_blend") != NULL
+                  && vertexTextureUnits >= 3;
+    if (!mHasScatter)
+    {
+        LOG_INFO("Scatter engine of the stats phase is not supported");
+        return;
+    }
+
+    // Float table with one pixel per cell, as many rows as the table can have
+    int i = 0;
+    while( (1<<i) & bfUsedTextures) ++i;
+    GL_CHECK( glActiveTexture( GL_TEXTURE0 + i) );
+    mTexSumsId = createSimpleTexture2D(TABLE_COLUMNS, mHeight);
+    GL_CHECK( glTexImage2D ( GL_TEXTURE_2D, 0, isEs3 ? GL_RGBA32F : GL_RGBA, TABLE_COLUMNS, mHeight, 0, GL_RGBA, GL_FLOAT, NULL) );
+
+    // Not every driver which lists the extensions can render into an unsized float texture
+    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[0]) );
+    GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexSumsId, 0) );
+    mHasScatter = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0) );
+    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, 0) );
+    if (!mHasScatter)
+    {
+        LOG_INFO("Scatter engine of the stats phase is not supported (float framebuffer incomplete)");
+        GL_CHECK( glDeleteTextures(1, &mTexSumsId) );
+        mTexSumsId = 0;
+        return;
+    }
+    bfUsedTextures |= (1<<i);
+    mSumsTextureUnit = i;
+
+    mProgScatter.program = loadProgramFromFile( mProgScatter.vertFilename, mProgScatter.filename);
+    mProgPack.program    = loadProgramFromFile( mVertFilename, mProgPack.filename);
+    if (mProgScatter.program == 0 || mProgPack.program == 0)
+    {
+        cerr << "Failed to generate Program object for scatter engine of stats phase" << endl;
+        mHasScatter = false;
+        return;
+    }
+
+    mProgScatter.positionLoc = glGetAttribLocation ( mProgScatter.program, "a_position" );
+    mProgScatter.s_tableLoc  = glGetUniformLocation( mProgScatter.program, "s_table" );
+    mProgScatter.s_labelLoc  = glGetUniformLocation( mProgScatter.program, "s_label" );
+    mProgScatter.s_cellsLoc  = glGetUniformLocation( mProgScatter.program, "s_cells" );
+    mProgScatter.s_origLoc   = glGetUniformLocation( mProgScatter.program, "s_orig" );
+    mProgScatter.u_texDimLoc       = glGetUniformLocation ( mProgScatter.program, "u_texDimensions" );
+    mProgScatter.u_stageLoc        = glGetUniformLocation ( mProgScatter.program, "u_stage" );
+    mProgScatter.u_targetDimLoc    = glGetUniformLocation ( mProgScatter.program, "u_targetDimensions" );
+    mProgScatter.u_tableDimLoc     = glGetUniformLocation ( mProgScatter.program, "u_tableDimensions" );
+    mProgScatter.u_origTopDownLoc  = glGetUniformLocation ( mProgScatter.program, "u_origTopDown" );
+    mProgScatter.u_origMaxValueLoc = glGetUniformLocation ( mProgScatter.program, "u_origMaxValue" );
+
+    mProgPack.positionLoc  = glGetAttribLocation ( mProgPack.program, "a_position" );
+    mProgPack.texCoordLoc  = glGetAttribLocation ( mProgPack.program, "a_texCoord" );  // -1, statsPack.frag does not read v_texCoord
+    mProgPack.s_sumsLoc    = glGetUniformLocation( mProgPack.program, "s_sums" );
+    mProgPack.u_texDimLoc  = glGetUniformLocation( mProgPack.program, "u_texDimensions" );
+    mProgPack.u_sumsDimLoc = glGetUniformLocation( mProgPack.program, "u_sumsDimensions" );
+    mProgPack.u_wideSumsLoc = glGetUniformLocation( mProgPack.program, "u_wideSums" );
+
+    // One vertex per table cell, row by row so the first rows can be drawn
+    // alone. The coordinates of all vertices are unsigned shorts, the frame
+    // is never larger than the maximum texture size.
+    std::vector<GLushort> cells(2*TABLE_COLUMNS*mHeight);
+    for (int y=0; y<mHeight; ++y)
+    {
+        for (int x=0; x<TABLE_COLUMNS; ++x)
+        {
+            cells[2*(y*TABLE_COLUMNS + x) + 0] = x;
+            cells[2*(y*TABLE_COLUMNS + x) + 1] = y;
+        }
+    }
+    GL_CHECK( glGenBuffers(1, &mCellVboId) );
+    GL_CHECK( glBindBuffer(GL_ARRAY_BUFFER, mCellVboId) );
+    GL_CHECK( glBufferData(GL_ARRAY_BUFFER, cells.size()*sizeof(GLushort), cells.data(), GL_STATIC_DRAW) );
+
+    GL_CHECK( glGenBuffers(1, &mPointVboId) );
+    GL_CHECK( glBindBuffer(GL_ARRAY_BUFFER, 0) );
+    mPointsAreFullFrame = false;
+}
+
 GLint StatsPhase::initIndependent(GLuint fbos[], GLuint &bfUsedTextures)
 {
     int i = 0;
@@ -165,10 +340,17 @@ GLint StatsPhase::initIndependent(GLuint fbos[], GLuint &bfUsedTextures)
     i = 0;
     while( (1<<i) & bfUsedTextures) ++i;
     GL_CHECK( glActiveTexture( GL_TEXTURE0 + i) );
-    mTexReducedId = createSimpleTexture2D(mWidth, mHeight, mImageReduced.data());
+    // The table may be wider than a narrow frame, the reduced image is its left part
+    mStatsAreaWidth = OFFSET*(wideLuminance() ? SPOT_FIELDS_WIDE : SPOT_FIELDS);
+    int tableWidth  = std::max<int>(mWidth, mStatsAreaWidth);
+    std::vector<GLubyte> table(4*tableWidth*mHeight, 0);
+    for (int y=0; y<mHeight; ++y)
+        std::copy(mImageReduced.data() + 4*y*mWidth, mImageReduced.data() + 4*(y+1)*mWidth, table.begin() + 4*y*tableWidth);
+    mTexReducedId = createSimpleTexture2D(tableWidth, mHeight, table.data());
     bfUsedTextures |= (1<<i);
     mTextureUnits[TEX_REDUCED] = i;
     GL_CHECK( glBindTexture(GL_TEXTURE_2D, mTexReducedId) );
+    setTableSize(tableWidth, mHeight, mHeight);
 
     i = 0;
     while( (1<<i) & bfUsedTextures) ++i;
@@ -203,10 +385,12 @@ GLint StatsPhase::initIndependent(GLuint fbos[], GLuint &bfUsedTextures)
 void StatsPhase::updateTextures(GLuint origTex, GLint origTexUnit,
                                 GLuint labelTex, GLint labelTexUnit,
                                 GLuint reducedTex, GLint reducedTexUnit,
-                                GLuint freeTex, GLint freeTexUnit, GLuint freeTex2, GLint freeTexUnit2)
+                                GLuint freeTex, GLint freeTexUnit, GLuint freeTex2, GLint freeTexUnit2,
+                                bool origTopDown)
 {
     mTexOrigId                 = origTex;
     mTextureUnits[TEX_ORIG]    = origTexUnit;
+    mOrigTopDown               = origTopDown;
 
     mTexLabelId                = labelTex;
     mTextureUnits[TEX_LABEL]   = labelTexUnit;
@@ -219,6 +403,28 @@ void StatsPhase::updateTextures(GLuint origTex, GLint origTexUnit,
 
     mTexPiPoId[0]              = freeTex2;
     mTextureUnits[TEX_PIPO+0]  = freeTexUnit2;
+
+    mTexPiPoId[1]              = mOwnTexPiPoId;
+    mTextureUnits[TEX_PIPO+1]  = mOwnTextureUnit;
+    mRead  = 0;
+    mWrite = 1;
+}
+
+void StatsPhase::setTableSize(int width, int height, int rows)
+{
+    mTableWidth  = width;
+    mTableHeight = height;
+    mTableRows   = rows;
+}
+
+int StatsPhase::tableRows() const
+{
+    return std::min<int>(std::min<int>(mStatsAreaHeight, mTableRows), mTableHeight);
+}
+
+int StatsPhase::tableColumns() const
+{
+    return std::min(TABLE_COLUMNS, mWidth);
 }
 
 void StatsPhase::setupGeometry()
@@ -245,6 +451,22 @@ double StatsPhase::run()
 
     startTime = getRealTime();
 
+    runPasses();
+
+    // Download only the spots of the final table back to program memory
+    readSpots();
+
+    endTime = getRealTime();
+
+    return (endTime-startTime)*1000;
+}
+
+double StatsPhase::runPasses()
+{
+    double startTime, endTime;
+
+    startTime = getRealTime();
+
     ///////////// --------- GENERAL SETUP ---------- ////////////////////
 
     GL_CHECK( glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0) );
@@ -259,93 +481,202 @@ double StatsPhase::run()
         CHECK_FBO();
     }
 
-#ifdef _DEBUG
-{
-        char filename[50];
-        sprintf(filename, "out0%03d.png", 0);
-//        debugImage("Pixels before run:\n", filename);
-}
-#endif
+    if (mEngine == ENGINE_SCATTER)
+    {
+        if (mHasScatter)
+        {
+            runScatter();
+            return (getRealTime()-startTime)*1000;
+        }
+        if (!mWarnedScatter)
+        {
+            LOG_WARN("Scatter engine of the stats phase is not supported, using the quadrants");
+            mWarnedScatter = true;
+        }
+    }
+
     float factorX = 1.0, factorY = 1.0;
 
-    fillStage(factorX, factorY);
-    countStage(factorX, factorY, OFFSET);
-    centroidingStage(factorX, factorY,CENTROID_X_COORD, 2*OFFSET);
-    centroidingStage(factorX, factorY, CENTROID_Y_COORD, 3*OFFSET);
+    runQuadrant(0, factorX, factorY);
 
     factorX = -1.0;
-    fillStage(factorX, factorY);
-    countStage(factorX, factorY, OFFSET);
-    centroidingStage(factorX, factorY,CENTROID_X_COORD, 2*OFFSET);
-    centroidingStage(factorX, factorY, CENTROID_Y_COORD, 3*OFFSET);
+    runQuadrant(1, factorX, factorY);
 
     factorY = -1.0;
-    fillStage(factorX, factorY);
-    countStage(factorX, factorY, OFFSET);
-    centroidingStage(factorX, factorY,CENTROID_X_COORD, 2*OFFSET);
-    centroidingStage(factorX, factorY, CENTROID_Y_COORD, 3*OFFSET);
+    runQuadrant(2, factorX, factorY);
 
     factorX = 1.0;
-    fillStage(factorX, factorY);
-    countStage(factorX, factorY, OFFSET);
-    centroidingStage(factorX, factorY,CENTROID_X_COORD, 2*OFFSET);
-    centroidingStage(factorX, factorY, CENTROID_Y_COORD, 3*OFFSET);
+    runQuadrant(3, factorX, factorY);
 
-    // Download the area of the final texture with the results back to program memory
-    unsigned char data[4*mStatsAreaWidth*mStatsAreaHeight];
-    GL_CHECK( glReadPixels(0, 0, mStatsAreaWidth, mStatsAreaHeight, GL_RGBA, GL_UNSIGNED_BYTE, data) );
+    endTime = getRealTime();
 
-    mSpots.clear();
-    printf("Checking for spots %d x %d\n", mStatsAreaHeight, mStatsAreaWidth);
-    for (unsigned j=0; j<mStatsAreaHeight; ++j)
+    return (endTime-startTime)*1000;
+}
+
+void StatsPhase::runQuadrant(int quadrant, float factorX, float factorY)
+{
     {
-        for (unsigned i=0; i<mStatsAreaWidth/4; ++i)
-        {
-            int index = 4*(j*mStatsAreaWidth+ i);
+        Profiler::Scope scope("stats.quadrant[%d].fill", quadrant);
+        fillStage(factorX, factorY);
+    }
+    {
+        Profiler::Scope scope("stats.quadrant[%d].count", quadrant);
+        countStage(factorX, factorY, OFFSET);
+    }
+    {
+        Profiler::Scope scope("stats.quadrant[%d].centroid", quadrant);
+        centroidingStage(factorX, factorY,CENTROID_X_COORD, 2*OFFSET);
+        centroidingStage(factorX, factorY, CENTROID_Y_COORD, 3*OFFSET);
+        if (wideLuminance())
+            centroidingStage(factorX, factorY, CENTROID_LUMINANCE, 4*OFFSET);
+    }
+}
+
+void StatsPhase::runScatter()
+{
+    const int numRows = tableRows();
+    // Without labels the table stays empty
+    if (numRows == 0)
+        return;
+
+    ///---------- 1. CELLS --------------------
+
+    {
+        Profiler::Scope scope("stats.scatter.cells");
+
+        // The fill texture is free, the quadrants are not run
+        GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mWrite]) );
+        GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexFillId, 0) );
+        CHECK_FBO();
+        GL_CHECK( glClear( GL_COLOR_BUFFER_BIT ) );
+
+        GL_CHECK( glUseProgram (mProgScatter.program) );
+        GL_CHECK( glUniform1i ( mProgScatter.u_stageLoc, STAGE_CELLS ) );
+        GL_CHECK( glUniform2f ( mProgScatter.u_texDimLoc, mWidth, mHeight) );
+        GL_CHECK( glUniform2f ( mProgScatter.u_targetDimLoc, mWidth, mHeight) );
+        GL_CHECK( glUniform2f ( mProgScatter.u_tableDimLoc, mTableWidth, mTableHeight) );
+        GL_CHECK( glUniform1i ( mProgScatter.s_tableLoc, mTextureUnits[TEX_REDUCED] ) );
+
+        GL_CHECK( glBindBuffer(GL_ARRAY_BUFFER, mCellVboId) );
+        GL_CHECK( glVertexAttribPointer ( mProgScatter.positionLoc, 2, GL_UNSIGNED_SHORT, GL_FALSE, 0, 0) );
+        GL_CHECK( glEnableVertexAttribArray ( mProgScatter.positionLoc ) );
+        GL_CHECK( glDrawArrays( GL_POINTS, 0, TABLE_COLUMNS*numRows) );
+    }
+
+    ///---------- 2. ACCUMULATE --------------------
+
+    {
+        Profiler::Scope scope("stats.scatter.accumulate");
+
+        GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexSumsId, 0) );
+        CHECK_FBO();
+        GL_CHECK( glViewport ( 0, 0, TABLE_COLUMNS, numRows ) );
+        GL_CHECK( glClear( GL_COLOR_BUFFER_BIT ) );
+
+        GL_CHECK( glUniform1i ( mProgScatter.u_stageLoc, STAGE_ACCUMULATE ) );
+        GL_CHECK( glUniform2f ( mProgScatter.u_targetDimLoc, TABLE_COLUMNS, numRows) );
+        GL_CHECK( glUniform1i ( mProgScatter.s_labelLoc, mTextureUnits[TEX_LABEL] ) );
+        GL_CHECK( glUniform1i ( mProgScatter.s_cellsLoc, mTextureUnits[TEX_FILL] ) );
+        GL_CHECK( glUniform1i ( mProgScatter.s_origLoc,  mTextureUnits[TEX_ORIG] ) );
+        GL_CHECK( glUniform1f ( mProgScatter.u_origTopDownLoc, mOrigTopDown ? 1.0f : 0.0f ) );
+        GL_CHECK( glUniform1f ( mProgScatter.u_origMaxValueLoc, (1 << mBitDepth) - 1 ) );
+
+        updateScatterPoints();
+        GL_CHECK( glBindBuffer(GL_ARRAY_BUFFER, mPointVboId) );
+        GL_CHECK( glVertexAttribPointer ( mProgScatter.positionLoc, 2, GL_UNSIGNED_SHORT, GL_FALSE, 0, 0) );
+
+        GL_CHECK( glEnable( GL_BLEND ) );
+        GL_CHECK( glBlendFunc( GL_ONE, GL_ONE ) );
+        GL_CHECK( glDrawArrays( GL_POINTS, 0, mNumPoints) );
+        GL_CHECK( glDisable( GL_BLEND ) );
+
+        GL_CHECK( glDisableVertexAttribArray ( mProgScatter.positionLoc ) );
+        GL_CHECK( glBindBuffer(GL_ARRAY_BUFFER, 0) );
+    }
+
+    ///---------- 3. PACK --------------------
+
+    {
+        Profiler::Scope scope("stats.scatter.pack");
+
+        // The pack stage does not read the table, so it is drawn into it directly
+        GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexReducedId, 0) );
+        CHECK_FBO();
+        GL_CHECK( glViewport ( TABLE_COLUMNS, 0, mStatsAreaWidth - TABLE_COLUMNS, numRows ) );
+
+        GL_CHECK( glUseProgram (mProgPack.program) );
+        GL_CHECK( glEnableVertexAttribArray ( mProgPack.positionLoc ) );
+        if (mProgPack.texCoordLoc >= 0)
+            GL_CHECK( glEnableVertexAttribArray ( mProgPack.texCoordLoc ) );
+        GL_CHECK( glUniform2f ( mProgPack.u_texDimLoc, mWidth, mHeight) );
+        GL_CHECK( glUniform2f ( mProgPack.u_sumsDimLoc, TABLE_COLUMNS, mHeight) );
+        GL_CHECK( glUniform1f ( mProgPack.u_wideSumsLoc, mWideSums ? 1.0f : 0.0f ) );
+        GL_CHECK( glUniform1i ( mProgPack.s_sumsLoc, mSumsTextureUnit ) );
+        drawScene(NULL, RegionSet::SHAPE_BOXES, mProgPack.positionLoc, mProgPack.texCoordLoc, mVertices, mIndices);
+
+        GL_CHECK( glDisableVertexAttribArray ( mProgPack.positionLoc ) );
+        if (mProgPack.texCoordLoc >= 0)
+            GL_CHECK( glDisableVertexAttribArray ( mProgPack.texCoordLoc ) );
+        GL_CHECK( glViewport ( 0, 0, mWidth, mHeight ) );
+    }
 
-            if (data[index] != 0)
+    GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexPiPoId[mWrite], 0) );
+    CHECK_FBO();
+}
+
+void StatsPhase::updateScatterPoints()
+{
+    if (mRegions == NULL || !mRegions->isActive())
+    {
+        if (mPointsAreFullFrame)
+            return;
+
+        mPoints.resize((size_t)2*mWidth*mHeight);
+        size_t n = 0;
+        for (int y=0; y<mHeight; ++y)
+        {
+            for (int x=0; x<mWidth; ++x)
             {
-                Spot spot;
-                GLushort sumLuminance = *(GLushort*) (data + index+ OFFSET_LUMINANCE);
-                spot.area = *(GLushort*) (data + index+ OFFSET_AREA);
-                if (spot.area > 2)
-                {
-                spot.x = convertSignedGl(*(GLuint*) (data + index+ OFFSET_SUM_X));
-                spot.y = convertSignedGl(*(GLuint*) (data + index+ OFFSET_SUM_Y));
-                printf("i: %4d j: %4d area: %2d\t x: %4d \t y: %4d \t sx: %f (0x%08x) \tsy: %f (0x%08x)\t lum: %d\n", i, j,
-                       spot.area,
-                       *(GLushort*) (data + index+ OFFSET_X)-1,
-                       *(GLushort*) (data + index+ OFFSET_Y)-1,
-                       spot.x,
-                       *(GLuint*) (data + index+ OFFSET_SUM_X),
-                       spot.y,
-                       *(GLuint*) (data + index+ OFFSET_SUM_Y),
-                       sumLuminance
-                       );
-                }
-                spot.x = *(GLushort*) (data + index+ OFFSET_X)-1 - spot.x / sumLuminance;
-                spot.y = *(GLushort*) (data + index+ OFFSET_Y)-1 - spot.y / sumLuminance;
-                if (spot.area > 2)
-                {
-                    mSpots.push_back(spot);
-                }
+                mPoints[n++] = x;
+                mPoints[n++] = y;
             }
         }
+        mPointsAreFullFrame = true;
     }
-//#ifdef _DEBUG
+    else
     {
-        printf("Found %lu spots\n", mSpots.size());
-        for (unsigned i=0; i<mSpots.size(); ++i)
+        const std::vector<RegionSet::Rect> &boxes = mRegions->boxes();
+        std::vector<std::pair<int, int> > spans;
+        mPoints.clear();
+        for (int y=0; y<mHeight; ++y)
         {
-            printf ("i: %d  area: %d  x: %f  y: %f\n", i, mSpots[i].area, mSpots[i].x, mSpots[i].y);
+            spans.clear();
+            for (size_t i=0; i<boxes.size(); ++i)
+            {
+                if (y >= boxes[i].y && y < boxes[i].y + boxes[i].height)
+                    spans.push_back(std::make_pair(boxes[i].x, boxes[i].x + boxes[i].width));
+            }
+            std::sort(spans.begin(), spans.end());
+
+            int end = 0;
+            for (size_t i=0; i<spans.size(); ++i)
+            {
+                for (int x=std::max(spans[i].first, end); x<spans[i].second; ++x)
+                {
+                    mPoints.push_back(x);
+                    mPoints.push_back(y);
+                }
+                end = std::max(end, spans[i].second);
+            }
         }
+        mPointsAreFullFrame = false;
     }
-//#endif
-    printLabels(mStatsAreaWidth, mStatsAreaHeight, data);
 
-    endTime = getRealTime();
-
-    return (endTime-startTime)*1000;
+    mNumPoints = mPoints.size()/2;
+    GL_CHECK( glBindBuffer(GL_ARRAY_BUFFER, mPointVboId) );
+    GL_CHECK( glBufferData(GL_ARRAY_BUFFER, mPoints.size()*sizeof(GLushort), mPoints.data(),
+                           mPointsAreFullFrame ? GL_STATIC_DRAW : GL_STREAM_DRAW) );
+    GL_CHECK( glBindBuffer(GL_ARRAY_BUFFER, 0) );
 }
 
 void StatsPhase::releaseGlResources()
@@ -353,6 +684,15 @@ void StatsPhase::releaseGlResources()
     GL_CHECK( glDeleteProgram(mProgFill.program) );
     GL_CHECK( glDeleteProgram(mProgCount.program) );
     GL_CHECK( glDeleteProgram(mProgCentroid.program) );
+    GL_CHECK( glDeleteProgram(mProgCompact.program) );
+    if (mHasScatter)
+    {
+        GL_CHECK( glDeleteProgram(mProgScatter.program) );
+        GL_CHECK( glDeleteProgram(mProgPack.program) );
+        GL_CHECK( glDeleteTextures(1, &mTexSumsId) );
+        GL_CHECK( glDeleteBuffers(1, &mCellVboId) );
+        GL_CHECK( glDeleteBuffers(1, &mPointVboId) );
+    }
     GL_CHECK( glDeleteTextures(1, &mTexOrigId) );
     GL_CHECK( glDeleteTextures(2, mTexPiPoId) );
 }
@@ -365,6 +705,16 @@ void StatsPhase::fillStage(float factorX, float factorY)
     GL_CHECK( glEnableVertexAttribArray ( mProgFill.positionLoc ) );
     GL_CHECK( glEnableVertexAttribArray ( mProgFill.texCoordLoc ) );
 
+    // Only the occupied regions are drawn, everything else has to be background
+    if (mRegions != NULL && mRegions->isActive())
+    {
+        for(int i=0; i<2; i++)
+        {
+            GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[i]) );
+            GL_CHECK( glClear( GL_COLOR_BUFFER_BIT ) );
+        }
+    }
+
     // Bind the FBO to write to
     GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mWrite]) );
     GL_CHECK( glUniform2f ( mProgFill.u_texDimLoc, mWidth, mHeight) );
@@ -374,18 +724,17 @@ void StatsPhase::fillStage(float factorX, float factorY)
     GL_CHECK( glUniform1i ( mProgFill.u_passLoc,  0) );
     GL_CHECK( glUniform2f ( mProgFill.u_factorLoc, factorX, factorY ) );
     // Draw scene
-    GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, mIndices ) );
+    drawScene(mRegions, RegionSet::SHAPE_BOXES, mProgFill.positionLoc, mProgFill.texCoordLoc, mVertices, mIndices);
     std::swap(mRead, mWrite);
 
-#ifdef _DEBUG
-{
+    if (LOG_ENABLED(LOG_LEVEL_TRACE))
+    {
         char filename[50];
         char text[50];
         sprintf(filename, "outF%03d.png", 0);
         sprintf(text, "Pixels after pass %d:\n", 0);
         debugImage(text, filename);
-}
-#endif
+    }
 
     for(unsigned i=1; i<mNumFillIterations; ++i)
     {
@@ -397,18 +746,17 @@ void StatsPhase::fillStage(float factorX, float factorY)
         GL_CHECK( glUniform1i ( mProgFill.u_passLoc,  i) );
         //    GL_CHECK( glUniform1f ( u_factorLoc, u_factor) );
         // Draw scene
-        GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, mIndices ) );
+        drawScene(mRegions, RegionSet::SHAPE_BOXES, mProgFill.positionLoc, mProgFill.texCoordLoc, mVertices, mIndices);
         std::swap(mRead, mWrite);
 
-#ifdef _DEBUG
-{
+        if (LOG_ENABLED(LOG_LEVEL_TRACE))
+        {
             char filename[50];
             char text[50];
             sprintf(filename, "outF%03d.png", i);
             sprintf(text, "Pixels after fill pass %d:\n", i);
             debugImage(text, filename);
-}
-#endif
+        }
 
     }
 
@@ -437,6 +785,8 @@ void StatsPhase::countStage(float factorX, float factorY, int offset)
     // Texture with the filled spots from previous stage (read only)
     GL_CHECK( glUniform1i ( mProgCount.s_fillLoc,  mTextureUnits[TEX_FILL] ) );
     GL_CHECK( glUniform1i ( mProgCount.s_origLoc,  mTextureUnits[TEX_ORIG] ) );
+    GL_CHECK( glUniform1f ( mProgCount.u_origTopDownLoc, mOrigTopDown ? 1.0f : 0.0f ) );
+    GL_CHECK( glUniform1f ( mProgCount.u_origMaxValueLoc, (1 << mBitDepth) - 1 ) );
     // Texture with the labels from last phase (read only)
     GL_CHECK( glUniform1i ( mProgCount.s_labelLoc,  mTextureUnits[TEX_LABEL] ) );
 
@@ -451,10 +801,10 @@ void StatsPhase::countStage(float factorX, float factorY, int offset)
         GL_CHECK( glUniform1i ( mProgCount.s_resultLoc, mTextureUnits[TEX_PIPO+mRead] ) );
 
         // Draw scene
-        GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, mIndices ) );
+        drawScene(mRegions, RegionSet::SHAPE_BOXES, mProgCount.positionLoc, mProgCount.texCoordLoc, mVertices, mIndices);
         std::swap(mRead, mWrite);
 
-#ifdef _DEBUG
+        if (LOG_ENABLED(LOG_LEVEL_TRACE))
         {
             char filename[50];
             char text[50];
@@ -462,55 +812,54 @@ void StatsPhase::countStage(float factorX, float factorY, int offset)
             sprintf(text, "Pixels after count %d:\n", i);
             debugImage(text, filename);
         }
-#endif
 
     }
 
-    // Write the count result as a reduced table (with an offset so it won't interfere
-    // with the table in texLabelId in the next step
+    // Write the count result as a reduced table, it is copied into the columns
+    // starting at offset by copyIntoTable. Only the columns of the
+    // result in the rows of the table are drawn
+    GL_CHECK( glViewport ( 0, 0, tableColumns(), tableRows() ) );
+    GL_CHECK( glUniform2f ( mProgCount.u_tableDimLoc, mTableWidth, mTableHeight) );
     GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mWrite]) );
     GL_CHECK( glUniform1i ( mProgCount.u_stageLoc,  STAGE_SAVE ) );
     GL_CHECK( glUniform2f ( mProgCount.u_factorLoc, factorX, factorY ) );
     GL_CHECK( glUniform1f ( mProgCount.u_savingOffsetLoc, offset) );
     GL_CHECK( glUniform1i ( mProgCount.s_labelLoc,  mTextureUnits[TEX_REDUCED] ) );
-    GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, mIndices ) );
+    // The result of the last pass, not the target of this draw
+    GL_CHECK( glUniform1i ( mProgCount.s_resultLoc, mTextureUnits[TEX_PIPO+mRead] ) );
+    // The table is written outside of the regions
+    drawScene(NULL, RegionSet::SHAPE_BOXES, mProgCount.positionLoc, mProgCount.texCoordLoc, mVertices, mIndices);
     std::swap(mRead, mWrite);
 
-#ifdef _DEBUG
+    if (LOG_ENABLED(LOG_LEVEL_TRACE))
     {
         char filename[50];
         sprintf(filename, "outS.png");
         debugImage("Pixels after save:\n", filename);
     }
-#endif
 
-    // Add/blend texture from previous step and mTexLabel together
-    // This yields a texture which has the lookup table for root pixels in its first few
-    // columns and the count values in the next few columns
+    // Add/blend texture from previous step and the table together
+    // This yields the count values in the columns of the result
     GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mWrite]) );
     GL_CHECK( glUniform1i ( mProgCount.u_stageLoc,  STAGE_BLEND ) );
     // u_factor limits the write, i.e. only write between the columns [OFFSET, 2*OFFSET)
     GL_CHECK( glUniform2f ( mProgCount.u_factorLoc, OFFSET, 2*OFFSET ) );
     GL_CHECK( glUniform1i ( mProgCount.s_resultLoc, mTextureUnits[TEX_PIPO+mRead] ) );
     GL_CHECK( glUniform1i ( mProgCount.s_labelLoc,  mTextureUnits[TEX_REDUCED] ) );
-    GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, mIndices ) );
+    // The table is written outside of the regions
+    drawScene(NULL, RegionSet::SHAPE_BOXES, mProgCount.positionLoc, mProgCount.texCoordLoc, mVertices, mIndices);
     std::swap(mRead, mWrite);
 
-#ifdef _DEBUG
+    if (LOG_ENABLED(LOG_LEVEL_TRACE))
     {
         char filename[50];
         sprintf(filename, "outM.png");
         debugImage("Pixels after merge:\n", filename);
     }
-#endif
 
-    // Save the result from the previous step into mTexLabel (by switching the texture
-    // objects and the corresponding texture unit)
-    std::swap(mTexPiPoId[mRead], mTexReducedId);
-    std::swap(mTextureUnits[TEX_REDUCED], mTextureUnits[TEX_PIPO+mRead]);
-    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mRead]) );
-    GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexPiPoId[mRead], 0) );
-    CHECK_FBO();
+    // Save the result from the previous step into the table
+    copyIntoTable(offset);
+    GL_CHECK( glViewport ( 0, 0, mWidth, mHeight ) );
 
     GL_CHECK( glDisableVertexAttribArray ( mProgCount.positionLoc ) );
     GL_CHECK( glDisableVertexAttribArray ( mProgCount.texCoordLoc ) );
@@ -529,6 +878,9 @@ void StatsPhase::centroidingStage(float factorX, float factorY, int coordinate,
     // Bind the different sampler2D
     // Texture with the filled spots from previous stage (read only)
     GL_CHECK( glUniform1i ( mProgCentroid.s_origLoc,  mTextureUnits[TEX_ORIG] ) );
+    GL_CHECK( glUniform1f ( mProgCentroid.u_origTopDownLoc, mOrigTopDown ? 1.0f : 0.0f ) );
+    GL_CHECK( glUniform1f ( mProgCentroid.u_origMaxValueLoc, (1 << mBitDepth) - 1 ) );
+    GL_CHECK( glUniform1f ( mProgCentroid.u_wideSumsLoc, mWideSums ? 1.0f : 0.0f ) );
     GL_CHECK( glUniform1i ( mProgCentroid.s_fillLoc,   mTextureUnits[TEX_FILL] ) );
     // Texture with the labels from last phase (read only)
     GL_CHECK( glUniform1i ( mProgCentroid.s_labelLoc,  mTextureUnits[TEX_LABEL] ) );
@@ -541,16 +893,15 @@ void StatsPhase::centroidingStage(float factorX, float factorY, int coordinate,
     // Set the sampler texture to use the texture containing the labels
     GL_CHECK( glUniform1i ( mProgCentroid.s_resultLoc, mTextureUnits[TEX_PIPO+mRead] ) );
     // Draw scene
-    GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, mIndices ) );
+    drawScene(mRegions, RegionSet::SHAPE_BOXES, mProgCentroid.positionLoc, mProgCentroid.texCoordLoc, mVertices, mIndices);
     std::swap(mRead, mWrite);
 
-#ifdef _DEBUG
+    if (LOG_ENABLED(LOG_LEVEL_TRACE))
     {
         char filename[50];
         sprintf(filename, "outS1.png");
         debugImage("Pixels after Init:\n", filename);
     }
-#endif
 
     for (int i=0; i<4   ; ++i)
     {
@@ -562,10 +913,10 @@ void StatsPhase::centroidingStage(float factorX, float factorY, int coordinate,
         GL_CHECK( glUniform1i ( mProgCentroid.s_resultLoc, mTextureUnits[TEX_PIPO+mRead] ) );
 
         // Draw scene
-        GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, mIndices ) );
+        drawScene(mRegions, RegionSet::SHAPE_BOXES, mProgCentroid.positionLoc, mProgCentroid.texCoordLoc, mVertices, mIndices);
         std::swap(mRead, mWrite);
 
-#ifdef _DEBUG
+        if (LOG_ENABLED(LOG_LEVEL_TRACE))
         {
             char filename[50];
             char text[50];
@@ -573,61 +924,179 @@ void StatsPhase::centroidingStage(float factorX, float factorY, int coordinate,
             sprintf(text, "Pixels after count %d:\n", i);
             debugImage(text, filename);
         }
-#endif
     }
-    // Write the centroiding result as a reduced table (with an offset so it won't interfere
-    // with the table in texLabelId in the next step
+    // Write the centroiding result as a reduced table, it is copied into the columns
+    // starting at offset by copyIntoTable. Only the columns of the
+    // result in the rows of the table are drawn
+    GL_CHECK( glViewport ( 0, 0, tableColumns(), tableRows() ) );
+    GL_CHECK( glUniform2f ( mProgCentroid.u_tableDimLoc, mTableWidth, mTableHeight) );
     GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mWrite]) );
     GL_CHECK( glUniform1i ( mProgCentroid.u_stageLoc,  STAGE_SAVE ) );
     GL_CHECK( glUniform2f ( mProgCentroid.u_factorLoc, factorX, factorY ) );
     GL_CHECK( glUniform1f ( mProgCentroid.u_savingOffsetLoc, offset) );
     GL_CHECK( glUniform1i ( mProgCentroid.s_labelLoc,  mTextureUnits[TEX_REDUCED] ) );
-    GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, mIndices ) );
+    // The result of the last pass, not the target of this draw
+    GL_CHECK( glUniform1i ( mProgCentroid.s_resultLoc, mTextureUnits[TEX_PIPO+mRead] ) );
+    // The table is written outside of the regions
+    drawScene(NULL, RegionSet::SHAPE_BOXES, mProgCentroid.positionLoc, mProgCentroid.texCoordLoc, mVertices, mIndices);
     std::swap(mRead, mWrite);
 
-#ifdef _DEBUG
+    if (LOG_ENABLED(LOG_LEVEL_TRACE))
     {
         char filename[50];
         sprintf(filename, "outS.png");
         debugImage("Pixels after save:\n", filename);
     }
-#endif
 
-    // Add/blend texture from previous step and mTexLabel together
-    // This yields a texture which has the lookup table for root pixels in its first few
-    // columns and the count values in the next few columns
+    // Add/blend texture from previous step and the table together
+    // This yields the centroiding values in the columns of the result
     GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mWrite]) );
     GL_CHECK( glUniform1i ( mProgCentroid.u_stageLoc,  STAGE_BLEND ) );
     GL_CHECK( glUniform1i ( mProgCentroid.s_resultLoc, mTextureUnits[TEX_PIPO+mRead] ) );
     GL_CHECK( glUniform1i ( mProgCentroid.s_labelLoc,  mTextureUnits[TEX_REDUCED] ) );
-    GL_CHECK( glDrawElements ( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, mIndices ) );
+    // The table is written outside of the regions
+    drawScene(NULL, RegionSet::SHAPE_BOXES, mProgCentroid.positionLoc, mProgCentroid.texCoordLoc, mVertices, mIndices);
     std::swap(mRead, mWrite);
 
-#ifdef _DEBUG
+    if (LOG_ENABLED(LOG_LEVEL_TRACE))
     {
         char filename[50];
         sprintf(filename, "outM.png");
         debugImage("Pixels after merge:\n", filename);
     }
-#endif
-
-    // Save the result from the previous step into mTexLabel (by switching the texture
-    // objects and the corresponding texture unit)
-    std::swap(mTexPiPoId[mRead], mTexReducedId);
-    std::swap(mTextureUnits[TEX_REDUCED], mTextureUnits[TEX_PIPO+mRead]);
-    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mRead]) );
-    GL_CHECK( glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexPiPoId[mRead], 0) );
-    CHECK_FBO();
 
+    // Save the result from the previous step into the table
+    copyIntoTable(offset);
+    GL_CHECK( glViewport ( 0, 0, mWidth, mHeight ) );
 
     GL_CHECK( glDisableVertexAttribArray ( mProgCentroid.positionLoc ) );
     GL_CHECK( glDisableVertexAttribArray ( mProgCentroid.texCoordLoc ) );
 }
 
+void StatsPhase::copyIntoTable(int offset)
+{
+    if (tableRows() == 0)
+        return;
+
+    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mRead]) );
+    GL_CHECK( glActiveTexture( GL_TEXTURE0 + mTextureUnits[TEX_REDUCED]) );
+    GL_CHECK( glBindTexture(GL_TEXTURE_2D, mTexReducedId) );
+    GL_CHECK( glCopyTexSubImage2D(GL_TEXTURE_2D, 0, offset, 0, 0, 0, tableColumns(), tableRows()) );
+}
+
+void StatsPhase::readSpots()
+{
+    Profiler::Scope scope("stats.readback");
+
+    GL_CHECK( glUseProgram (mProgCompact.program) );
+
+    GL_CHECK( glEnableVertexAttribArray ( mProgCompact.positionLoc ) );
+    if (mProgCompact.texCoordLoc >= 0)
+        GL_CHECK( glEnableVertexAttribArray ( mProgCompact.texCoordLoc ) );
+
+    GL_CHECK( glUniform2f ( mProgCompact.u_texDimLoc, mWidth, mHeight) );
+    GL_CHECK( glUniform2f ( mProgCompact.u_tableDimLoc, mTableWidth, mTableHeight) );
+    GL_CHECK( glUniform1f ( mProgCompact.u_tableRowsLoc, tableRows() ) );
+    // The final table was saved into the reduced texture by the last stage
+    GL_CHECK( glUniform1i ( mProgCompact.s_tableLoc, mTextureUnits[TEX_REDUCED] ) );
+    GL_CHECK( glBindFramebuffer(GL_FRAMEBUFFER, mFboId[mWrite]) );
+
+    ///---------- 1. HEADER --------------------
+
+    // Number of spots in each column of the table
+    GL_CHECK( glUniform1i ( mProgCompact.u_stageLoc, STAGE_HEADER ) );
+    GL_CHECK( glViewport ( 0, 0, tableColumns(), 1 ) );
+    drawScene(NULL, RegionSet::SHAPE_BOXES, mProgCompact.positionLoc, mProgCompact.texCoordLoc, mVertices, mIndices);
+
+    // The columns beyond a narrow frame are empty
+    mHeader.assign(4*TABLE_COLUMNS, 0);
+    GL_CHECK( glReadPixels(0, 0, tableColumns(), 1, GL_RGBA, GL_UNSIGNED_BYTE, mHeader.data()) );
+    mReadbackSize = 4*tableColumns();
+
+    // The sums of high bit depth images do not fit into the 16 bits of the area column
+    unsigned spotFields = wideLuminance() ? SPOT_FIELDS_WIDE : SPOT_FIELDS;
+    size_t spotSize = spotFields*sizeof(uint32_t);
+
+    GLfloat columnRows[TABLE_COLUMNS];
+    unsigned numSpots = 0;
+    for (int i=0; i<TABLE_COLUMNS; ++i)
+    {
+        columnRows[i] = *(GLushort*) (mHeader.data() + 4*i);
+        numSpots += columnRows[i];
+    }
+
+    ///---------- 2. GATHER --------------------
+
+    mSpots.clear();
+    if (numSpots > 0)
+    {
+        unsigned spotsPerRow = std::max(1u, std::min<unsigned>(mCompactWidth, mWidth/spotFields));
+        unsigned blockWidth  = spotFields*std::min(numSpots, spotsPerRow);
+        unsigned blockHeight = (numSpots + spotsPerRow - 1)/spotsPerRow;
+
+        GL_CHECK( glUniform1i ( mProgCompact.u_stageLoc, STAGE_GATHER ) );
+        GL_CHECK( glUniform1fv ( mProgCompact.u_columnRowsLoc, TABLE_COLUMNS, columnRows ) );
+        GL_CHECK( glUniform1f ( mProgCompact.u_numSpotsLoc, numSpots ) );
+        GL_CHECK( glUniform1f ( mProgCompact.u_spotsPerRowLoc, spotsPerRow ) );
+        GL_CHECK( glUniform1f ( mProgCompact.u_spotFieldsLoc, spotFields ) );
+        GL_CHECK( glViewport ( 0, 0, blockWidth, blockHeight ) );
+        drawScene(NULL, RegionSet::SHAPE_BOXES, mProgCompact.positionLoc, mProgCompact.texCoordLoc, mVertices, mIndices);
+
+        mCompact.resize(4*blockWidth*blockHeight);
+        GL_CHECK( glReadPixels(0, 0, blockWidth, blockHeight, GL_RGBA, GL_UNSIGNED_BYTE, mCompact.data()) );
+        mReadbackSize += mCompact.size();
+    }
+
+    GL_CHECK( glViewport ( 0, 0, mWidth, mHeight ) );
+    GL_CHECK( glDisableVertexAttribArray ( mProgCompact.positionLoc ) );
+    if (mProgCompact.texCoordLoc >= 0)
+        GL_CHECK( glDisableVertexAttribArray ( mProgCompact.texCoordLoc ) );
+
+    LOG_DEBUG("Checking for spots " << numSpots << " in " << mReadbackSize << " bytes");
+    for (unsigned n=0; n<numSpots; ++n)
+    {
+        const GLubyte *data = mCompact.data() + n*spotSize;
+
+        Spot spot;
+        GLuint sumLuminance = mWideSums ? *(GLuint*) (data + OFFSET_LUMINANCE_WIDE)
+                            : wideLuminance() ? *(GLuint*) (data + OFFSET_LUMINANCE_WIDE) & 0x00ffffff
+                                              : *(GLushort*) (data + OFFSET_LUMINANCE);
+        spot.area = *(GLushort*) (data + OFFSET_AREA);
+        spot.luminance = sumLuminance;
+        if (spot.area > 2)
+        {
+            // Wide sums are two's complement, the others have a sign byte
+            spot.x = mWideSums ? (int32_t) *(GLuint*) (data + OFFSET_SUM_X) : convertSignedGl(*(GLuint*) (data + OFFSET_SUM_X));
+            spot.y = mWideSums ? (int32_t) *(GLuint*) (data + OFFSET_SUM_Y) : convertSignedGl(*(GLuint*) (data + OFFSET_SUM_Y));
+            if (LOG_ENABLED(LOG_LEVEL_TRACE))
+            {
+                printf("n: %4d area: %2d\t x: %4d \t y: %4d \t sx: %f (0x%08x) \tsy: %f (0x%08x)\t lum: %u\n", n,
+                       spot.area,
+                       *(GLushort*) (data + OFFSET_X)-1,
+                       *(GLushort*) (data + OFFSET_Y)-1,
+                       spot.x,
+                       *(GLuint*) (data + OFFSET_SUM_X),
+                       spot.y,
+                       *(GLuint*) (data + OFFSET_SUM_Y),
+                       sumLuminance
+                       );
+            }
+            spot.x = *(GLushort*) (data + OFFSET_X)-1 - spot.x / sumLuminance;
+            spot.y = *(GLushort*) (data + OFFSET_Y)-1 - spot.y / sumLuminance;
+            mSpots.push_back(spot);
+        }
+    }
+    for (unsigned i=0; i<mSpots.size(); ++i)
+    {
+        LOG_DEBUG("i: " << i << "  area: " << mSpots[i].area << "  x: " << mSpots[i].x << "  y: " << mSpots[i].y);
+    }
+}
+
 void StatsPhase::debugImage(const char *text, const char *filename)
 {
     CImg<unsigned char> image(4, mWidth, mHeight, 1, 0);
     GL_CHECK( glReadPixels(0, 0, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, image.data()) );
+    Log::countDebugReadback(image.size());
     printf("%s", text);
     printLabels(mWidth, mHeight, image.data());
     writeImage(mWidth, mHeight, filename, image);
@@ -0,0 +1,86 @@
+#include "threadPool.h"
+
+ThreadPool::ThreadPool(unsigned numThreads)
+    : mStop(false)
+{
+    if (numThreads == 0)
+        numThreads = std::thread::hardware_concurrency();
+    if (numThreads == 0)
+        numThreads = 1;
+
+    for (unsigned i=0; i<numThreads; ++i)
+    {
+        mThreads.push_back( std::thread(&ThreadPool::worker, this) );
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mCondition.notify_all();
+
+    for (unsigned i=0; i<mThreads.size(); ++i)
+    {
+        mThreads[i].join();
+    }
+}
+
+unsigned ThreadPool::size() const
+{
+    return mThreads.size();
+}
+
+void ThreadPool::enqueue(const std::function<void()> &job)
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mJobs.push(job);
+    }
+    mCondition.notify_one();
+}
+
+void ThreadPool::run(unsigned numTasks, const std::function<void(unsigned)> &task)
+{
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    unsigned numDone = 0;
+
+    for (unsigned i=0; i<numTasks; ++i)
+    {
+        enqueue( [&, i]()
+        {
+            task(i);
+
+            std::unique_lock<std::mutex> lock(doneMutex);
+            if (++numDone == numTasks)
+                doneCondition.notify_one();
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(doneMutex);
+    while (numDone < numTasks)
+        doneCondition.wait(lock);
+}
+
+void ThreadPool::worker()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            while (!mStop && mJobs.empty())
+                mCondition.wait(lock);
+
+            if (mStop && mJobs.empty())
+                return;
+
+            job = mJobs.front();
+            mJobs.pop();
+        }
+        job();
+    }
+}
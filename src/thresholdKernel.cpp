@@ -0,0 +1,369 @@
+#include "thresholdKernel.h"
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define THRESHOLD_X86
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define THRESHOLD_NEON
+#endif
+
+// Writes one bit per pixel of a row: 1 if the pixel is >= threshold
+typedef void (*ThresholdRowFunc)(const uint8_t *row, int width, uint8_t threshold, uint64_t *bits);
+
+static void thresholdTail(const uint8_t *row, int start, int width, uint8_t threshold, uint64_t *bits)
+{
+    for (int x=start; x<width; ++x)
+    {
+        if (row[x] >= threshold)
+            bits[x >> 6] |= (uint64_t)1 << (x & 63);
+    }
+}
+
+static void thresholdRowScalar(const uint8_t *row, int width, uint8_t threshold, uint64_t *bits)
+{
+    memset(bits, 0, ThresholdKernel::wordsPerRow(width)*sizeof(uint64_t));
+    thresholdTail(row, 0, width, threshold, bits);
+}
+
+#if defined(THRESHOLD_X86) && defined(__SSE2__)
+static void thresholdRowSse2(const uint8_t *row, int width, uint8_t threshold, uint64_t *bits)
+{
+    memset(bits, 0, ThresholdKernel::wordsPerRow(width)*sizeof(uint64_t));
+
+    const __m128i t = _mm_set1_epi8((char)threshold);
+    int x = 0;
+    for (; x+64<=width; x+=64)
+    {
+        uint64_t word = 0;
+        for (int k=0; k<4; ++k)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(row + x + 16*k));
+            // Unsigned v >= t  <=>  max(v, t) == v
+            __m128i isAbove = _mm_cmpeq_epi8(_mm_max_epu8(v, t), v);
+            word |= (uint64_t)(uint16_t)_mm_movemask_epi8(isAbove) << (16*k);
+        }
+        bits[x >> 6] = word;
+    }
+    thresholdTail(row, x, width, threshold, bits);
+}
+#endif
+
+#if defined(THRESHOLD_X86)
+__attribute__((target("avx2")))
+static void thresholdRowAvx2(const uint8_t *row, int width, uint8_t threshold, uint64_t *bits)
+{
+    memset(bits, 0, ThresholdKernel::wordsPerRow(width)*sizeof(uint64_t));
+
+    const __m256i t = _mm256_set1_epi8((char)threshold);
+    int x = 0;
+    for (; x+64<=width; x+=64)
+    {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*)(row + x));
+        __m256i v1 = _mm256_loadu_si256((const __m256i*)(row + x + 32));
+        __m256i isAbove0 = _mm256_cmpeq_epi8(_mm256_max_epu8(v0, t), v0);
+        __m256i isAbove1 = _mm256_cmpeq_epi8(_mm256_max_epu8(v1, t), v1);
+        bits[x >> 6] = (uint64_t)(uint32_t)_mm256_movemask_epi8(isAbove0) |
+                       (uint64_t)(uint32_t)_mm256_movemask_epi8(isAbove1) << 32;
+    }
+    thresholdTail(row, x, width, threshold, bits);
+}
+#endif
+
+#if defined(THRESHOLD_NEON)
+static void thresholdRowNeon(const uint8_t *row, int width, uint8_t threshold, uint64_t *bits)
+{
+    memset(bits, 0, ThresholdKernel::wordsPerRow(width)*sizeof(uint64_t));
+
+    static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128,
+                                         1, 2, 4, 8, 16, 32, 64, 128 };
+    const uint8x16_t w = vld1q_u8(weights);
+    const uint8x16_t t = vdupq_n_u8(threshold);
+    int x = 0;
+    for (; x+64<=width; x+=64)
+    {
+        uint64_t word = 0;
+        for (int k=0; k<4; ++k)
+        {
+            // NEON has no movemask: weight each lane with its bit and add them up pairwise
+            uint8x16_t m = vandq_u8(vcgeq_u8(vld1q_u8(row + x + 16*k), t), w);
+            uint8x8_t  p = vpadd_u8(vget_low_u8(m), vget_high_u8(m));
+            p = vpadd_u8(p, p);
+            p = vpadd_u8(p, p);
+            word |= (uint64_t)(vget_lane_u8(p, 0) | (vget_lane_u8(p, 1) << 8)) << (16*k);
+        }
+        bits[x >> 6] = word;
+    }
+    thresholdTail(row, x, width, threshold, bits);
+}
+#endif
+
+// Element-wise maximum of two rows: acc = max(acc, row)
+typedef void (*MaxRowFunc)(const uint8_t *row, int width, uint8_t *acc);
+
+static void maxRowScalar(const uint8_t *row, int width, uint8_t *acc)
+{
+    for (int x=0; x<width; ++x)
+        acc[x] = std::max(acc[x], row[x]);
+}
+
+#if defined(THRESHOLD_X86) && defined(__SSE2__)
+static void maxRowSse2(const uint8_t *row, int width, uint8_t *acc)
+{
+    int x = 0;
+    for (; x+16<=width; x+=16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(row + x));
+        __m128i a = _mm_loadu_si128((const __m128i*)(acc + x));
+        _mm_storeu_si128((__m128i*)(acc + x), _mm_max_epu8(a, v));
+    }
+    maxRowScalar(row + x, width - x, acc + x);
+}
+#endif
+
+#if defined(THRESHOLD_X86)
+__attribute__((target("avx2")))
+static void maxRowAvx2(const uint8_t *row, int width, uint8_t *acc)
+{
+    int x = 0;
+    for (; x+32<=width; x+=32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(row + x));
+        __m256i a = _mm256_loadu_si256((const __m256i*)(acc + x));
+        _mm256_storeu_si256((__m256i*)(acc + x), _mm256_max_epu8(a, v));
+    }
+    maxRowScalar(row + x, width - x, acc + x);
+}
+#endif
+
+#if defined(THRESHOLD_NEON)
+static void maxRowNeon(const uint8_t *row, int width, uint8_t *acc)
+{
+    int x = 0;
+    for (; x+16<=width; x+=16)
+        vst1q_u8(acc + x, vmaxq_u8(vld1q_u8(acc + x), vld1q_u8(row + x)));
+    maxRowScalar(row + x, width - x, acc + x);
+}
+#endif
+
+static ThresholdKernel::Isa detectIsa()
+{
+#if defined(THRESHOLD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return ThresholdKernel::ISA_AVX2;
+#if defined(__SSE2__)
+    return ThresholdKernel::ISA_SSE2;
+#endif
+#elif defined(THRESHOLD_NEON)
+    return ThresholdKernel::ISA_NEON;
+#endif
+    return ThresholdKernel::ISA_SCALAR;
+}
+
+static ThresholdRowFunc thresholdRowFunc(ThresholdKernel::Isa isa)
+{
+    switch (isa)
+    {
+#if defined(THRESHOLD_X86)
+    case ThresholdKernel::ISA_AVX2:
+        return thresholdRowAvx2;
+#if defined(__SSE2__)
+    case ThresholdKernel::ISA_SSE2:
+        return thresholdRowSse2;
+#endif
+#endif
+#if defined(THRESHOLD_NEON)
+    case ThresholdKernel::ISA_NEON:
+        return thresholdRowNeon;
+#endif
+    default:
+        return thresholdRowScalar;
+    }
+}
+
+static MaxRowFunc maxRowFunc(ThresholdKernel::Isa isa)
+{
+    switch (isa)
+    {
+#if defined(THRESHOLD_X86)
+    case ThresholdKernel::ISA_AVX2:
+        return maxRowAvx2;
+#if defined(__SSE2__)
+    case ThresholdKernel::ISA_SSE2:
+        return maxRowSse2;
+#endif
+#endif
+#if defined(THRESHOLD_NEON)
+    case ThresholdKernel::ISA_NEON:
+        return maxRowNeon;
+#endif
+    default:
+        return maxRowScalar;
+    }
+}
+
+ThresholdKernel::Isa ThresholdKernel::isa()
+{
+    static const Isa selected = detectIsa();
+    return selected;
+}
+
+const char *ThresholdKernel::isaName()
+{
+    switch (isa())
+    {
+    case ISA_AVX2: return "AVX2";
+    case ISA_SSE2: return "SSE2";
+    case ISA_NEON: return "NEON";
+    default:       return "scalar";
+    }
+}
+
+int ThresholdKernel::thresholdValue(float threshold, int maxValue)
+{
+    // Start just below the estimate, the loop does the exact comparison
+    int value = std::max(0, std::min(maxValue, (int)(threshold * maxValue)) - 1);
+    while (value <= maxValue && value / (float)maxValue < threshold)
+        ++value;
+    return value;
+}
+
+void ThresholdKernel::computeMask(const uint8_t *pixels, ptrdiff_t rowStride, int pixelStride,
+                                  int width, int height, int rowStart, int rowEnd,
+                                  int thresholdValue, uint64_t *mask,
+                                  int wordStart, int wordEnd)
+{
+    const unsigned rowWords = wordsPerRow(width);
+    if (wordEnd < 0)
+        wordEnd = rowWords;
+    if (wordStart >= wordEnd)
+        return;
+    // From here on the words, pixels and mask are those of the range
+    const unsigned words = wordEnd - wordStart;
+    const int xStart = 64*wordStart;
+    const bool hasLeft  = xStart > 0;
+    const bool hasRight = xStart + 64*(int)words < width;
+    pixels += (ptrdiff_t)xStart*pixelStride;
+    width = std::min(width - xStart, 64*(int)words);
+    mask += wordStart;
+
+    if (thresholdValue > 255)
+    {
+        for (int y=rowStart; y<rowEnd; ++y)
+            memset(mask + (size_t)y*rowWords, 0, words*sizeof(uint64_t));
+        return;
+    }
+
+    // The vector kernels need contiguous pixels
+    ThresholdRowFunc thresholdRow = thresholdRowFunc(pixelStride == 1 ? isa() : ISA_SCALAR);
+    std::vector<uint8_t> contiguous(pixelStride == 1 ? 0 : width);
+
+    // Rolling window over the thresholded rows y-1, y and y+1 (plus one guard
+    // word on each side, which holds the pixel beside a range of words)
+    std::vector<uint64_t> window(3*(words+2), 0);
+    uint64_t *below   = &window[1];
+    uint64_t *current = &window[words+3];
+    uint64_t *above   = &window[2*words+5];
+
+    auto loadRow = [&](int y, uint64_t *bits)
+    {
+        if (y < 0 || y >= height)
+        {
+            memset(bits-1, 0, (words+2)*sizeof(uint64_t));
+            return;
+        }
+
+        const uint8_t *row = pixels + y*rowStride;
+        bits[-1]    = (hasLeft  && row[-pixelStride] >= thresholdValue) ? (uint64_t)1 << 63 : 0;
+        bits[words] = (hasRight && row[width*pixelStride] >= thresholdValue) ? 1 : 0;
+        if (pixelStride != 1)
+        {
+            for (int x=0; x<width; ++x)
+                contiguous[x] = row[x*pixelStride];
+            row = contiguous.data();
+        }
+        thresholdRow(row, width, (uint8_t)thresholdValue, bits);
+    };
+
+    loadRow(rowStart-1, below);
+    loadRow(rowStart, current);
+
+    for (int y=rowStart; y<rowEnd; ++y)
+    {
+        loadRow(y+1, above);
+
+        uint64_t *out = mask + (size_t)y*rowWords;
+        // Signed, as the guard words at w-1 and w+1 are read
+        for (int w=0; w<(int)words; ++w)
+        {
+            uint64_t c = current[w];
+            if (c == 0)
+            {
+                out[w] = 0;
+                continue;
+            }
+
+            // Shifted by one pixel, the guard words at both ends take care of the borders
+            uint64_t toRight = (c << 1) | (current[w-1] >> 63);
+            uint64_t toLeft  = (c >> 1) | (current[w+1] << 63);
+            uint64_t vertical = below[w] | above[w];
+            uint64_t verticalToRight = (vertical << 1) | ((below[w-1] | above[w-1]) >> 63);
+            uint64_t verticalToLeft  = (vertical >> 1) | ((below[w+1] | above[w+1]) << 63);
+
+            out[w] = c & (toRight | toLeft | vertical | verticalToRight | verticalToLeft);
+        }
+
+        uint64_t *tmp = below;
+        below   = current;
+        current = above;
+        above   = tmp;
+    }
+}
+
+void ThresholdKernel::computeTileMax(const uint8_t *pixels, ptrdiff_t rowStride, int pixelStride,
+                                     int width, int height, int tileSize, uint8_t *tileMax)
+{
+    const int tilesX = (width + tileSize - 1) / tileSize;
+
+    // The vector kernels need contiguous pixels
+    MaxRowFunc maxRow = maxRowFunc(pixelStride == 1 ? isa() : ISA_SCALAR);
+    std::vector<uint8_t> contiguous(pixelStride == 1 ? 0 : width);
+    std::vector<uint8_t> acc(width);
+
+    for (int ty=0; ty*tileSize<height; ++ty)
+    {
+        // 1. Maximum over the rows of the tile row
+        int rowEnd = std::min((ty+1)*tileSize, height);
+        memset(acc.data(), 0, width);
+        for (int y=ty*tileSize; y<rowEnd; ++y)
+        {
+            const uint8_t *row = pixels + y*rowStride;
+            if (pixelStride != 1)
+            {
+                for (int x=0; x<width; ++x)
+                    contiguous[x] = row[x*pixelStride];
+                row = contiguous.data();
+            }
+            maxRow(row, width, acc.data());
+        }
+
+        // 2. Maximum within each tile
+        uint8_t *out = tileMax + (size_t)ty*tilesX;
+        for (int tx=0; tx<tilesX; ++tx)
+        {
+            const uint8_t *tile = acc.data() + tx*tileSize;
+            int tileWidth = std::min(tileSize, width - tx*tileSize);
+            uint8_t value = 0;
+            for (int x=0; x<tileWidth; ++x)
+                value = tile[x] > value ? tile[x] : value;
+            out[tx] = value;
+        }
+    }
+}